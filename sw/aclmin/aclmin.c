@@ -0,0 +1,182 @@
+/* ****************************************************************************
+ * Module: aclmin.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Compile the wildcard rules of a flow file into an
+ *              equivalent image of at most OPENFLOW_WILDCARD_TABLE_SIZE
+ *              entries (common/nf2_aclmin.c), check it with random
+ *              lookups and write it as a flow file.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <time.h>
+
+#include "../common/nf2_flowfile.h"
+#include "../common/nf2_aclmin.h"
+
+#define DEFAULT_TRIALS	100000
+
+void usage (void);
+void set_merge_bits (struct nf2_aclmin *);
+void report (struct nf2_aclmin *, struct nf2_flowfile_rule *, int verbose);
+int write_image (struct nf2_aclmin *, struct nf2_flowfile_rule *, int n, const char *path);
+
+int main(int argc, char *argv[]) {
+	struct nf2_aclmin a;
+	struct nf2_flowfile_rule *rules;
+	struct timespec t0, t1;
+	const char *out = NULL;
+	int trials = DEFAULT_TRIALS, verbose = 0, c, i, n, failed;
+	unsigned seed = time(NULL);
+
+	while ((c = getopt(argc, argv, "o:c:s:vh")) != -1) {
+		switch (c) {
+		case 'o':
+			out = optarg;
+			break;
+		case 'c':
+			trials = atoi(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (argc - optind != 1 || trials < 0) {
+		usage();
+		exit(1);
+	}
+	if ((n = nf2_flowfile_read(argv[optind], &rules)) < 0)
+		exit(1);
+
+	nf2_aclmin_init(&a);
+	set_merge_bits(&a);
+	for (i = 0; i < n; i++) {
+		if (rules[i].exact)
+			continue;
+		if (nf2_aclmin_add(&a, &rules[i].entry, &rules[i].mask, &rules[i].action,
+				   rules[i].priority, i)) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (nf2_aclmin_compile(&a) < 0) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	nf2_aclmin_print_stats(&a, stdout);
+	printf("compiled in:  %.2f ms\n", (t1.tv_sec - t0.tv_sec) * 1e3 +
+	       (t1.tv_nsec - t0.tv_nsec) / 1e6);
+	report(&a, rules, verbose);
+	failed = nf2_aclmin_check(&a, trials, seed, stderr);
+	printf("check:        %d random keys (seed %u), %d failed\n", trials, seed, failed);
+
+	if (out != NULL && write_image(&a, rules, n, out))
+		failed++;
+	nf2_aclmin_free(&a);
+	free(rules);
+	return failed ? 1 : 0;
+}
+
+
+void usage(void) {
+	printf("Usage: aclmin [-o out_file] [-c trials] [-s seed] [-v] flow_file\n");
+	printf("  Compiles the wildcard rules of flow_file (format in\n"
+	       "  common/nf2_flowfile.h) into an image of at most %d entries, and\n"
+	       "  lists the rules shadowed and the rules that did not fit, whose\n"
+	       "  packets go to the controller.\n", OPENFLOW_WILDCARD_TABLE_SIZE);
+	printf("  -o  write the exact flows of flow_file and the image, as a flow file\n"
+	       "      with the image's priorities numbered down in its order\n");
+	printf("  -c  random keys to check the image with (default %d)\n", DEFAULT_TRIALS);
+	printf("  -s  seed of the check (default the time)\n");
+	printf("  -v  also list the rules in the image and the entry of each\n");
+}
+
+
+//
+// set_merge_bits: merge only bits the flow file format can mask: not the
+//    MAC addresses or the VLAN tag
+//
+void set_merge_bits(struct nf2_aclmin *a) {
+	struct nf2_of_entry *m = &a->merge_bits.entry;
+
+	memset(&a->merge_bits, 0, sizeof(a->merge_bits));
+	m->src_port = 0xff;
+	m->eth_type = 0xffff;
+	m->ip_tos = 0xfc;
+	m->ip_proto = 0xff;
+	m->ip_src = 0xffffffff;
+	m->ip_dst = 0xffffffff;
+	m->transp_src = 0xffff;
+	m->transp_dst = 0xffff;
+}
+
+
+void report(struct nf2_aclmin *a, struct nf2_flowfile_rule *rules, int verbose) {
+	struct nf2_flowfile_rule *r;
+	int i, entry;
+
+	for (i = 0; i < a->num_rules; i++) {
+		r = &rules[a->rules[i].id];
+		switch (nf2_aclmin_fate(a, i, &entry)) {
+		case NF2_ACLMIN_IMAGE:
+			if (!verbose)
+				continue;
+			printf("line %d: entry %d: ", r->line, entry);
+			break;
+		case NF2_ACLMIN_SPILLED:
+			printf("line %d: does not fit (entry %d): ", r->line, entry);
+			break;
+		case NF2_ACLMIN_SHADOWED:
+			printf("line %d: shadowed: ", r->line);
+			break;
+		}
+		nf2_flowfile_print(stdout, r);
+	}
+}
+
+
+int write_image(struct nf2_aclmin *a, struct nf2_flowfile_rule *rules, int n,
+		const char *path) {
+	struct nf2_flowfile_rule r;
+	int i, num = a->num_out < a->size ? a->num_out : a->size;
+	FILE *f;
+
+	if ((f = fopen(path, "w")) == NULL) {
+		perror(path);
+		return -1;
+	}
+	for (i = 0; i < n; i++)
+		if (rules[i].exact)
+			nf2_flowfile_print(f, &rules[i]);
+	for (i = 0; i < num; i++) {
+		memset(&r, 0, sizeof(r));
+		r.entry = a->out[i].entry;
+		r.mask = a->out[i].mask;
+		r.action = a->out[i].action;
+		r.priority = num - i;
+		fprintf(f, "# entry %d, %d rules\n", i, a->out[i].num_rules);
+		nf2_flowfile_print(f, &r);
+	}
+	if (fclose(f)) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,381 @@
+/* ****************************************************************************
+ * Module: aclbench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Fit of generated ACLs into the 32 entry wildcard table
+ *              with the rule-set minimizer of common/nf2_aclmin.c.
+ *
+ *              Generates ACLs as operators write them: permits of a
+ *              service from lists of source subnets and port lists,
+ *              denies above them, and rules repeated below broader ones.
+ *              Reports the entries before and after compiling, the share
+ *              of the ACL's traffic that misses the table and goes to the
+ *              controller when the first 32 rules are loaded as they are
+ *              and when the compiled image is, and checks the image by
+ *              random lookups. Then adds and deletes rules one at a time,
+ *              recompiling and writing the image to the register file
+ *              emulator, and checks the emulated table after each.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <time.h>
+
+#include "../common/nf2_emu.h"
+#include "../common/nf2_aclmin.h"
+
+#define DEFAULT_POLICIES	12
+#define DEFAULT_TRIALS		200000
+#define DEFAULT_UPDATES		200
+#define DEFAULT_SEED		1
+
+struct rule {
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;
+	nf2_of_action_wrap action;
+	uint16_t priority;
+	int id;
+};
+
+static struct rule *acl;
+static int num_acl, max_acl;
+static int next_id;
+static unsigned seed = DEFAULT_SEED;
+
+static const uint16_t ports[] = { 22, 25, 53, 80, 443, 993, 3306, 8080 };
+
+void usage (void);
+double now_ms (void);
+void add_rule (const struct rule *);
+void gen_policy (void);
+void gen_deny (void);
+void random_rule (struct rule *);
+void random_key (const struct rule *, nf2_of_entry_wrap *);
+double punt_rate (struct nf2_aclmin *, int trials, double *naive);
+int check_emu (struct nf2_aclmin *, struct nf2_emu *);
+int cmp_rank (const void *, const void *);
+
+int main(int argc, char *argv[]) {
+	struct nf2_aclmin a;
+	struct nf2_emu emu;
+	struct nf2_of_wildcard_stage stage;
+	struct rule r;
+	double t0, compile_ms, update_ms = 0, punt, naive;
+	int policies = DEFAULT_POLICIES, trials = DEFAULT_TRIALS, updates = DEFAULT_UPDATES;
+	int c, i, n, writes, failures = 0;
+	unsigned long writes_total = 0, moves0;
+
+	while ((c = getopt(argc, argv, "p:c:u:s:h")) != -1) {
+		switch (c) {
+		case 'p':
+			policies = atoi(optarg);
+			break;
+		case 'c':
+			trials = atoi(optarg);
+			break;
+		case 'u':
+			updates = atoi(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (policies <= 0 || trials < 0 || updates < 0) {
+		usage();
+		exit(1);
+	}
+
+	srand(seed);
+	for (i = 0; i < policies; i++) {
+		gen_policy();
+		if (rand() % 3 == 0)
+			gen_deny();
+	}
+
+	nf2_aclmin_init(&a);
+	for (i = 0; i < num_acl; i++)
+		if (nf2_aclmin_add(&a, &acl[i].entry, &acl[i].mask, &acl[i].action,
+				   acl[i].priority, acl[i].id)) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	t0 = now_ms();
+	if (nf2_aclmin_compile(&a) < 0) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	compile_ms = now_ms() - t0;
+	nf2_aclmin_print_stats(&a, stdout);
+	printf("compile:      %.2f ms\n", compile_ms);
+	punt = punt_rate(&a, trials, &naive);
+	printf("punted:       %.1f%% of the ACL's traffic with its first %d rules loaded, "
+	       "%.1f%% with the image\n", naive * 100, a.size, punt * 100);
+	n = nf2_aclmin_check(&a, trials, seed, stderr);
+	printf("check:        %d random keys, %d failed\n\n", trials, n);
+	failures += n;
+
+	if (nf2_emu_open(&emu, 0, 0)) {
+		fprintf(stderr, "Could not allocate the emulated register file\n");
+		exit(1);
+	}
+	nf2_of_wildcard_stage_invalidate(&stage);
+	if ((writes = nf2_aclmin_write(&a, &emu.io, &stage)) < 0) {
+		fprintf(stderr, "Register access failed\n");
+		exit(1);
+	}
+	failures += check_emu(&a, &emu);
+	moves0 = a.stats.hw_moves;
+
+	for (i = 0; i < updates; i++) {
+		if (rand() % 2 && num_acl > 0) {
+			n = rand() % num_acl;
+			nf2_aclmin_delete(&a, acl[n].id);
+			acl[n] = acl[--num_acl];
+		}
+		else {
+			random_rule(&r);
+			add_rule(&r);
+			nf2_aclmin_add(&a, &r.entry, &r.mask, &r.action, r.priority, r.id);
+		}
+		t0 = now_ms();
+		if (nf2_aclmin_compile(&a) < 0 || (writes = nf2_aclmin_write(&a, &emu.io, &stage)) < 0) {
+			fprintf(stderr, "Update %d failed\n", i);
+			exit(1);
+		}
+		update_ms += now_ms() - t0;
+		writes_total += writes;
+		failures += check_emu(&a, &emu);
+		failures += nf2_aclmin_check(&a, trials / 100, seed + i, stderr);
+	}
+	if (updates) {
+		printf("updates:      %d adds and deletes, %.2f ms and %.1f entries written "
+		       "(%.1f moved) each, %d rules in %d entries at the end\n", updates,
+		       update_ms / updates, (double)writes_total / updates,
+		       (double)(a.stats.hw_moves - moves0) / updates, a.stats.rules,
+		       a.stats.entries);
+		printf("gaps:         %lu writes with a moved entry off the card\n",
+		       a.stats.hw_gaps);
+		printf("check:        %s\n", failures ? "FAILED" : "ok");
+	}
+
+	nf2_emu_close(&emu);
+	nf2_aclmin_free(&a);
+	free(acl);
+	return failures ? 1 : 0;
+}
+
+
+void usage(void) {
+	printf("Usage: aclbench [-p policies] [-c trials] [-u updates] [-s seed]\n");
+	printf("  -p  services in the generated ACL (default %d)\n", DEFAULT_POLICIES);
+	printf("  -c  random keys to check the image with (default %d)\n", DEFAULT_TRIALS);
+	printf("  -u  rules added or deleted one at a time (default %d)\n", DEFAULT_UPDATES);
+	printf("  -s  seed (default %d)\n", DEFAULT_SEED);
+}
+
+
+double now_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+
+void add_rule(const struct rule *r) {
+	struct rule *tmp;
+
+	if (num_acl == max_acl) {
+		max_acl = max_acl ? 2 * max_acl : 256;
+		if ((tmp = realloc(acl, max_acl * sizeof(*acl))) == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		acl = tmp;
+	}
+	acl[num_acl] = *r;
+	acl[num_acl++].id = next_id++;
+}
+
+
+static void ip_rule(struct rule *r, uint16_t priority) {
+	memset(r, 0, sizeof(*r));
+	memset(&r->mask, 0xff, sizeof(r->mask));
+	r->entry.entry.eth_type = 0x0800;
+	r->mask.entry.eth_type = 0;
+	r->priority = priority;
+}
+
+
+static void set_src(struct rule *r, uint32_t net, int len) {
+	r->mask.entry.ip_src = len ? ~(0xffffffff << (32 - len)) : 0xffffffff;
+	r->entry.entry.ip_src = net & ~r->mask.entry.ip_src;
+}
+
+
+static void set_dst(struct rule *r, uint32_t net, int len) {
+	r->mask.entry.ip_dst = len ? ~(0xffffffff << (32 - len)) : 0xffffffff;
+	r->entry.entry.ip_dst = net & ~r->mask.entry.ip_dst;
+}
+
+
+static void set_port(struct rule *r, uint8_t proto, uint16_t port) {
+	r->entry.entry.ip_proto = proto;
+	r->mask.entry.ip_proto = 0;
+	r->entry.entry.transp_dst = port;
+	r->mask.entry.transp_dst = 0;
+}
+
+
+//
+// gen_policy: a service: one server, a list of the /24s of a site
+//    allowed to reach it, on one port or a list of ports, each as a rule
+//
+void gen_policy(void) {
+	struct rule r;
+	uint32_t site = (10 << 24) | ((rand() % 8) << 16), server;
+	uint16_t priority = 100 + 10 * (rand() % 4), port = ports[rand() % 8];
+	int first = rand() % 64, subnets = 1 + rand() % 8, num_ports = 1, s, p;
+	uint16_t out = 1 << (2 * (rand() % NF2_PORT_NUM));
+
+	server = (172u << 24) | (16 << 16) | (rand() % 4) << 8 | (1 + rand() % 20);
+	if (rand() % 4 == 0) {
+		/* a port range, as a list */
+		port = 8000 + 8 * (rand() % 8);
+		num_ports = 2 + rand() % 7;
+	}
+	for (s = 0; s < subnets; s++) {
+		for (p = 0; p < num_ports; p++) {
+			ip_rule(&r, priority);
+			set_src(&r, site | (first + s) << 8, 24);
+			set_dst(&r, server, 32);
+			set_port(&r, 6, port + p);
+			r.action.action.forward_bitmask = out;
+			add_rule(&r);
+			/* the same permit again, below, as ACLs collect them */
+			if (rand() % 8 == 0) {
+				r.priority -= 5;
+				add_rule(&r);
+			}
+		}
+	}
+}
+
+
+//
+// gen_deny: a deny of a host or of a service from a whole site, above the
+//    permits
+//
+void gen_deny(void) {
+	struct rule r;
+
+	ip_rule(&r, 200);
+	if (rand() % 2)
+		set_src(&r, (10 << 24) | ((rand() % 8) << 16) | (rand() % 64) << 8 | (rand() % 256), 32);
+	else {
+		set_src(&r, (10 << 24) | ((rand() % 8) << 16), 16);
+		set_port(&r, 6, ports[rand() % 8]);
+	}
+	add_rule(&r);
+}
+
+
+void random_rule(struct rule *r) {
+	if (rand() % 4 == 0) {
+		ip_rule(r, 200);
+		set_src(r, (10 << 24) | ((rand() % 8) << 16) | (rand() % 64) << 8 | (rand() % 256), 32);
+		return;
+	}
+	ip_rule(r, 100 + 10 * (rand() % 4));
+	set_src(r, (10 << 24) | ((rand() % 8) << 16) | (rand() % 64) << 8, 24);
+	set_dst(r, (172u << 24) | (16 << 16) | (rand() % 4) << 8 | (1 + rand() % 20), 32);
+	set_port(r, 6, ports[rand() % 8]);
+	r->action.action.forward_bitmask = 1 << (2 * (rand() % NF2_PORT_NUM));
+}
+
+
+void random_key(const struct rule *r, nf2_of_entry_wrap *key) {
+	int w;
+
+	for (w = 0; w < NF2_OF_ENTRY_WORD_LEN; w++)
+		key->raw[w] = (((uint32_t)rand() << 16 ^ rand()) & r->mask.raw[w]) | r->entry.raw[w];
+	key->raw[NF2_OF_ENTRY_WORD_LEN - 1] &= 0x00ffffff;
+}
+
+
+static int *rank;
+
+int cmp_rank(const void *x, const void *y) {
+	const struct rule *rx = &acl[*(const int *)x], *ry = &acl[*(const int *)y];
+
+	if (rx->priority != ry->priority)
+		return rx->priority > ry->priority ? -1 : 1;
+	return rx->id - ry->id;
+}
+
+
+//
+// punt_rate: the share of keys, each in a random rule of the ACL, that
+//    miss the image and, in *naive, that miss the table loaded with the
+//    ACL's first size rules as they are
+//
+double punt_rate(struct nf2_aclmin *a, int trials, double *naive) {
+	nf2_of_entry_wrap key;
+	int *order, t, r, i, hit = 0, naive_punts = 0, punts = 0;
+
+	order = malloc(num_acl * sizeof(*order));
+	rank = malloc(num_acl * sizeof(*rank));
+	if (order == NULL || rank == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < num_acl; i++)
+		order[i] = i;
+	qsort(order, num_acl, sizeof(*order), cmp_rank);
+	for (i = 0; i < num_acl; i++)
+		rank[order[i]] = i;
+
+	/* rules[] of the minimizer are in the order they were added, as acl[] */
+	for (t = 0; t < trials; t++) {
+		random_key(&acl[rand() % num_acl], &key);
+		if ((r = nf2_aclmin_match_rules(a, &key)) < 0)
+			continue;
+		hit++;
+		naive_punts += rank[r] >= a->size;
+		punts += nf2_aclmin_match_compiled(a, &key) >= a->size;
+	}
+	free(order);
+	free(rank);
+	*naive = hit ? (double)naive_punts / hit : 0;
+	return hit ? (double)punts / hit : 0;
+}
+
+
+//
+// check_emu: the emulated wildcard table holds the image, and zeroes
+//    past it
+//
+int check_emu(struct nf2_aclmin *a, struct nf2_emu *emu) {
+	struct nf2_aclmin_entry zero, *e;
+	int i, failures = 0;
+
+	memset(&zero, 0, sizeof(zero));
+	for (i = 0; i < OPENFLOW_WILDCARD_TABLE_SIZE; i++) {
+		e = i < a->num_out && i < a->size ? &a->out[i] : &zero;
+		if (!nf2_emu_wildcard_holds(&emu->wildcard[i], &e->entry, &e->mask, &e->action)) {
+			fprintf(stderr, "wildcard entry %d differs from the image\n", i);
+			failures++;
+		}
+	}
+	return failures;
+}
@@ -0,0 +1,318 @@
+/* ****************************************************************************
+ * Module: actbench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Checks the host opl_processor rewrites and measures their
+ *              throughput.
+ *
+ *              Random actions are applied to random frames (tagged and
+ *              untagged, IP with and without options, TCP, UDP, ICMP
+ *              and ARP) with every method. The methods must agree to the
+ *              byte, and frames that had valid IP and TCP/UDP checksums
+ *              must still have valid ones, checked by recomputing them
+ *              from scratch.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <time.h>
+
+#include "../common/nf2_action.h"
+#include "../common/nf2_flowkey.h"
+
+#define BATCH		4096
+#define NUM_PLANS	64
+#define CHECK_ROUNDS	64
+#define BUF_LEN		256
+#define MAX_FRAME	(BUF_LEN - 2 * NF2_ACTION_HEADROOM)
+
+struct frame {
+	uint8_t buf[BUF_LEN];
+	uint32_t len;
+};
+
+static struct frame frames[BATCH];
+static uint8_t work[2][BATCH][BUF_LEN];
+static struct nf2_pkt pkts[2][BATCH];
+static int fwd[2][BATCH];
+
+static struct nf2_action_plan plans[NUM_PLANS];
+static const struct nf2_action_plan *plan_of[BATCH];
+
+static const enum nf2_action_method methods[] = {
+	NF2_ACTION_SCALAR, NF2_ACTION_SSE2
+};
+#define NUM_METHODS	(sizeof(methods) / sizeof(methods[0]))
+
+void usage (void);
+void random_frame (struct frame *);
+void random_plans (void);
+void load (int set);
+int check (void);
+int checksums_ok (const uint8_t *, uint32_t len, int *ip_ok, int *tp_ok);
+double now_ns (void);
+
+int main(int argc, char *argv[]) {
+	int iters = 200, check_only = 0;
+	int c, i, k, failures = 0;
+	double start, ns, copy_ns;
+
+	while ((c = getopt(argc, argv, "n:ch")) != -1) {
+		switch (c) {
+		case 'n':
+			iters = atoi(optarg);
+			break;
+		case 'c':
+			check_only = 1;
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	srandom(1);
+	for (i = 0; i < CHECK_ROUNDS; i++) {
+		for (k = 0; k < BATCH; k++)
+			random_frame(&frames[k]);
+		random_plans();
+		failures += check();
+	}
+	printf("checks on %d random frames: %s\n", CHECK_ROUNDS * BATCH,
+	       failures ? "FAILED" : "ok");
+	if (failures || check_only)
+		return failures != 0;
+
+	/* the frames are rewritten in place: time the copy alone and take
+	 * it off */
+	start = now_ns();
+	for (i = 0; i < iters; i++)
+		load(0);
+	copy_ns = now_ns() - start;
+
+	printf("\n%-8s %12s %12s\n", "method", "ns/pkt", "Mpkts/s");
+	for (k = 0; k < NUM_METHODS; k++) {
+		if (nf2_action_set_method(methods[k])) {
+			printf("%-8s not supported on this CPU\n",
+			       nf2_action_method_name(methods[k]));
+			continue;
+		}
+		start = now_ns();
+		for (i = 0; i < iters; i++) {
+			load(0);
+			nf2_action_apply_batch(plan_of, pkts[0], BATCH, fwd[0]);
+		}
+		ns = (now_ns() - start - copy_ns) / ((double)iters * BATCH);
+		printf("%-8s %12.2f %12.2f\n", nf2_action_method_name(methods[k]),
+		       ns, 1e3 / ns);
+	}
+	return 0;
+}
+
+
+void usage(void) {
+	printf("Usage: actbench [-n batches] [-c]\n");
+	printf("  -n  batches of %d frames to time (default 200)\n", BATCH);
+	printf("  -c  only run the checks\n");
+}
+
+
+static void put16(uint8_t *b, uint16_t v) {
+	b[0] = v >> 8;
+	b[1] = v;
+}
+
+
+static uint16_t get16(const uint8_t *b) {
+	return (b[0] << 8) | b[1];
+}
+
+
+static uint32_t sum16(const uint8_t *b, int len) {
+	uint32_t sum = 0;
+	int i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		sum += get16(b + i);
+	if (len & 1)
+		sum += b[len - 1] << 8;
+	return sum;
+}
+
+
+static uint16_t fold(uint32_t sum) {
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return sum;
+}
+
+
+/* checksum over the L4 segment and its pseudo header */
+static uint16_t tp_csum(const uint8_t *ip, const uint8_t *l4, int l4_len) {
+	return fold(sum16(ip + 12, 8) + ip[9] + l4_len + sum16(l4, l4_len));
+}
+
+
+void random_frame(struct frame *f) {
+	uint8_t *d = f->buf + NF2_ACTION_HEADROOM;
+	uint8_t *ip, *l4;
+	int l3 = 14, ihl, proto, l4_len, csum, r = random() % 16;
+	uint32_t i;
+
+	f->len = 60 + random() % (MAX_FRAME - 60);
+	for (i = 0; i < f->len; i++)
+		d[i] = random();
+
+	if (random() % 3 == 0) {
+		put16(d + 12, NF2_ETH_TYPE_VLAN);
+		l3 += 4;
+	}
+	if (r == 0) {
+		put16(d + l3 - 2, NF2_ETH_TYPE_ARP);
+		return;
+	}
+	if (r == 1)
+		return;		/* random ethertype */
+	put16(d + l3 - 2, NF2_ETH_TYPE_IP);
+
+	/* IHL 5..8, and now and then a bad one */
+	ihl = r == 2 ? random() % 5 : 5 + random() % 4;
+	proto = r < 9 ? NF2_IP_PROTO_TCP : r < 14 ? NF2_IP_PROTO_UDP : NF2_IP_PROTO_ICMP;
+	ip = d + l3;
+	ip[0] = 0x40 | ihl;
+	ip[9] = proto;
+	put16(ip + 2, f->len - l3);
+	put16(ip + 10, 0);
+	if (ihl >= 5)
+		put16(ip + 10, ~fold(sum16(ip, ihl * 4)));
+
+	l4 = ip + ihl * 4;
+	l4_len = f->len - l3 - ihl * 4;
+	if (ihl < 5 || proto == NF2_IP_PROTO_ICMP)
+		return;
+	csum = proto == NF2_IP_PROTO_TCP ? 16 : 6;
+	if (l4_len < csum + 2)
+		return;
+	put16(l4 + csum, 0);
+	if (proto == NF2_IP_PROTO_UDP) {
+		put16(l4 + 4, l4_len);
+		if (random() % 4 == 0)
+			return;		/* no checksum */
+	}
+	put16(l4 + csum, ~tp_csum(ip, l4, l4_len));
+}
+
+
+void random_plans(void) {
+	nf2_of_action_wrap action;
+	int i, j;
+
+	for (i = 0; i < NUM_PLANS; i++) {
+		for (j = 0; j < NF2_OF_ACTION_WORD_LEN; j++)
+			action.raw[j] = random() ^ (random() << 16);
+		action.action.nf2_action_flag &= 0x7fe;
+		if (i % 16 == 0)
+			action.action.forward_bitmask = 0;
+		nf2_action_compile(&action, &plans[i]);
+	}
+	for (i = 0; i < BATCH; i++)
+		plan_of[i] = &plans[random() % NUM_PLANS];
+}
+
+
+void load(int set) {
+	int i;
+
+	for (i = 0; i < BATCH; i++) {
+		memcpy(work[set][i], frames[i].buf, frames[i].len + NF2_ACTION_HEADROOM);
+		pkts[set][i].data = work[set][i] + NF2_ACTION_HEADROOM;
+		pkts[set][i].len = frames[i].len;
+		pkts[set][i].headroom = NF2_ACTION_HEADROOM;
+	}
+}
+
+
+/*
+ * Returns 0 if the frame's IP or TCP/UDP checksum is present and wrong.
+ * ip_ok and tp_ok say which ones were checked.
+ */
+int checksums_ok(const uint8_t *d, uint32_t len, int *ip_ok, int *tp_ok) {
+	int l3 = get16(d + 12) == NF2_ETH_TYPE_VLAN ? 18 : 14;
+	const uint8_t *ip = d + l3, *l4;
+	int ihl, csum;
+
+	*ip_ok = *tp_ok = 0;
+	if (get16(d + l3 - 2) != NF2_ETH_TYPE_IP)
+		return 1;
+	ihl = ip[0] & 0xf;
+	if (ihl < 5)
+		return 1;
+	*ip_ok = 1;
+	if (fold(sum16(ip, ihl * 4)) != 0xffff)
+		return 0;
+
+	l4 = ip + ihl * 4;
+	if (ip[9] == NF2_IP_PROTO_ICMP)
+		return 1;
+	csum = ip[9] == NF2_IP_PROTO_TCP ? 16 : 6;
+	if (len < l3 + ihl * 4 + csum + 2 || get16(l4 + csum) == 0)
+		return 1;
+	*tp_ok = 1;
+	return tp_csum(ip, l4, len - l3 - ihl * 4) == 0xffff;
+}
+
+
+int check(void) {
+	int i, k, failures = 0, ip_before, tp_before, ip_after, tp_after;
+	int ok_before, ok_after;
+
+	nf2_action_set_method(NF2_ACTION_SCALAR);
+	load(0);
+	nf2_action_apply_batch(plan_of, pkts[0], BATCH, fwd[0]);
+
+	for (k = 1; k < NUM_METHODS; k++) {
+		if (nf2_action_set_method(methods[k]))
+			continue;
+		load(1);
+		nf2_action_apply_batch(plan_of, pkts[1], BATCH, fwd[1]);
+		for (i = 0; i < BATCH; i++) {
+			if (fwd[0][i] != fwd[1][i] || pkts[0][i].len != pkts[1][i].len ||
+			    pkts[0][i].headroom != pkts[1][i].headroom ||
+			    memcmp(pkts[0][i].data, pkts[1][i].data, pkts[0][i].len)) {
+				printf("%-8s disagrees with scalar on frame %d\n",
+				       nf2_action_method_name(methods[k]), i);
+				failures++;
+			}
+		}
+	}
+
+	/* a rewrite keeps valid checksums valid */
+	for (i = 0; i < BATCH; i++) {
+		if (fwd[0][i] <= 0)
+			continue;
+		ok_before = checksums_ok(frames[i].buf + NF2_ACTION_HEADROOM,
+					 frames[i].len, &ip_before, &tp_before);
+		ok_after = checksums_ok(pkts[0][i].data, pkts[0][i].len, &ip_after,
+					&tp_after);
+		if (ok_before && ip_before == ip_after && tp_before == tp_after &&
+		    !ok_after) {
+			printf("checksum broken on frame %d\n", i);
+			failures++;
+		}
+	}
+	return failures;
+}
+
+
+double now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
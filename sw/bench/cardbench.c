@@ -0,0 +1,277 @@
+/* ****************************************************************************
+ * Module: cardbench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Flow install throughput of several emulated cards driven
+ *              by one process (common/nf2_cards.c), for 1, 2, 4 ... cards:
+ *              random exact flows are queued to the cards in turn, with
+ *              counter sweeps in between, and each card's worker waits
+ *              for the modelled PCI time of its register accesses as it
+ *              would wait for the bus.
+ *
+ *              Every card is then checked: each flow is in the emulated
+ *              SRAM at a slot of its own, valid, with its actions, and a
+ *              sweep after traffic counted into the entries harvests the
+ *              packets of each flow exactly.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <time.h>
+
+#include "../common/nf2_cards.h"
+
+#define DEFAULT_CARDS		4
+#define DEFAULT_FLOWS		8192
+#define DEFAULT_SWEEPS		1
+#define DEFAULT_TXN_NS		1500
+#define DEFAULT_WORD_NS		500
+
+struct card_flows {
+	nf2_of_entry_wrap *entries;
+	nf2_of_action_wrap *actions;
+	uint32_t *pkts;			/* counted in for the check */
+};
+
+struct result {
+	int cards;
+	int workers;
+	double wall_ms;
+	struct nf2_card_stats st;
+	unsigned long txns;
+	unsigned long long model_ns;
+	int failed;
+};
+
+static struct card_flows flows[NF2_CARDS_MAX];
+static int num_flows = DEFAULT_FLOWS;
+static int num_sweeps = DEFAULT_SWEEPS;
+static struct nf2_cards_cfg cfg = {
+	.max_kicks = NF2_EXACT_DEFAULT_MAX_KICKS,
+	.harvest = { 1000000000ULL, 10000000000ULL, 0 },
+	.emu_txn_ns = DEFAULT_TXN_NS,
+	.emu_word_ns = DEFAULT_WORD_NS,
+	.emu_pace = 1,
+};
+
+void usage (void);
+void make_flows (int cards);
+double now_ms (void);
+int run (int cards, int workers, struct result *);
+int check (struct nf2_cards *, int card);
+
+int main(int argc, char *argv[]) {
+	struct result res[2 * NF2_CARDS_MAX];
+	int c, i, k, n = 0, max_cards = DEFAULT_CARDS, failures = 0;
+
+	while ((c = getopt(argc, argv, "c:n:s:t:w:ph")) != -1) {
+		switch (c) {
+		case 'c':
+			max_cards = atoi(optarg);
+			break;
+		case 'n':
+			num_flows = atoi(optarg);
+			break;
+		case 's':
+			num_sweeps = atoi(optarg);
+			break;
+		case 't':
+			cfg.emu_txn_ns = atoi(optarg);
+			break;
+		case 'w':
+			cfg.emu_word_ns = atoi(optarg);
+			break;
+		case 'p':
+			cfg.emu_pace = 0;
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (max_cards <= 0 || max_cards > NF2_CARDS_MAX || num_flows <= 0 ||
+	    num_flows > OPENFLOW_NF2_EXACT_TABLE_SIZE / 2 || num_sweeps < 0) {
+		usage();
+		exit(1);
+	}
+
+	make_flows(max_cards);
+	for (k = 1; k <= max_cards; k *= 2)
+		failures += run(k, k, &res[n++]);
+	if (max_cards > 1)
+		failures += run(max_cards, 1, &res[n++]);
+
+	printf("%d flows and %d sweeps per card, model: %u ns/transaction + %u ns/word%s\n\n",
+	       num_flows, num_sweeps, cfg.emu_txn_ns, cfg.emu_word_ns,
+	       cfg.emu_pace ? " (paced)" : "");
+	printf("%5s %7s %10s %12s %8s %8s %10s %10s %6s\n", "cards", "workers", "wall ms",
+	       "flow-mods/s", "speedup", "stolen", "txns/flow", "model ms", "check");
+	for (i = 0; i < n; i++) {
+		printf("%5d %7d %10.1f %12.0f %8.2f %8lu %10.2f %10.1f %6s\n", res[i].cards,
+		       res[i].workers, res[i].wall_ms, res[i].st.installs / res[i].wall_ms * 1e3,
+		       (res[i].st.installs / res[i].wall_ms) / (res[0].st.installs / res[0].wall_ms),
+		       res[i].st.stolen, (double)res[i].txns / res[i].st.installs,
+		       res[i].model_ns / 1e6, res[i].failed ? "FAILED" : "ok");
+	}
+	return failures ? 1 : 0;
+}
+
+
+void usage(void) {
+	printf("Usage: cardbench [-c max_cards] [-n flows] [-s sweeps] [-t txn_ns] [-w word_ns] [-p]\n");
+	printf("  -c  largest number of emulated cards (default %d, at most %d)\n",
+	       DEFAULT_CARDS, NF2_CARDS_MAX);
+	printf("  -n  flows installed per card (default %d)\n", DEFAULT_FLOWS);
+	printf("  -s  counter sweeps per card among the installs (default %d)\n", DEFAULT_SWEEPS);
+	printf("  -t  modelled ns per register transaction (default %d)\n", DEFAULT_TXN_NS);
+	printf("  -w  modelled ns per register word (default %d)\n", DEFAULT_WORD_NS);
+	printf("  -p  do not wait for the modelled time, only count it\n");
+}
+
+
+void make_flows(int cards) {
+	int c, i, w;
+
+	srandom(1);
+	for (c = 0; c < cards; c++) {
+		flows[c].entries = calloc(num_flows, sizeof(*flows[c].entries));
+		flows[c].actions = calloc(num_flows, sizeof(*flows[c].actions));
+		flows[c].pkts = calloc(num_flows, sizeof(*flows[c].pkts));
+		if (flows[c].entries == NULL || flows[c].actions == NULL || flows[c].pkts == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		for (i = 0; i < num_flows; i++) {
+			for (w = 0; w < NF2_OF_ENTRY_WORD_LEN; w++)
+				flows[c].entries[i].raw[w] = random() ^ (random() << 16);
+			flows[c].entries[i].entry.pad = 0;
+			flows[c].actions[i].action.forward_bitmask = 1 << (random() % NF2_PORT_NUM);
+			flows[c].pkts[i] = 1 + random() % 1000;
+		}
+	}
+}
+
+
+double now_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+
+//
+// run: installs the flows of each card, NF2_EXACT_BATCH at a time and the
+//    cards in turn as a controller's flow-mods would come, with the
+//    sweeps spread among them, then checks the cards
+//
+int run(int cards, int workers, struct result *res) {
+	static const char *const ifaces[NF2_CARDS_MAX] = {
+		NF2_CARDS_EMU, NF2_CARDS_EMU, NF2_CARDS_EMU, NF2_CARDS_EMU,
+		NF2_CARDS_EMU, NF2_CARDS_EMU, NF2_CARDS_EMU, NF2_CARDS_EMU,
+	};
+	struct nf2_cards cs;
+	double t0;
+	int c, i, k, sweep_every;
+
+	memset(res, 0, sizeof(*res));
+	res->cards = cards;
+	res->workers = workers;
+	cfg.workers = workers;
+	if (nf2_cards_open(&cs, ifaces, cards, &cfg)) {
+		fprintf(stderr, "Could not open %d emulated cards\n", cards);
+		exit(1);
+	}
+
+	sweep_every = num_sweeps ? num_flows / (num_sweeps + 1) : num_flows + 1;
+	if (sweep_every < NF2_EXACT_BATCH)
+		sweep_every = NF2_EXACT_BATCH;
+	t0 = now_ms();
+	for (i = 0; i < num_flows; i += k) {
+		k = num_flows - i < NF2_EXACT_BATCH ? num_flows - i : NF2_EXACT_BATCH;
+		for (c = 0; c < cards; c++)
+			nf2_cards_install(&cs, c, flows[c].entries + i, flows[c].actions + i, k);
+		if (i / sweep_every != (i + k) / sweep_every && i + k < num_flows)
+			nf2_cards_sweep(&cs, -1);
+	}
+	nf2_cards_wait(&cs);
+	res->wall_ms = now_ms() - t0;
+	nf2_cards_total(&cs, &res->st, &res->txns, &res->model_ns);
+
+	nf2_cards_print_stats(&cs, stdout);
+	printf("\n");
+
+	for (c = 0; c < cards; c++)
+		res->failed += check(&cs, c);
+	if (res->st.errors || res->st.installs != (unsigned long)cards * num_flows)
+		res->failed++;
+	nf2_cards_close(&cs);
+	return res->failed ? 1 : 0;
+}
+
+
+//
+// check: every flow of the card is in the emulated SRAM at its slot, with
+//    its actions; packets counted into the entries are all harvested
+//
+int check(struct nf2_cards *cs, int card) {
+	struct nf2_card *c = &cs->cards[card];
+	struct card_flows *f = &flows[card];
+	uint32_t word;
+	int *idx, i, w, n, failures = 0;
+
+	idx = malloc(num_flows * sizeof(*idx));
+	if (idx == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < num_flows; i++) {
+		idx[i] = nf2_exact_find(&c->exact, &f->entries[i]);
+		if (idx[i] < 0) {
+			failures++;
+			continue;
+		}
+		for (w = 0; w < NF2_OF_ENTRY_WORD_LEN; w++) {
+			word = f->entries[i].raw[w];
+			if (w == NF2_OF_ENTRY_WORD_LEN - 1)
+				word |= NF2_EXACT_VALID_BIT;
+			if (*nf2_regio_mock_reg(c->io, NF2_EXACT_ADDR(idx[i],
+					OPENFLOW_EXACT_ENTRY_HDR_BASE_POS + w)) != word)
+				failures++;
+		}
+		for (w = 0; w < NF2_OF_ACTION_WORD_LEN; w++) {
+			if (*nf2_regio_mock_reg(c->io, NF2_EXACT_ADDR(idx[i],
+					OPENFLOW_EXACT_ENTRY_ACTION_BASE_POS + w)) !=
+			    f->actions[i].raw[w])
+				failures++;
+		}
+	}
+
+	/* count the packets in with the card's worker idle, then sweep them
+	 * out through the scheduler */
+	nf2_cards_sweep(cs, card);
+	nf2_cards_wait(cs);
+	for (i = 0; i < num_flows; i++) {
+		if (idx[i] < 0)
+			continue;
+		c->harvest.flows[idx[i]].pkts = 0;
+		for (n = 0; n < (int)f->pkts[i]; n++)
+			nf2_emu_exact_hit(&c->emu, idx[i], 64);
+	}
+	nf2_cards_sweep(cs, card);
+	nf2_cards_wait(cs);
+	for (i = 0; i < num_flows; i++) {
+		if (idx[i] >= 0 && c->harvest.flows[idx[i]].pkts != f->pkts[i])
+			failures++;
+	}
+	free(idx);
+	if (failures)
+		fprintf(stderr, "%s: %d check failures\n", c->iface, failures);
+	return failures;
+}
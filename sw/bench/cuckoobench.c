@@ -0,0 +1,174 @@
+/* ****************************************************************************
+ * Module: cuckoobench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Fills the host managed exact table (common/nf2_exact_table.c)
+ *              with random flows for a range of kick chain bounds and
+ *              reports the load factor reached and the collision and
+ *              write statistics. The last run goes through the mock
+ *              register file and checks the table written there against
+ *              the host shadow.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/nf2_hash.h"
+#include "../common/nf2_exact_table.h"
+
+static const int kick_bounds[] = { 0, 1, 2, 4, 8, 16, 32 };
+#define NUM_BOUNDS	(sizeof(kick_bounds) / sizeof(kick_bounds[0]))
+
+void usage (void);
+void random_flow (nf2_of_entry_wrap *, nf2_of_action_wrap *);
+int fill (struct nf2_exact_table *, int max_failures, double *first_fail);
+int check_card (struct nf2_exact_table *, struct nf2_regio *);
+
+int main(int argc, char *argv[]) {
+	struct nf2_exact_table tbl;
+	struct nf2_regio io;
+	int max_failures = 100, verbose = 0;
+	int c, k, failures;
+	double first_fail;
+
+	while ((c = getopt(argc, argv, "f:vh")) != -1) {
+		switch (c) {
+		case 'f':
+			max_failures = atoi(optarg);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	printf("%-6s %11s %11s %11s %11s %11s\n", "kicks", "first fail",
+	       "final load", "collisions", "moves/ins", "writes/ins");
+	for (k = 0; k < NUM_BOUNDS; k++) {
+		srandom(1);
+		if (nf2_exact_table_init(&tbl, NULL, kick_bounds[k])) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		fill(&tbl, max_failures, &first_fail);
+		printf("%-6d %10.1f%% %10.1f%% %11lu %11.3f %11.3f\n", kick_bounds[k],
+		       100.0 * first_fail, 100.0 * nf2_exact_load_factor(&tbl),
+		       tbl.stats.collisions,
+		       (double)tbl.stats.moves / tbl.stats.inserts,
+		       (double)tbl.stats.hw_writes / tbl.stats.inserts);
+		if (verbose)
+			nf2_exact_print_stats(&tbl, stdout);
+		nf2_exact_table_free(&tbl);
+	}
+
+	/* same fill against the mock register file, then compare */
+	srandom(1);
+	if (nf2_regio_open_mock(&io, 0, 0) ||
+	    nf2_exact_table_init(&tbl, &io, NF2_EXACT_DEFAULT_MAX_KICKS)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	fill(&tbl, max_failures, &first_fail);
+	printf("\nmock register file, %d kicks:\n", NF2_EXACT_DEFAULT_MAX_KICKS);
+	nf2_exact_print_stats(&tbl, stdout);
+	printf("register words:   %.1f per insert (%lu transactions)\n",
+	       (double)io.num_words / tbl.stats.inserts, io.num_txns);
+	failures = check_card(&tbl, &io);
+	printf("card vs shadow:   %s\n", failures ? "FAILED" : "ok");
+
+	nf2_exact_table_free(&tbl);
+	nf2_regio_close(&io);
+	return failures != 0;
+}
+
+
+void usage(void) {
+	printf("Usage: cuckoobench [-f failures] [-v]\n");
+	printf("  -f  stop filling after this many failed inserts (default 100)\n");
+	printf("  -v  print the full statistics of every run\n");
+}
+
+
+void random_flow(nf2_of_entry_wrap *entry, nf2_of_action_wrap *action) {
+	int i;
+
+	for (i = 0; i < NF2_OF_ENTRY_WORD_LEN; i++)
+		entry->raw[i] = random() ^ (random() << 16);
+	entry->entry.pad = 0;
+
+	memset(action, 0, sizeof(*action));
+	action->action.forward_bitmask = 1 << (random() % NF2_PORT_NUM);
+}
+
+
+//
+// fill: insert random flows until max_failures inserts have failed.
+//    Returns the number of flows inserted.
+//
+int fill(struct nf2_exact_table *tbl, int max_failures, double *first_fail) {
+	nf2_of_entry_wrap entry;
+	nf2_of_action_wrap action;
+	int n = 0;
+
+	*first_fail = 1.0;
+	while (tbl->stats.failures < max_failures && tbl->used < tbl->size) {
+		random_flow(&entry, &action);
+		if (nf2_exact_insert(tbl, &entry, &action) >= 0) {
+			n++;
+			continue;
+		}
+		if (tbl->stats.failures == 1)
+			*first_fail = nf2_exact_load_factor(tbl);
+	}
+	return n;
+}
+
+
+//
+// check_card: every used slot must be one of its flow's two hash slots
+//    and hold the flow, valid, in the mock SRAM; every free slot must be
+//    invalid.
+//
+int check_card(struct nf2_exact_table *tbl, struct nf2_regio *io) {
+	uint32_t h0, h1, word;
+	int i, w, failures = 0;
+
+	for (i = 0; i < tbl->size; i++) {
+		struct nf2_exact_slot *slot = &tbl->slots[i];
+		uint32_t *valid = nf2_regio_mock_reg(io, NF2_EXACT_ADDR(i,
+				OPENFLOW_EXACT_ENTRY_HDR_BASE_POS + NF2_OF_ENTRY_WORD_LEN - 1));
+
+		if (!slot->used) {
+			if (*valid & NF2_EXACT_VALID_BIT)
+				failures++;
+			continue;
+		}
+
+		nf2_header_hash(&slot->entry, &h0, &h1);
+		if (i != h0 && i != h1)
+			failures++;
+		for (w = 0; w < NF2_OF_ENTRY_WORD_LEN; w++) {
+			word = slot->entry.raw[w];
+			if (w == NF2_OF_ENTRY_WORD_LEN - 1)
+				word |= NF2_EXACT_VALID_BIT;
+			if (*nf2_regio_mock_reg(io, NF2_EXACT_ADDR(i,
+					OPENFLOW_EXACT_ENTRY_HDR_BASE_POS + w)) != word)
+				failures++;
+		}
+		for (w = 0; w < NF2_OF_ACTION_WORD_LEN; w++) {
+			if (*nf2_regio_mock_reg(io, NF2_EXACT_ADDR(i,
+					OPENFLOW_EXACT_ENTRY_ACTION_BASE_POS + w)) !=
+			    slot->action.raw[w])
+				failures++;
+		}
+	}
+	return failures;
+}
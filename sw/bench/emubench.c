@@ -0,0 +1,353 @@
+/* ****************************************************************************
+ * Module: emubench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Register transactions and modelled time per operation of
+ *              the host code on the register file emulator
+ *              (common/nf2_emu.c): a register dump, wildcard and exact
+ *              flow installs and an exact counter sweep, through
+ *              readReg/writeReg (one transaction per register, as the
+ *              drivers do) and through block accesses (as over the mapped
+ *              register BAR).
+ *
+ *              Each operation is checked against the emulated semantics:
+ *              the dump reads the wildcard entries back through
+ *              OPENFLOW_WILDCARD_LOOKUP_READ_ADDR_REG, the sweep totals
+ *              match the traffic counted in and a second sweep reads zero.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <time.h>
+
+#include "../../../../lib/C/common/nf2util.h"
+#include "../common/nf2_emu.h"
+#include "../common/nf2_of_hw.h"
+#include "../common/nf2_snapshot.h"
+
+#define DEFAULT_FLOWS		4096
+#define DEFAULT_TXN_NS		1500
+#define DEFAULT_WORD_NS		500
+
+struct flow {
+	int index;
+	nf2_of_entry_wrap entry;
+	nf2_of_action_wrap action;
+	uint64_t pkts;		/* counted in */
+};
+
+struct rule {
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;
+	nf2_of_action_wrap action;
+};
+
+struct result {
+	const char *op;
+	const char *method;
+	int ops;
+	unsigned long txns;
+	unsigned long words;
+	unsigned long long model_ns;
+	double host_ns;
+	int failed;
+};
+
+static struct nf2device nf2;
+static struct nf2_snapshot snap;
+static struct flow *flows;
+static struct rule rules[OPENFLOW_WILDCARD_TABLE_SIZE];
+static int num_flows = DEFAULT_FLOWS;
+
+void usage (void);
+void make_flows (void);
+void make_rules (void);
+double now_ns (void);
+void begin (struct result *, const char *op, const char *method, int ops);
+void end (struct result *);
+int dump (struct nf2_regio *, struct result *);
+int install_wildcard (struct nf2_regio *, struct nf2_of_wildcard_stage *, struct result *);
+int install_exact (struct nf2_regio *, struct result *);
+int sweep (struct nf2_regio *, struct result *);
+
+int main(int argc, char *argv[]) {
+	struct nf2_regio ioctl_io, *block_io;
+	struct nf2_of_wildcard_stage stage;
+	struct result res[9];
+	unsigned txn_ns = DEFAULT_TXN_NS, word_ns = DEFAULT_WORD_NS;
+	int c, i, n = 0, failures = 0;
+
+	while ((c = getopt(argc, argv, "n:t:w:h")) != -1) {
+		switch (c) {
+		case 'n':
+			num_flows = atoi(optarg);
+			break;
+		case 't':
+			txn_ns = atoi(optarg);
+			break;
+		case 'w':
+			word_ns = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (num_flows <= 0 || num_flows > OPENFLOW_NF2_EXACT_TABLE_SIZE) {
+		usage();
+		exit(1);
+	}
+
+	nf2.device_name = "emu";
+	if (check_iface(&nf2) || openDescriptor(&nf2))
+		exit(1);
+	nf2util_emu.io.mock_txn_ns = txn_ns;
+	nf2util_emu.io.mock_word_ns = word_ns;
+	nf2_regio_open_ioctl(&ioctl_io, &nf2);
+	block_io = &nf2util_emu.io;
+
+	make_flows();
+	make_rules();
+
+	failures += install_wildcard(&ioctl_io, NULL, &res[n++]);
+	failures += dump(&ioctl_io, &res[n++]);
+	failures += install_exact(&ioctl_io, &res[n++]);
+	failures += sweep(&ioctl_io, &res[n++]);
+
+	nf2_emu_reset(&nf2util_emu);
+	failures += install_wildcard(block_io, NULL, &res[n++]);
+	nf2_emu_reset(&nf2util_emu);
+	nf2_of_wildcard_stage_invalidate(&stage);
+	failures += install_wildcard(block_io, &stage, &res[n++]);
+	failures += dump(block_io, &res[n++]);
+	failures += install_exact(block_io, &res[n++]);
+	failures += sweep(block_io, &res[n++]);
+
+	printf("%d wildcard rules, %d exact flows, model: %u ns/transaction + %u ns/word\n\n",
+	       OPENFLOW_WILDCARD_TABLE_SIZE, num_flows, txn_ns, word_ns);
+	printf("%-17s %-16s %10s %10s %12s %12s %6s\n", "operation", "method", "txns/op",
+	       "words/op", "model us/op", "host ns/op", "check");
+	for (i = 0; i < n; i++) {
+		printf("%-17s %-16s %10.1f %10.1f %12.1f %12.1f %6s\n", res[i].op,
+		       res[i].method, res[i].txns / (double)res[i].ops,
+		       res[i].words / (double)res[i].ops,
+		       res[i].model_ns / 1e3 / res[i].ops, res[i].host_ns / res[i].ops,
+		       res[i].failed ? "FAILED" : "ok");
+	}
+	printf("\n%lu wildcard commits, %lu wildcard loads, %lu counter words cleared on read\n",
+	       nf2util_emu.wildcard_commits, nf2util_emu.wildcard_loads,
+	       nf2util_emu.counter_clears);
+
+	nf2_emu_close(&nf2util_emu);
+	return failures ? 1 : 0;
+}
+
+
+void usage(void) {
+	printf("Usage: emubench [-n exact_flows] [-t txn_ns] [-w word_ns]\n");
+}
+
+
+//
+// make_flows: random flows in distinct random slots, with the traffic
+//    each one will see
+//
+void make_flows(void) {
+	char *taken;
+	int i, j;
+
+	flows = calloc(num_flows, sizeof(*flows));
+	taken = calloc(OPENFLOW_NF2_EXACT_TABLE_SIZE, 1);
+	if (flows == NULL || taken == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	srandom(1);
+	for (i = 0; i < num_flows; i++) {
+		do {
+			flows[i].index = random() % OPENFLOW_NF2_EXACT_TABLE_SIZE;
+		} while (taken[flows[i].index]);
+		taken[flows[i].index] = 1;
+		for (j = 0; j < NF2_OF_ENTRY_WORD_LEN; j++)
+			flows[i].entry.raw[j] = random();
+		flows[i].entry.raw[NF2_OF_ENTRY_WORD_LEN - 1] &= ~NF2_EXACT_VALID_BIT;
+		memset(&flows[i].action, 0, sizeof(flows[i].action));
+		flows[i].action.action.forward_bitmask = 1 << (random() % 8);
+		flows[i].pkts = random() % 1000;
+	}
+	free(taken);
+}
+
+
+//
+// make_rules: an access list: one mask, rules that differ in the
+//    destination address, protocol port and output port
+//
+void make_rules(void) {
+	int i;
+
+	for (i = 0; i < OPENFLOW_WILDCARD_TABLE_SIZE; i++) {
+		memset(&rules[i], 0, sizeof(rules[i]));
+		memset(&rules[i].mask, 0xff, sizeof(rules[i].mask));
+		rules[i].mask.entry.ip_dst = 0;
+		rules[i].mask.entry.ip_proto = 0;
+		rules[i].mask.entry.transp_dst = 0;
+		rules[i].mask.entry.eth_type = 0;
+		rules[i].mask.entry.pad = 0;		/* not kept: reads back as 0 */
+		rules[i].entry.entry.eth_type = 0x0800;
+		rules[i].entry.entry.ip_proto = 6;
+		rules[i].entry.entry.ip_dst = 0x0a000001 + i;
+		rules[i].entry.entry.transp_dst = i & 1 ? 443 : 80;
+		rules[i].action.action.forward_bitmask = 1 << (i % 4 * 2);
+	}
+}
+
+
+double now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+void begin(struct result *res, const char *op, const char *method, int ops) {
+	memset(res, 0, sizeof(*res));
+	res->op = op;
+	res->method = method;
+	res->ops = ops;
+	nf2_regio_clear_stats(&nf2util_emu.io);
+	res->host_ns = now_ns();
+}
+
+
+//
+// end: the traffic of the operation, as the emulator counted it (an
+//    ioctl handle does not model the cost of its own transactions)
+//
+void end(struct result *res) {
+	res->host_ns = now_ns() - res->host_ns;
+	res->txns = nf2util_emu.io.num_txns;
+	res->words = nf2util_emu.io.num_words;
+	res->model_ns = nf2util_emu.io.model_ns;
+}
+
+
+static const char *method(struct nf2_regio *io, struct nf2_of_wildcard_stage *stage) {
+	if (io->type == NF2_REGIO_IOCTL)
+		return "readReg/writeReg";
+	return stage != NULL ? "block, staged" : "block";
+}
+
+
+//
+// dump: the register dump of regdump; checks that every wildcard entry
+//    reads back as installed
+//
+int dump(struct nf2_regio *io, struct result *res) {
+	int i;
+
+	begin(res, "register dump", method(io, NULL), 1);
+	if (nf2_snapshot_read(io, &snap, NF2_SNAP_ALL))
+		res->failed = 1;
+	end(res);
+
+	for (i = 0; i < OPENFLOW_WILDCARD_TABLE_SIZE; i++) {
+		if (memcmp(&snap.wildcard[i].entry, &rules[i].entry, sizeof(rules[i].entry)) ||
+		    memcmp(&snap.wildcard[i].mask, &rules[i].mask, sizeof(rules[i].mask)) ||
+		    memcmp(&snap.wildcard[i].action, &rules[i].action, sizeof(rules[i].action)))
+			res->failed = 1;
+	}
+	return res->failed;
+}
+
+
+int install_wildcard(struct nf2_regio *io, struct nf2_of_wildcard_stage *stage,
+		     struct result *res) {
+	struct nf2_emu_wildcard *w;
+	int i;
+
+	begin(res, "wildcard install", method(io, stage), OPENFLOW_WILDCARD_TABLE_SIZE);
+	for (i = 0; i < OPENFLOW_WILDCARD_TABLE_SIZE; i++) {
+		if (nf2_of_wildcard_write(io, stage, i, &rules[i].entry, &rules[i].mask,
+					  &rules[i].action))
+			res->failed = 1;
+	}
+	end(res);
+
+	for (i = 0; i < OPENFLOW_WILDCARD_TABLE_SIZE; i++) {
+		w = &nf2util_emu.wildcard[i];
+		if (!nf2_emu_wildcard_holds(w, &rules[i].entry, &rules[i].mask, &rules[i].action))
+			res->failed = 1;
+	}
+	return res->failed;
+}
+
+
+int install_exact(struct nf2_regio *io, struct result *res) {
+	uint32_t hdr[NF2_OF_ENTRY_WORD_LEN];
+	int i;
+
+	begin(res, "exact install", method(io, NULL), num_flows);
+	for (i = 0; i < num_flows; i++) {
+		if (nf2_of_exact_write(io, flows[i].index, &flows[i].entry, &flows[i].action, 0))
+			res->failed = 1;
+	}
+	end(res);
+
+	for (i = 0; i < num_flows; i++) {
+		if (nf2_regio_read_block(&nf2util_emu.io,
+					 NF2_EXACT_ADDR(flows[i].index, OPENFLOW_EXACT_ENTRY_HDR_BASE_POS),
+					 hdr, NF2_OF_ENTRY_WORD_LEN) ||
+		    memcmp(hdr, flows[i].entry.raw, sizeof(hdr) - 4) ||
+		    hdr[NF2_OF_ENTRY_WORD_LEN - 1] !=
+		    (flows[i].entry.raw[NF2_OF_ENTRY_WORD_LEN - 1] | NF2_EXACT_VALID_BIT))
+			res->failed = 1;
+	}
+	return res->failed;
+}
+
+
+//
+// sweep: count the traffic of every flow in, then read the counters of
+//    the whole table, as a statistics poll does. The totals must match
+//    and, the counters being cleared on read, a second sweep reads zero.
+//
+int sweep(struct nf2_regio *io, struct result *res) {
+	uint32_t pkts, bytes;
+	uint64_t got_pkts = 0, got_bytes = 0, sent_pkts = 0, sent_bytes = 0;
+	uint64_t n;
+	int i, left;
+
+	nf2_emu_set_timer(&nf2util_emu, 42);
+	for (i = 0; i < num_flows; i++) {
+		for (n = 0; n < flows[i].pkts; n++)
+			nf2_emu_exact_hit(&nf2util_emu, flows[i].index, 64 + i % 1400);
+		sent_pkts += flows[i].pkts;
+		sent_bytes += flows[i].pkts * (64 + i % 1400);
+	}
+
+	begin(res, "counter sweep", method(io, NULL), 1);
+	for (i = 0; i < OPENFLOW_NF2_EXACT_TABLE_SIZE; i++) {
+		if (nf2_of_exact_read_counters(io, i, &pkts, &bytes, NULL))
+			res->failed = 1;
+		got_pkts += pkts;
+		got_bytes += bytes;
+	}
+	end(res);
+
+	if (got_pkts != sent_pkts || got_bytes != sent_bytes)
+		res->failed = 1;
+	for (left = 0, i = 0; i < OPENFLOW_NF2_EXACT_TABLE_SIZE; i++) {
+		if (nf2_of_exact_read_counters(io, i, &pkts, &bytes, NULL) || pkts || bytes)
+			left = 1;
+	}
+	res->failed |= left;
+	return res->failed;
+}
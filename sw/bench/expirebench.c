@@ -0,0 +1,380 @@
+/* ****************************************************************************
+ * Module: expirebench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Exactness and register traffic of the idle and hard
+ *              timeouts of common/nf2_expire.c.
+ *
+ *              Flows with random OpenFlow timeouts are installed in the
+ *              exact entries of the mock register file and send in on
+ *              and off periods, some of them longer than their idle
+ *              timeout and many longer than the 128 s the 7-bit
+ *              last_seen spans. Packets count into the entries as
+ *              exact_match counts them, only while the entry is valid,
+ *              and reads clear the counters as sram_arbiter does. Once a
+ *              second the harvester is polled and the expiry engine run;
+ *              each flow must expire in the second a reference model
+ *              says, for the right reason and with its exact totals,
+ *              and its slot takes a new flow a few seconds later. Some
+ *              flows are moved to a free entry each second, as a cuckoo
+ *              move does, and must keep their timeouts and totals.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/nf2_expire.h"
+
+#define DEFAULT_SECS		1800
+#define DEFAULT_FLOWS		20000
+#define DEFAULT_BATCH		1024
+#define DEFAULT_MOVES		100	/* per second */
+#define DEFAULT_TXN_NS		1500
+#define DEFAULT_WORD_NS		500
+
+#define TIMER_START		100000
+#define CLEARED_BITS		0x00ffffff
+#define VALID_REG(index) \
+	NF2_EXACT_ADDR(index, OPENFLOW_EXACT_ENTRY_HDR_BASE_POS + NF2_OF_ENTRY_WORD_LEN - 1)
+
+struct flow {
+	int index;
+	int installed;
+	uint32_t install, last;		/* timer of the install and last packet */
+	uint16_t idle_s, hard_s;
+	uint32_t pps, size;
+	int on, left;			/* seconds left of the on or off period */
+	int reinstall;			/* second the slot takes a new flow */
+	int late;
+	uint64_t pkts, bytes;		/* sent */
+};
+
+static struct flow *flows;
+static int num_flows;
+static int flow_of[NF2_HARVEST_ENTRIES];
+
+void usage (void);
+void install (struct nf2_regio *, struct nf2_expire *, struct flow *, uint32_t timer,
+	      uint64_t now_ns);
+void count (struct nf2_regio *, uint32_t timer);
+void move (struct nf2_regio *, struct nf2_expire *, struct flow *, uint64_t now_ns);
+void clear_on_read (struct nf2_regio *, unsigned reg, int n);
+uint32_t ref_deadline (const struct flow *, enum nf2_expire_reason *);
+
+int main(int argc, char *argv[]) {
+	struct nf2_regio io;
+	struct nf2_harvest h;
+	struct nf2_harvest_cfg cfg;
+	struct nf2_expire e;
+	struct nf2_expired *out;
+	enum nf2_expire_reason reason;
+	struct flow *f;
+	unsigned txn_ns = DEFAULT_TXN_NS, word_ns = DEFAULT_WORD_NS;
+	unsigned long txns = 0, words = 0, expired = 0, early = 0, late = 0, wrong = 0, moved = 0;
+	unsigned long long model_ns = 0, max_ns = 0, run_ns, harvest_ns = 0;
+	uint64_t now_ns;
+	uint32_t timer;
+	int secs = DEFAULT_SECS, batch = DEFAULT_BATCH, moves = DEFAULT_MOVES;
+	int c, i, n, s;
+
+	num_flows = DEFAULT_FLOWS;
+	while ((c = getopt(argc, argv, "s:n:b:m:t:w:h")) != -1) {
+		switch (c) {
+		case 's':
+			secs = atoi(optarg);
+			break;
+		case 'n':
+			num_flows = atoi(optarg);
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		case 'm':
+			moves = atoi(optarg);
+			break;
+		case 't':
+			txn_ns = atoi(optarg);
+			break;
+		case 'w':
+			word_ns = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (secs <= 0 || num_flows <= 0 || num_flows > NF2_HARVEST_ENTRIES || batch <= 0 ||
+	    moves < 0) {
+		usage();
+		exit(1);
+	}
+
+	flows = calloc(num_flows, sizeof(*flows));
+	out = malloc(batch * sizeof(*out));
+	if (flows == NULL || out == NULL || nf2_regio_open_mock(&io, txn_ns, word_ns)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	io.mock_read_hook = clear_on_read;
+
+	cfg.hot_ns = 1000000000ULL;
+	cfg.idle_ns = 10000000000ULL;
+	cfg.merge_words = 0;
+	if (nf2_harvest_init(&h, &cfg, 0) || nf2_expire_init(&e, &h, TIMER_START)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	/* flows in entries chosen at random */
+	srandom(1);
+	for (i = 0; i < NF2_HARVEST_ENTRIES; i++)
+		flow_of[i] = -1;
+	for (i = 0; i < num_flows; i++) {
+		do
+			flows[i].index = random() % NF2_HARVEST_ENTRIES;
+		while (flow_of[flows[i].index] >= 0);
+		flow_of[flows[i].index] = i;
+	}
+
+	for (s = 0; s < secs; s++) {
+		timer = TIMER_START + s;
+		now_ns = (uint64_t)s * 1000000000ULL;
+		*nf2_regio_mock_reg(&io, OPENFLOW_LOOKUP_TIMER_REG) = timer;
+
+		for (i = 0; i < num_flows; i++)
+			if (!flows[i].installed && flows[i].reinstall <= s)
+				install(&io, &e, &flows[i], timer, now_ns);
+		count(&io, timer);
+
+		for (i = 0; i < moves && num_flows < NF2_HARVEST_ENTRIES; i++) {
+			f = &flows[random() % num_flows];
+			if (!f->installed)
+				continue;
+			move(&io, &e, f, now_ns);
+			moved++;
+		}
+
+		nf2_regio_clear_stats(&io);
+		if (nf2_harvest_poll(&h, &io, now_ns + 500000000ULL) < 0)
+			exit(1);
+		harvest_ns += io.model_ns;
+
+		nf2_regio_clear_stats(&io);
+		n = nf2_expire_run(&e, &io, now_ns + 500000000ULL, out, batch);
+		if (n < 0)
+			exit(1);
+		txns += io.num_txns;
+		words += io.num_words;
+		run_ns = io.model_ns;
+		model_ns += run_ns;
+		if (run_ns > max_ns)
+			max_ns = run_ns;
+
+		for (i = 0; i < n; i++) {
+			f = &flows[flow_of[out[i].index]];
+			expired++;
+			if (!f->installed || ref_deadline(f, &reason) > timer) {
+				early++;
+				continue;
+			}
+			if (out[i].reason != reason || out[i].pkts != f->pkts ||
+			    out[i].bytes != f->bytes || out[i].duration_s != timer - f->install ||
+			    (*nf2_regio_mock_reg(&io, VALID_REG(f->index)) & NF2_EXACT_VALID_BIT))
+				wrong++;
+			f->installed = 0;
+			f->reinstall = s + 1 + random() % 5;
+		}
+
+		/* anything the engine should have expired by now */
+		for (i = 0; i < num_flows; i++) {
+			f = &flows[i];
+			if (f->installed && !f->late && ref_deadline(f, &reason) <= timer) {
+				f->late = 1;
+				late++;
+			}
+		}
+	}
+
+	printf("%d flows over %d entries, %d s, batches of %d, %lu moves\n", num_flows,
+	       NF2_HARVEST_ENTRIES, secs, batch, moved);
+	printf("model: %u ns/transaction + %u ns/word\n\n", txn_ns, word_ns);
+	printf("expired            %10lu (idle %lu, hard %lu)\n", expired, e.stats.idle,
+	       e.stats.hard);
+	printf("early/late/wrong   %10lu %lu %lu\n", early, late, wrong);
+	printf("wheel fired        %10lu, rescheduled %lu, cascaded %lu\n", e.stats.fired,
+	       e.stats.rescheduled, e.stats.cascaded);
+	printf("idle rechecks      %10lu\n\n", e.stats.rechecks);
+	printf("expiry             %10.0f txns/s %10.0f words/s %8.3f bus ms/s, %.3f ms max\n",
+	       txns / (double)secs, words / (double)secs, model_ns / 1e6 / secs, max_ns / 1e6);
+	printf("harvest            %43.3f bus ms/s\n", harvest_ns / 1e6 / secs);
+	printf("full scan          %10d txns     %10d words   %8.3f bus ms each\n",
+	       NF2_HARVEST_ENTRIES, NF2_HARVEST_ENTRIES * NF2_OF_EXACT_COUNTERS_WORD_LEN,
+	       NF2_HARVEST_ENTRIES * (txn_ns + NF2_OF_EXACT_COUNTERS_WORD_LEN * word_ns) / 1e6);
+
+	nf2_expire_free(&e);
+	nf2_harvest_free(&h);
+	nf2_regio_close(&io);
+	return early || late || wrong;
+}
+
+
+void usage(void) {
+	printf("Usage: expirebench [-s seconds] [-n flows] [-b batch] [-m moves] [-t txn_ns]\n"
+	       "                   [-w word_ns]\n");
+	printf("  -s  simulated time (default %d s)\n", DEFAULT_SECS);
+	printf("  -n  flows, at most %d (default %d)\n", NF2_HARVEST_ENTRIES, DEFAULT_FLOWS);
+	printf("  -b  entries expired per run, once a second (default %d)\n", DEFAULT_BATCH);
+	printf("  -m  flows moved to a free entry per second (default %d)\n", DEFAULT_MOVES);
+	printf("  -t  modelled cost of a register transaction (default %d ns)\n",
+	       DEFAULT_TXN_NS);
+	printf("  -w  modelled cost of a register word (default %d ns)\n", DEFAULT_WORD_NS);
+}
+
+
+static int uniform(int lo, int hi) {
+	return lo + random() % (hi - lo + 1);
+}
+
+
+//
+// install: a new flow in f's entry, as nf2_of_exact_write leaves it:
+//    valid, zeroed counters and last_seen the timer now
+//
+void install(struct nf2_regio *io, struct nf2_expire *e, struct flow *f, uint32_t timer,
+	     uint64_t now_ns) {
+	static const uint16_t idle[] = { 0, 5, 10, 30, 60, 180, 300 };
+
+	f->idle_s = idle[random() % 7];
+	f->hard_s = random() % 2 ? uniform(30, 1200) : 0;
+	if (f->idle_s == 0 && f->hard_s == 0)
+		f->idle_s = 10;
+	f->pps = uniform(1, 1000);
+	f->size = uniform(64, 1518);
+	f->on = 1;
+	f->left = uniform(1, 60);
+	f->install = f->last = timer;
+	f->installed = 1;
+	f->late = 0;
+	f->pkts = f->bytes = 0;
+
+	*nf2_regio_mock_reg(io, VALID_REG(f->index)) = NF2_EXACT_VALID_BIT;
+	*nf2_regio_mock_reg(io, NF2_EXACT_ADDR(f->index, OPENFLOW_EXACT_ENTRY_COUNTERS_POS)) =
+		(timer & NF2_EXACT_LAST_SEEN_MASK) << OPENFLOW_EXACT_ENTRY_LAST_SEEN_POS;
+	*nf2_regio_mock_reg(io, NF2_EXACT_ADDR(f->index, OPENFLOW_EXACT_ENTRY_COUNTERS_POS + 1)) = 0;
+	if (nf2_expire_add(e, f->index, f->idle_s, f->hard_s, timer, now_ns))
+		exit(1);
+}
+
+
+//
+// move: relocate f to a free entry as nf2_exact_table does: read its
+//    counters into the harvester, write the new entry with zeroed
+//    counters and the old last seen time, invalidate the old one and
+//    carry what it counted since the first read
+//
+void move(struct nf2_regio *io, struct nf2_expire *e, struct flow *f, uint64_t now_ns) {
+	uint32_t last_seen, pkts, bytes;
+	int src = f->index, dst;
+
+	do
+		dst = random() % NF2_HARVEST_ENTRIES;
+	while (flow_of[dst] >= 0);
+
+	if (nf2_harvest_entry(e->h, io, src, now_ns))
+		exit(1);
+	last_seen = *nf2_regio_mock_reg(io, NF2_EXACT_ADDR(src, OPENFLOW_EXACT_ENTRY_COUNTERS_POS)) &
+		    (NF2_EXACT_LAST_SEEN_MASK << OPENFLOW_EXACT_ENTRY_LAST_SEEN_POS);
+	*nf2_regio_mock_reg(io, NF2_EXACT_ADDR(dst, OPENFLOW_EXACT_ENTRY_COUNTERS_POS)) = last_seen;
+	*nf2_regio_mock_reg(io, NF2_EXACT_ADDR(dst, OPENFLOW_EXACT_ENTRY_COUNTERS_POS + 1)) = 0;
+	*nf2_regio_mock_reg(io, VALID_REG(dst)) = NF2_EXACT_VALID_BIT;
+	*nf2_regio_mock_reg(io, VALID_REG(src)) = 0;
+	if (nf2_of_exact_read_counters(io, src, &pkts, &bytes, NULL))
+		exit(1);
+
+	nf2_expire_move(e, src, dst, pkts, bytes, now_ns);
+	flow_of[dst] = flow_of[src];
+	flow_of[src] = -1;
+	f->index = dst;
+}
+
+
+//
+// count: one second of traffic of every flow with a valid entry,
+//    counted as exact_match counts it. Off periods are mostly shorter
+//    than the idle timeout, the rest a little longer.
+//
+void count(struct nf2_regio *io, uint32_t timer) {
+	struct flow *f;
+	uint32_t *w0, *w1, pkts;
+	int i;
+
+	for (i = 0; i < num_flows; i++) {
+		f = &flows[i];
+		if (!(*nf2_regio_mock_reg(io, VALID_REG(f->index)) & NF2_EXACT_VALID_BIT))
+			continue;
+
+		if (f->on) {
+			w0 = nf2_regio_mock_reg(io, NF2_EXACT_ADDR(f->index,
+								   OPENFLOW_EXACT_ENTRY_COUNTERS_POS));
+			w1 = nf2_regio_mock_reg(io, NF2_EXACT_ADDR(f->index,
+								   OPENFLOW_EXACT_ENTRY_COUNTERS_POS + 1));
+			pkts = ((*w0 >> OPENFLOW_EXACT_ENTRY_PKT_COUNTER_POS) + f->pps) &
+			       NF2_EXACT_PKT_MASK;
+			*w0 = (pkts << OPENFLOW_EXACT_ENTRY_PKT_COUNTER_POS) |
+			      ((timer & NF2_EXACT_LAST_SEEN_MASK) << OPENFLOW_EXACT_ENTRY_LAST_SEEN_POS);
+			*w1 += f->pps * f->size;
+			f->pkts += f->pps;
+			f->bytes += f->pps * f->size;
+			f->last = timer;
+		}
+
+		if (--f->left > 0)
+			continue;
+		f->on = !f->on;
+		if (f->on)
+			f->left = uniform(1, 60);
+		else if (f->idle_s > 1 && random() % 10 < 7)
+			f->left = uniform(1, f->idle_s - 1);
+		else
+			f->left = uniform(f->idle_s, f->idle_s + 200);
+	}
+}
+
+
+//
+// clear_on_read: sram_arbiter clears the counter words of an exact entry
+//    read through the registers, except the last seen time and bit 24
+//    of the packet counter
+//
+void clear_on_read(struct nf2_regio *io, unsigned reg, int n) {
+	unsigned word;
+	int i;
+
+	for (i = 0; i < n; i++, reg += 4) {
+		if (reg < NF2_EXACT_ADDR(0, 0) || reg >= NF2_EXACT_ADDR(NF2_HARVEST_ENTRIES, 0))
+			continue;
+		word = (reg - NF2_EXACT_ADDR(0, 0)) / 4 % NF2_EXACT_ENTRY_WORDS;
+		if (word == OPENFLOW_EXACT_ENTRY_COUNTERS_POS)
+			*nf2_regio_mock_reg(io, reg) &= ~CLEARED_BITS;
+		else if (word == OPENFLOW_EXACT_ENTRY_COUNTERS_POS + 1)
+			*nf2_regio_mock_reg(io, reg) = 0;
+	}
+}
+
+
+/* when the flow must expire, by its true last packet */
+uint32_t ref_deadline(const struct flow *f, enum nf2_expire_reason *reason) {
+	uint64_t idle_at = UINT64_MAX, hard_at = UINT64_MAX;
+
+	if (f->idle_s)
+		idle_at = (uint64_t)f->last + f->idle_s;
+	if (f->hard_s)
+		hard_at = (uint64_t)f->install + f->hard_s;
+	*reason = hard_at <= idle_at ? NF2_EXPIRE_HARD : NF2_EXPIRE_IDLE;
+	return hard_at <= idle_at ? hard_at : idle_at;
+}
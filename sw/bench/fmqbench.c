@@ -0,0 +1,543 @@
+/* ****************************************************************************
+ * Module: fmqbench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Flow-setup latency of several controller threads writing
+ *              flows into one emulated card: each thread calling the
+ *              register writes itself under a device lock, as the callers
+ *              of nf2_write_of_exact and friends do, against the threads
+ *              queueing them to the register writer of common/nf2_fmq.c.
+ *
+ *              The card's register accesses take their modelled PCI time
+ *              (the writer, or the thread holding the lock, waits for
+ *              it). The threads mix exact adds, modifies and deletes of
+ *              slots of their own with some wildcard writes; a share of
+ *              the ops is followed at once by a modify or delete of the
+ *              same slot, as a controller replacing a flow does.
+ *
+ *              Both methods are checked: the exact SRAM and the wildcard
+ *              entries of the emulator end as the last op of each slot
+ *              left them. With -v each write is also read back once
+ *              written. Each run prints the queueing, register-write,
+ *              read-back and total latency percentiles of each operation
+ *              and table, from common/nf2_fmlat.c.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <time.h>
+
+#include "../common/nf2_emu.h"
+#include "../common/nf2_fmq.h"
+#include "../common/nf2_fmlat.h"
+
+#define DEFAULT_THREADS		4
+#define DEFAULT_OPS		20000
+#define DEFAULT_WINDOW		16
+#define DEFAULT_FOLLOW		0.2
+#define DEFAULT_TXN_NS		1500
+#define DEFAULT_WORD_NS		500
+#define MAX_THREADS		32
+#define SLOTS_PER_THREAD	1024
+
+/* what a slot holds after the last op */
+struct slot {
+	int valid;
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;
+	nf2_of_action_wrap action;
+};
+
+struct producer {
+	int id;
+	pthread_t thread;
+	unsigned seed;
+	struct slot exact[SLOTS_PER_THREAD];
+	struct slot wildcard[OPENFLOW_WILDCARD_TABLE_SIZE];
+	int num_wildcard;
+	uint64_t *lat_ns;
+	int num_ops;
+	int errors;
+	int coalesced;
+};
+
+struct result {
+	const char *method;
+	int window;
+	double wall_ms;
+	uint64_t p50, p99, p999, max;
+	double mean;
+	unsigned long txns;
+	unsigned long long model_ns;
+	int coalesced;
+	int failed;
+};
+
+static struct producer producers[MAX_THREADS];
+static int num_threads = DEFAULT_THREADS;
+static int num_ops = DEFAULT_OPS;
+static int max_window = DEFAULT_WINDOW;
+static int window;
+static double follow = DEFAULT_FOLLOW;
+static int pace = 1;
+static int verify;
+
+static struct nf2_emu emu;
+static struct nf2_fmq fmq;
+static pthread_mutex_t dev_lock = PTHREAD_MUTEX_INITIALIZER;
+static int use_queue;
+static struct nf2_fmlat_set lat;
+
+void usage (void);
+uint64_t now_ns (void);
+void next_op (struct producer *, struct nf2_fmq_op *, int follow_up);
+int direct (struct nf2_fmq_op *);
+void *produce (void *);
+int run (const char *method, int queue, int window, struct result *);
+int check (void);
+int cmp_u64 (const void *, const void *);
+
+int main(int argc, char *argv[]) {
+	struct result res[3];
+	unsigned txn_ns = DEFAULT_TXN_NS, word_ns = DEFAULT_WORD_NS;
+	int c, i, failures = 0;
+
+	while ((c = getopt(argc, argv, "p:n:W:f:t:w:Pvh")) != -1) {
+		switch (c) {
+		case 'p':
+			num_threads = atoi(optarg);
+			break;
+		case 'n':
+			num_ops = atoi(optarg);
+			break;
+		case 'W':
+			max_window = atoi(optarg);
+			break;
+		case 'f':
+			follow = atof(optarg);
+			break;
+		case 't':
+			txn_ns = atoi(optarg);
+			break;
+		case 'w':
+			word_ns = atoi(optarg);
+			break;
+		case 'P':
+			pace = 0;
+			break;
+		case 'v':
+			verify = 1;
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (num_threads <= 0 || num_threads > MAX_THREADS ||
+	    num_threads * SLOTS_PER_THREAD > OPENFLOW_NF2_EXACT_TABLE_SIZE || num_ops <= 0 ||
+	    max_window <= 0 || follow < 0 || follow > 1) {
+		usage();
+		exit(1);
+	}
+
+	if (nf2_emu_open(&emu, txn_ns, word_ns)) {
+		fprintf(stderr, "Could not allocate the emulated register file\n");
+		exit(1);
+	}
+	failures += run("device lock", 0, 1, &res[0]);
+	failures += run("fmq", 1, 1, &res[1]);
+	failures += run("fmq", 1, max_window, &res[2]);
+
+	printf("%d threads, %d flow-mods each, %.0f%% followed by an op on the same slot, "
+	       "model: %u ns/transaction + %u ns/word%s%s\n\n", num_threads, num_ops,
+	       follow * 100, txn_ns, word_ns, pace ? " (paced)" : "",
+	       verify ? ", read back" : "");
+	printf("%-12s %6s %10s %10s %9s %9s %9s %9s %9s %9s %6s\n", "method", "window",
+	       "wall ms", "ops/s", "mean us", "p50 us", "p99 us", "p99.9 us", "txns/op",
+	       "coalesced", "check");
+	for (i = 0; i < 3; i++) {
+		printf("%-12s %6d %10.1f %10.0f %9.1f %9.1f %9.1f %9.1f %9.2f %9d %6s\n",
+		       res[i].method, res[i].window, res[i].wall_ms,
+		       (double)num_threads * num_ops / res[i].wall_ms * 1e3, res[i].mean / 1e3,
+		       res[i].p50 / 1e3, res[i].p99 / 1e3, res[i].p999 / 1e3,
+		       (double)res[i].txns / ((double)num_threads * num_ops), res[i].coalesced,
+		       res[i].failed ? "FAILED" : "ok");
+	}
+	nf2_emu_close(&emu);
+	return failures ? 1 : 0;
+}
+
+
+void usage(void) {
+	printf("Usage: fmqbench [-p threads] [-n ops] [-W window] [-f follow] [-t txn_ns] "
+	       "[-w word_ns] [-P] [-v]\n");
+	printf("  -p  controller threads (default %d)\n", DEFAULT_THREADS);
+	printf("  -n  flow-mods per thread (default %d)\n", DEFAULT_OPS);
+	printf("  -W  flow-mods a thread keeps queued in the last run (default %d); the\n"
+	       "      others wait for each one\n", DEFAULT_WINDOW);
+	printf("  -f  share of ops followed by an op on the same slot (default %.1f)\n",
+	       DEFAULT_FOLLOW);
+	printf("  -t  modelled ns per register transaction (default %d)\n", DEFAULT_TXN_NS);
+	printf("  -w  modelled ns per register word (default %d)\n", DEFAULT_WORD_NS);
+	printf("  -P  do not wait for the modelled time, only count it\n");
+	printf("  -v  read back each write once written\n");
+}
+
+
+uint64_t now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static uint32_t rand32(struct producer *p) {
+	return rand_r(&p->seed) ^ ((uint32_t)rand_r(&p->seed) << 16);
+}
+
+
+static void random_action(struct producer *p, nf2_of_action_wrap *action) {
+	memset(action, 0, sizeof(*action));
+	action->action.forward_bitmask = 1 << (rand_r(&p->seed) % NF2_PORT_NUM);
+	if (rand_r(&p->seed) % 2) {
+		action->action.nf2_action_flag = NF2_OFPAT_SET_NW_DST;
+		action->action.ip_dst = rand32(p);
+	}
+}
+
+
+//
+// next_op: the producer's next op, on a slot of its own, and what the
+//    slot holds after it. A follow-up modifies or deletes the slot of
+//    the op before.
+//
+void next_op(struct producer *p, struct nf2_fmq_op *op, int follow_up) {
+	static int last_exact[MAX_THREADS], last_slot[MAX_THREADS];
+	struct slot *s;
+	int i, exact, r, w;
+
+	memset(op, 0, sizeof(*op));
+	exact = follow_up ? last_exact[p->id] : rand_r(&p->seed) % 20 != 0 || p->num_wildcard == 0;
+	if (exact) {
+		i = follow_up ? last_slot[p->id] : (int)(rand_r(&p->seed) % SLOTS_PER_THREAD);
+		s = &p->exact[i];
+		op->index = p->id * SLOTS_PER_THREAD + i;
+		r = rand_r(&p->seed) % 100;
+		if (!s->valid || (!follow_up && r >= 80)) {
+			op->type = NF2_FMQ_EXACT_WRITE;
+			for (w = 0; w < NF2_OF_ENTRY_WORD_LEN; w++)
+				op->entry.raw[w] = rand32(p);
+			op->entry.entry.pad = 0;
+			random_action(p, &op->action);
+			s->valid = 1;
+			s->entry = op->entry;
+			s->action = op->action;
+		}
+		else if (r < 60) {
+			op->type = NF2_FMQ_EXACT_MODIFY;
+			random_action(p, &op->action);
+			s->action = op->action;
+		}
+		else {
+			op->type = NF2_FMQ_EXACT_DELETE;
+			s->valid = 0;
+		}
+	}
+	else {
+		i = follow_up ? last_slot[p->id] : (int)(rand_r(&p->seed) % p->num_wildcard);
+		s = &p->wildcard[i];
+		op->index = p->id + i * num_threads;
+		r = rand_r(&p->seed) % 100;
+		if (s->valid && r < 30) {
+			op->type = NF2_FMQ_WILDCARD_DELETE;
+			memset(s, 0, sizeof(*s));
+		}
+		else {
+			op->type = s->valid && r < 70 ? NF2_FMQ_WILDCARD_MODIFY : NF2_FMQ_WILDCARD_WRITE;
+			for (w = 0; w < NF2_OF_ENTRY_WORD_LEN; w++) {
+				op->entry.raw[w] = rand32(p);
+				op->mask.raw[w] = rand32(p) & rand32(p);
+			}
+			random_action(p, &op->action);
+			s->valid = 1;
+			s->entry = op->entry;
+			s->mask = op->mask;
+			s->action = op->action;
+		}
+	}
+	last_exact[p->id] = exact;
+	last_slot[p->id] = i;
+}
+
+
+static void wait_model(unsigned long long model) {
+	struct timespec ts;
+	uint64_t wait;
+
+	if (!pace)
+		return;
+	wait = emu.io.model_ns - model;
+	ts.tv_sec = wait / 1000000000ULL;
+	ts.tv_nsec = wait % 1000000000ULL;
+	nanosleep(&ts, NULL);
+}
+
+
+static int verify_direct(struct nf2_fmq_op *op, struct nf2_of_wildcard_stage *stage) {
+	switch (op->type) {
+	case NF2_FMQ_EXACT_WRITE:
+		return nf2_of_exact_verify(&emu.io, op->index, &op->entry, &op->action);
+	case NF2_FMQ_EXACT_MODIFY:
+		return nf2_of_exact_verify(&emu.io, op->index, NULL, &op->action);
+	case NF2_FMQ_EXACT_DELETE:
+		return nf2_of_exact_verify(&emu.io, op->index, NULL, NULL);
+	case NF2_FMQ_WILDCARD_DELETE:
+		return nf2_of_wildcard_verify(&emu.io, stage, op->index, NULL, NULL, NULL);
+	default:
+		return nf2_of_wildcard_verify(&emu.io, stage, op->index, &op->entry, &op->mask,
+					      &op->action);
+	}
+}
+
+
+//
+// direct: the op as its caller would write it, holding the device, and
+//    the latency of each phase (queueing is the wait for the lock)
+//
+int direct(struct nf2_fmq_op *op) {
+	static struct nf2_of_wildcard_stage stage;
+	static uint8_t valid[OPENFLOW_NF2_EXACT_TABLE_SIZE];
+	unsigned long long model;
+	uint64_t t0, t1;
+	uint32_t timer;
+	int r = 0;
+
+	op->submit_ns = now_ns();
+	pthread_mutex_lock(&dev_lock);
+	t0 = now_ns();
+	nf2_fmlat_record(op->type, NF2_FMLAT_QUEUE, t0 - op->submit_ns);
+	model = emu.io.model_ns;
+	switch (op->type) {
+	case NF2_FMQ_EXACT_WRITE:
+		if (valid[op->index])
+			r = nf2_of_exact_invalidate(&emu.io, op->index);
+		r = r || nf2_regio_read(&emu.io, OPENFLOW_LOOKUP_TIMER_REG, &timer) ||
+		    nf2_of_exact_write(&emu.io, op->index, &op->entry, &op->action, timer);
+		valid[op->index] = 1;
+		break;
+	case NF2_FMQ_EXACT_MODIFY:
+		r = nf2_of_exact_write_action(&emu.io, op->index, &op->action);
+		break;
+	case NF2_FMQ_EXACT_DELETE:
+		r = nf2_of_exact_invalidate(&emu.io, op->index);
+		valid[op->index] = 0;
+		break;
+	case NF2_FMQ_WILDCARD_WRITE:
+		r = nf2_of_wildcard_write(&emu.io, &stage, op->index, &op->entry, &op->mask,
+					  &op->action);
+		break;
+	case NF2_FMQ_WILDCARD_MODIFY:
+		r = nf2_of_wildcard_modify(&emu.io, &stage, op->index, &op->entry, &op->mask,
+					   &op->action);
+		break;
+	case NF2_FMQ_WILDCARD_DELETE:
+		r = nf2_of_wildcard_clear(&emu.io, &stage, op->index);
+		break;
+	default:
+		r = -1;
+		break;
+	}
+	wait_model(model);
+	t1 = now_ns();
+	nf2_fmlat_record(op->type, NF2_FMLAT_WRITE, t1 - t0);
+	if (verify && !r) {
+		model = emu.io.model_ns;
+		r = verify_direct(op, &stage);
+		wait_model(model);
+		nf2_fmlat_record(op->type, NF2_FMLAT_VERIFY, now_ns() - t1);
+	}
+	pthread_mutex_unlock(&dev_lock);
+	op->apply_ns = now_ns();
+	nf2_fmlat_record(op->type, NF2_FMLAT_TOTAL, op->apply_ns - op->submit_ns);
+	return r ? -1 : 0;
+}
+
+
+//
+// produce: a controller thread; keeps up to window ops queued
+//
+void *produce(void *arg) {
+	struct producer *p = arg;
+	struct nf2_fmq_op *ring, op;
+	int i, n = 0, k;
+
+	ring = calloc(window, sizeof(*ring));
+	if (ring == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < num_ops; i++) {
+		k = i % window;
+		if (use_queue && i >= window) {
+			p->errors += nf2_fmq_wait(&ring[k]) != 0;
+			p->coalesced += ring[k].coalesced;
+			p->lat_ns[n++] = ring[k].apply_ns - ring[k].submit_ns;
+		}
+		next_op(p, use_queue ? &ring[k] : &op,
+			i > 0 && rand_r(&p->seed) < follow * ((double)RAND_MAX + 1));
+		if (use_queue)
+			nf2_fmq_submit(&fmq, &ring[k]);
+		else {
+			p->errors += direct(&op) != 0;
+			p->lat_ns[n++] = op.apply_ns - op.submit_ns;
+		}
+	}
+	for (i = num_ops > window ? num_ops - window : 0; use_queue && i < num_ops; i++) {
+		k = i % window;
+		p->errors += nf2_fmq_wait(&ring[k]) != 0;
+		p->coalesced += ring[k].coalesced;
+		p->lat_ns[n++] = ring[k].apply_ns - ring[k].submit_ns;
+	}
+	free(ring);
+	return NULL;
+}
+
+
+//
+// run: the threads write their flow-mods with the device lock, or queue
+//    them keeping up to window queued
+//
+int run(const char *method, int queue, int win, struct result *res) {
+	uint64_t *all, sum = 0;
+	double t0;
+	int i, j, n = 0, total = num_threads * num_ops;
+
+	memset(res, 0, sizeof(*res));
+	res->method = method;
+	res->window = win;
+	window = win;
+	nf2_emu_reset(&emu);
+	nf2_regio_clear_stats(&emu.io);
+	use_queue = queue;
+	nf2_fmlat_reset();
+	if (queue && nf2_fmq_init(&fmq, &emu.io, pace)) {
+		fprintf(stderr, "Could not start the register writer\n");
+		exit(1);
+	}
+	fmq.verify = verify;
+
+	for (i = 0; i < num_threads; i++) {
+		memset(&producers[i], 0, sizeof(producers[i]));
+		producers[i].id = i;
+		producers[i].seed = i + 1;
+		producers[i].num_wildcard = (OPENFLOW_WILDCARD_TABLE_SIZE - i + num_threads - 1) /
+			num_threads;
+		producers[i].lat_ns = malloc(num_ops * sizeof(uint64_t));
+		if (producers[i].lat_ns == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+	t0 = now_ns();
+	for (i = 0; i < num_threads; i++)
+		pthread_create(&producers[i].thread, NULL, produce, &producers[i]);
+	for (i = 0; i < num_threads; i++)
+		pthread_join(producers[i].thread, NULL);
+	res->wall_ms = (now_ns() - t0) / 1e6;
+	printf("%s, window %d:\n", method, win);
+	if (queue) {
+		nf2_fmq_free(&fmq);
+		nf2_fmq_print_stats(&fmq, stdout);
+	}
+	nf2_fmlat_merge(&lat);
+	nf2_fmlat_print(stdout, &lat);
+	printf("\n");
+	res->txns = emu.io.num_txns;
+	res->model_ns = emu.io.model_ns;
+
+	all = malloc(total * sizeof(*all));
+	if (all == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < num_threads; i++) {
+		for (j = 0; j < num_ops; j++) {
+			all[n++] = producers[i].lat_ns[j];
+			sum += producers[i].lat_ns[j];
+		}
+		res->failed += producers[i].errors;
+		res->coalesced += producers[i].coalesced;
+		free(producers[i].lat_ns);
+	}
+	qsort(all, n, sizeof(*all), cmp_u64);
+	res->mean = (double)sum / n;
+	res->p50 = all[n / 2];
+	res->p99 = all[(int)(n * 0.99)];
+	res->p999 = all[(int)(n * 0.999)];
+	res->max = all[n - 1];
+	free(all);
+
+	res->failed += check();
+	if (res->failed)
+		fprintf(stderr, "%s: %d check failures\n", method, res->failed);
+	return res->failed ? 1 : 0;
+}
+
+
+//
+// check: every slot of the emulator holds what the last op on it left
+//
+int check(void) {
+	struct producer *p;
+	struct nf2_emu_wildcard *wc;
+	struct slot *s;
+	uint32_t word, got;
+	int i, j, w, failures = 0;
+
+	for (i = 0; i < num_threads; i++) {
+		p = &producers[i];
+		for (j = 0; j < SLOTS_PER_THREAD; j++) {
+			s = &p->exact[j];
+			for (w = 0; w < NF2_OF_ENTRY_WORD_LEN; w++) {
+				got = *nf2_regio_mock_reg(&emu.io, NF2_EXACT_ADDR(i * SLOTS_PER_THREAD + j,
+						OPENFLOW_EXACT_ENTRY_HDR_BASE_POS + w));
+				if (!s->valid) {
+					if (w == NF2_OF_ENTRY_WORD_LEN - 1 && (got & NF2_EXACT_VALID_BIT))
+						failures++;
+					continue;
+				}
+				word = s->entry.raw[w];
+				if (w == NF2_OF_ENTRY_WORD_LEN - 1)
+					word |= NF2_EXACT_VALID_BIT;
+				failures += got != word;
+			}
+			for (w = 0; s->valid && w < NF2_OF_ACTION_WORD_LEN; w++) {
+				got = *nf2_regio_mock_reg(&emu.io, NF2_EXACT_ADDR(i * SLOTS_PER_THREAD + j,
+						OPENFLOW_EXACT_ENTRY_ACTION_BASE_POS + w));
+				failures += got != s->action.raw[w];
+			}
+		}
+		for (j = 0; j < p->num_wildcard; j++) {
+			s = &p->wildcard[j];
+			wc = &emu.wildcard[i + j * num_threads];
+			if (!nf2_emu_wildcard_holds(wc, &s->entry, &s->mask, &s->action))
+				failures++;
+		}
+	}
+	return failures;
+}
+
+
+int cmp_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
@@ -0,0 +1,161 @@
+/* ****************************************************************************
+ * Module: genbench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Checks the frames of the test traffic generator
+ *              (common/nf2_trafgen.c) against their headers recomputed
+ *              from scratch: IP total length and checksum, UDP length,
+ *              TCP and UDP checksums over the pseudo header and the
+ *              payload. Measures the packets per second it builds.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <time.h>
+
+#include "../common/nf2_trafgen.h"
+
+#define DEFAULT_PKTS	1000000
+#define REPORT_FAILURES	10
+
+static uint8_t frame[NF2_TRAFGEN_MAX_LEN + 4 + NF2_TRAFGEN_SLACK];
+
+/* frame lengths of the runs: IMIX, every length, the largest */
+static const int len_min[] = { NF2_TRAFGEN_IMIX, 60, 1514 };
+static const int len_max[] = { 0, 1514, 1514 };
+#define NUM_RUNS	(sizeof(len_min) / sizeof(len_min[0]))
+
+void usage (void);
+uint32_t sum16 (const uint8_t *, int len);
+uint16_t fold (uint32_t sum);
+int check_frame (const uint8_t *, uint32_t len);
+double now_ns (void);
+
+int main(int argc, char *argv[]) {
+	struct nf2_trafgen_cfg cfg;
+	struct nf2_trafgen gen;
+	struct nf2_trafgen_pkt pkt;
+	int num_pkts = DEFAULT_PKTS;
+	int c, i, r, bad, failures = 0;
+	double start, ns;
+
+	while ((c = getopt(argc, argv, "n:h")) != -1) {
+		switch (c) {
+		case 'n':
+			num_pkts = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	printf("%-12s %12s %10s %8s\n", "lengths", "packets", "Mpps", "failed");
+	for (r = 0; r < NUM_RUNS; r++) {
+		memset(&cfg, 0, sizeof(cfg));
+		cfg.seed = r + 1;
+		cfg.num_flows = 1000;
+		cfg.num_ports = 1;
+		cfg.len_min = len_min[r];
+		cfg.len_max = len_max[r];
+		cfg.vlan_frac = 0.3;
+		cfg.ipopt_frac = 0.3;
+		cfg.tcp_frac = 0.5;
+		cfg.rate_mbps = 1000;
+		if (nf2_trafgen_init(&gen, &cfg))
+			exit(1);
+
+		bad = 0;
+		for (i = 0; i < num_pkts; i++) {
+			nf2_trafgen_next(&gen, &pkt);
+			nf2_trafgen_build(&gen, &pkt, frame);
+			if (check_frame(frame, pkt.len) && bad++ < REPORT_FAILURES)
+				fprintf(stderr, "packet %d of flow %d, %u bytes: bad header\n", i,
+					pkt.flow, pkt.len);
+		}
+
+		start = now_ns();
+		for (i = 0; i < num_pkts; i++) {
+			nf2_trafgen_next(&gen, &pkt);
+			nf2_trafgen_build(&gen, &pkt, frame);
+		}
+		ns = now_ns() - start;
+
+		if (len_min[r] == NF2_TRAFGEN_IMIX)
+			printf("%-12s", "imix");
+		else
+			printf("%5d-%-6d", len_min[r], len_max[r]);
+		printf(" %12d %10.2f %8d\n", num_pkts, num_pkts / ns * 1e3, bad);
+		failures += bad;
+		nf2_trafgen_free(&gen);
+	}
+	printf("%s\n", failures ? "FAILED" : "all checksums ok");
+	return failures != 0;
+}
+
+
+void usage(void) {
+	printf("Usage: genbench [-n packets]\n");
+	printf("  -n  packets per run (default %d)\n", DEFAULT_PKTS);
+}
+
+
+uint32_t sum16(const uint8_t *b, int len) {
+	uint32_t sum = 0;
+	int i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		sum += (b[i] << 8) | b[i + 1];
+	if (len & 1)
+		sum += b[len - 1] << 8;
+	return sum;
+}
+
+
+uint16_t fold(uint32_t sum) {
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return sum;
+}
+
+
+//
+// check_frame: the IP header and the TCP or UDP segment must each sum
+//    to 0xffff, with the pseudo header for the segment
+//
+int check_frame(const uint8_t *f, uint32_t len) {
+	const uint8_t *ip, *l4;
+	uint32_t ip_off = 14, ihl, l4_len, sum;
+	int proto;
+
+	if (f[12] == 0x81 && f[13] == 0x00)
+		ip_off += 4;
+	ip = f + ip_off;
+	ihl = (ip[0] & 0x0f) * 4;
+	if (((ip[2] << 8) | ip[3]) != len - ip_off || fold(sum16(ip, ihl)) != 0xffff)
+		return 1;
+
+	l4 = ip + ihl;
+	l4_len = len - ip_off - ihl;
+	proto = ip[9];
+	if (proto == 17 && (((l4[4] << 8) | l4[5]) != l4_len || (l4[6] == 0 && l4[7] == 0)))
+		return 1;
+	if (proto != 6 && proto != 17)
+		return 1;
+	sum = sum16(ip + 12, 8) + proto + l4_len + sum16(l4, l4_len);
+	return fold(sum) != 0xffff;
+}
+
+
+double now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
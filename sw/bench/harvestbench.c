@@ -0,0 +1,336 @@
+/* ****************************************************************************
+ * Module: harvestbench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Register traffic and exactness of the exact counter
+ *              harvesting, against the drivers' per-word sweep.
+ *
+ *              Simulated traffic (a few flows at line rate, some that
+ *              turn on at line rate late, many slow ones, short bursts,
+ *              the rest idle) counts into the exact entries of the mock
+ *              register file as exact_match does, and reads clear the
+ *              counters as sram_arbiter does. Each strategy then runs
+ *              over the same traffic and its totals are compared, flow
+ *              by flow, with the packets and bytes sent.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/nf2_harvest.h"
+
+#define DEFAULT_SECS		120
+#define DEFAULT_STEP_MS		100
+#define DEFAULT_TXN_NS		1500
+#define DEFAULT_WORD_NS		500
+
+#define LINE_PPS		1488095.0	/* 64 byte frames on 1 Gb/s */
+#define CLEARED_BITS		0x00ffffff
+
+struct flow {
+	int index;
+	double pps;
+	uint32_t size;
+	double start, stop;	/* seconds */
+	uint64_t pkts, bytes;	/* sent */
+};
+
+struct result {
+	const char *name;
+	unsigned long txns;
+	unsigned long words;
+	unsigned long long model_ns;
+	int wrong;
+};
+
+static struct flow *flows;
+static int num_flows;
+static uint64_t naive_pkts[NF2_HARVEST_ENTRIES], naive_bytes[NF2_HARVEST_ENTRIES];
+
+void usage (void);
+void make_flows (void);
+void count (struct nf2_regio *, double t0, double t1);
+void clear_on_read (struct nf2_regio *, unsigned reg, int n);
+int naive_sweep (struct nf2_regio *);
+void run (struct nf2_regio *, const char *name, const struct nf2_harvest_cfg *,
+	  double sweep_s, double secs, double step, struct result *);
+
+int main(int argc, char *argv[]) {
+	struct nf2_regio io;
+	struct nf2_harvest_cfg cfg;
+	struct result res[6];
+	unsigned txn_ns = DEFAULT_TXN_NS, word_ns = DEFAULT_WORD_NS;
+	int secs = DEFAULT_SECS, step_ms = DEFAULT_STEP_MS;
+	int c, i, n = 0, failures = 0;
+
+	while ((c = getopt(argc, argv, "s:p:t:w:h")) != -1) {
+		switch (c) {
+		case 's':
+			secs = atoi(optarg);
+			break;
+		case 'p':
+			step_ms = atoi(optarg);
+			break;
+		case 't':
+			txn_ns = atoi(optarg);
+			break;
+		case 'w':
+			word_ns = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (secs <= 0 || step_ms <= 0 || step_ms > 1000) {
+		usage();
+		exit(1);
+	}
+
+	if (nf2_regio_open_mock(&io, txn_ns, word_ns)) {
+		fprintf(stderr, "Could not allocate the mock register file\n");
+		exit(1);
+	}
+	io.mock_read_hook = clear_on_read;
+	make_flows();
+
+	cfg.hot_ns = 1000000000ULL;
+	cfg.idle_ns = 10000000000ULL;
+	cfg.merge_words = 0;
+	run(&io, "per-word sweep 1 s", NULL, 1, secs, step_ms / 1e3, &res[n++]);
+	run(&io, "per-word sweep 15 s", NULL, 15, secs, step_ms / 1e3, &res[n++]);
+	run(&io, "per-word sweep 30 s", NULL, 30, secs, step_ms / 1e3, &res[n++]);
+	run(&io, "harvest 1 s/10 s", &cfg, 0, secs, step_ms / 1e3, &res[n++]);
+	cfg.merge_words = 3 * NF2_EXACT_ENTRY_WORDS;
+	run(&io, "harvest, merge 96", &cfg, 0, secs, step_ms / 1e3, &res[n++]);
+	/* long enough for bit 24 of the packet counter to be left set */
+	cfg.hot_ns = 15000000000ULL;
+	cfg.idle_ns = 20000000000ULL;
+	cfg.merge_words = 0;
+	run(&io, "harvest 15 s/20 s", &cfg, 0, secs, step_ms / 1e3, &res[n++]);
+
+	printf("%d flows over %d entries, %d s, polled every %d ms\n", num_flows,
+	       NF2_HARVEST_ENTRIES, secs, step_ms);
+	printf("model: %u ns/transaction + %u ns/word\n\n", txn_ns, word_ns);
+	printf("%-20s %12s %12s %14s %12s\n", "strategy", "txns/s", "words/s",
+	       "bus ms/s", "wrong flows");
+	for (i = 0; i < n; i++) {
+		printf("%-20s %12.0f %12.0f %14.2f %12d\n", res[i].name,
+		       res[i].txns / (double)secs, res[i].words / (double)secs,
+		       res[i].model_ns / 1e6 / secs, res[i].wrong);
+		/* the harvester must be exact */
+		if (i >= 3 && res[i].wrong)
+			failures++;
+	}
+
+	nf2_regio_close(&io);
+	return failures != 0;
+}
+
+
+void usage(void) {
+	printf("Usage: harvestbench [-s seconds] [-p poll_ms] [-t txn_ns] [-w word_ns]\n");
+	printf("  -s  simulated traffic time (default %d s)\n", DEFAULT_SECS);
+	printf("  -p  time between polls, at most 1000 (default %d ms)\n", DEFAULT_STEP_MS);
+	printf("  -t  modelled cost of a register transaction (default %d ns)\n",
+	       DEFAULT_TXN_NS);
+	printf("  -w  modelled cost of a register word (default %d ns)\n", DEFAULT_WORD_NS);
+}
+
+
+static double uniform(double lo, double hi) {
+	return lo + (hi - lo) * random() / 2147483648.0;
+}
+
+
+//
+// make_flows: the traffic, in entries chosen at random
+//
+void make_flows(void) {
+	static uint8_t taken[NF2_HARVEST_ENTRIES];
+	struct flow *f;
+	int i;
+
+	num_flows = 4 + 4 + 2000 + 4000;
+	flows = calloc(num_flows, sizeof(*flows));
+	if (flows == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	srandom(1);
+	for (i = 0; i < num_flows; i++) {
+		f = &flows[i];
+		do
+			f->index = random() % NF2_HARVEST_ENTRIES;
+		while (taken[f->index]);
+		taken[f->index] = 1;
+
+		f->stop = 1e9;
+		if (i < 4) {
+			/* minimum size frames at line rate, the whole time */
+			f->pps = LINE_PPS;
+			f->size = 64;
+		}
+		else if (i < 8) {
+			/* idle, then full size frames at line rate */
+			f->pps = LINE_PPS * 84 / 1538;
+			f->size = 1518;
+			f->start = uniform(5, 60);
+		}
+		else if (i < 2008) {
+			f->pps = uniform(1, 2000);
+			f->size = 64 + random() % 1455;
+		}
+		else {
+			/* a short burst */
+			f->pps = uniform(1000, 100000);
+			f->size = 64 + random() % 1455;
+			f->start = uniform(0, 100);
+			f->stop = f->start + uniform(0.01, 2);
+		}
+	}
+}
+
+
+//
+// count: the packets of every flow between t0 and t1, counted into the
+//    mock SRAM as exact_match counts them: the packet counter wraps at
+//    25 bits, the byte counter at 32
+//
+void count(struct nf2_regio *io, double t0, double t1) {
+	struct flow *f;
+	uint32_t *w0, *w1, pkts;
+	double a, b;
+	uint64_t n;
+	int i;
+
+	for (i = 0; i < num_flows; i++) {
+		f = &flows[i];
+		a = t0 > f->start ? t0 : f->start;
+		b = t1 < f->stop ? t1 : f->stop;
+		if (b <= a)
+			continue;
+		n = (uint64_t)((b - f->start) * f->pps) - (uint64_t)((a - f->start) * f->pps);
+		if (n == 0)
+			continue;
+		f->pkts += n;
+		f->bytes += n * f->size;
+
+		w0 = nf2_regio_mock_reg(io, NF2_EXACT_ADDR(f->index, OPENFLOW_EXACT_ENTRY_COUNTERS_POS));
+		w1 = nf2_regio_mock_reg(io, NF2_EXACT_ADDR(f->index,
+							   OPENFLOW_EXACT_ENTRY_COUNTERS_POS + 1));
+		pkts = ((*w0 >> OPENFLOW_EXACT_ENTRY_PKT_COUNTER_POS) + n) & NF2_EXACT_PKT_MASK;
+		*w0 = (*w0 & ~(NF2_EXACT_PKT_MASK << OPENFLOW_EXACT_ENTRY_PKT_COUNTER_POS)) |
+		      (pkts << OPENFLOW_EXACT_ENTRY_PKT_COUNTER_POS);
+		*w1 += n * f->size;
+	}
+}
+
+
+//
+// clear_on_read: sram_arbiter clears the counter words of an exact entry
+//    read through the registers, except the last seen time and bit 24
+//    of the packet counter
+//
+void clear_on_read(struct nf2_regio *io, unsigned reg, int n) {
+	unsigned word;
+	int i;
+
+	for (i = 0; i < n; i++, reg += 4) {
+		if (reg < NF2_EXACT_ADDR(0, 0) || reg >= NF2_EXACT_ADDR(NF2_HARVEST_ENTRIES, 0))
+			continue;
+		word = (reg - NF2_EXACT_ADDR(0, 0)) / 4 % NF2_EXACT_ENTRY_WORDS;
+		if (word == OPENFLOW_EXACT_ENTRY_COUNTERS_POS)
+			*nf2_regio_mock_reg(io, reg) &= ~CLEARED_BITS;
+		else if (word == OPENFLOW_EXACT_ENTRY_COUNTERS_POS + 1)
+			*nf2_regio_mock_reg(io, reg) = 0;
+	}
+}
+
+
+//
+// naive_sweep: what nf2_get_exact_packet_count and
+//    nf2_get_exact_byte_count give, one register read each, for every
+//    entry
+//
+int naive_sweep(struct nf2_regio *io) {
+	uint32_t w0, w1;
+	int i;
+
+	for (i = 0; i < NF2_HARVEST_ENTRIES; i++) {
+		if (nf2_regio_read(io, NF2_EXACT_ADDR(i, OPENFLOW_EXACT_ENTRY_COUNTERS_POS), &w0) ||
+		    nf2_regio_read(io, NF2_EXACT_ADDR(i, OPENFLOW_EXACT_ENTRY_COUNTERS_POS + 1), &w1))
+			return -1;
+		naive_pkts[i] += (w0 >> OPENFLOW_EXACT_ENTRY_PKT_COUNTER_POS) & NF2_EXACT_PKT_MASK;
+		naive_bytes[i] += w1;
+	}
+	return 0;
+}
+
+
+//
+// run: replay the traffic from the start with the harvester (cfg) or
+//    the per-word sweep every sweep_s seconds (cfg NULL), and check the
+//    totals after a last read of everything
+//
+void run(struct nf2_regio *io, const char *name, const struct nf2_harvest_cfg *cfg,
+	 double sweep_s, double secs, double step, struct result *res) {
+	struct nf2_harvest h;
+	double t, next_sweep = sweep_s;
+	uint64_t pkts, bytes;
+	int i;
+
+	/* zeroed counters, as nf2_of_exact_write leaves them */
+	for (i = 0; i < num_flows; i++) {
+		flows[i].pkts = flows[i].bytes = 0;
+		*nf2_regio_mock_reg(io, NF2_EXACT_ADDR(flows[i].index,
+						       OPENFLOW_EXACT_ENTRY_COUNTERS_POS)) = 0;
+		*nf2_regio_mock_reg(io, NF2_EXACT_ADDR(flows[i].index,
+						       OPENFLOW_EXACT_ENTRY_COUNTERS_POS + 1)) = 0;
+	}
+	memset(naive_pkts, 0, sizeof(naive_pkts));
+	memset(naive_bytes, 0, sizeof(naive_bytes));
+	if (cfg != NULL && nf2_harvest_init(&h, cfg, 0)) {
+		fprintf(stderr, "Could not set up the harvester\n");
+		exit(1);
+	}
+	nf2_regio_clear_stats(io);
+
+	for (t = 0; t < secs; t += step) {
+		count(io, t, t + step);
+		if (cfg != NULL) {
+			if (nf2_harvest_poll(&h, io, (t + step) * 1e9) < 0)
+				exit(1);
+		}
+		else if (t + step >= next_sweep) {
+			if (naive_sweep(io))
+				exit(1);
+			next_sweep += sweep_s;
+		}
+	}
+
+	res->name = name;
+	res->txns = io->num_txns;
+	res->words = io->num_words;
+	res->model_ns = io->model_ns;
+
+	if (cfg != NULL)
+		nf2_harvest_sweep(&h, io, secs * 1e9);
+	else
+		naive_sweep(io);
+	res->wrong = 0;
+	for (i = 0; i < num_flows; i++) {
+		pkts = cfg ? h.flows[flows[i].index].pkts : naive_pkts[flows[i].index];
+		bytes = cfg ? h.flows[flows[i].index].bytes : naive_bytes[flows[i].index];
+		if (pkts != flows[i].pkts || bytes != flows[i].bytes)
+			res->wrong++;
+	}
+	if (cfg != NULL)
+		nf2_harvest_free(&h);
+}
@@ -0,0 +1,136 @@
+/* ****************************************************************************
+ * Module: hashbench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Checks the host header_hash implementation against the
+ *              golden vectors, cross-checks the methods on random flow
+ *              entries and measures their throughput.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <time.h>
+
+#include "../common/nf2_hash.h"
+
+#define BATCH		4096
+#define CHECK_KEYS	(256 * 1024)
+
+static nf2_of_entry_wrap entries[BATCH];
+static uint32_t hash_0[BATCH], hash_1[BATCH];
+static uint32_t ref_0[BATCH], ref_1[BATCH];
+
+static const enum nf2_hash_method methods[] = {
+	NF2_HASH_BITWISE, NF2_HASH_TABLE, NF2_HASH_CLMUL
+};
+#define NUM_METHODS	(sizeof(methods) / sizeof(methods[0]))
+
+void usage (void);
+void random_entries (void);
+double now_ns (void);
+
+int main(int argc, char *argv[]) {
+	int iters = 200, check_only = 0;
+	int c, i, k, failures = 0;
+	double start, ns;
+	volatile uint32_t sink = 0;
+
+	while ((c = getopt(argc, argv, "n:ch")) != -1) {
+		switch (c) {
+		case 'n':
+			iters = atoi(optarg);
+			break;
+		case 'c':
+			check_only = 1;
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	nf2_hash_init();
+	srandom(1);
+
+	/* golden vectors, for every method */
+	for (k = 0; k < NUM_METHODS; k++) {
+		if (nf2_hash_set_method(methods[k])) {
+			printf("%-8s not supported on this CPU\n",
+			       nf2_hash_method_name(methods[k]));
+			continue;
+		}
+		i = nf2_hash_selftest();
+		printf("%-8s golden vectors: %s\n", nf2_hash_method_name(methods[k]),
+		       i ? "FAILED" : "ok");
+		failures += i;
+	}
+
+	/* random entries: every method must agree with the bit-serial one */
+	for (i = 0; i < CHECK_KEYS / BATCH; i++) {
+		random_entries();
+		nf2_hash_set_method(NF2_HASH_BITWISE);
+		nf2_header_hash_batch(entries, BATCH, ref_0, ref_1);
+		for (k = 1; k < NUM_METHODS; k++) {
+			if (nf2_hash_set_method(methods[k]))
+				continue;
+			nf2_header_hash_batch(entries, BATCH, hash_0, hash_1);
+			if (memcmp(hash_0, ref_0, sizeof(ref_0)) ||
+			    memcmp(hash_1, ref_1, sizeof(ref_1))) {
+				printf("%-8s disagrees with bitwise\n",
+				       nf2_hash_method_name(methods[k]));
+				failures++;
+			}
+		}
+	}
+	printf("cross-check on %d random entries: %s\n", CHECK_KEYS,
+	       failures ? "FAILED" : "ok");
+	if (failures || check_only)
+		return failures != 0;
+
+	printf("\n%-8s %12s %12s\n", "method", "ns/entry", "Mentries/s");
+	for (k = 0; k < NUM_METHODS; k++) {
+		int n = methods[k] == NF2_HASH_BITWISE ? iters / 20 + 1 : iters;
+
+		if (nf2_hash_set_method(methods[k]))
+			continue;
+		start = now_ns();
+		for (i = 0; i < n; i++) {
+			nf2_header_hash_batch(entries, BATCH, hash_0, hash_1);
+			sink ^= hash_0[i % BATCH];
+		}
+		ns = (now_ns() - start) / ((double)n * BATCH);
+		printf("%-8s %12.2f %12.2f\n", nf2_hash_method_name(methods[k]),
+		       ns, 1e3 / ns);
+	}
+	return 0;
+}
+
+
+void usage(void) {
+	printf("Usage: hashbench [-n batches] [-c]\n");
+	printf("  -n  batches of %d entries to time (default 200)\n", BATCH);
+	printf("  -c  only run the golden vector and cross checks\n");
+}
+
+
+void random_entries(void) {
+	int i, j;
+
+	for (i = 0; i < BATCH; i++)
+		for (j = 0; j < NF2_OF_ENTRY_WORD_LEN; j++)
+			entries[i].raw[j] = random() ^ (random() << 16);
+}
+
+
+double now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
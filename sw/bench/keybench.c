@@ -0,0 +1,266 @@
+/* ****************************************************************************
+ * Module: keybench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Checks the batch flow key extractor against the reference
+ *              one and measures both.
+ *
+ *              Random frames (tagged and untagged, truncated captures,
+ *              IP with any IHL, TCP, UDP, ICMP, other protocols, ARP and
+ *              other ethertypes) must give the same nf2_of_entry from
+ *              nf2_flowkey_extract_batch as from nf2_flowkey_extract.
+ *              The timing runs over frames in cache and over a pool of
+ *              frames larger than the cache, visited in random order as
+ *              a trace of many flows would be. "-w" writes frames and
+ *              keys for keycheck.pl, which encodes the same fields with
+ *              OpenFlowHdr of lib/Perl5/OpenFlowLib.pm.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <time.h>
+
+#include "../common/nf2_flowkey.h"
+
+#define BATCH		4096
+#define CHECK_ROUNDS	64
+#define SLOT_LEN	256		/* bytes kept of each frame */
+#define POOL_FRAMES	(256 * 1024)	/* 64 MB of frames */
+
+static uint8_t *pool;
+static const uint8_t *frames[POOL_FRAMES];
+static uint32_t caplens[POOL_FRAMES];
+static int ports[POOL_FRAMES];
+static nf2_of_entry_wrap keys[BATCH], ref[BATCH];
+
+void usage (void);
+void random_frame (uint8_t *, uint32_t *caplen, int *port, int check);
+int write_vectors (const char *path, int num);
+double time_scalar (int base, int iters);
+double time_batch (int base, int iters);
+double now_ns (void);
+
+static inline void put16(uint8_t *b, uint16_t v) {
+	b[0] = v >> 8;
+	b[1] = v;
+}
+
+
+int main(int argc, char *argv[]) {
+	const char *vectors = NULL;
+	int iters = 200, check_only = 0, num_vectors = BATCH;
+	int c, i, k, failures = 0;
+	double ns[2];
+
+	while ((c = getopt(argc, argv, "n:cw:v:h")) != -1) {
+		switch (c) {
+		case 'n':
+			iters = atoi(optarg);
+			break;
+		case 'c':
+			check_only = 1;
+			break;
+		case 'w':
+			vectors = optarg;
+			break;
+		case 'v':
+			num_vectors = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (num_vectors <= 0 || num_vectors > POOL_FRAMES) {
+		usage();
+		exit(1);
+	}
+
+	pool = malloc((size_t)POOL_FRAMES * SLOT_LEN);
+	if (pool == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	srandom(1);
+
+	/* checks: any caplen, any header */
+	for (i = 0; i < CHECK_ROUNDS; i++) {
+		for (k = 0; k < BATCH; k++) {
+			frames[k] = pool + (size_t)k * SLOT_LEN;
+			random_frame(pool + (size_t)k * SLOT_LEN, &caplens[k], &ports[k], 1);
+			nf2_flowkey_extract(frames[k], caplens[k], ports[k], &ref[k]);
+		}
+		memset(keys, 0xa5, sizeof(keys));
+		nf2_flowkey_extract_batch(frames, caplens, ports, BATCH, keys);
+		for (k = 0; k < BATCH; k++) {
+			if (memcmp(&keys[k], &ref[k], sizeof(ref[k]))) {
+				if (failures++ < 5)
+					printf("frame of %u bytes, port %d: batch key differs\n",
+					       caplens[k], ports[k]);
+			}
+		}
+	}
+	printf("checks on %d random frames: %s\n", CHECK_ROUNDS * BATCH,
+	       failures ? "FAILED" : "ok");
+	if (vectors && write_vectors(vectors, num_vectors))
+		exit(1);
+	if (failures || check_only)
+		return failures != 0;
+
+	/* timing: captured frames of the usual lengths, in random order */
+	for (i = 0; i < POOL_FRAMES; i++)
+		random_frame(pool + (size_t)i * SLOT_LEN, &caplens[i], &ports[i], 0);
+	for (i = 0; i < POOL_FRAMES; i++)
+		frames[i] = pool + (size_t)(random() % POOL_FRAMES) * SLOT_LEN;
+
+	printf("\n%-24s %12s %12s %12s\n", "frames", "ref ns/pkt", "batch ns/pkt", "Mpkts/s");
+	ns[0] = time_scalar(-1, iters);
+	ns[1] = time_batch(-1, iters);
+	printf("%-24s %12.2f %12.2f %12.2f\n", "in cache", ns[0], ns[1], 1e3 / ns[1]);
+	ns[0] = time_scalar(0, iters);
+	ns[1] = time_batch(0, iters);
+	printf("%-24s %12.2f %12.2f %12.2f\n", "64 MB pool, random", ns[0], ns[1],
+	       1e3 / ns[1]);
+	return 0;
+}
+
+
+void usage(void) {
+	printf("Usage: keybench [-n batches] [-c] [-w vectors] [-v count]\n");
+	printf("  -n  batches of %d frames to time (default 200)\n", BATCH);
+	printf("  -c  only run the checks\n");
+	printf("  -w  write frames and their keys for keycheck.pl\n");
+	printf("  -v  frames to write (default %d)\n", BATCH);
+}
+
+
+//
+// random_frame: fills a slot. check: any caplen, including truncated
+//    captures, and any IHL; otherwise frames of 60, 590 and 1514 bytes
+//    captured whole, as a trace would hold them (only the first SLOT_LEN
+//    bytes exist, which is more than any header).
+//
+void random_frame(uint8_t *d, uint32_t *caplen, int *port, int check) {
+	static const uint8_t protos[] = {
+		NF2_IP_PROTO_TCP, NF2_IP_PROTO_TCP, NF2_IP_PROTO_UDP, NF2_IP_PROTO_UDP,
+		NF2_IP_PROTO_ICMP, 47, 50, 0
+	};
+	int l3 = 14, ihl, r = random() % 16, len;
+	int i;
+
+	for (i = 0; i < SLOT_LEN; i++)
+		d[i] = random();
+	*port = random() % 8;
+	if (check) {
+		len = random() % 4 == 0 ? random() % 64 : random() % SLOT_LEN;
+		*caplen = len;
+	}
+	else {
+		len = random() % 12;
+		*caplen = len < 7 ? 60 : len < 11 ? 590 : 1514;
+	}
+
+	if (random() % 3 == 0) {
+		put16(d + 12, NF2_ETH_TYPE_VLAN);
+		l3 += 4;
+		if (check && random() % 8 == 0) {
+			put16(d + 16, NF2_ETH_TYPE_VLAN);	/* QinQ: inner tag not parsed */
+			l3 += 4;
+		}
+	}
+	if (r == 0) {
+		put16(d + l3 - 2, NF2_ETH_TYPE_ARP);
+		return;
+	}
+	if (r == 1)
+		return;		/* random ethertype */
+	put16(d + l3 - 2, NF2_ETH_TYPE_IP);
+
+	/* IHL 5..15 with options, and now and then a bad one */
+	ihl = r == 2 && check ? random() % 5 : 5 + (random() % 4 ? 0 : random() % 11);
+	d[l3] = 0x40 | ihl;
+	d[l3 + 9] = protos[random() % 8];
+}
+
+
+//
+// write_vectors: the first num check frames, one per line: source port,
+//    caplen, the captured bytes up to NF2_FLOWKEY_MAX_HDR in hex and the
+//    eight words of the key in hex.
+//
+int write_vectors(const char *path, int num) {
+	nf2_of_entry_wrap key;
+	uint8_t buf[SLOT_LEN];
+	uint32_t caplen;
+	FILE *f;
+	int i, j, port;
+
+	f = fopen(path, "w");
+	if (f == NULL) {
+		perror(path);
+		return -1;
+	}
+	srandom(2);
+	for (i = 0; i < num; i++) {
+		random_frame(buf, &caplen, &port, 1);
+		nf2_flowkey_extract(buf, caplen, port, &key);
+		fprintf(f, "%d %u ", port, caplen);
+		for (j = 0; j < (int)caplen && j < NF2_FLOWKEY_MAX_HDR; j++)
+			fprintf(f, "%02x", buf[j]);
+		if (j == 0)
+			fprintf(f, "-");
+		for (j = 0; j < NF2_OF_ENTRY_WORD_LEN; j++)
+			fprintf(f, " %08x", key.raw[j]);
+		fprintf(f, "\n");
+	}
+	if (fclose(f)) {
+		perror(path);
+		return -1;
+	}
+	printf("wrote %d frames and keys to %s\n", num, path);
+	return 0;
+}
+
+
+//
+// time_scalar, time_batch: ns per frame over batches of BATCH frames: the
+//    first batch again and again for base -1, otherwise every batch of
+//    the pool in turn.
+//
+double time_scalar(int base, int iters) {
+	double start = now_ns();
+	int i, k, b;
+
+	for (i = 0; i < iters; i++) {
+		b = base < 0 ? 0 : (i % (POOL_FRAMES / BATCH)) * BATCH;
+		for (k = 0; k < BATCH; k++)
+			nf2_flowkey_extract(frames[b + k], caplens[b + k], ports[b + k], &keys[k]);
+	}
+	return (now_ns() - start) / ((double)iters * BATCH);
+}
+
+
+double time_batch(int base, int iters) {
+	double start = now_ns();
+	int i, b;
+
+	for (i = 0; i < iters; i++) {
+		b = base < 0 ? 0 : (i % (POOL_FRAMES / BATCH)) * BATCH;
+		nf2_flowkey_extract_batch(frames + b, caplens + b, ports + b, BATCH, keys);
+	}
+	return (now_ns() - start) / ((double)iters * BATCH);
+}
+
+
+double now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
@@ -0,0 +1,159 @@
+#!/usr/bin/perl -w
+#
+# keycheck.pl
+#
+# Differential check of the host flow key extractor (common/nf2_flowkey.c)
+# against the encoder the verification tests use, OpenFlowHdr of
+# lib/Perl5/OpenFlowLib.pm.
+#
+#   bench/keybench -c -w keys.txt [-v count]
+#   bench/keycheck.pl keys.txt
+#
+# Every line of keys.txt is a source port, a caplen, the captured header
+# bytes and the eight words of the key the C code built. The fields of the
+# frame are read as header_parser reads them, handed to OpenFlowHdr->new as
+# a test would and the words it encodes must be those of the C key.
+#
+# OpenFlowHdr::new zeroes the transport ports of every protocol but TCP and
+# UDP and the IP fields of every ethertype but IP, where header_parser puts
+# the ICMP type and code and the ARP opcode and addresses; those are set on
+# the header after new, and counted. A frame with an IHL below 5 has the
+# default entry, which OpenFlowHdr does not build; it is only checked to be
+# that.
+#
+# Needs the NetFPGA Perl libraries (NFUtils, reg_defines_openflow_switch)
+# on PERL5LIB, as the verif tests do.
+#
+
+use strict;
+use FindBin;
+use lib "$FindBin::Bin/../../lib/Perl5";
+
+use OpenFlowLib;
+use NFUtils::SimplePacket;
+
+use constant HDR_LEN => 4 + 14 + 15 * 4 + 4;
+
+my $num = 0;
+my $failed = 0;
+my %departed = ('icmp' => 0, 'arp' => 0, 'reset' => 0);
+
+die "Usage: keycheck.pl vectors\n" unless @ARGV == 1;
+open(VECTORS, "<$ARGV[0]") or die "$ARGV[0]: $!\n";
+while (my $line = <VECTORS>) {
+  chomp $line;
+  my ($port, $caplen, $hex, @key) = split(' ', $line);
+  my @bytes = $hex eq '-' ? () : map { hex } unpack('(A2)*', $hex);
+  push @bytes, (0) x (HDR_LEN - scalar @bytes);
+  @key = map { hex } @key;
+  $num++;
+
+  my @words = encode($port, $caplen, @bytes);
+  if (join(' ', @words) ne join(' ', @key)) {
+    $failed++;
+    if ($failed <= 5) {
+      print "line $num: OpenFlowHdr ", join(' ', map { sprintf('%08x', $_) } @words), "\n";
+      print "line $num: nf2_flowkey ", join(' ', map { sprintf('%08x', $_) } @key), "\n";
+    }
+  }
+}
+close(VECTORS);
+
+print "$num keys, ", $num - $failed, " encoded alike by OpenFlowHdr\n";
+print "  header_parser fields OpenFlowHdr::new zeroes: $departed{icmp} ICMP, $departed{arp} ARP\n";
+print "  IHL below 5, default entry: $departed{reset}\n";
+print $failed ? "FAILED\n" : "ok\n";
+exit($failed ? 1 : 0);
+
+
+# The words of the entry of a frame: its fields as header_parser reads
+# them, encoded by OpenFlowHdr
+sub encode {
+  my ($port, $caplen, @b) = @_;
+  my $vlan = 0xffff;
+
+  # vlan_remover takes the first tag off the frame
+  if ($caplen >= 16 && get16(\@b, 12) == 0x8100) {
+    $vlan = get16(\@b, 14) & 0xefff;
+    splice(@b, 12, 4);
+  }
+  my $eth_type = get16(\@b, 12);
+  my %fields = (NFUtils::SimplePacket::SRC_PORT() => $port,
+                NFUtils::SimplePacket::VLAN_TAG() => $vlan,
+                NFUtils::SimplePacket::ETH_DST() => mac(@b[0..5]),
+                NFUtils::SimplePacket::ETH_SRC() => mac(@b[6..11]),
+                NFUtils::SimplePacket::ETH_TYPE() => $eth_type,
+                NFUtils::SimplePacket::IP_TOS() => 0,
+                NFUtils::SimplePacket::IP_PROTO() => 0,
+                NFUtils::SimplePacket::IP_SRC() => 0,
+                NFUtils::SimplePacket::IP_DST() => 0,
+                NFUtils::SimplePacket::TRANSP_SRC() => 0,
+                NFUtils::SimplePacket::TRANSP_DST() => 0);
+  my ($icmp, $arp);
+
+  if ($eth_type == NFUtils::SimplePacket::ETH_TYPE_IP) {
+    my $ihl = $b[14] & 0xf;
+    my $l4 = 14 + $ihl * 4;
+
+    if ($ihl < 5) {
+      $departed{reset}++;
+      return default_words();
+    }
+    $fields{NFUtils::SimplePacket::IP_TOS()} = $b[15] & 0xfc;
+    $fields{NFUtils::SimplePacket::IP_PROTO()} = $b[23];
+    $fields{NFUtils::SimplePacket::IP_SRC()} = get32(\@b, 26);
+    $fields{NFUtils::SimplePacket::IP_DST()} = get32(\@b, 30);
+    if ($b[23] == NFUtils::SimplePacket::IP_PROTO_TCP
+        || $b[23] == NFUtils::SimplePacket::IP_PROTO_UDP) {
+      $fields{NFUtils::SimplePacket::TRANSP_SRC()} = get16(\@b, $l4);
+      $fields{NFUtils::SimplePacket::TRANSP_DST()} = get16(\@b, $l4 + 2);
+    }
+    elsif ($b[23] == 1) {
+      $icmp = [$b[$l4], $b[$l4 + 1]];
+    }
+  }
+  elsif ($eth_type == 0x0806) {
+    $arp = [$b[21], get32(\@b, 28), get32(\@b, 38)];
+  }
+
+  my $hdr = OpenFlowHdr->new(%fields);
+  if ($icmp) {
+    $departed{icmp}++;
+    $hdr->setCmpData(NFUtils::SimplePacket::TRANSP_SRC(), $icmp->[0]);
+    $hdr->setCmpData(NFUtils::SimplePacket::TRANSP_DST(), $icmp->[1]);
+  }
+  if ($arp) {
+    $departed{arp}++;
+    $hdr->setCmpData(NFUtils::SimplePacket::IP_PROTO(), $arp->[0]);
+    $hdr->setCmpData(NFUtils::SimplePacket::IP_SRC(), $arp->[1]);
+    $hdr->setCmpData(NFUtils::SimplePacket::IP_DST(), $arp->[2]);
+  }
+  return pad_words($hdr->cmpDataWords());
+}
+
+# The entry header_parser builds for an IHL below 5: all zero but an
+# untagged vlan_id
+sub default_words {
+  return (0, 0, 0, 0, 0, 0, 0, 0xffff << 8);
+}
+
+# The entry is 248 bits: the C key has a zero byte on top
+sub pad_words {
+  my @words = @_;
+  push @words, 0 while @words < 8;
+  return @words;
+}
+
+sub get16 {
+  my ($b, $i) = @_;
+  return ($b->[$i] << 8) | $b->[$i + 1];
+}
+
+sub get32 {
+  my ($b, $i) = @_;
+  return ($b->[$i] << 24) | ($b->[$i + 1] << 16) | ($b->[$i + 2] << 8) | $b->[$i + 3];
+}
+
+sub mac {
+  return join(':', map { sprintf('%02x', $_) } @_);
+}
@@ -0,0 +1,231 @@
+/* ****************************************************************************
+ * Module: modbench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Register traffic of a flow-mod storm, with and without
+ *              differential writes.
+ *
+ *              Installs exact flows and wildcard rules on the mock
+ *              register file, then reroutes everything forwarding to one
+ *              port (a port going down), once writing whole entries and
+ *              once writing only the changed words. The card contents
+ *              are checked against the host shadow afterwards.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/nf2_exact_table.h"
+#include "../common/nf2_wildcard_table.h"
+
+#define DEFAULT_FLOWS		16384
+#define NUM_RULES		24
+#define DOWN_PORT		1
+#define BACKUP_PORT		2
+
+struct rule {
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;
+	nf2_of_action_wrap action;
+	uint16_t priority;
+};
+
+static nf2_of_entry_wrap *flows;
+static nf2_of_action_wrap *flow_actions;
+static int num_flows;
+static struct rule rules[NUM_RULES];
+
+void usage (void);
+void random_action (nf2_of_action_wrap *);
+int install (struct nf2_exact_table *, struct nf2_wildcard_table *, int nflows);
+int reroute (nf2_of_action_wrap *);
+int check_card (struct nf2_exact_table *, struct nf2_wildcard_table *, struct nf2_regio *);
+
+int main(int argc, char *argv[]) {
+	struct nf2_exact_table exact;
+	struct nf2_wildcard_table wildcard;
+	struct nf2_regio io;
+	nf2_of_action_wrap action;
+	int nflows = DEFAULT_FLOWS, diff, c, i, n, failures = 0;
+	unsigned long words[2], txns[2];
+
+	while ((c = getopt(argc, argv, "n:h")) != -1) {
+		switch (c) {
+		case 'n':
+			nflows = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (nflows <= 0 || nflows > OPENFLOW_NF2_EXACT_TABLE_SIZE) {
+		usage();
+		exit(1);
+	}
+
+	flows = calloc(nflows, sizeof(*flows));
+	flow_actions = calloc(nflows, sizeof(*flow_actions));
+	if (flows == NULL || flow_actions == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	for (diff = 0; diff < 2; diff++) {
+		srandom(1);
+		if (nf2_regio_open_mock(&io, 0, 0) ||
+		    nf2_exact_table_init(&exact, &io, NF2_EXACT_DEFAULT_MAX_KICKS)) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		nf2_wildcard_table_init(&wildcard, &io);
+		exact.diff_writes = diff;
+		wildcard.diff_writes = diff;
+
+		install(&exact, &wildcard, nflows);
+		nf2_regio_clear_stats(&io);
+
+		n = 0;
+		for (i = 0; i < num_flows; i++) {
+			action = flow_actions[i];
+			if (!reroute(&action))
+				continue;
+			if (nf2_exact_modify(&exact, &flows[i], &action) < 0)
+				failures++;
+			n++;
+		}
+		for (i = 0; i < NUM_RULES; i++) {
+			action = rules[i].action;
+			if (!reroute(&action))
+				continue;
+			if (nf2_wildcard_modify(&wildcard, &rules[i].entry, &rules[i].mask,
+						&action, rules[i].priority) < 0)
+				failures++;
+			n++;
+		}
+		words[diff] = io.num_words;
+		txns[diff] = io.num_txns;
+
+		failures += check_card(&exact, &wildcard, &io);
+		if (diff)
+			printf("%d flows and %d wildcard rules, %d rerouted from port %d\n\n",
+			       num_flows, NUM_RULES, n, DOWN_PORT);
+
+		nf2_exact_table_free(&exact);
+		nf2_regio_close(&io);
+	}
+
+	printf("%-14s %14s %14s\n", "", "words/modify", "txns/modify");
+	printf("%-14s %14.2f %14.2f\n", "full", (double)words[0] / n, (double)txns[0] / n);
+	printf("%-14s %14.2f %14.2f\n", "differential", (double)words[1] / n,
+	       (double)txns[1] / n);
+	printf("\ncard vs shadow: %s\n", failures ? "FAILED" : "ok");
+	return failures != 0;
+}
+
+
+void usage(void) {
+	printf("Usage: modbench [-n flows]\n");
+	printf("  -n  exact flows to install (default %d)\n", DEFAULT_FLOWS);
+}
+
+
+void random_action(nf2_of_action_wrap *action) {
+	memset(action, 0, sizeof(*action));
+	action->action.forward_bitmask = 1 << (2 * (random() % NF2_PORT_NUM));
+	if (random() % 4 == 0) {
+		action->action.nf2_action_flag = 1 << (random() % 10);
+		action->action.vlan_id = random() & 0xfff;
+		action->action.ip_dst = random();
+	}
+}
+
+
+//
+// install: the exact flows (those that fit) and the wildcard rules
+//
+int install(struct nf2_exact_table *exact, struct nf2_wildcard_table *wildcard,
+	    int nflows) {
+	int i, j;
+
+	num_flows = 0;
+	for (i = 0; i < nflows; i++) {
+		for (j = 0; j < NF2_OF_ENTRY_WORD_LEN; j++)
+			flows[num_flows].raw[j] = random() ^ (random() << 16);
+		flows[num_flows].entry.pad = 0;
+		random_action(&flow_actions[num_flows]);
+		if (nf2_exact_insert(exact, &flows[num_flows], &flow_actions[num_flows]) >= 0)
+			num_flows++;
+	}
+
+	for (i = 0; i < NUM_RULES; i++) {
+		struct rule *r = &rules[i];
+
+		for (j = 0; j < NF2_OF_ENTRY_WORD_LEN; j++)
+			r->entry.raw[j] = random() ^ (random() << 16);
+		memset(&r->mask, 0, sizeof(r->mask));
+		r->mask.entry.ip_src = 0xffffffff;
+		r->mask.entry.transp_src = 0xffff;
+		r->mask.entry.pad = 0xff;
+		random_action(&r->action);
+		r->priority = random() % 8;
+		if (nf2_wildcard_insert(wildcard, &r->entry, &r->mask, &r->action,
+					r->priority) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+
+//
+// reroute: move the output of an action off DOWN_PORT. Returns 1 if the
+//    action changed.
+//
+int reroute(nf2_of_action_wrap *action) {
+	uint16_t down = 1 << (2 * DOWN_PORT);
+
+	if (!(action->action.forward_bitmask & down))
+		return 0;
+	action->action.forward_bitmask &= ~down;
+	action->action.forward_bitmask |= 1 << (2 * BACKUP_PORT);
+	return 1;
+}
+
+
+//
+// check_card: the exact actions in the mock SRAM and the last wildcard
+//    entry in the staging registers must match the host shadow
+//
+int check_card(struct nf2_exact_table *exact, struct nf2_wildcard_table *wildcard,
+	       struct nf2_regio *io) {
+	int i, w, failures = 0;
+
+	for (i = 0; i < exact->size; i++) {
+		if (!exact->slots[i].used)
+			continue;
+		for (w = 0; w < NF2_OF_ACTION_WORD_LEN; w++)
+			if (*nf2_regio_mock_reg(io, NF2_EXACT_ADDR(i,
+					OPENFLOW_EXACT_ENTRY_ACTION_BASE_POS + w)) !=
+			    exact->slots[i].action.raw[w])
+				failures++;
+	}
+
+	if (wildcard->diff_writes) {
+		for (w = 0; w < NF2_OF_ACTION_WORD_LEN; w++)
+			if (*nf2_regio_mock_reg(io, OPENFLOW_WILDCARD_LOOKUP_ACTION_0_REG + w * 4) !=
+			    wildcard->stage.action.raw[w])
+				failures++;
+		for (w = 0; w < NF2_OF_ENTRY_WORD_LEN; w++)
+			if (*nf2_regio_mock_reg(io, OPENFLOW_WILDCARD_LOOKUP_CMP_0_REG + w * 4) !=
+			    wildcard->stage.entry.raw[w] ||
+			    *nf2_regio_mock_reg(io, OPENFLOW_WILDCARD_LOOKUP_CMP_MASK_0_REG + w * 4) !=
+			    wildcard->stage.mask.raw[w])
+				failures++;
+	}
+	return failures;
+}
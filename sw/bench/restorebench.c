@@ -0,0 +1,350 @@
+/* ****************************************************************************
+ * Module: restorebench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Time to repopulate the flow tables after a watchdog flush
+ *              or a card reset, by reinstalling the flows one by one
+ *              and by restoring the table image (common/nf2_tablesnap.c).
+ *
+ *              The exact and wildcard tables are filled through their
+ *              host shadows with random flows, with some deletes and
+ *              modifies, on the mock register file, keeping the image
+ *              current. The mock SRAM is then zeroed as the flush
+ *              leaves it and the tables written again both ways; the
+ *              restored card must hold what it held before, and a fresh
+ *              shadow loaded from the image must match the old one.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/nf2_tablesnap.h"
+
+#define DEFAULT_FLOWS		28000
+#define DEFAULT_TXN_NS		1500
+#define DEFAULT_WORD_NS		500
+#define DEFAULT_PATH		"/tmp/restorebench.img"
+#define UPDATE_LOOPS		1000000
+
+#define EXACT_WORDS		(OPENFLOW_EXACT_ENTRY_ACTION_BASE_POS + NF2_OF_ACTION_WORD_LEN)
+#define VALID_WORD		(OPENFLOW_EXACT_ENTRY_HDR_BASE_POS + NF2_OF_ENTRY_WORD_LEN - 1)
+
+struct flow {
+	nf2_of_entry_wrap entry;
+	nf2_of_action_wrap action;
+};
+
+static uint32_t (*before)[EXACT_WORDS];
+
+void usage (void);
+void random_flow (nf2_of_entry_wrap *, nf2_of_action_wrap *);
+void random_rule (nf2_of_entry_wrap *, nf2_of_mask_wrap *, nf2_of_action_wrap *,
+		  uint16_t *priority);
+void save_card (struct nf2_regio *);
+void flush (struct nf2_regio *);
+int check_card (struct nf2_regio *);
+int check_load (const char *, struct nf2_exact_table *, struct nf2_wildcard_table *);
+double ns_now (void);
+
+int main(int argc, char *argv[]) {
+	struct nf2_regio io;
+	struct nf2_exact_table exact, reinst;
+	struct nf2_wildcard_table wildcard, reinst_wc;
+	struct nf2_tablesnap snap;
+	struct nf2_tablesnap_stats st;
+	struct nf2_exact_slot *slot;
+	struct flow *flows;
+	struct {
+		nf2_of_entry_wrap entry;
+		nf2_of_mask_wrap mask;
+		nf2_of_action_wrap action;
+		uint16_t priority;
+	} rules[OPENFLOW_WILDCARD_TABLE_SIZE];
+	const char *path = DEFAULT_PATH;
+	unsigned txn_ns = DEFAULT_TXN_NS, word_ns = DEFAULT_WORD_NS;
+	unsigned long long reinst_ns, reinst_txns, reinst_words;
+	double t0, reinst_wall, update_ns;
+	int num_flows = DEFAULT_FLOWS, keep = 0;
+	int c, i, n = 0, failures = 0;
+
+	while ((c = getopt(argc, argv, "n:f:kt:w:h")) != -1) {
+		switch (c) {
+		case 'n':
+			num_flows = atoi(optarg);
+			break;
+		case 'f':
+			path = optarg;
+			break;
+		case 'k':
+			keep = 1;
+			break;
+		case 't':
+			txn_ns = atoi(optarg);
+			break;
+		case 'w':
+			word_ns = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (num_flows <= 0 || num_flows > OPENFLOW_NF2_EXACT_TABLE_SIZE) {
+		usage();
+		exit(1);
+	}
+
+	flows = malloc(num_flows * sizeof(*flows));
+	before = malloc(OPENFLOW_NF2_EXACT_TABLE_SIZE * sizeof(*before));
+	if (flows == NULL || before == NULL || nf2_regio_open_mock(&io, txn_ns, word_ns) ||
+	    nf2_exact_table_init(&exact, &io, NF2_EXACT_DEFAULT_MAX_KICKS) ||
+	    nf2_exact_table_init(&reinst, &io, NF2_EXACT_DEFAULT_MAX_KICKS)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	nf2_wildcard_table_init(&wildcard, &io);
+	nf2_wildcard_table_init(&reinst_wc, &io);
+	unlink(path);
+	if (nf2_tablesnap_open(&snap, path))
+		exit(1);
+	exact.snap = &snap;
+	wildcard.snap = &snap;
+
+	/* fill, then churn: a tenth deleted and a tenth modified */
+	srandom(1);
+	for (i = 0; i < num_flows; i++) {
+		random_flow(&flows[n].entry, &flows[n].action);
+		if (nf2_exact_insert(&exact, &flows[n].entry, &flows[n].action) >= 0)
+			n++;
+	}
+	for (i = 0; i < OPENFLOW_WILDCARD_TABLE_SIZE; i++) {
+		random_rule(&rules[i].entry, &rules[i].mask, &rules[i].action, &rules[i].priority);
+		if (nf2_wildcard_insert(&wildcard, &rules[i].entry, &rules[i].mask,
+					&rules[i].action, rules[i].priority) < 0)
+			failures++;
+	}
+	for (i = 0; i < n / 10; i++)
+		nf2_exact_delete(&exact, &flows[random() % n].entry);
+	for (i = 0; i < n / 10; i++) {
+		flows[i].action.action.forward_bitmask ^= 0xff;
+		nf2_exact_modify(&exact, &flows[i].entry, &flows[i].action);
+	}
+	for (i = 0; i < OPENFLOW_WILDCARD_TABLE_SIZE / 4; i++)
+		nf2_wildcard_delete(&wildcard, &rules[i].entry, &rules[i].mask, rules[i].priority);
+	save_card(&io);
+
+	/* the controller reinstalls everything one by one */
+	flush(&io);
+	nf2_regio_clear_stats(&io);
+	t0 = ns_now();
+	for (i = 0; i < n; i++)
+		if (nf2_exact_find(&exact, &flows[i].entry) >= 0)
+			nf2_exact_insert(&reinst, &flows[i].entry, &flows[i].action);
+	for (i = OPENFLOW_WILDCARD_TABLE_SIZE / 4; i < OPENFLOW_WILDCARD_TABLE_SIZE; i++)
+		nf2_wildcard_insert(&reinst_wc, &rules[i].entry, &rules[i].mask, &rules[i].action,
+				    rules[i].priority);
+	reinst_wall = ns_now() - t0;
+	reinst_ns = io.model_ns;
+	reinst_txns = io.num_txns;
+	reinst_words = io.num_words;
+
+	/* the image, written back in bulk */
+	flush(&io);
+	nf2_regio_clear_stats(&io);
+	if (nf2_tablesnap_restore(&snap, &io, 0, &st))
+		exit(1);
+	failures += check_card(&io);
+	if (st.exact != exact.used || st.wildcard != wildcard.used || st.torn)
+		failures++;
+	failures += check_load(path, &exact, &wildcard);
+
+	/* what keeping the image current costs a table write */
+	t0 = ns_now();
+	for (i = 0; i < UPDATE_LOOPS; i++) {
+		slot = &exact.slots[i % OPENFLOW_NF2_EXACT_TABLE_SIZE];
+		nf2_tablesnap_exact(&snap, i % OPENFLOW_NF2_EXACT_TABLE_SIZE,
+				    slot->used ? &slot->entry : NULL, &slot->action);
+	}
+	update_ns = (ns_now() - t0) / UPDATE_LOOPS;
+
+	printf("%d exact entries, %d wildcard entries, image %lu bytes\n", exact.used,
+	       wildcard.used, (unsigned long)sizeof(struct nf2_tablesnap_file));
+	printf("model: %u ns/transaction + %u ns/word\n\n", txn_ns, word_ns);
+	printf("%-20s %12s %12s %12s %12s\n", "", "txns", "words", "bus ms", "host ms");
+	printf("%-20s %12llu %12llu %12.1f %12.1f\n", "reinstall", reinst_txns, reinst_words,
+	       reinst_ns / 1e6, reinst_wall / 1e6);
+	printf("%-20s %12lu %12lu %12.1f %12.1f\n", "restore", io.num_txns, io.num_words,
+	       io.model_ns / 1e6, st.elapsed_ns / 1e6);
+	printf("\nimage update per table write: %.1f ns\n", update_ns);
+
+	/* a record left half written (its writer died) is skipped, and
+	 * counted, once the retries run out */
+	for (i = 0; !snap.file->exact[i].used; i++)
+		;
+	snap.file->exact[i].gen |= 1;
+	flush(&io);
+	if (nf2_tablesnap_restore(&snap, &io, 0, &st))
+		exit(1);
+	if (st.torn != 1 || st.exact != exact.used - 1)
+		failures++;
+	snap.file->exact[i].gen++;
+
+	printf("%s\n", failures ? "FAILED" : "restored card and shadows match");
+
+	nf2_tablesnap_close(&snap);
+	if (!keep)
+		unlink(path);
+	nf2_exact_table_free(&exact);
+	nf2_exact_table_free(&reinst);
+	nf2_regio_close(&io);
+	return failures != 0;
+}
+
+
+void usage(void) {
+	printf("Usage: restorebench [-n flows] [-f image] [-k] [-t txn_ns] [-w word_ns]\n");
+	printf("  -n  exact flows to insert, at most %d (default %d)\n",
+	       OPENFLOW_NF2_EXACT_TABLE_SIZE, DEFAULT_FLOWS);
+	printf("  -f  table image file (default %s)\n", DEFAULT_PATH);
+	printf("  -k  keep the image file\n");
+	printf("  -t  modelled cost of a register transaction (default %d ns)\n",
+	       DEFAULT_TXN_NS);
+	printf("  -w  modelled cost of a register word (default %d ns)\n", DEFAULT_WORD_NS);
+}
+
+
+void random_flow(nf2_of_entry_wrap *entry, nf2_of_action_wrap *action) {
+	int i;
+
+	for (i = 0; i < NF2_OF_ENTRY_WORD_LEN; i++)
+		entry->raw[i] = random() ^ (random() << 16);
+	entry->entry.pad = 0;
+
+	memset(action, 0, sizeof(*action));
+	action->action.forward_bitmask = 1 << (random() % NF2_PORT_NUM);
+}
+
+
+void random_rule(nf2_of_entry_wrap *entry, nf2_of_mask_wrap *mask,
+		 nf2_of_action_wrap *action, uint16_t *priority) {
+	int i;
+
+	random_flow(entry, action);
+	memset(mask, 0, sizeof(*mask));
+	mask->entry.ip_src = 0xffffffff >> (random() % 32);
+	mask->entry.transp_src = 0xffff;
+	mask->entry.pad = 0xff;
+	for (i = 0; i < NF2_OF_ENTRY_WORD_LEN; i++)
+		entry->raw[i] &= ~mask->raw[i];
+	*priority = 100 * (1 + random() % 4);
+}
+
+
+//
+// save_card: the header and action words of every exact entry
+//
+void save_card(struct nf2_regio *io) {
+	int i, w;
+
+	for (i = 0; i < OPENFLOW_NF2_EXACT_TABLE_SIZE; i++)
+		for (w = 0; w < EXACT_WORDS; w++)
+			before[i][w] = *nf2_regio_mock_reg(io, NF2_EXACT_ADDR(i, w));
+}
+
+
+//
+// flush: zero the exact table, as sram_arbiter does on table_flush and
+//    reset. The mock has no wildcard table to clear.
+//
+void flush(struct nf2_regio *io) {
+	int i, w;
+
+	for (i = 0; i < OPENFLOW_NF2_EXACT_TABLE_SIZE; i++)
+		for (w = 0; w < NF2_EXACT_ENTRY_WORDS; w++)
+			*nf2_regio_mock_reg(io, NF2_EXACT_ADDR(i, w)) = 0;
+}
+
+
+//
+// check_card: the restored entries against the saved ones, but for the
+//    counters, which start again from zero, and the words an
+//    invalidation leaves behind
+//
+int check_card(struct nf2_regio *io) {
+	int i, w, failures = 0;
+
+	for (i = 0; i < OPENFLOW_NF2_EXACT_TABLE_SIZE; i++) {
+		if (!(before[i][VALID_WORD] & NF2_EXACT_VALID_BIT)) {
+			if (*nf2_regio_mock_reg(io, NF2_EXACT_ADDR(i, VALID_WORD)) &
+			    NF2_EXACT_VALID_BIT)
+				failures++;
+			continue;
+		}
+		for (w = 0; w < EXACT_WORDS; w++) {
+			if (w == OPENFLOW_EXACT_ENTRY_COUNTERS_POS ||
+			    w == OPENFLOW_EXACT_ENTRY_COUNTERS_POS + 1)
+				continue;
+			if (*nf2_regio_mock_reg(io, NF2_EXACT_ADDR(i, w)) != before[i][w]) {
+				failures++;
+				break;
+			}
+		}
+	}
+	return failures;
+}
+
+
+//
+// check_load: shadows loaded from a fresh mapping of the image must
+//    hold what the tables that wrote it hold
+//
+int check_load(const char *path, struct nf2_exact_table *exact,
+	       struct nf2_wildcard_table *wildcard) {
+	struct nf2_tablesnap snap;
+	struct nf2_exact_table e;
+	struct nf2_wildcard_table w;
+	int i, failures = 0;
+
+	if (nf2_exact_table_init(&e, NULL, NF2_EXACT_DEFAULT_MAX_KICKS)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	nf2_wildcard_table_init(&w, NULL);
+	if (nf2_tablesnap_open(&snap, path))
+		exit(1);
+	if (nf2_tablesnap_load(&snap, &e, &w))
+		failures++;
+	nf2_tablesnap_close(&snap);
+
+	for (i = 0; i < exact->size; i++)
+		if (e.slots[i].used != exact->slots[i].used || (e.slots[i].used &&
+		    (memcmp(&e.slots[i].entry, &exact->slots[i].entry, sizeof(e.slots[i].entry)) ||
+		     memcmp(&e.slots[i].action, &exact->slots[i].action,
+			    sizeof(e.slots[i].action)) ||
+		     e.slots[i].hash[0] != exact->slots[i].hash[0] ||
+		     e.slots[i].hash[1] != exact->slots[i].hash[1])))
+			failures++;
+	for (i = 0; i < wildcard->size; i++)
+		if (w.rules[i].used != wildcard->rules[i].used ||
+		    (w.rules[i].used && w.rules[i].priority != wildcard->rules[i].priority))
+			failures++;
+	if (e.used != exact->used || w.used != wildcard->used)
+		failures++;
+
+	nf2_exact_table_free(&e);
+	return failures;
+}
+
+
+double ns_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
@@ -0,0 +1,339 @@
+/* ****************************************************************************
+ * Module: rlncbench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Checks the host random linear network coding and measures
+ *              what it costs per core.
+ *
+ *              The GF(2^8) product is checked against carry-less
+ *              multiplication for every pair, the kernels of every
+ *              method against the TABLE one, and random generations are
+ *              coded, sent through a lossy channel and decoded.
+ *
+ *              The sweep over generation size and packet length reports,
+ *              per method, encode and decode throughput in Gbps of source
+ *              data, and the coded packets a decoder needs per source
+ *              packet (linear dependence overhead).
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <time.h>
+
+#include "../common/nf2_rlnc.h"
+
+#define MAX_K		64
+#define MAX_LEN		9000
+#define CHECK_GENS	2000
+#define KERNEL_LEN	4096
+#define OVERHEAD_GENS	2000
+
+static const enum nf2_rlnc_method methods[] = {
+	NF2_RLNC_TABLE, NF2_RLNC_SSSE3, NF2_RLNC_AVX2
+};
+#define NUM_METHODS	(sizeof(methods) / sizeof(methods[0]))
+
+static const int sweep_k[] = { 2, 4, 8, 16, 32, 64 };
+static const int sweep_len[] = { 64, 512, 1500, 9000 };
+#define NUM_SWEEP_K	(sizeof(sweep_k) / sizeof(sweep_k[0]))
+#define NUM_SWEEP_LEN	(sizeof(sweep_len) / sizeof(sweep_len[0]))
+
+static uint8_t src[MAX_K][MAX_LEN];
+static uint32_t src_len[MAX_K];
+static uint8_t coded[2 * MAX_K][NF2_RLNC_HDR_LEN + MAX_K + MAX_LEN + 2];
+
+void usage (void);
+int check_gf (void);
+int check_kernels (void);
+int check_coding (int loss_pct);
+int run_generation (struct nf2_rlnc_enc *, struct nf2_rlnc_dec *, int k, uint32_t max_len,
+		    int loss_pct, int *sent);
+double overhead (int k);
+double now_ns (void);
+
+int main(int argc, char *argv[]) {
+	struct nf2_rlnc_enc enc;
+	struct nf2_rlnc_dec dec;
+	int gens = 0, check_only = 0;
+	int c, i, j, k, m, g, n, failures = 0;
+	double start, enc_ns, dec_ns, bits;
+
+	while ((c = getopt(argc, argv, "n:ch")) != -1) {
+		switch (c) {
+		case 'n':
+			gens = atoi(optarg);
+			break;
+		case 'c':
+			check_only = 1;
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	nf2_rlnc_init();
+	srandom(1);
+
+	i = check_gf();
+	printf("GF(2^8) product and inverse: %s\n", i ? "FAILED" : "ok");
+	failures += i;
+	for (m = 0; m < NUM_METHODS; m++) {
+		if (nf2_rlnc_set_method(methods[m])) {
+			printf("%-6s not supported on this CPU\n",
+			       nf2_rlnc_method_name(methods[m]));
+			continue;
+		}
+		i = check_kernels() + check_coding(0) + check_coding(30);
+		printf("%-6s kernels and %d generations: %s\n",
+		       nf2_rlnc_method_name(methods[m]), 2 * CHECK_GENS, i ? "FAILED" : "ok");
+		failures += i;
+	}
+	if (failures || check_only)
+		return failures != 0;
+
+	printf("\n%-6s %4s %6s %12s %12s %10s\n", "method", "k", "bytes", "encode Gbps",
+	       "decode Gbps", "pkts/src");
+	for (i = 0; i < NUM_SWEEP_K; i++) {
+		for (j = 0; j < NUM_SWEEP_LEN; j++) {
+			k = sweep_k[i];
+			/* about 64 MB of source data per point unless -n is given */
+			n = gens ? gens : 1 + (64 << 20) / (k * sweep_len[j]);
+			bits = 8.0 * k * sweep_len[j] * n;
+			for (g = 0; g < k; g++) {
+				src_len[g] = sweep_len[j];
+				for (c = 0; c < sweep_len[j]; c++)
+					src[g][c] = random();
+			}
+
+			for (m = 0; m < NUM_METHODS; m++) {
+				if (nf2_rlnc_set_method(methods[m]))
+					continue;
+				nf2_rlnc_enc_init(&enc, k, sweep_len[j], 1);
+				nf2_rlnc_dec_init(&dec, k, sweep_len[j]);
+
+				/* k coded packets per generation, as a lossless
+				 * link needs */
+				start = now_ns();
+				for (g = 0; g < n; g++) {
+					nf2_rlnc_enc_reset(&enc, g);
+					for (c = 0; c < k; c++)
+						nf2_rlnc_enc_add(&enc, src[c], src_len[c]);
+					for (c = 0; c < k; c++)
+						nf2_rlnc_encode(&enc, coded[c], sizeof(coded[c]));
+				}
+				enc_ns = now_ns() - start;
+
+				/* the coded packets of the last generation, with
+				 * more coded if they are not enough */
+				start = now_ns();
+				for (g = 0; g < n; g++) {
+					nf2_rlnc_dec_reset(&dec, n - 1);
+					for (c = 0; dec.rank < k; c++) {
+						if (c >= k)
+							nf2_rlnc_encode(&enc, coded[k],
+									sizeof(coded[k]));
+						nf2_rlnc_dec_add(&dec, coded[c < k ? c : k],
+								 nf2_rlnc_coded_len(k, sweep_len[j]));
+					}
+				}
+				dec_ns = now_ns() - start;
+				nf2_rlnc_enc_free(&enc);
+				nf2_rlnc_dec_free(&dec);
+
+				printf("%-6s %4d %6d %12.2f %12.2f %10.4f\n",
+				       nf2_rlnc_method_name(methods[m]), k, sweep_len[j],
+				       bits / enc_ns, bits / dec_ns,
+				       overhead(k));
+			}
+		}
+	}
+	return 0;
+}
+
+
+void usage(void) {
+	printf("Usage: rlncbench [-n generations] [-c]\n");
+	printf("  -n  generations to time per point (default: about 64 MB of data)\n");
+	printf("  -c  only run the checks\n");
+}
+
+
+static uint8_t clmul_mod(uint8_t a, uint8_t b) {
+	unsigned p = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		if (b & (1 << i))
+			p ^= a << i;
+	for (i = 15; i >= 8; i--)
+		if (p & (1 << i))
+			p ^= NF2_RLNC_GF_POLY << (i - 8);
+	return p;
+}
+
+
+int check_gf(void) {
+	int a, b, failures = 0;
+
+	for (a = 0; a < 256; a++) {
+		for (b = 0; b < 256; b++)
+			if (nf2_gf_mul(a, b) != clmul_mod(a, b))
+				failures++;
+		if (a && nf2_gf_mul(a, nf2_gf_inv(a)) != 1)
+			failures++;
+	}
+	return failures;
+}
+
+
+int check_kernels(void) {
+	static uint8_t x[KERNEL_LEN], y[KERNEL_LEN], want[KERNEL_LEN], got[KERNEL_LEN];
+	enum nf2_rlnc_method m = nf2_rlnc_get_method();
+	int i, j, n, off, c, failures = 0;
+
+	for (i = 0; i < 1000; i++) {
+		n = random() % (KERNEL_LEN - 32);
+		off = random() % 32;
+		c = random() % 256;
+		for (j = 0; j < KERNEL_LEN; j++) {
+			x[j] = random();
+			y[j] = random();
+		}
+
+		nf2_rlnc_set_method(NF2_RLNC_TABLE);
+		memcpy(want, y, sizeof(y));
+		nf2_gf_mul_add(want + off, x, c, n);
+		nf2_rlnc_set_method(m);
+		memcpy(got, y, sizeof(y));
+		nf2_gf_mul_add(got + off, x, c, n);
+		if (memcmp(want, got, sizeof(got)))
+			failures++;
+
+		nf2_rlnc_set_method(NF2_RLNC_TABLE);
+		memcpy(want, y, sizeof(y));
+		nf2_gf_scale(want + off, c, n);
+		nf2_rlnc_set_method(m);
+		memcpy(got, y, sizeof(y));
+		nf2_gf_scale(got + off, c, n);
+		if (memcmp(want, got, sizeof(got)))
+			failures++;
+	}
+	return failures;
+}
+
+
+/*
+ * Codes one generation of the packets in src and feeds the decoder
+ * through a channel losing loss_pct percent of the coded packets until
+ * it has rank k. Returns the failures.
+ */
+int run_generation(struct nf2_rlnc_enc *enc, struct nf2_rlnc_dec *dec, int k,
+		   uint32_t max_len, int loss_pct, int *sent) {
+	const uint8_t *data;
+	uint32_t len;
+	int i, r, failures = 0;
+
+	*sent = 0;
+	for (i = 0; i < k; i++) {
+		nf2_rlnc_enc_add(enc, src[i], src_len[i]);
+		/* code as the packets come in */
+		len = nf2_rlnc_encode(enc, coded[0], sizeof(coded[0]));
+		++*sent;
+		if (random() % 100 >= loss_pct)
+			nf2_rlnc_dec_add(dec, coded[0], len);
+	}
+	while (dec->rank < k && *sent < 100 * k) {
+		len = nf2_rlnc_encode(enc, coded[0], sizeof(coded[0]));
+		++*sent;
+		if (random() % 100 < loss_pct)
+			continue;
+		r = nf2_rlnc_dec_add(dec, coded[0], len);
+		if (r < 0)
+			failures++;
+	}
+	for (i = 0; i < k; i++) {
+		if (nf2_rlnc_dec_packet(dec, i, &data, &len) || len != src_len[i] ||
+		    memcmp(data, src[i], len))
+			failures++;
+	}
+	return failures;
+}
+
+
+int check_coding(int loss_pct) {
+	struct nf2_rlnc_enc enc;
+	struct nf2_rlnc_dec dec;
+	int g, i, j, k, sent, failures = 0;
+	uint32_t max_len;
+
+	for (g = 0; g < CHECK_GENS; g++) {
+		k = 1 + random() % MAX_K;
+		max_len = random() % 1600;
+		for (i = 0; i < k; i++) {
+			src_len[i] = random() % (max_len + 1);
+			for (j = 0; j < src_len[i]; j++)
+				src[i][j] = random();
+		}
+		if (nf2_rlnc_enc_init(&enc, k, max_len, g + 1) ||
+		    nf2_rlnc_dec_init(&dec, k, max_len))
+			return 1;
+		nf2_rlnc_enc_reset(&enc, g);
+		nf2_rlnc_dec_reset(&dec, g);
+		failures += run_generation(&enc, &dec, k, max_len, loss_pct, &sent);
+
+		/* another generation is not mixed in */
+		nf2_rlnc_enc_reset(&enc, g + 1);
+		nf2_rlnc_enc_add(&enc, src[0], src_len[0]);
+		if (nf2_rlnc_dec_add(&dec, coded[0],
+				     nf2_rlnc_encode(&enc, coded[0], sizeof(coded[0]))) != -1)
+			failures++;
+
+		nf2_rlnc_enc_free(&enc);
+		nf2_rlnc_dec_free(&dec);
+	}
+	return failures;
+}
+
+
+/*
+ * Coded packets a decoder needs per source packet, over fresh random
+ * generations. It only depends on the coefficients, so the symbols are
+ * empty.
+ */
+double overhead(int k) {
+	struct nf2_rlnc_enc enc;
+	struct nf2_rlnc_dec dec;
+	int g, c, sent = 0;
+
+	nf2_rlnc_enc_init(&enc, k, 0, k);
+	nf2_rlnc_dec_init(&dec, k, 0);
+	for (g = 0; g < OVERHEAD_GENS; g++) {
+		nf2_rlnc_enc_reset(&enc, g);
+		nf2_rlnc_dec_reset(&dec, g);
+		for (c = 0; c < k; c++)
+			nf2_rlnc_enc_add(&enc, src[c], 0);
+		while (dec.rank < k) {
+			nf2_rlnc_dec_add(&dec, coded[0],
+					 nf2_rlnc_encode(&enc, coded[0], sizeof(coded[0])));
+			sent++;
+		}
+	}
+	nf2_rlnc_enc_free(&enc);
+	nf2_rlnc_dec_free(&dec);
+	return (double)sent / ((double)OVERHEAD_GENS * k);
+}
+
+
+double now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
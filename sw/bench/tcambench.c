@@ -0,0 +1,223 @@
+/* ****************************************************************************
+ * Module: tcambench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Register writes per flow-mod for the wildcard table.
+ *
+ *              Runs a churn of random inserts and deletes against the
+ *              priority manager (common/nf2_wildcard_table.c) on the mock
+ *              register file, and against a table kept compact and sorted,
+ *              where an insert or delete rewrites every entry after it.
+ *              The manager's table is checked for priority order and
+ *              content after every flow-mod.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/nf2_wildcard_table.h"
+
+#define DEFAULT_OPS		100000
+#define DEFAULT_LEVELS		8
+#define DEFAULT_TARGET		24
+
+struct rule {
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;
+	uint16_t priority;
+};
+
+static struct rule active[OPENFLOW_WILDCARD_TABLE_SIZE];
+static int num_active;
+
+/* compact, sorted reference: priorities only */
+static uint16_t compact[OPENFLOW_WILDCARD_TABLE_SIZE];
+
+void usage (void);
+void random_rule (struct rule *, int levels);
+int compact_insert (uint16_t);
+int compact_delete (uint16_t);
+int check (struct nf2_wildcard_table *);
+
+int main(int argc, char *argv[]) {
+	struct nf2_wildcard_table tbl;
+	struct nf2_regio io;
+	nf2_of_action_wrap action;
+	int ops = DEFAULT_OPS, levels = DEFAULT_LEVELS, target = DEFAULT_TARGET;
+	unsigned long compact_writes = 0, flow_mods = 0;
+	int c, i, k, failures = 0;
+
+	while ((c = getopt(argc, argv, "n:l:u:h")) != -1) {
+		switch (c) {
+		case 'n':
+			ops = atoi(optarg);
+			break;
+		case 'l':
+			levels = atoi(optarg);
+			break;
+		case 'u':
+			target = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (ops <= 0 || levels <= 0 || target <= 0 || target > OPENFLOW_WILDCARD_TABLE_SIZE) {
+		usage();
+		exit(1);
+	}
+
+	if (nf2_regio_open_mock(&io, 0, 0)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	nf2_wildcard_table_init(&tbl, &io);
+	srandom(1);
+	memset(&action, 0, sizeof(action));
+
+	for (i = 0; i < ops; i++) {
+		/* hover around the target occupancy */
+		int insert = num_active == 0 || num_active < target - 2 ||
+			     (num_active < OPENFLOW_WILDCARD_TABLE_SIZE &&
+			      num_active <= target + 2 && (random() & 1));
+
+		if (insert) {
+			struct rule *r = &active[num_active];
+
+			random_rule(r, levels);
+			action.action.forward_bitmask = random() & 0xff;
+			if (nf2_wildcard_insert(&tbl, &r->entry, &r->mask, &action,
+						r->priority) < 0) {
+				printf("insert %d failed\n", i);
+				failures++;
+				break;
+			}
+			compact_writes += compact_insert(r->priority);
+			num_active++;
+		}
+		else {
+			k = random() % num_active;
+			if (nf2_wildcard_delete(&tbl, &active[k].entry, &active[k].mask,
+						active[k].priority) < 0) {
+				printf("delete %d failed\n", i);
+				failures++;
+				break;
+			}
+			compact_writes += compact_delete(active[k].priority);
+			active[k] = active[--num_active];
+		}
+		flow_mods++;
+
+		if (check(&tbl)) {
+			printf("table check failed after flow-mod %d\n", i);
+			failures++;
+			break;
+		}
+	}
+
+	printf("%lu flow-mods, %d priority levels, ~%d rules in use\n\n",
+	       flow_mods, levels, target);
+	nf2_wildcard_print_stats(&tbl, stdout);
+	printf("\n%-20s %14s %14s\n", "", "entries/mod", "registers/mod");
+	printf("%-20s %14.2f %14.2f\n", "compact rewrite",
+	       (double)compact_writes / flow_mods,
+	       (double)compact_writes * NF2_WILDCARD_ENTRY_REGS / flow_mods);
+	printf("%-20s %14.2f %14.2f\n", "priority manager",
+	       (double)tbl.stats.hw_writes / flow_mods,
+	       (double)io.num_words / flow_mods);
+	printf("\norder and content checks: %s\n", failures ? "FAILED" : "ok");
+
+	nf2_regio_close(&io);
+	return failures != 0;
+}
+
+
+void usage(void) {
+	printf("Usage: tcambench [-n flow_mods] [-l priority_levels] [-u rules_in_use]\n");
+	printf("  -n  flow-mods to run (default %d)\n", DEFAULT_OPS);
+	printf("  -l  distinct priorities (default %d)\n", DEFAULT_LEVELS);
+	printf("  -u  rules kept in the table (default %d of %d)\n", DEFAULT_TARGET,
+	       OPENFLOW_WILDCARD_TABLE_SIZE);
+}
+
+
+//
+// random_rule: a rule wildcarding a random subset of the fields, with
+//    the lower priorities more common (most rules are routes, few are
+//    ACL exceptions).
+//
+void random_rule(struct rule *r, int levels) {
+	struct nf2_of_entry *m = &r->mask.entry;
+	int i;
+
+	for (i = 0; i < NF2_OF_ENTRY_WORD_LEN; i++)
+		r->entry.raw[i] = random() ^ (random() << 16);
+	r->entry.entry.pad = 0;
+
+	memset(&r->mask, 0, sizeof(r->mask));
+	if (random() & 1) {
+		m->transp_dst = 0xffff;
+		m->transp_src = 0xffff;
+	}
+	if (random() & 1)
+		m->ip_src = 0xffffffff >> (random() % 32);
+	if (random() & 1)
+		m->ip_dst = 0xffffffff >> (random() % 32);
+	if (random() & 1) {
+		memset(m->eth_dst, 0xff, sizeof(m->eth_dst));
+		memset(m->eth_src, 0xff, sizeof(m->eth_src));
+	}
+	if (random() & 1)
+		m->vlan_id = 0xffff;
+	m->pad = 0xff;
+
+	i = random() % (levels * (levels + 1) / 2);
+	for (r->priority = 0; i >= levels - r->priority; r->priority++)
+		i -= levels - r->priority;
+	r->priority = (r->priority + 1) * 100;
+}
+
+
+//
+// compact_insert: entry writes of an insert that keeps the rules compact
+//    and sorted: the new rule and every rule after it.
+//
+int compact_insert(uint16_t priority) {
+	int pos, n = num_active;
+
+	for (pos = 0; pos < n && compact[pos] >= priority; pos++)
+		;
+	memmove(&compact[pos + 1], &compact[pos], (n - pos) * sizeof(compact[0]));
+	compact[pos] = priority;
+	return n - pos + 1;
+}
+
+
+int compact_delete(uint16_t priority) {
+	int pos, n = num_active;
+
+	for (pos = 0; compact[pos] != priority; pos++)
+		;
+	memmove(&compact[pos], &compact[pos + 1], (n - pos - 1) * sizeof(compact[0]));
+	/* every rule after it moves up, and the last entry is cleared */
+	return n - pos;
+}
+
+
+int check(struct nf2_wildcard_table *tbl) {
+	int i;
+
+	if (nf2_wildcard_check_order(tbl) || tbl->used != num_active)
+		return -1;
+	for (i = 0; i < num_active; i++)
+		if (nf2_wildcard_find(tbl, &active[i].entry, &active[i].mask,
+				      active[i].priority) < 0)
+			return -1;
+	return 0;
+}
@@ -0,0 +1,224 @@
+/* ****************************************************************************
+ * Module: xorbench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Checks the host XOR network coding and measures its
+ *              throughput per core.
+ *
+ *              Every method is checked against a byte by byte reference
+ *              on random pairs of any length and alignment, and coded
+ *              pairs are decoded with either packet, in place and not.
+ *              Encoding and decoding are then timed for a few packet
+ *              size mixes; Gbps counts the bits of the coded payload.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <time.h>
+
+#include "../common/nf2_xor.h"
+
+#define MAX_PKT		9018
+#define BUF_LEN		(MAX_PKT + 64)
+#define NUM_PAIRS	256
+#define CHECK_PAIRS	(64 * 1024)
+
+struct pair {
+	struct nf2_xor_pkt pkt[2];
+	uint8_t data[2][BUF_LEN];
+	uint8_t coded[BUF_LEN + NF2_XOR_HDR_LEN];
+	int coded_len;
+};
+
+static struct pair pairs[NUM_PAIRS];
+static uint8_t ref[BUF_LEN], out[BUF_LEN + NF2_XOR_HDR_LEN];
+
+static const enum nf2_xor_method methods[] = {
+	NF2_XOR_SCALAR, NF2_XOR_SSE2, NF2_XOR_AVX2
+};
+#define NUM_METHODS	(sizeof(methods) / sizeof(methods[0]))
+
+/* packet length mixes for the timing */
+static const struct {
+	const char *name;
+	int min, max;
+} mixes[] = {
+	{ "64",		64,	64 },
+	{ "512",	512,	512 },
+	{ "1500",	1500,	1500 },
+	{ "9000",	9000,	9000 },
+	{ "64-1518",	64,	1518 },
+};
+#define NUM_MIXES	(sizeof(mixes) / sizeof(mixes[0]))
+
+void usage (void);
+void random_pair (struct pair *, int min, int max, int misalign);
+int check (void);
+double now_ns (void);
+
+int main(int argc, char *argv[]) {
+	int iters = 2000, check_only = 0;
+	int c, i, j, k, m, failures = 0;
+	struct nf2_xor_pkt rec;
+	double start, enc_ns, dec_ns, bits;
+
+	while ((c = getopt(argc, argv, "n:ch")) != -1) {
+		switch (c) {
+		case 'n':
+			iters = atoi(optarg);
+			break;
+		case 'c':
+			check_only = 1;
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	srandom(1);
+	for (k = 0; k < NUM_METHODS; k++) {
+		if (nf2_xor_set_method(methods[k])) {
+			printf("%-8s not supported on this CPU\n",
+			       nf2_xor_method_name(methods[k]));
+			continue;
+		}
+		i = check();
+		printf("%-8s checks on %d random pairs: %s\n",
+		       nf2_xor_method_name(methods[k]), CHECK_PAIRS, i ? "FAILED" : "ok");
+		failures += i;
+	}
+	if (failures || check_only)
+		return failures != 0;
+
+	printf("\n%-8s %-8s %12s %12s\n", "method", "bytes", "encode Gbps", "decode Gbps");
+	for (m = 0; m < NUM_MIXES; m++) {
+		bits = 0;
+		for (j = 0; j < NUM_PAIRS; j++) {
+			random_pair(&pairs[j], mixes[m].min, mixes[m].max, 0);
+			pairs[j].coded_len = nf2_xor_encode(&pairs[j].pkt[0], &pairs[j].pkt[1],
+							    pairs[j].coded,
+							    sizeof(pairs[j].coded));
+			bits += 8.0 * (pairs[j].coded_len - NF2_XOR_HDR_LEN);
+		}
+		for (k = 0; k < NUM_METHODS; k++) {
+			if (nf2_xor_set_method(methods[k]))
+				continue;
+			start = now_ns();
+			for (i = 0; i < iters; i++)
+				for (j = 0; j < NUM_PAIRS; j++)
+					nf2_xor_encode(&pairs[j].pkt[0], &pairs[j].pkt[1],
+						       out, sizeof(out));
+			enc_ns = now_ns() - start;
+
+			start = now_ns();
+			for (i = 0; i < iters; i++)
+				for (j = 0; j < NUM_PAIRS; j++)
+					nf2_xor_decode(pairs[j].coded, pairs[j].coded_len,
+						       &pairs[j].pkt[j & 1], out,
+						       sizeof(out), &rec);
+			dec_ns = now_ns() - start;
+
+			printf("%-8s %-8s %12.2f %12.2f\n", nf2_xor_method_name(methods[k]),
+			       mixes[m].name, bits * iters / enc_ns, bits * iters / dec_ns);
+		}
+	}
+	return 0;
+}
+
+
+void usage(void) {
+	printf("Usage: xorbench [-n rounds] [-c]\n");
+	printf("  -n  rounds of %d pairs to time per size mix (default 2000)\n",
+	       NUM_PAIRS);
+	printf("  -c  only run the checks\n");
+}
+
+
+void random_pair(struct pair *p, int min, int max, int misalign) {
+	int k, off, i;
+
+	for (k = 0; k < 2; k++) {
+		off = misalign ? random() % 32 : 0;
+		p->pkt[k].len = min + random() % (max - min + 1);
+		p->pkt[k].data = p->data[k] + off;
+		p->pkt[k].id = random();
+		p->pkt[k].port = k * 2;
+		for (i = 0; i < p->pkt[k].len; i++)
+			p->data[k][off + i] = random();
+	}
+}
+
+
+static int check_pad(const uint8_t *got, const uint8_t *a, int len_a, const uint8_t *b,
+		     int len_b, int n) {
+	int i;
+
+	for (i = 0; i < n; i++)
+		ref[i] = (i < len_a ? a[i] : 0) ^ (i < len_b ? b[i] : 0);
+	return memcmp(got, ref, n) != 0;
+}
+
+
+int check(void) {
+	static struct pair p;
+	struct nf2_xor_pkt rec;
+	uint8_t *coded;
+	int i, k, len, failures = 0;
+
+	for (i = 0; i < CHECK_PAIRS; i++) {
+		/* mostly short and unaligned, now and then jumbo */
+		random_pair(&p, 0, i % 64 ? 300 : MAX_PKT, 1);
+		coded = p.coded + random() % 8;
+		len = nf2_xor_encode(&p.pkt[0], &p.pkt[1], coded,
+				     sizeof(p.coded) - 8);
+		if (len != nf2_xor_coded_len(p.pkt[0].len, p.pkt[1].len) ||
+		    check_pad(coded + NF2_XOR_HDR_LEN, p.pkt[0].data, p.pkt[0].len,
+			      p.pkt[1].data, p.pkt[1].len, len - NF2_XOR_HDR_LEN)) {
+			printf("pair %d: bad coded packet\n", i);
+			failures++;
+			continue;
+		}
+
+		for (k = 0; k < 2; k++) {
+			if (nf2_xor_decode(coded, len, &p.pkt[k], out, sizeof(out), &rec) ||
+			    rec.len != p.pkt[!k].len || rec.id != p.pkt[!k].id ||
+			    rec.port != p.pkt[!k].port ||
+			    memcmp(rec.data, p.pkt[!k].data, rec.len)) {
+				printf("pair %d: packet %d not recovered\n", i, !k);
+				failures++;
+			}
+		}
+
+		/* in place, into the coded packet */
+		if (nf2_xor_decode(coded, len, &p.pkt[1], coded, len, &rec) ||
+		    memcmp(rec.data, p.pkt[0].data, rec.len)) {
+			printf("pair %d: in place decode failed\n", i);
+			failures++;
+		}
+	}
+
+	/* a packet that is not in the pair */
+	random_pair(&p, 64, 64, 0);
+	len = nf2_xor_encode(&p.pkt[0], &p.pkt[1], p.coded, sizeof(p.coded));
+	p.pkt[0].id++;
+	if (nf2_xor_decode(p.coded, len, &p.pkt[0], out, sizeof(out), &rec) == 0) {
+		printf("decoded with a packet not in the pair\n");
+		failures++;
+	}
+	return failures;
+}
+
+
+double now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
@@ -0,0 +1,731 @@
+/* ****************************************************************************
+ * Module: nf2_aclmin.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Wildcard rule-set minimizer: compiles a prioritized list
+ *              of wildcard rules into an equivalent image of at most
+ *              OPENFLOW_WILDCARD_TABLE_SIZE entries.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "nf2_aclmin.h"
+
+#define W		NF2_OF_ENTRY_WORD_LEN
+#define LAST_WORD_BITS	0x00ffffff	/* of the last header word, the key's */
+#define WITNESSES	8		/* random keys tried before cutting pieces */
+
+/* a set of keys: those with the care bits equal to value */
+struct cube {
+	uint32_t care[W];
+	uint32_t value[W];
+};
+
+/* a rule of the list being compiled */
+struct item {
+	struct cube c;
+	int action;			/* number of its distinct action */
+	int rule;			/* the rule at its place */
+	int alive;
+	int first, last;		/* its rules, linked through link[] */
+	int n;
+};
+
+struct compile {
+	struct nf2_aclmin *a;
+	struct item *items;
+	int n;
+	int *link;
+	struct cube *pieces[2];
+	uint32_t rand;
+};
+
+
+void nf2_aclmin_init(struct nf2_aclmin *a) {
+	memset(a, 0, sizeof(*a));
+	memset(&a->merge_bits, 0xff, sizeof(a->merge_bits));
+	a->size = OPENFLOW_WILDCARD_TABLE_SIZE;
+}
+
+
+void nf2_aclmin_free(struct nf2_aclmin *a) {
+	free(a->rules);
+	free(a->out);
+	free(a->origin);
+	a->rules = NULL;
+	a->out = NULL;
+	a->origin = NULL;
+	a->num_rules = a->max_rules = a->num_out = 0;
+}
+
+
+int nf2_aclmin_add(struct nf2_aclmin *a, const nf2_of_entry_wrap *entry,
+		   const nf2_of_mask_wrap *mask, const nf2_of_action_wrap *action,
+		   uint16_t priority, int id) {
+	struct nf2_aclmin_rule *r;
+	int w;
+
+	if (a->num_rules == a->max_rules) {
+		r = realloc(a->rules, (a->max_rules ? 2 * a->max_rules : 64) * sizeof(*r));
+		if (r == NULL)
+			return -1;
+		a->rules = r;
+		a->max_rules = a->max_rules ? 2 * a->max_rules : 64;
+	}
+	r = &a->rules[a->num_rules++];
+	r->mask = *mask;
+	for (w = 0; w < W; w++)
+		r->entry.raw[w] = entry->raw[w] & ~mask->raw[w];
+	r->action = *action;
+	r->priority = priority;
+	r->id = id;
+	r->seq = a->seq++;
+	return 0;
+}
+
+
+int nf2_aclmin_delete(struct nf2_aclmin *a, int id) {
+	int i, n = 0;
+
+	/* the order of rules[] does not matter, seq keeps the ties */
+	for (i = 0; i < a->num_rules; ) {
+		if (a->rules[i].id == id) {
+			a->rules[i] = a->rules[--a->num_rules];
+			n++;
+		}
+		else
+			i++;
+	}
+	return n;
+}
+
+
+static void rule_cube(const nf2_of_entry_wrap *entry, const nf2_of_mask_wrap *mask,
+		      struct cube *c) {
+	int w;
+
+	for (w = 0; w < W; w++) {
+		c->care[w] = ~mask->raw[w];
+		c->value[w] = entry->raw[w] & c->care[w];
+	}
+	c->care[W - 1] &= LAST_WORD_BITS;
+	c->value[W - 1] &= LAST_WORD_BITS;
+}
+
+
+static inline int overlap(const struct cube *x, const struct cube *y) {
+	uint32_t diff = 0;
+	int w;
+
+	for (w = 0; w < W; w++)
+		diff |= (x->value[w] ^ y->value[w]) & x->care[w] & y->care[w];
+	return diff == 0;
+}
+
+
+/* x holds every key of y */
+static inline int covers(const struct cube *x, const struct cube *y) {
+	uint32_t diff = 0;
+	int w;
+
+	for (w = 0; w < W; w++)
+		diff |= (x->care[w] & ~y->care[w]) | ((y->value[w] & x->care[w]) ^ x->value[w]);
+	return diff == 0;
+}
+
+
+static inline int match(const struct cube *c, const nf2_of_entry_wrap *key) {
+	uint32_t diff = 0;
+	int w;
+
+	for (w = 0; w < W; w++)
+		diff |= (key->raw[w] & c->care[w]) ^ c->value[w];
+	return diff == 0;
+}
+
+
+static int rule_before(const struct nf2_aclmin_rule *x, const struct nf2_aclmin_rule *y) {
+	return x->priority != y->priority ? x->priority > y->priority : x->seq < y->seq;
+}
+
+
+static const struct nf2_aclmin_rule *sort_rules;
+
+static int cmp_rules(const void *x, const void *y) {
+	const struct nf2_aclmin_rule *rx = &sort_rules[*(const int *)x];
+	const struct nf2_aclmin_rule *ry = &sort_rules[*(const int *)y];
+
+	return rule_before(rx, ry) ? -1 : rule_before(ry, rx);
+}
+
+
+static uint32_t next_rand(uint32_t *s) {
+	/* xorshift32 */
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+	return *s;
+}
+
+
+//
+// shadowed: whether the live items above j match every key of j. A few
+//    random keys of j that none of them matches settle most rules that
+//    are not. Otherwise the keys of j left by the items checked so far
+//    are kept as disjoint pieces; an item cuts each piece it overlaps
+//    into the pieces outside it, one per bit it cares about and the
+//    piece does not.
+//
+static int shadowed(struct compile *cp, int j) {
+	struct item *items = cp->items;
+	struct cube *from = cp->pieces[0], *to = cp->pieces[1], *tmp, x, y;
+	nf2_of_entry_wrap key;
+	uint32_t bits, b;
+	int i, k, w, n = 1, m;
+
+	for (k = 0; k < WITNESSES; k++) {
+		for (w = 0; w < W; w++)
+			key.raw[w] = (next_rand(&cp->rand) & ~items[j].c.care[w]) |
+				     items[j].c.value[w];
+		for (i = 0; i < j; i++)
+			if (items[i].alive && match(&items[i].c, &key))
+				break;
+		if (i == j)
+			return 0;
+	}
+
+	from[0] = items[j].c;
+	for (i = 0; i < j; i++) {
+		if (!items[i].alive || !overlap(&items[i].c, &items[j].c))
+			continue;
+		m = 0;
+		for (k = 0; k < n; k++) {
+			x = from[k];
+			if (!overlap(&items[i].c, &x)) {
+				to[m++] = x;
+				continue;
+			}
+			for (w = 0; w < W; w++) {
+				for (bits = items[i].c.care[w] & ~x.care[w]; bits; bits &= bits - 1) {
+					if (m + n - k > NF2_ACLMIN_MAX_PIECES) {
+						cp->a->stats.giveups++;
+						return 0;
+					}
+					b = bits & -bits;
+					y = x;
+					y.care[w] |= b;
+					y.value[w] |= ~items[i].c.value[w] & b;
+					to[m++] = y;
+					x.care[w] |= b;
+					x.value[w] |= items[i].c.value[w] & b;
+				}
+			}
+			/* what is left of x is inside item i */
+		}
+		if (m == 0)
+			return 1;
+		tmp = from;
+		from = to;
+		to = tmp;
+		n = m;
+	}
+	return 0;
+}
+
+
+//
+// clear_between: no live item strictly between lo and hi with an action
+//    other than action overlaps c
+//
+static int clear_between(struct compile *cp, int lo, int hi, int action,
+			 const struct cube *c) {
+	int m;
+
+	for (m = lo + 1; m < hi; m++)
+		if (cp->items[m].alive && cp->items[m].action != action &&
+		    overlap(&cp->items[m].c, c))
+			return 0;
+	return 1;
+}
+
+
+/* moves the rules of item from to item to */
+static void join(struct compile *cp, int to, int from) {
+	struct item *t = &cp->items[to], *f = &cp->items[from];
+
+	cp->link[t->last] = f->first;
+	t->last = f->last;
+	t->n += f->n;
+	f->alive = 0;
+}
+
+
+static int shadow_pass(struct compile *cp) {
+	int j, changed = 0;
+
+	for (j = 1; j < cp->n; j++) {
+		if (cp->items[j].alive && shadowed(cp, j)) {
+			cp->items[j].alive = 0;
+			cp->a->stats.shadowed += cp->items[j].n;
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+
+static int absorb_pass(struct compile *cp) {
+	struct item *items = cp->items;
+	int i, j, changed = 0;
+
+	for (i = 0; i < cp->n; i++) {
+		if (!items[i].alive)
+			continue;
+		for (j = i + 1; j < cp->n; j++) {
+			if (!items[j].alive || items[j].action != items[i].action ||
+			    !covers(&items[j].c, &items[i].c))
+				continue;
+			if (clear_between(cp, i, j, items[i].action, &items[i].c)) {
+				cp->a->stats.absorbed += items[i].n;
+				join(cp, j, i);
+				changed = 1;
+			}
+			break;
+		}
+	}
+	return changed;
+}
+
+
+//
+// one_bit: the bit of merge_bits in which x and y, with the same care
+//    bits, differ, if they differ in only one
+//
+static int one_bit(struct compile *cp, const struct cube *x, const struct cube *y,
+		   int *word, uint32_t *bit) {
+	uint32_t diff;
+	int w, found = 0;
+
+	for (w = 0; w < W; w++) {
+		if (x->care[w] != y->care[w])
+			return 0;
+		if ((diff = x->value[w] ^ y->value[w]) == 0)
+			continue;
+		if (found || (diff & (diff - 1)) || (diff & cp->a->merge_bits.raw[w]) == 0)
+			return 0;
+		found = 1;
+		*word = w;
+		*bit = diff;
+	}
+	return found;
+}
+
+
+static int merge_pass(struct compile *cp) {
+	struct item *items = cp->items;
+	uint32_t bit;
+	int i, j, w, changed = 0;
+
+	for (i = 0; i < cp->n; i++) {
+		for (j = i + 1; items[i].alive && j < cp->n; j++) {
+			if (!items[j].alive || items[j].action != items[i].action ||
+			    !one_bit(cp, &items[i].c, &items[j].c, &w, &bit))
+				continue;
+			/* keys of j decided at i, or keys of i decided at j */
+			if (clear_between(cp, i, j, items[i].action, &items[j].c)) {
+				join(cp, i, j);
+				items[i].c.care[w] &= ~bit;
+				items[i].c.value[w] &= ~bit;
+			}
+			else if (clear_between(cp, i, j, items[i].action, &items[i].c)) {
+				join(cp, j, i);
+				items[j].c.care[w] &= ~bit;
+				items[j].c.value[w] &= ~bit;
+			}
+			else
+				continue;
+			cp->a->stats.merged++;
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+
+//
+// number_actions: numbers the distinct actions of the items
+//
+static int number_actions(struct compile *cp, int *order) {
+	const struct nf2_aclmin_rule *rules = cp->a->rules;
+	int *first, num = 0, i, k;
+
+	if ((first = malloc(cp->n * sizeof(*first))) == NULL)
+		return -1;
+	for (i = 0; i < cp->n; i++) {
+		for (k = 0; k < num; k++)
+			if (!memcmp(&rules[first[k]].action, &rules[order[i]].action,
+				    sizeof(nf2_of_action_wrap)))
+				break;
+		if (k == num)
+			first[num++] = order[i];
+		cp->items[i].action = k;
+	}
+	free(first);
+	return 0;
+}
+
+
+int nf2_aclmin_compile(struct nf2_aclmin *a) {
+	struct compile cp;
+	struct nf2_aclmin_entry *out, *e;
+	struct nf2_aclmin_rule *r;
+	int *order = NULL, *origin = NULL;
+	int i, k, w, changed, ret = -1;
+
+	memset(&cp, 0, sizeof(cp));
+	cp.a = a;
+	cp.rand = 1;
+	cp.n = a->num_rules;
+	memset(&a->stats, 0, offsetof(struct nf2_aclmin_stats, compiles));
+	a->stats.rules = a->num_rules;
+	a->stats.compiles++;
+
+	order = malloc((cp.n + 1) * sizeof(*order));
+	origin = malloc((cp.n + 1) * sizeof(*origin));
+	cp.items = malloc((cp.n + 1) * sizeof(*cp.items));
+	cp.link = malloc((cp.n + 1) * sizeof(*cp.link));
+	cp.pieces[0] = malloc(NF2_ACLMIN_MAX_PIECES * sizeof(struct cube));
+	cp.pieces[1] = malloc(NF2_ACLMIN_MAX_PIECES * sizeof(struct cube));
+	out = malloc((cp.n + 1) * sizeof(*out));
+	if (order == NULL || origin == NULL || cp.items == NULL || cp.link == NULL ||
+	    cp.pieces[0] == NULL || cp.pieces[1] == NULL || out == NULL)
+		goto done;
+
+	for (i = 0; i < cp.n; i++)
+		order[i] = i;
+	sort_rules = a->rules;
+	qsort(order, cp.n, sizeof(*order), cmp_rules);
+	for (i = 0; i < cp.n; i++) {
+		r = &a->rules[order[i]];
+		rule_cube(&r->entry, &r->mask, &cp.items[i].c);
+		cp.items[i].rule = order[i];
+		cp.items[i].alive = 1;
+		cp.items[i].first = cp.items[i].last = order[i];
+		cp.items[i].n = 1;
+		cp.link[order[i]] = -1;
+	}
+	if (number_actions(&cp, order))
+		goto done;
+
+	do {
+		changed = shadow_pass(&cp);
+		changed |= absorb_pass(&cp);
+		changed |= merge_pass(&cp);
+	} while (changed);
+
+	for (i = 0; i < cp.n; i++)
+		origin[i] = -1;
+	a->num_out = 0;
+	for (i = 0; i < cp.n; i++) {
+		if (!cp.items[i].alive)
+			continue;
+		e = &out[a->num_out];
+		r = &a->rules[cp.items[i].rule];
+		for (w = 0; w < W; w++) {
+			/* the bits outside the key as the rule had them */
+			e->mask.raw[w] = ~cp.items[i].c.care[w];
+			e->entry.raw[w] = cp.items[i].c.value[w];
+		}
+		e->mask.raw[W - 1] = (e->mask.raw[W - 1] & LAST_WORD_BITS) |
+				     (r->mask.raw[W - 1] & ~LAST_WORD_BITS);
+		e->entry.raw[W - 1] |= r->entry.raw[W - 1] & ~LAST_WORD_BITS;
+		e->action = r->action;
+		e->priority = r->priority;
+		e->num_rules = cp.items[i].n;
+		for (k = cp.items[i].first; k >= 0; k = cp.link[k])
+			origin[k] = a->num_out;
+		a->num_out++;
+	}
+	a->stats.entries = a->num_out;
+	a->stats.spilled = a->num_out > a->size ? a->num_out - a->size : 0;
+
+	free(a->out);
+	free(a->origin);
+	a->out = out;
+	a->origin = origin;
+	out = NULL;
+	origin = NULL;
+	ret = a->num_out;
+
+done:
+	free(order);
+	free(origin);
+	free(out);
+	free(cp.items);
+	free(cp.link);
+	free(cp.pieces[0]);
+	free(cp.pieces[1]);
+	return ret;
+}
+
+
+enum nf2_aclmin_fate nf2_aclmin_fate(const struct nf2_aclmin *a, int i, int *entry) {
+	*entry = a->origin[i];
+	if (*entry < 0)
+		return NF2_ACLMIN_SHADOWED;
+	return *entry < a->size ? NF2_ACLMIN_IMAGE : NF2_ACLMIN_SPILLED;
+}
+
+
+int nf2_aclmin_match_rules(const struct nf2_aclmin *a, const nf2_of_entry_wrap *key) {
+	struct cube c;
+	int i, best = -1;
+
+	for (i = 0; i < a->num_rules; i++) {
+		if (best >= 0 && !rule_before(&a->rules[i], &a->rules[best]))
+			continue;
+		rule_cube(&a->rules[i].entry, &a->rules[i].mask, &c);
+		if (match(&c, key))
+			best = i;
+	}
+	return best;
+}
+
+
+int nf2_aclmin_match_compiled(const struct nf2_aclmin *a, const nf2_of_entry_wrap *key) {
+	struct cube c;
+	int i;
+
+	for (i = 0; i < a->num_out; i++) {
+		rule_cube(&a->out[i].entry, &a->out[i].mask, &c);
+		if (match(&c, key))
+			return i;
+	}
+	return -1;
+}
+
+
+//
+// random_key: a key in a random rule, a key next to one or any key
+//
+static void random_key(const struct nf2_aclmin *a, uint32_t *s, nf2_of_entry_wrap *key) {
+	const struct nf2_aclmin_rule *r;
+	struct cube c;
+	uint32_t kind = next_rand(s) % 8, bits;
+	int w, b;
+
+	for (w = 0; w < W; w++)
+		key->raw[w] = next_rand(s);
+	key->raw[W - 1] &= LAST_WORD_BITS;
+	if (kind == 0 || a->num_rules == 0)
+		return;
+
+	r = &a->rules[next_rand(s) % a->num_rules];
+	rule_cube(&r->entry, &r->mask, &c);
+	for (w = 0; w < W; w++)
+		key->raw[w] = (key->raw[w] & ~c.care[w]) | c.value[w];
+	if (kind > 2)
+		return;
+
+	/* flip a bit the rule cares about */
+	for (b = 0, w = 0; w < W; w++)
+		b += __builtin_popcount(c.care[w]);
+	if (b == 0)
+		return;
+	b = next_rand(s) % b;
+	for (w = 0; w < W; w++) {
+		bits = c.care[w];
+		if (b >= __builtin_popcount(bits)) {
+			b -= __builtin_popcount(bits);
+			continue;
+		}
+		for (; b > 0; b--)
+			bits &= bits - 1;
+		key->raw[w] ^= bits & -bits;
+		return;
+	}
+}
+
+
+static void print_key(FILE *err, const nf2_of_entry_wrap *key) {
+	int w;
+
+	for (w = 0; w < W; w++)
+		fprintf(err, "%s%08x", w ? " " : "", key->raw[w]);
+}
+
+
+int nf2_aclmin_check(const struct nf2_aclmin *a, int trials, unsigned seed, FILE *err) {
+	nf2_of_entry_wrap key;
+	uint32_t s = seed ? seed : 1;
+	int t, r, e, entry, bad, failures = 0;
+
+	for (t = 0; t < trials; t++) {
+		random_key(a, &s, &key);
+		r = nf2_aclmin_match_rules(a, &key);
+		e = nf2_aclmin_match_compiled(a, &key);
+		if (r < 0 || e < 0)
+			bad = (r < 0) != (e < 0);
+		else
+			bad = memcmp(&a->rules[r].action, &a->out[e].action,
+				     sizeof(nf2_of_action_wrap)) != 0;
+		/* the entry that decides a key stands for the rule that did, so
+		 * a key missing the image belongs to a spilled rule */
+		if (!bad && r >= 0 && a->origin[r] != e)
+			bad = 1;
+		if (!bad && e >= a->size)
+			bad = nf2_aclmin_fate(a, r, &entry) != NF2_ACLMIN_SPILLED;
+		if (!bad)
+			continue;
+		if (failures++ < 10 && err != NULL) {
+			fprintf(err, "key ");
+			print_key(err, &key);
+			fprintf(err, ": rule %d (id %d), compiled entry %d\n", r,
+				r >= 0 ? a->rules[r].id : -1, e);
+		}
+	}
+	return failures;
+}
+
+
+static int same_entry(const struct nf2_aclmin_entry *x, const struct nf2_aclmin_entry *y) {
+	return !memcmp(&x->entry, &y->entry, sizeof(x->entry)) &&
+	       !memcmp(&x->mask, &y->mask, sizeof(x->mask)) &&
+	       !memcmp(&x->action, &y->action, sizeof(x->action));
+}
+
+
+//
+// moved_to: the index at which the new image has the entry the card holds
+//    at i, if it has still to be written there, or -1
+//
+static int moved_to(const struct nf2_aclmin *a, struct nf2_aclmin_entry **want,
+		    const uint8_t *pending, int size, int i) {
+	int t;
+
+	if (!a->hw_known || !a->hw_used[i])
+		return -1;
+	for (t = 0; t < size; t++)
+		if (t != i && pending[t] && want[t] != NULL && same_entry(&a->hw[i], want[t]))
+			return t;
+	return -1;
+}
+
+
+//
+// safe_gap: whether the card may go without the entry it holds at i while
+//    the others are written: no entry below it, of either image, overlaps
+//    it with another action, so its packets miss (and go to the
+//    controller) or get its action
+//
+static int safe_gap(const struct nf2_aclmin *a, struct nf2_aclmin_entry **want, int size,
+		    int i) {
+	const struct nf2_aclmin_entry *x = &a->hw[i], *y;
+	struct cube c, d;
+	int j, k;
+
+	rule_cube(&x->entry, &x->mask, &c);
+	for (j = i + 1; j < size; j++) {
+		for (k = 0; k < 2; k++) {
+			y = k ? want[j] : a->hw_used[j] ? &a->hw[j] : NULL;
+			if (y == NULL || !memcmp(&x->action, &y->action, sizeof(x->action)))
+				continue;
+			rule_cube(&y->entry, &y->mask, &d);
+			if (overlap(&c, &d))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+
+int nf2_aclmin_write(struct nf2_aclmin *a, struct nf2_regio *io,
+		     struct nf2_of_wildcard_stage *stage) {
+	struct nf2_aclmin_entry *want[OPENFLOW_WILDCARD_TABLE_SIZE], *e;
+	uint8_t pending[OPENFLOW_WILDCARD_TABLE_SIZE];
+	int dst[OPENFLOW_WILDCARD_TABLE_SIZE];
+	uint64_t carry_pkts[OPENFLOW_WILDCARD_TABLE_SIZE];
+	uint64_t carry_bytes[OPENFLOW_WILDCARD_TABLE_SIZE];
+	uint32_t pkts, bytes;
+	int size = a->size < OPENFLOW_WILDCARD_TABLE_SIZE ? a->size : OPENFLOW_WILDCARD_TABLE_SIZE;
+	int i, k, left = 0, n = 0;
+
+	for (i = 0; i < size; i++) {
+		e = want[i] = i < a->num_out ? &a->out[i] : NULL;
+		pending[i] = !a->hw_known ||
+			     !(e ? a->hw_used[i] && same_entry(&a->hw[i], e) : !a->hw_used[i]);
+		left += pending[i];
+		carry_pkts[i] = carry_bytes[i] = 0;
+	}
+	for (i = 0; i < size; i++)
+		dst[i] = pending[i] ? moved_to(a, want, pending, size, i) : -1;
+
+	while (left) {
+		/* the lowest index whose entry is not waiting to be written at
+		 * its new index */
+		for (k = -1, i = 0; i < size && k < 0; i++)
+			if (pending[i] && (dst[i] < 0 || !pending[dst[i]]))
+				k = i;
+
+		/* every one is: the entries rotate (one moves past the others,
+		 * which shift by one), and one of them has to leave the card
+		 * for a while, preferably one whose packets lose nothing */
+		for (i = 0; i < size && k < 0; i++)
+			if (pending[i] && safe_gap(a, want, size, i))
+				k = i;
+		if (k < 0) {
+			for (k = 0; !pending[k]; k++)
+				;
+			a->stats.hw_gaps++;
+		}
+		i = k;
+		e = want[i];
+
+		/* the hits of a moved entry go with it */
+		if (dst[i] >= 0) {
+			if (nf2_of_wildcard_read_counters(io, i, &pkts, &bytes)) {
+				a->hw_known = 0;
+				return -1;
+			}
+			carry_pkts[dst[i]] += a->hw_carry_pkts[i] + pkts;
+			carry_bytes[dst[i]] += a->hw_carry_bytes[i] + bytes;
+			a->stats.hw_moves++;
+		}
+		if (e ? nf2_of_wildcard_write(io, stage, i, &e->entry, &e->mask, &e->action) :
+			nf2_of_wildcard_clear(io, stage, i)) {
+			a->hw_known = 0;
+			return -1;
+		}
+		if (e)
+			a->hw[i] = *e;
+		a->hw_used[i] = e != NULL;
+		a->hw_carry_pkts[i] = a->hw_carry_bytes[i] = 0;
+		pending[i] = 0;
+		left--;
+		n++;
+	}
+	for (i = 0; i < size; i++) {
+		a->hw_carry_pkts[i] += carry_pkts[i];
+		a->hw_carry_bytes[i] += carry_bytes[i];
+	}
+	a->hw_known = 1;
+	a->stats.hw_writes += n;
+	return n;
+}
+
+
+void nf2_aclmin_print_stats(const struct nf2_aclmin *a, FILE *out) {
+	const struct nf2_aclmin_stats *st = &a->stats;
+
+	fprintf(out, "rules:        %d\n", st->rules);
+	fprintf(out, "shadowed:     %d (%d checks gave up)\n", st->shadowed, st->giveups);
+	fprintf(out, "absorbed:     %d\n", st->absorbed);
+	fprintf(out, "merged:       %d\n", st->merged);
+	fprintf(out, "entries:      %d of %d (%d did not fit)\n", st->entries, a->size,
+		st->spilled);
+}
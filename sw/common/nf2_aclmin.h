@@ -0,0 +1,161 @@
+/* ****************************************************************************
+ * Module: nf2_aclmin.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Wildcard rule-set minimizer: compiles a prioritized list
+ *              of wildcard rules into an equivalent image of at most
+ *              OPENFLOW_WILDCARD_TABLE_SIZE entries.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_ACLMIN_H_
+#define NF2_ACLMIN_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "nf2_regio.h"
+#include "nf2_of_hw.h"
+
+struct nf2_aclmin_rule {
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;		/* bits set to 1 are don't care */
+	nf2_of_action_wrap action;
+	uint16_t priority;		/* higher wins; of equal ones, the first added */
+	int id;				/* the caller's, e.g. a flow file line */
+	unsigned seq;
+};
+
+enum nf2_aclmin_fate {
+	NF2_ACLMIN_IMAGE,		/* in the image, alone or merged */
+	NF2_ACLMIN_SPILLED,		/* its entry did not fit: the controller's */
+	NF2_ACLMIN_SHADOWED,		/* rules of higher priority match all of it */
+};
+
+/* A compiled entry, and the rules it stands for */
+struct nf2_aclmin_entry {
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;
+	nf2_of_action_wrap action;
+	uint16_t priority;		/* of the rule at its place */
+	int num_rules;
+};
+
+struct nf2_aclmin_stats {
+	int rules;
+	int shadowed;			/* matched by rules above */
+	int absorbed;			/* a rule below with the same action covers it */
+	int merged;			/* merged with a rule one bit apart */
+	int entries;			/* compiled */
+	int spilled;			/* compiled entries that did not fit */
+	int giveups;			/* shadow checks that hit NF2_ACLMIN_MAX_PIECES */
+	unsigned long compiles;
+	unsigned long hw_writes;	/* image entries written */
+	unsigned long hw_moves;		/* of them, entries the card had at another index */
+	unsigned long hw_gaps;		/* writes during which a moved entry's packets
+					 * could take an entry below it */
+};
+
+#define NF2_ACLMIN_MAX_PIECES	1024
+
+/*
+ * The rules form a first-match list: by priority, and among rules of
+ * equal priority in the order they were added. Compiling repeats three
+ * rewrites of that list, each of which leaves the action of every packet
+ * unchanged, until none applies:
+ *
+ *  - a rule is dropped if the rules above it match all of it (it is cut
+ *    into the pieces the rules above leave, up to NF2_ACLMIN_MAX_PIECES,
+ *    beyond which the rule is kept);
+ *  - a rule is dropped if a rule below it with the same action covers
+ *    it, and no rule in between with another action overlaps it;
+ *  - two rules with the same action and the same mask, whose entries
+ *    differ in one bit of merge_bits, become one with that bit don't
+ *    care, in place of either if no rule in between with another action
+ *    overlaps the other one (prefix and port range aggregation).
+ *
+ * The image is the first size entries of the result, so every packet
+ * that hits it gets the action of the full list, and the packets of the
+ * rules that did not fit miss it and go to the controller, which has the
+ * full list. merge_bits defaults to every bit; a caller that prints the
+ * image as a flow file clears the bits the format cannot mask.
+ *
+ * Adding or deleting rules and compiling again only writes the image
+ * entries that changed (nf2_aclmin_write), lowest index first, except
+ * that an entry the new image has at another index is first written
+ * there and only then is its old index reused, as nf2_wildcard_table
+ * moves rules, so an entry of both images stays on the card while it
+ * writes. Only when the moves form a cycle (an entry moves past others
+ * that shift by one) must one of them leave the card for a few writes:
+ * one whose packets then miss or keep its action if there is one, else
+ * the lowest, counted in hw_gaps. The hits counted at the old index are
+ * read just before it is reused and added to hw_carry_pkts and
+ * hw_carry_bytes of the new one.
+ */
+struct nf2_aclmin {
+	struct nf2_aclmin_rule *rules;
+	int num_rules;
+	int max_rules;
+	unsigned seq;
+	nf2_of_mask_wrap merge_bits;
+	int size;			/* image entries, OPENFLOW_WILDCARD_TABLE_SIZE */
+
+	/* the compiled list, in priority order */
+	struct nf2_aclmin_entry *out;
+	int num_out;
+	int *origin;			/* per rule: its entry, or -1 if shadowed */
+
+	/* what nf2_aclmin_write left in the card */
+	struct nf2_aclmin_entry hw[OPENFLOW_WILDCARD_TABLE_SIZE];
+	uint8_t hw_used[OPENFLOW_WILDCARD_TABLE_SIZE];
+	int hw_known;
+
+	/* Hits the entry at an index collected at the indices it was moved
+	 * out of, to add to what the card counts for it */
+	uint64_t hw_carry_pkts[OPENFLOW_WILDCARD_TABLE_SIZE];
+	uint64_t hw_carry_bytes[OPENFLOW_WILDCARD_TABLE_SIZE];
+
+	struct nf2_aclmin_stats stats;
+};
+
+void nf2_aclmin_init(struct nf2_aclmin *);
+void nf2_aclmin_free(struct nf2_aclmin *);
+
+/* Adds a rule; returns 0 or -1 if out of memory */
+int nf2_aclmin_add(struct nf2_aclmin *, const nf2_of_entry_wrap *, const nf2_of_mask_wrap *,
+		   const nf2_of_action_wrap *, uint16_t priority, int id);
+
+/* Deletes the rules of an id; returns how many */
+int nf2_aclmin_delete(struct nf2_aclmin *, int id);
+
+/* Compiles the rules; returns the number of entries, which may exceed
+ * size, or -1 if out of memory */
+int nf2_aclmin_compile(struct nf2_aclmin *);
+
+/* What became of rule i (of rules[]) in the last compile, and the index
+ * of its entry in the compiled list */
+enum nf2_aclmin_fate nf2_aclmin_fate(const struct nf2_aclmin *, int i, int *entry);
+
+/* Index of the first rule (of rules[]) or compiled entry matching key,
+ * or -1 */
+int nf2_aclmin_match_rules(const struct nf2_aclmin *, const nf2_of_entry_wrap *key);
+int nf2_aclmin_match_compiled(const struct nf2_aclmin *, const nf2_of_entry_wrap *key);
+
+/*
+ * Randomized equivalence check of the last compile: keys in the rules,
+ * next to them (a bit they match flipped) and anywhere, looked up in the
+ * rules and in the compiled list, which must agree on the action or on
+ * missing, and in the image, which must agree or miss with a spilled
+ * rule first. Returns the keys that failed; prints the first few to err.
+ */
+int nf2_aclmin_check(const struct nf2_aclmin *, int trials, unsigned seed, FILE *err);
+
+/* Writes the image entries that differ from what it wrote last (all of
+ * them the first time) and clears the others; returns how many it wrote
+ * or -1 */
+int nf2_aclmin_write(struct nf2_aclmin *, struct nf2_regio *, struct nf2_of_wildcard_stage *);
+
+void nf2_aclmin_print_stats(const struct nf2_aclmin *, FILE *);
+
+#endif
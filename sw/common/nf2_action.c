@@ -0,0 +1,436 @@
+/* ****************************************************************************
+ * Module: nf2_action.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host implementation of the packet rewrites of
+ *              src/opl_processor.v.
+ *
+ *              opl_processor updates the checksums with one folded
+ *              one's complement add per rewritten 16-bit word (RFC 1624).
+ *              An end-around carry sum is 0 only if every term is 0, so
+ *              the folded result depends only on the plain integer sum of
+ *              the terms, in any order. Both methods add the same terms
+ *              as 32-bit integers and fold once at the end.
+ *
+ *              The SSE2 method blends the MACs and the first 32 bytes of
+ *              the IP header with the plan's masks in two loads and two
+ *              stores, and sums the complemented old words under the
+ *              masks with psadbw (high and low bytes of the big-endian
+ *              words separately). The sums of the new words are constants
+ *              of the plan.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define HAVE_SSE2	1
+#endif
+
+#include "nf2_action.h"
+#include "nf2_flowkey.h"
+
+#define ETH_HLEN	14
+#define VLAN_HLEN	4
+#define MAC_LEN		12	/* destination and source */
+
+#define IP_HLEN		20
+#define IP_TOS		1
+#define IP_PROTO	9
+#define IP_CSUM		10
+#define IP_SRC		12
+#define IP_DST		16
+
+#define TCP_CSUM	16
+#define UDP_CSUM	6
+
+#define VLAN_VID_MASK	0x0fff
+#define VLAN_PCP_SHIFT	13
+#define TOS_DSCP_MASK	0xfc
+
+#define VLAN_ACTIONS	(NF2_OFPAT_SET_VLAN_VID | NF2_OFPAT_SET_VLAN_PCP)
+
+static enum nf2_action_method method = NF2_ACTION_AUTO;
+
+
+static inline uint16_t get16(const uint8_t *b) {
+	return (b[0] << 8) | b[1];
+}
+
+
+static inline void put16(uint8_t *b, uint16_t v) {
+	b[0] = v >> 8;
+	b[1] = v;
+}
+
+
+static inline void put32(uint8_t *b, uint32_t v) {
+	put16(b, v >> 16);
+	put16(b + 2, v);
+}
+
+
+/* ~m + m' of one 16-bit word, as opl_processor's *_diff registers */
+static inline uint32_t word_diff(uint16_t old, uint16_t new) {
+	return (uint16_t)~old + new;
+}
+
+
+/* end-around carry fold of a sum of up to 2^16 terms */
+static inline uint16_t csum_fold(uint32_t sum) {
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return sum;
+}
+
+
+static int sse2_supported(void) {
+#ifdef HAVE_SSE2
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#else
+	return 0;
+#endif
+}
+
+
+int nf2_action_set_method(enum nf2_action_method m) {
+	if (m == NF2_ACTION_AUTO)
+		m = sse2_supported() ? NF2_ACTION_SSE2 : NF2_ACTION_SCALAR;
+	if (m == NF2_ACTION_SSE2 && !sse2_supported())
+		return -1;
+	method = m;
+	return 0;
+}
+
+
+enum nf2_action_method nf2_action_get_method(void) {
+	if (method == NF2_ACTION_AUTO)
+		nf2_action_set_method(NF2_ACTION_AUTO);
+	return method;
+}
+
+
+const char *nf2_action_method_name(enum nf2_action_method m) {
+	switch (m) {
+	case NF2_ACTION_AUTO:	return "auto";
+	case NF2_ACTION_SCALAR:	return "scalar";
+	case NF2_ACTION_SSE2:	return "sse2";
+	}
+	return "?";
+}
+
+
+void nf2_action_compile(const nf2_of_action_wrap *wrap, struct nf2_action_plan *p) {
+	const struct nf2_of_action *a = &wrap->action;
+	int i;
+
+	memset(p, 0, sizeof(*p));
+	p->forward_bitmask = a->forward_bitmask;
+	p->flags = a->nf2_action_flag;
+	p->vlan_vid = a->vlan_id & VLAN_VID_MASK;
+	p->vlan_pcp = a->vlan_pcp & 0x7;
+	p->tp_src = a->transp_src;
+	p->tp_dst = a->transp_dst;
+
+	/* the driver keeps MACs with the last wire byte first */
+	for (i = 0; i < 6; i++) {
+		if (p->flags & NF2_OFPAT_SET_DL_DST) {
+			p->l2_val[i] = a->eth_dst[5 - i];
+			p->l2_mask[i] = 0xff;
+		}
+		if (p->flags & NF2_OFPAT_SET_DL_SRC) {
+			p->l2_val[6 + i] = a->eth_src[5 - i];
+			p->l2_mask[6 + i] = 0xff;
+		}
+	}
+
+	/* the TOS word is diffed with the version/IHL byte and the ECN bits
+	 * taken as 0 in both the old and new values: ~old is the masked old
+	 * value complemented plus ~mask (0xff03) */
+	if (p->flags & NF2_OFPAT_SET_NW_TOS) {
+		p->ip_val[IP_TOS] = a->ip_tos & TOS_DSCP_MASK;
+		p->ip_mask[IP_TOS] = TOS_DSCP_MASK;
+		p->tos_const = p->ip_val[IP_TOS] + (uint16_t)~TOS_DSCP_MASK;
+	}
+	if (p->flags & NF2_OFPAT_SET_NW_SRC) {
+		put32(p->ip_val + IP_SRC, a->ip_src);
+		memset(p->ip_mask + IP_SRC, 0xff, 4);
+		p->addr_const += (a->ip_src >> 16) + (a->ip_src & 0xffff);
+	}
+	if (p->flags & NF2_OFPAT_SET_NW_DST) {
+		put32(p->ip_val + IP_DST, a->ip_dst);
+		memset(p->ip_mask + IP_DST, 0xff, 4);
+		p->addr_const += (a->ip_dst >> 16) + (a->ip_dst & 0xffff);
+	}
+}
+
+
+/*
+ * VLAN actions. Returns the offset of the L3 header in the rewritten
+ * frame, or -1 if a tag cannot be added.
+ */
+static int apply_vlan(const struct nf2_action_plan *p, struct nf2_pkt *pkt) {
+	uint8_t *d = pkt->data;
+	uint16_t tci;
+
+	if (get16(d + MAC_LEN) == NF2_ETH_TYPE_VLAN) {
+		if (pkt->len < ETH_HLEN + VLAN_HLEN)
+			return ETH_HLEN + VLAN_HLEN;
+		if (p->flags & NF2_OFPAT_STRIP_VLAN) {
+			memmove(d + VLAN_HLEN, d, MAC_LEN);
+			pkt->data += VLAN_HLEN;
+			pkt->len -= VLAN_HLEN;
+			pkt->headroom += VLAN_HLEN;
+			return ETH_HLEN;
+		}
+		/* CFI is kept */
+		tci = get16(d + ETH_HLEN);
+		if (p->flags & NF2_OFPAT_SET_VLAN_VID)
+			tci = (tci & ~VLAN_VID_MASK) | p->vlan_vid;
+		if (p->flags & NF2_OFPAT_SET_VLAN_PCP)
+			tci = (tci & ~(0x7 << VLAN_PCP_SHIFT)) | p->vlan_pcp << VLAN_PCP_SHIFT;
+		put16(d + ETH_HLEN, tci);
+		return ETH_HLEN + VLAN_HLEN;
+	}
+
+	if (!(p->flags & VLAN_ACTIONS))
+		return ETH_HLEN;
+	if (pkt->headroom < VLAN_HLEN)
+		return -1;
+
+	/* the new tag starts from 0 as the one opl_processor inserts */
+	d -= VLAN_HLEN;
+	memmove(d, d + VLAN_HLEN, MAC_LEN);
+	put16(d + MAC_LEN, NF2_ETH_TYPE_VLAN);
+	tci = 0;
+	if (p->flags & NF2_OFPAT_SET_VLAN_VID)
+		tci |= p->vlan_vid;
+	if (p->flags & NF2_OFPAT_SET_VLAN_PCP)
+		tci |= p->vlan_pcp << VLAN_PCP_SHIFT;
+	put16(d + ETH_HLEN, tci);
+	pkt->data = d;
+	pkt->len += VLAN_HLEN;
+	pkt->headroom -= VLAN_HLEN;
+	return ETH_HLEN + VLAN_HLEN;
+}
+
+
+/*
+ * TCP/UDP ports and checksum. addr_sum holds the address terms of the
+ * IP header, which are also in the pseudo header.
+ */
+static void apply_tp(const struct nf2_action_plan *p, uint8_t *l4, uint32_t room,
+		     uint8_t proto, uint32_t addr_sum) {
+	int csum = proto == NF2_IP_PROTO_TCP ? TCP_CSUM : UDP_CSUM;
+	uint32_t sum;
+
+	if (room < csum + 2)
+		return;
+
+	sum = (uint16_t)~get16(l4 + csum) + addr_sum;
+	if (p->flags & NF2_OFPAT_SET_TP_SRC) {
+		sum += word_diff(get16(l4), p->tp_src);
+		put16(l4, p->tp_src);
+	}
+	if (p->flags & NF2_OFPAT_SET_TP_DST) {
+		sum += word_diff(get16(l4 + 2), p->tp_dst);
+		put16(l4 + 2, p->tp_dst);
+	}
+	put16(l4 + csum, ~csum_fold(sum));
+}
+
+
+/* IP fields field by field; returns the address terms */
+static uint32_t ip_scalar(const struct nf2_action_plan *p, uint8_t *ip) {
+	uint32_t sum, addr_sum = 0;
+	int i;
+
+	sum = (uint16_t)~get16(ip + IP_CSUM);
+	if (p->flags & NF2_OFPAT_SET_NW_TOS) {
+		sum += word_diff(ip[IP_TOS] & TOS_DSCP_MASK, p->ip_val[IP_TOS]);
+		ip[IP_TOS] = (ip[IP_TOS] & ~TOS_DSCP_MASK) | p->ip_val[IP_TOS];
+	}
+	if (p->flags & NF2_OFPAT_SET_NW_SRC) {
+		for (i = IP_SRC; i < IP_SRC + 4; i += 2)
+			addr_sum += word_diff(get16(ip + i), get16(p->ip_val + i));
+		memcpy(ip + IP_SRC, p->ip_val + IP_SRC, 4);
+	}
+	if (p->flags & NF2_OFPAT_SET_NW_DST) {
+		for (i = IP_DST; i < IP_DST + 4; i += 2)
+			addr_sum += word_diff(get16(ip + i), get16(p->ip_val + i));
+		memcpy(ip + IP_DST, p->ip_val + IP_DST, 4);
+	}
+	put16(ip + IP_CSUM, ~csum_fold(sum + addr_sum));
+	return addr_sum;
+}
+
+
+static int apply_scalar(const struct nf2_action_plan *p, struct nf2_pkt *pkt) {
+	uint32_t addr_sum;
+	uint8_t *ip, proto;
+	int l3, l4;
+
+	if (!p->forward_bitmask)
+		return 0;
+	if (pkt->len < ETH_HLEN)
+		return p->forward_bitmask;
+	if ((l3 = apply_vlan(p, pkt)) < 0)
+		return -1;
+
+	if (p->flags & NF2_OFPAT_SET_DL_DST)
+		memcpy(pkt->data, p->l2_val, 6);
+	if (p->flags & NF2_OFPAT_SET_DL_SRC)
+		memcpy(pkt->data + 6, p->l2_val + 6, 6);
+
+	ip = pkt->data + l3;
+	if (pkt->len < l3 + IP_HLEN || get16(ip - 2) != NF2_ETH_TYPE_IP)
+		return p->forward_bitmask;
+	addr_sum = ip_scalar(p, ip);
+
+	l4 = (ip[0] & 0xf) * 4;
+	proto = ip[IP_PROTO];
+	if (l4 >= IP_HLEN && (proto == NF2_IP_PROTO_TCP || proto == NF2_IP_PROTO_UDP) &&
+	    pkt->len > l3 + l4)
+		apply_tp(p, ip + l4, pkt->len - l3 - l4, proto, addr_sum);
+	return p->forward_bitmask;
+}
+
+
+#ifdef HAVE_SSE2
+/* ~old & mask of the 16-bit big-endian words of v, summed per 8-byte lane */
+__attribute__((target("sse2")))
+static inline __m128i masked_sum(__m128i v, __m128i mask) {
+	const __m128i hi = _mm_set1_epi16(0x00ff);	/* first byte of each word */
+	const __m128i zero = _mm_setzero_si128();
+	__m128i c = _mm_andnot_si128(v, mask);
+
+	return _mm_add_epi64(_mm_slli_epi64(_mm_sad_epu8(_mm_and_si128(c, hi), zero), 8),
+			     _mm_sad_epu8(_mm_andnot_si128(hi, c), zero));
+}
+
+
+__attribute__((target("sse2")))
+static inline __m128i blend(__m128i v, __m128i val, __m128i mask) {
+	return _mm_or_si128(_mm_andnot_si128(mask, v), val);
+}
+
+
+/* IP header in the first 32 bytes of ip; returns the address terms */
+__attribute__((target("sse2")))
+static inline uint32_t ip_sse2(const struct nf2_action_plan *p, uint8_t *ip) {
+	__m128i a = _mm_loadu_si128((const __m128i *)ip);
+	__m128i b = _mm_loadu_si128((const __m128i *)(ip + 16));
+	__m128i ma = _mm_load_si128((const __m128i *)p->ip_mask);
+	__m128i mb = _mm_load_si128((const __m128i *)(p->ip_mask + 16));
+	__m128i sa = masked_sum(a, ma);
+	__m128i sb = masked_sum(b, mb);
+	uint32_t sum, addr_sum;
+
+	/* bytes 0..7 hold TOS, 12..15 the source and 16..19 the destination */
+	addr_sum = p->addr_const + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sa, sa)) +
+		   _mm_cvtsi128_si32(sb);
+	sum = (uint16_t)~get16(ip + IP_CSUM) + p->tos_const + _mm_cvtsi128_si32(sa) +
+	      addr_sum;
+
+	a = blend(a, _mm_load_si128((const __m128i *)p->ip_val), ma);
+	b = blend(b, _mm_load_si128((const __m128i *)(p->ip_val + 16)), mb);
+	_mm_storeu_si128((__m128i *)ip, a);
+	_mm_storeu_si128((__m128i *)(ip + 16), b);
+	put16(ip + IP_CSUM, ~csum_fold(sum));
+	return addr_sum;
+}
+
+
+__attribute__((target("sse2")))
+static inline int apply_sse2(const struct nf2_action_plan *p, struct nf2_pkt *pkt) {
+	uint32_t addr_sum;
+	uint8_t *d, *ip, proto;
+	int l3, l4;
+
+	if (!p->forward_bitmask)
+		return 0;
+	if (pkt->len < ETH_HLEN)
+		return p->forward_bitmask;
+	if ((l3 = apply_vlan(p, pkt)) < 0)
+		return -1;
+
+	d = pkt->data;
+	if (pkt->len >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)d);
+
+		v = blend(v, _mm_load_si128((const __m128i *)p->l2_val),
+			  _mm_load_si128((const __m128i *)p->l2_mask));
+		_mm_storeu_si128((__m128i *)d, v);
+	}
+	else {
+		if (p->flags & NF2_OFPAT_SET_DL_DST)
+			memcpy(d, p->l2_val, 6);
+		if (p->flags & NF2_OFPAT_SET_DL_SRC)
+			memcpy(d + 6, p->l2_val + 6, 6);
+	}
+
+	ip = d + l3;
+	if (pkt->len < l3 + IP_HLEN || get16(ip - 2) != NF2_ETH_TYPE_IP)
+		return p->forward_bitmask;
+	addr_sum = pkt->len >= l3 + 32 ? ip_sse2(p, ip) : ip_scalar(p, ip);
+
+	l4 = (ip[0] & 0xf) * 4;
+	proto = ip[IP_PROTO];
+	if (l4 >= IP_HLEN && (proto == NF2_IP_PROTO_TCP || proto == NF2_IP_PROTO_UDP) &&
+	    pkt->len > l3 + l4)
+		apply_tp(p, ip + l4, pkt->len - l3 - l4, proto, addr_sum);
+	return p->forward_bitmask;
+}
+
+
+/* kept separate so that the per-packet code is inlined with the sse2 target */
+__attribute__((target("sse2")))
+static int apply_batch_sse2(const struct nf2_action_plan **plans, struct nf2_pkt *pkts,
+			    int n, int *fwd) {
+	int i, failed = 0;
+
+	for (i = 0; i < n; i++) {
+		if (i + 1 < n) {
+			__builtin_prefetch(pkts[i + 1].data - VLAN_HLEN, 1);
+			__builtin_prefetch(plans[i + 1]);
+		}
+		fwd[i] = apply_sse2(plans[i], &pkts[i]);
+		if (fwd[i] < 0)
+			failed++;
+	}
+	return failed;
+}
+#endif
+
+
+int nf2_action_apply(const struct nf2_action_plan *p, struct nf2_pkt *pkt) {
+	int fwd;
+
+	nf2_action_apply_batch(&p, pkt, 1, &fwd);
+	return fwd;
+}
+
+
+int nf2_action_apply_batch(const struct nf2_action_plan **plans, struct nf2_pkt *pkts,
+			   int n, int *fwd) {
+	int i, failed = 0;
+
+	switch (nf2_action_get_method()) {
+#ifdef HAVE_SSE2
+	case NF2_ACTION_SSE2:
+		return apply_batch_sse2(plans, pkts, n, fwd);
+#endif
+	default:
+		for (i = 0; i < n; i++) {
+			fwd[i] = apply_scalar(plans[i], &pkts[i]);
+			if (fwd[i] < 0)
+				failed++;
+		}
+		return failed;
+	}
+}
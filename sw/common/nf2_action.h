@@ -0,0 +1,103 @@
+/* ****************************************************************************
+ * Module: nf2_action.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host implementation of the packet rewrites of
+ *              src/opl_processor.v.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_ACTION_H_
+#define NF2_ACTION_H_
+
+#include <stdint.h>
+
+#include "../../lib/C/reg_defines_openflow_switch.h"
+#include "../../../../lib/C/common/nf2util.h"
+#include "../regdump/nf2_drv.h"
+
+/* Room a packet needs in front of its data for a VLAN tag to be added */
+#define NF2_ACTION_HEADROOM	4
+
+/*
+ * A frame as it is on the wire (802.1Q tag included), in a buffer with
+ * headroom bytes free in front of data.
+ */
+struct nf2_pkt {
+	uint8_t *data;
+	uint32_t len;
+	uint32_t headroom;
+};
+
+/*
+ * nf2_action_compile turns an action into the blend masks and checksum
+ * constants the rewrite uses; compile once per flow, apply per packet.
+ */
+struct nf2_action_plan {
+	uint16_t forward_bitmask;
+	uint16_t flags;			/* nf2_action_flag */
+	uint16_t vlan_vid;
+	uint8_t vlan_pcp;
+	uint16_t tp_src;
+	uint16_t tp_dst;
+
+	/* new bytes and byte masks: MACs (frame bytes 0..11) and the IP
+	 * header (bytes 0..19: TOS bits 7:2, source and destination) */
+	uint8_t l2_val[16] __attribute__((aligned(16)));
+	uint8_t l2_mask[16] __attribute__((aligned(16)));
+	uint8_t ip_val[32] __attribute__((aligned(16)));
+	uint8_t ip_mask[32] __attribute__((aligned(16)));
+
+	/* sum of the new values (and of the complemented masks) of the
+	 * rewritten IP header words: TOS, and the addresses that also go
+	 * into the TCP/UDP pseudo header */
+	uint32_t tos_const;
+	uint32_t addr_const;
+};
+
+/*
+ * The rewrites, as opl_processor does them:
+ *   - STRIP_VLAN removes the tag of a tagged frame. Otherwise SET_VLAN_VID
+ *     and SET_VLAN_PCP replace the VID and PCP of the tag, and add a tag
+ *     (VID and PCP 0 unless set) to an untagged frame, even with
+ *     STRIP_VLAN set.
+ *   - SET_DL_SRC and SET_DL_DST on any frame.
+ *   - IPv4 only: SET_NW_TOS (the 6 DSCP bits, ECN is kept), SET_NW_SRC,
+ *     SET_NW_DST. The header checksum is updated incrementally
+ *     (RFC 1624: HC' = ~(~HC + ~m + m')) and always written back, even
+ *     without rewrites, which leaves it unchanged.
+ *   - TCP and UDP after the IP options (IHL of at least 5): SET_TP_SRC
+ *     and SET_TP_DST, with the checksum updated for the ports and the
+ *     pseudo header addresses. A UDP checksum of 0 (none) is updated
+ *     like any other, as the hardware does.
+ * The one's complement sums fold the same way as the hardware's, so the
+ * result is the same to the bit, including the 0x0000/0xffff choice.
+ *
+ * Frames too short for a header are left alone from that header on.
+ */
+enum nf2_action_method {
+	NF2_ACTION_AUTO,	/* SSE2 if the CPU has it, else SCALAR */
+	NF2_ACTION_SCALAR,	/* field by field, as the hardware does */
+	NF2_ACTION_SSE2,	/* blended headers, psadbw checksum sums */
+};
+
+int nf2_action_set_method(enum nf2_action_method);
+enum nf2_action_method nf2_action_get_method(void);
+const char *nf2_action_method_name(enum nf2_action_method);
+
+void nf2_action_compile(const nf2_of_action_wrap *, struct nf2_action_plan *);
+
+/*
+ * Applies the plan to the packet. Returns the forward bitmask (0: drop),
+ * or -1 if a tag had to be added and the packet has no headroom, in
+ * which case it is left unchanged.
+ */
+int nf2_action_apply(const struct nf2_action_plan *, struct nf2_pkt *);
+
+/* Applies plans[i] to pkts[i]; fwd[i] gets what nf2_action_apply returns.
+ * Returns the number of packets that failed. */
+int nf2_action_apply_batch(const struct nf2_action_plan **plans, struct nf2_pkt *pkts,
+			   int n, int *fwd);
+
+#endif
@@ -0,0 +1,265 @@
+/* ****************************************************************************
+ * Module: nf2_afpacket.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Memory mapped AF_PACKET (TPACKET_V3) receive and transmit
+ *              rings on one interface.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+
+#include "nf2_afpacket.h"
+
+/* where the kernel takes a frame of the transmit ring from */
+#define TX_DATA_OFF	TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+#define TX_BLOCK_SIZE	(1 << 16)
+
+
+static inline void put16(uint8_t *b, uint16_t v) {
+	b[0] = v >> 8;
+	b[1] = v;
+}
+
+
+static int set_opt(struct nf2_afp_port *p, int opt, const void *val, socklen_t len,
+		   const char *what) {
+	if (setsockopt(p->fd, SOL_PACKET, opt, val, len) == 0)
+		return 0;
+	fprintf(stderr, "%s: %s: %s\n", p->name, what, strerror(errno));
+	return -1;
+}
+
+
+int nf2_afp_open(struct nf2_afp_port *p, const char *ifname, const struct nf2_afp_cfg *cfg) {
+	struct tpacket_req3 rx, tx;
+	struct sockaddr_ll addr;
+	size_t rx_len, tx_len;
+	int val;
+
+	memset(p, 0, sizeof(*p));
+	p->fd = -1;
+	snprintf(p->name, sizeof(p->name), "%s", ifname);
+	p->cfg = *cfg;
+	p->ifindex = if_nametoindex(ifname);
+	if (p->ifindex == 0) {
+		fprintf(stderr, "%s: no such interface\n", ifname);
+		return -1;
+	}
+	if (cfg->tx_frame_size < TX_DATA_OFF + ETH_FRAME_LEN ||
+	    TX_BLOCK_SIZE % cfg->tx_frame_size || cfg->tx_frames < TX_BLOCK_SIZE / cfg->tx_frame_size) {
+		fprintf(stderr, "%s: invalid ring configuration\n", ifname);
+		return -1;
+	}
+
+	p->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+	if (p->fd < 0) {
+		perror("socket(AF_PACKET)");
+		return -1;
+	}
+	val = TPACKET_V3;
+	if (set_opt(p, PACKET_VERSION, &val, sizeof(val), "TPACKET_V3"))
+		goto fail;
+	val = NF2_AFP_HEADROOM;
+	if (set_opt(p, PACKET_RESERVE, &val, sizeof(val), "PACKET_RESERVE"))
+		goto fail;
+
+	memset(&rx, 0, sizeof(rx));
+	rx.tp_block_size = cfg->rx_block_size;
+	rx.tp_block_nr = cfg->rx_blocks;
+	rx.tp_frame_size = TPACKET_ALIGNMENT << 7;
+	rx.tp_frame_nr = rx.tp_block_size / rx.tp_frame_size * rx.tp_block_nr;
+	rx.tp_retire_blk_tov = cfg->rx_timeout_ms;
+	if (set_opt(p, PACKET_RX_RING, &rx, sizeof(rx), "receive ring"))
+		goto fail;
+
+	/* the transmit ring takes no block timeout or private area */
+	memset(&tx, 0, sizeof(tx));
+	tx.tp_block_size = TX_BLOCK_SIZE;
+	tx.tp_frame_size = cfg->tx_frame_size;
+	tx.tp_block_nr = cfg->tx_frames / (TX_BLOCK_SIZE / cfg->tx_frame_size);
+	tx.tp_frame_nr = tx.tp_block_nr * (TX_BLOCK_SIZE / cfg->tx_frame_size);
+	p->cfg.tx_frames = tx.tp_frame_nr;
+	if (set_opt(p, PACKET_TX_RING, &tx, sizeof(tx), "transmit ring"))
+		goto fail;
+
+	rx_len = (size_t)rx.tp_block_size * rx.tp_block_nr;
+	tx_len = (size_t)tx.tp_block_size * tx.tp_block_nr;
+	p->map = mmap(NULL, rx_len + tx_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED,
+		      p->fd, 0);
+	if (p->map == MAP_FAILED) {
+		/* without the privilege or the limit to lock it */
+		p->map = mmap(NULL, rx_len + tx_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			      p->fd, 0);
+	}
+	if (p->map == MAP_FAILED) {
+		p->map = NULL;
+		fprintf(stderr, "%s: mmap of the rings: %s\n", ifname, strerror(errno));
+		goto fail;
+	}
+	p->map_len = rx_len + tx_len;
+	p->tx_ring = p->map + rx_len;
+
+	val = 1;
+	if (set_opt(p, PACKET_QDISC_BYPASS, &val, sizeof(val), "PACKET_QDISC_BYPASS"))
+		goto fail;
+#ifdef PACKET_IGNORE_OUTGOING
+	if (set_opt(p, PACKET_IGNORE_OUTGOING, &val, sizeof(val), "PACKET_IGNORE_OUTGOING"))
+		goto fail;
+#endif
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sll_family = AF_PACKET;
+	addr.sll_protocol = htons(ETH_P_ALL);
+	addr.sll_ifindex = p->ifindex;
+	if (bind(p->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		fprintf(stderr, "%s: bind: %s\n", ifname, strerror(errno));
+		goto fail;
+	}
+	return 0;
+
+fail:
+	nf2_afp_close(p);
+	return -1;
+}
+
+
+void nf2_afp_close(struct nf2_afp_port *p) {
+	if (p->map)
+		munmap(p->map, p->map_len);
+	if (p->fd >= 0)
+		close(p->fd);
+	p->map = NULL;
+	p->fd = -1;
+}
+
+
+int nf2_afp_rx_next(struct nf2_afp_port *p, struct nf2_afp_pkt *pkt) {
+	struct tpacket_block_desc *bd;
+	struct tpacket3_hdr *h;
+	uint8_t *d;
+
+	if (p->cur == NULL) {
+		bd = (struct tpacket_block_desc *)(p->map + (size_t)p->rx_block * p->cfg.rx_block_size);
+		if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+			return 0;
+		p->cur = bd;
+		p->left = bd->hdr.bh1.num_pkts;
+		p->next = (struct tpacket3_hdr *)((uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt);
+		p->stats.rx_blocks++;
+	}
+	if (p->left == 0)
+		return 0;
+
+	h = p->next;
+	p->left--;
+	p->next = (struct tpacket3_hdr *)((uint8_t *)h + h->tp_next_offset);
+
+	d = (uint8_t *)h + h->tp_mac;
+	pkt->data = d;
+	pkt->len = h->tp_len;
+	pkt->caplen = h->tp_snaplen;
+	pkt->headroom = NF2_AFP_HEADROOM;
+	if ((h->tp_status & TP_STATUS_VLAN_VALID) && pkt->caplen >= 2 * ETH_ALEN) {
+		/* the tag back between the MACs and the ethertype */
+		d -= 4;
+		memmove(d, d + 4, 2 * ETH_ALEN);
+		put16(d + 12, (h->tp_status & TP_STATUS_VLAN_TPID_VALID) ?
+			      h->hv1.tp_vlan_tpid : ETH_P_8021Q);
+		put16(d + 14, h->hv1.tp_vlan_tci);
+		pkt->data = d;
+		pkt->len += 4;
+		pkt->caplen += 4;
+		pkt->headroom -= 4;
+	}
+	p->stats.rx_pkts++;
+	p->stats.rx_bytes += pkt->len;
+	return 1;
+}
+
+
+void nf2_afp_rx_release(struct nf2_afp_port *p) {
+	if (p->cur == NULL)
+		return;
+	__atomic_store_n(&p->cur->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+	p->cur = NULL;
+	p->rx_block = (p->rx_block + 1) % p->cfg.rx_blocks;
+}
+
+
+static inline struct tpacket3_hdr *tx_hdr(struct nf2_afp_port *p, unsigned i) {
+	return (struct tpacket3_hdr *)(p->tx_ring + (size_t)i * p->cfg.tx_frame_size);
+}
+
+
+static inline int tx_free(struct tpacket3_hdr *h) {
+	uint32_t s = __atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE);
+
+	return s == TP_STATUS_AVAILABLE || (s & TP_STATUS_WRONG_FORMAT);
+}
+
+
+uint8_t *nf2_afp_tx_frame(struct nf2_afp_port *p, uint32_t len) {
+	struct tpacket3_hdr *h = tx_hdr(p, p->tx_head);
+
+	if (len > p->cfg.tx_frame_size - TX_DATA_OFF) {
+		p->stats.tx_too_long++;
+		return NULL;
+	}
+	if (!tx_free(h)) {
+		nf2_afp_tx_flush(p);
+		if (!tx_free(h)) {
+			p->stats.tx_full++;
+			return NULL;
+		}
+	}
+	return (uint8_t *)h + TX_DATA_OFF;
+}
+
+
+void nf2_afp_tx_commit(struct nf2_afp_port *p, uint32_t len) {
+	struct tpacket3_hdr *h = tx_hdr(p, p->tx_head);
+
+	h->tp_len = len;
+	h->tp_snaplen = len;
+	h->tp_next_offset = 0;
+	__atomic_store_n(&h->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+	p->tx_head = (p->tx_head + 1) % p->cfg.tx_frames;
+	p->tx_pending++;
+	p->stats.tx_pkts++;
+	p->stats.tx_bytes += len;
+}
+
+
+int nf2_afp_tx_flush(struct nf2_afp_port *p) {
+	if (p->tx_pending == 0)
+		return 0;
+	p->tx_pending = 0;
+	p->stats.tx_sends++;
+	if (send(p->fd, NULL, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != ENOBUFS) {
+		fprintf(stderr, "%s: send: %s\n", p->name, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+
+void nf2_afp_update_stats(struct nf2_afp_port *p) {
+	struct tpacket_stats_v3 st;
+	socklen_t len = sizeof(st);
+
+	/* the kernel clears its counters on every read */
+	if (getsockopt(p->fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0)
+		p->stats.kernel_drops += st.tp_drops;
+}
@@ -0,0 +1,107 @@
+/* ****************************************************************************
+ * Module: nf2_afpacket.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Memory mapped AF_PACKET (TPACKET_V3) receive and transmit
+ *              rings on one interface.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_AFPACKET_H_
+#define NF2_AFPACKET_H_
+
+#include <stdint.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+
+/* Free bytes kept in front of every received frame: its VLAN tag, taken
+ * off by the kernel, is put back there, and an action may add one */
+#define NF2_AFP_HEADROOM	8
+
+struct nf2_afp_cfg {
+	unsigned rx_block_size;		/* bytes, a multiple of the page size */
+	unsigned rx_blocks;
+	unsigned rx_timeout_ms;		/* a block is handed over when full or this old */
+	unsigned tx_frame_size;		/* bytes per frame of the transmit ring */
+	unsigned tx_frames;
+};
+
+#define NF2_AFP_DEFAULT_CFG	{ 1 << 20, 64, 1, 2048, 4096 }
+
+struct nf2_afp_stats {
+	uint64_t rx_pkts;
+	uint64_t rx_bytes;
+	uint64_t rx_blocks;
+	uint64_t tx_pkts;
+	uint64_t tx_bytes;
+	uint64_t tx_full;		/* frames dropped: the ring was full */
+	uint64_t tx_too_long;		/* frames dropped: longer than a ring frame */
+	uint64_t tx_sends;		/* send() calls */
+	uint32_t kernel_drops;		/* PACKET_STATISTICS: the receive ring was full */
+};
+
+/*
+ * The receive ring is a ring of blocks the kernel fills with packets and
+ * hands over whole (TPACKET_V3), so one poll() or none covers a block of
+ * packets. The packets of a block are used in place and stay valid until
+ * nf2_afp_rx_release. A frame is as it was on the wire: the kernel takes
+ * the 802.1Q tag off into the frame's header and nf2_afp_rx_next puts it
+ * back in front, in the NF2_AFP_HEADROOM reserved for it.
+ *
+ * Frames are sent by copying them into the transmit ring
+ * (nf2_afp_tx_frame, nf2_afp_tx_commit) and handing all the committed
+ * ones to the kernel with one send() (nf2_afp_tx_flush). The ring
+ * bypasses the qdisc, and the socket ignores its own outgoing frames.
+ */
+struct nf2_afp_port {
+	int fd;
+	int ifindex;
+	char name[IFNAMSIZ];
+	struct nf2_afp_cfg cfg;
+
+	uint8_t *map;			/* receive ring, then transmit ring */
+	size_t map_len;
+	uint8_t *tx_ring;
+
+	/* the block being read, and the next packet in it */
+	unsigned rx_block;
+	struct tpacket_block_desc *cur;
+	struct tpacket3_hdr *next;
+	unsigned left;
+
+	unsigned tx_head;		/* next transmit frame */
+	unsigned tx_pending;		/* committed since the last flush */
+
+	struct nf2_afp_stats stats;
+};
+
+struct nf2_afp_pkt {
+	uint8_t *data;
+	uint32_t len;
+	uint32_t caplen;		/* bytes in data; the rest was cut by the ring */
+	uint32_t headroom;		/* free bytes in front of data */
+};
+
+/* Returns -1 with a message */
+int nf2_afp_open(struct nf2_afp_port *, const char *ifname, const struct nf2_afp_cfg *);
+void nf2_afp_close(struct nf2_afp_port *);
+
+/* Returns 1 and the next received packet, or 0 if the block being read is
+ * used up and the next one is not ready yet (see nf2_afp_rx_release) */
+int nf2_afp_rx_next(struct nf2_afp_port *, struct nf2_afp_pkt *);
+
+/* Hands the block just used up back to the kernel; the packets of it are
+ * no longer valid */
+void nf2_afp_rx_release(struct nf2_afp_port *);
+
+/* A free frame of the transmit ring for len bytes, or NULL (counted) if
+ * the ring is full even after a flush or len does not fit a frame */
+uint8_t *nf2_afp_tx_frame(struct nf2_afp_port *, uint32_t len);
+void nf2_afp_tx_commit(struct nf2_afp_port *, uint32_t len);
+int nf2_afp_tx_flush(struct nf2_afp_port *);
+
+/* Reads the kernel's drop counter into stats.kernel_drops */
+void nf2_afp_update_stats(struct nf2_afp_port *);
+
+#endif
@@ -0,0 +1,345 @@
+/* ****************************************************************************
+ * Module: nf2_cards.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Several cards in one process: a register worker per card
+ *              and a scheduler for their flow installs and counter
+ *              sweeps.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nf2_cards.h"
+
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static int open_card(struct nf2_card *c, int i, const char *iface,
+		     const struct nf2_cards_cfg *cfg) {
+	snprintf(c->iface, sizeof(c->iface), "%s", iface);
+	if (strcmp(iface, NF2_CARDS_EMU) == 0) {
+		snprintf(c->iface, sizeof(c->iface), "%s%d", iface, i);
+		if (nf2_emu_open(&c->emu, cfg->emu_txn_ns, cfg->emu_word_ns)) {
+			fprintf(stderr, "Could not allocate the emulated register file\n");
+			return -1;
+		}
+		c->emulated = 1;
+		c->io = &c->emu.io;
+	}
+	else {
+		if (nf2_regio_open_mmap(&c->hw_io, iface))
+			return -1;
+		c->io = &c->hw_io;
+	}
+	if (nf2_exact_table_init(&c->exact, c->io, cfg->max_kicks) ||
+	    nf2_harvest_init(&c->harvest, &cfg->harvest, now_ns()) ||
+	    (c->jobs = calloc(NF2_CARDS_QUEUE, sizeof(*c->jobs))) == NULL) {
+		fprintf(stderr, "%s: out of memory\n", iface);
+		return -1;
+	}
+	return 0;
+}
+
+
+static void close_card(struct nf2_card *c) {
+	nf2_exact_table_free(&c->exact);
+	nf2_harvest_free(&c->harvest);
+	free(c->jobs);
+	c->jobs = NULL;
+	if (c->emulated)
+		nf2_emu_close(&c->emu);
+	else if (c->io != NULL)
+		nf2_regio_close(&c->hw_io);
+	c->io = NULL;
+}
+
+
+static void run_job(struct nf2_card *c, struct nf2_card_job *job) {
+	int idx[NF2_EXACT_BATCH];
+	int r;
+
+	switch (job->type) {
+	case NF2_CARD_INSTALL:
+		r = nf2_exact_insert_batch(&c->exact, job->entries, job->actions, job->n, idx);
+		if (r < 0) {
+			c->stats.errors++;
+			break;
+		}
+		c->stats.installs += job->n - r;
+		c->stats.install_failures += r;
+		break;
+
+	case NF2_CARD_SWEEP:
+		r = nf2_harvest_sweep(&c->harvest, c->io, now_ns());
+		if (r < 0) {
+			c->stats.errors++;
+			break;
+		}
+		c->stats.sweeps++;
+		c->stats.swept += r;
+		break;
+	}
+}
+
+
+//
+// pick: the worker's home card if it has jobs and is free, otherwise the
+//    free card with the most jobs queued
+//
+static struct nf2_card *pick(struct nf2_cards *cs, int home) {
+	struct nf2_card *c, *best = NULL;
+	int i;
+
+	if (home < cs->num_cards) {
+		c = &cs->cards[home];
+		if (!c->busy && c->tail != c->head)
+			return c;
+	}
+	for (i = 0; i < cs->num_cards; i++) {
+		c = &cs->cards[i];
+		if (c->busy || c->tail == c->head)
+			continue;
+		if (best == NULL || c->tail - c->head > best->tail - best->head)
+			best = c;
+	}
+	return best;
+}
+
+
+//
+// worker: runs the jobs of the cards it picks, up to NF2_CARDS_GRAB at a
+//    time, until the cards are closed and no job is left
+//
+static void *worker(void *arg) {
+	struct nf2_cards_worker *wk = arg;
+	struct nf2_cards *cs = wk->cards;
+	struct nf2_card *c;
+	struct timespec ts;
+	unsigned long long model;
+	uint64_t t0, wait;
+	unsigned n, k;
+
+	pthread_mutex_lock(&cs->lock);
+	for (;;) {
+		c = pick(cs, wk->home);
+		if (c == NULL) {
+			if (cs->stop)
+				break;
+			pthread_cond_wait(&cs->work, &cs->lock);
+			continue;
+		}
+		c->busy = 1;
+		n = c->tail - c->head;
+		if (n > NF2_CARDS_GRAB)
+			n = NF2_CARDS_GRAB;
+		pthread_mutex_unlock(&cs->lock);
+
+		/* the jobs from head on stay put until head moves */
+		t0 = now_ns();
+		model = c->io->model_ns;
+		for (k = 0; k < n; k++)
+			run_job(c, &c->jobs[(c->head + k) % NF2_CARDS_QUEUE]);
+		if (c->emulated && cs->cfg.emu_pace) {
+			wait = c->io->model_ns - model;
+			ts.tv_sec = wait / 1000000000ULL;
+			ts.tv_nsec = wait % 1000000000ULL;
+			nanosleep(&ts, NULL);
+			c->stats.pace_ns += wait;
+		}
+		c->stats.busy_ns += now_ns() - t0;
+		c->stats.jobs += n;
+		if (c != &cs->cards[wk->home])
+			c->stats.stolen += n;
+
+		pthread_mutex_lock(&cs->lock);
+		c->head += n;
+		c->busy = 0;
+		cs->pending -= n;
+		pthread_cond_broadcast(&cs->done);
+		if (c->tail != c->head)
+			pthread_cond_broadcast(&cs->work);
+	}
+	pthread_mutex_unlock(&cs->lock);
+	return NULL;
+}
+
+
+int nf2_cards_open(struct nf2_cards *cs, const char *const *ifaces, int n,
+		   const struct nf2_cards_cfg *cfg) {
+	int i;
+
+	memset(cs, 0, sizeof(*cs));
+	if (n <= 0 || n > NF2_CARDS_MAX || cfg->workers < 0 || cfg->workers > NF2_CARDS_MAX)
+		return -1;
+	cs->cfg = *cfg;
+	for (i = 0; i < n; i++) {
+		cs->num_cards++;
+		if (open_card(&cs->cards[i], i, ifaces[i], cfg)) {
+			for (i = 0; i < cs->num_cards; i++)
+				close_card(&cs->cards[i]);
+			return -1;
+		}
+	}
+
+	pthread_mutex_init(&cs->lock, NULL);
+	pthread_cond_init(&cs->work, NULL);
+	pthread_cond_init(&cs->done, NULL);
+	cs->num_workers = cfg->workers ? cfg->workers : n;
+	for (i = 0; i < cs->num_workers; i++) {
+		cs->workers[i].cards = cs;
+		cs->workers[i].home = i;
+		if (pthread_create(&cs->workers[i].thread, NULL, worker, &cs->workers[i])) {
+			perror("pthread_create");
+			cs->num_workers = i;
+			nf2_cards_close(cs);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+void nf2_cards_close(struct nf2_cards *cs) {
+	int i;
+
+	pthread_mutex_lock(&cs->lock);
+	cs->stop = 1;
+	pthread_cond_broadcast(&cs->work);
+	pthread_mutex_unlock(&cs->lock);
+	for (i = 0; i < cs->num_workers; i++)
+		pthread_join(cs->workers[i].thread, NULL);
+	for (i = 0; i < cs->num_cards; i++)
+		close_card(&cs->cards[i]);
+	pthread_mutex_destroy(&cs->lock);
+	pthread_cond_destroy(&cs->work);
+	pthread_cond_destroy(&cs->done);
+	cs->num_workers = 0;
+	cs->num_cards = 0;
+}
+
+
+//
+// queue: a free job at the tail of a card's ring, waiting for room;
+//    called with the lock held
+//
+static struct nf2_card_job *queue(struct nf2_cards *cs, struct nf2_card *c) {
+	if (c->tail - c->head == NF2_CARDS_QUEUE) {
+		c->stats.queue_full++;
+		while (c->tail - c->head == NF2_CARDS_QUEUE)
+			pthread_cond_wait(&cs->done, &cs->lock);
+	}
+	return &c->jobs[c->tail % NF2_CARDS_QUEUE];
+}
+
+
+static void queued(struct nf2_cards *cs, struct nf2_card *c) {
+	c->tail++;
+	cs->pending++;
+	pthread_cond_broadcast(&cs->work);
+}
+
+
+void nf2_cards_install(struct nf2_cards *cs, int card, const nf2_of_entry_wrap *entries,
+		       const nf2_of_action_wrap *actions, int n) {
+	struct nf2_card *c = &cs->cards[card];
+	struct nf2_card_job *job;
+	int i, k;
+
+	pthread_mutex_lock(&cs->lock);
+	for (i = 0; i < n; i += k) {
+		k = n - i < NF2_EXACT_BATCH ? n - i : NF2_EXACT_BATCH;
+		job = queue(cs, c);
+		job->type = NF2_CARD_INSTALL;
+		job->n = k;
+		memcpy(job->entries, entries + i, k * sizeof(*entries));
+		memcpy(job->actions, actions + i, k * sizeof(*actions));
+		queued(cs, c);
+	}
+	pthread_mutex_unlock(&cs->lock);
+}
+
+
+void nf2_cards_sweep(struct nf2_cards *cs, int card) {
+	struct nf2_card_job *job;
+	int i;
+
+	pthread_mutex_lock(&cs->lock);
+	for (i = 0; i < cs->num_cards; i++) {
+		if (card >= 0 && i != card)
+			continue;
+		job = queue(cs, &cs->cards[i]);
+		job->type = NF2_CARD_SWEEP;
+		job->n = 0;
+		queued(cs, &cs->cards[i]);
+	}
+	pthread_mutex_unlock(&cs->lock);
+}
+
+
+void nf2_cards_wait(struct nf2_cards *cs) {
+	pthread_mutex_lock(&cs->lock);
+	while (cs->pending)
+		pthread_cond_wait(&cs->done, &cs->lock);
+	pthread_mutex_unlock(&cs->lock);
+}
+
+
+void nf2_cards_total(struct nf2_cards *cs, struct nf2_card_stats *sum,
+		     unsigned long *txns, unsigned long long *model_ns) {
+	struct nf2_card_stats *st;
+	int i;
+
+	memset(sum, 0, sizeof(*sum));
+	*txns = 0;
+	*model_ns = 0;
+	for (i = 0; i < cs->num_cards; i++) {
+		st = &cs->cards[i].stats;
+		sum->jobs += st->jobs;
+		sum->stolen += st->stolen;
+		sum->installs += st->installs;
+		sum->install_failures += st->install_failures;
+		sum->sweeps += st->sweeps;
+		sum->swept += st->swept;
+		sum->errors += st->errors;
+		sum->queue_full += st->queue_full;
+		sum->busy_ns += st->busy_ns;
+		sum->pace_ns += st->pace_ns;
+		*txns += cs->cards[i].io->num_txns;
+		*model_ns += cs->cards[i].io->model_ns;
+	}
+}
+
+
+static void print_line(FILE *out, const char *name, const struct nf2_card_stats *st,
+		       unsigned long txns, unsigned long long model_ns) {
+	fprintf(out, "%-8s %7lu %7lu %9lu %7lu %7lu %10lu %10.1f %10.1f %6lu\n", name,
+		st->jobs, st->stolen, st->installs, st->install_failures, st->sweeps, txns,
+		model_ns / 1e6, st->busy_ns / 1e6, st->errors);
+}
+
+
+void nf2_cards_print_stats(struct nf2_cards *cs, FILE *out) {
+	struct nf2_card_stats sum;
+	unsigned long txns;
+	unsigned long long model_ns;
+	int i;
+
+	fprintf(out, "%-8s %7s %7s %9s %7s %7s %10s %10s %10s %6s\n", "card", "jobs", "stolen",
+		"installs", "no fit", "sweeps", "reg txns", "model ms", "busy ms", "errors");
+	for (i = 0; i < cs->num_cards; i++)
+		print_line(out, cs->cards[i].iface, &cs->cards[i].stats,
+			   cs->cards[i].io->num_txns, cs->cards[i].io->model_ns);
+	nf2_cards_total(cs, &sum, &txns, &model_ns);
+	print_line(out, "total", &sum, txns, model_ns);
+}
@@ -0,0 +1,151 @@
+/* ****************************************************************************
+ * Module: nf2_cards.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Several cards in one process: a register worker per card
+ *              and a scheduler for their flow installs and counter
+ *              sweeps.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_CARDS_H_
+#define NF2_CARDS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "nf2_regio.h"
+#include "nf2_emu.h"
+#include "nf2_exact_table.h"
+#include "nf2_harvest.h"
+
+#define NF2_CARDS_MAX		8
+#define NF2_CARDS_QUEUE		256	/* jobs queued per card */
+
+/* an interface name of "emu" opens an emulated card (common/nf2_emu.c),
+ * named emu<n> after its position */
+#define NF2_CARDS_EMU		"emu"
+
+struct nf2_cards_cfg {
+	int workers;			/* threads; 0: one per card */
+	int max_kicks;			/* of each exact table */
+	struct nf2_harvest_cfg harvest;
+
+	/* emulated cards: modelled PCI cost, and whether a worker waits for
+	 * it as it would wait for the bus (otherwise it is only counted) */
+	unsigned emu_txn_ns;
+	unsigned emu_word_ns;
+	int emu_pace;
+};
+
+enum nf2_card_job_type {
+	NF2_CARD_INSTALL,		/* up to NF2_EXACT_BATCH exact flows */
+	NF2_CARD_SWEEP,			/* harvest every exact entry's counters */
+};
+
+struct nf2_card_job {
+	enum nf2_card_job_type type;
+	int n;
+	nf2_of_entry_wrap entries[NF2_EXACT_BATCH];
+	nf2_of_action_wrap actions[NF2_EXACT_BATCH];
+};
+
+struct nf2_card_stats {
+	unsigned long jobs;
+	unsigned long stolen;		/* jobs run by another card's worker */
+	unsigned long installs;		/* flows installed */
+	unsigned long install_failures;	/* flows that did not fit */
+	unsigned long sweeps;
+	unsigned long swept;		/* entries read by the sweeps */
+	unsigned long errors;		/* jobs with a register access failure */
+	unsigned long queue_full;	/* submits that waited for room */
+	uint64_t busy_ns;		/* time a worker held the card */
+	uint64_t pace_ns;		/* of which waiting for the modelled PCI time */
+};
+
+/*
+ * A card: its register handle (the mapped BAR, or an emulator), the host
+ * shadow of its exact table and the harvested totals of its counters,
+ * and a ring of queued jobs. Only one worker holds a card at a time
+ * (busy), so the card's registers and tables need no lock of their own.
+ */
+struct nf2_card {
+	char iface[16];
+	int emulated;
+	struct nf2_emu emu;
+	struct nf2_regio hw_io;
+	struct nf2_regio *io;
+	struct nf2_exact_table exact;
+	struct nf2_harvest harvest;
+
+	struct nf2_card_job *jobs;
+	unsigned head, tail;		/* queued: tail - head */
+	int busy;
+	struct nf2_card_stats stats;
+};
+
+/*
+ * Each worker has a home card and serves it while it has queued jobs.
+ * A worker whose card has none takes the card with the most queued jobs
+ * that no worker holds, so with fewer workers than cards, or a worker
+ * held up, no card's queue waits while another worker is idle. A worker
+ * holds a card for at most NF2_CARDS_GRAB jobs before it looks again.
+ *
+ * The queues and the busy flags are under one lock, taken only to pick
+ * and return jobs; the register accesses of different cards proceed in
+ * parallel, and those of a card in the order its jobs were submitted.
+ */
+#define NF2_CARDS_GRAB		8
+
+struct nf2_cards;
+
+struct nf2_cards_worker {
+	struct nf2_cards *cards;
+	int home;
+	pthread_t thread;
+};
+
+struct nf2_cards {
+	struct nf2_cards_cfg cfg;
+	struct nf2_card cards[NF2_CARDS_MAX];
+	int num_cards;
+
+	struct nf2_cards_worker workers[NF2_CARDS_MAX];
+	int num_workers;
+	pthread_mutex_t lock;
+	pthread_cond_t work;		/* a job was queued or a card let go */
+	pthread_cond_t done;		/* a job finished */
+	unsigned long pending;		/* queued or running */
+	int stop;
+};
+
+/* Opens the cards of ifaces (NF2_CARDS_EMU for an emulated one) and
+ * starts the workers */
+int nf2_cards_open(struct nf2_cards *, const char *const *ifaces, int n,
+		   const struct nf2_cards_cfg *);
+void nf2_cards_close(struct nf2_cards *);
+
+/* Queues the installs of n exact flows on a card, NF2_EXACT_BATCH to a
+ * job; waits while its queue is full */
+void nf2_cards_install(struct nf2_cards *, int card, const nf2_of_entry_wrap *entries,
+		       const nf2_of_action_wrap *actions, int n);
+
+/* Queues a counter sweep of a card, or of every card with card < 0 */
+void nf2_cards_sweep(struct nf2_cards *, int card);
+
+/* Waits until every queued job has run */
+void nf2_cards_wait(struct nf2_cards *);
+
+/* Card of a switch port (nf2c0..3 are card 0, nf2c4..7 card 1, ...) */
+static inline int nf2_cards_of_port(int port) {
+	return port / 4;
+}
+
+/* The stats and register traffic of all cards added up */
+void nf2_cards_total(struct nf2_cards *, struct nf2_card_stats *sum,
+		     unsigned long *txns, unsigned long long *model_ns);
+void nf2_cards_print_stats(struct nf2_cards *, FILE *);
+
+#endif
@@ -0,0 +1,40 @@
+/* ****************************************************************************
+ * Module: nf2_counter.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Widening of the free-running hardware counters into 64-bit
+ *              host counters.
+ *
+ * Change history:
+ *
+ */
+
+#include "nf2_counter.h"
+
+void nf2_counter64_init(struct nf2_counter64 *c, int width) {
+	c->total = 0;
+	c->last = 0;
+	c->width = width;
+	c->primed = 0;
+}
+
+
+//
+// nf2_counter64_update: account a new raw sample and return the increment
+//    since the previous one. The first sample only sets the reference.
+//
+uint32_t nf2_counter64_update(struct nf2_counter64 *c, uint32_t raw) {
+	uint32_t mask = c->width >= 32 ? 0xffffffff : (1u << c->width) - 1;
+	uint32_t delta;
+
+	raw &= mask;
+	if (!c->primed) {
+		c->last = raw;
+		c->primed = 1;
+		return 0;
+	}
+
+	delta = (raw - c->last) & mask;
+	c->last = raw;
+	c->total += delta;
+	return delta;
+}
@@ -0,0 +1,31 @@
+/* ****************************************************************************
+ * Module: nf2_counter.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Widening of the free-running hardware counters into 64-bit
+ *              host counters.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_COUNTER_H_
+#define NF2_COUNTER_H_
+
+#include <stdint.h>
+
+/*
+ * A hardware counter of 'width' bits that wraps around, and the 64-bit
+ * total accumulated on the host. The counter must be sampled at least
+ * once per wrap period, otherwise whole wraps are lost.
+ */
+struct nf2_counter64 {
+	uint64_t total;
+	uint32_t last;
+	uint8_t width;
+	uint8_t primed;
+};
+
+void nf2_counter64_init(struct nf2_counter64 *, int width);
+uint32_t nf2_counter64_update(struct nf2_counter64 *, uint32_t raw);
+
+#endif
@@ -0,0 +1,163 @@
+/* ****************************************************************************
+ * Module: nf2_emu.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Register file emulator of the OpenFlow switch, to run and
+ *              measure the host code without a card.
+ *
+ * Change history:
+ *
+ */
+
+#include <string.h>
+
+#include "nf2_emu.h"
+
+#define EXACT_BASE	NF2_EXACT_ADDR(0, 0)
+#define EXACT_END	NF2_EXACT_ADDR(OPENFLOW_NF2_EXACT_TABLE_SIZE, 0)
+
+/* what a read of the first counter word clears: packet count [23:0] */
+#define PKT_CLEARED_BITS	0x00ffffff
+
+/* the bits of the last compare and mask word that the TCAM holds; it
+ * reads the others back as zero */
+#define CMP_LAST_WORD_BITS	0x00ffffff
+
+static void copy_words(struct nf2_regio *io, unsigned reg, uint32_t *words, int n, int load) {
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (load)
+			*nf2_regio_mock_reg(io, reg + i * 4) = words[i];
+		else
+			words[i] = *nf2_regio_mock_reg(io, reg + i * 4);
+	}
+}
+
+
+//
+// windows: commit (load = 0) the CMP, CMP_MASK and ACTION windows to a
+//    wildcard entry or load them with it (load = 1)
+//
+static void windows(struct nf2_regio *io, struct nf2_emu_wildcard *w, int load) {
+	copy_words(io, OPENFLOW_WILDCARD_LOOKUP_CMP_0_REG, w->cmp,
+		   OPENFLOW_WILDCARD_NUM_CMP_WORDS_USED, load);
+	copy_words(io, OPENFLOW_WILDCARD_LOOKUP_CMP_MASK_0_REG, w->mask,
+		   OPENFLOW_WILDCARD_NUM_CMP_WORDS_USED, load);
+	copy_words(io, OPENFLOW_WILDCARD_LOOKUP_ACTION_0_REG, w->action,
+		   OPENFLOW_WILDCARD_NUM_DATA_WORDS_USED, load);
+}
+
+
+static void write_hook(struct nf2_regio *io, unsigned reg, int n) {
+	struct nf2_emu *emu = io->mock_arg;
+	uint32_t index;
+	int i;
+
+	/* in address order, as the words of the block reach the card */
+	for (i = 0; i < n; i++, reg += 4) {
+		if (reg != OPENFLOW_WILDCARD_LOOKUP_READ_ADDR_REG &&
+		    reg != OPENFLOW_WILDCARD_LOOKUP_WRITE_ADDR_REG)
+			continue;
+		/* the state machine only looks at the low address bits */
+		index = *nf2_regio_mock_reg(io, reg) % OPENFLOW_WILDCARD_TABLE_SIZE;
+		if (reg == OPENFLOW_WILDCARD_LOOKUP_WRITE_ADDR_REG) {
+			windows(io, &emu->wildcard[index], 0);
+			emu->wildcard[index].cmp[OPENFLOW_WILDCARD_NUM_CMP_WORDS_USED - 1] &=
+				CMP_LAST_WORD_BITS;
+			emu->wildcard[index].mask[OPENFLOW_WILDCARD_NUM_CMP_WORDS_USED - 1] &=
+				CMP_LAST_WORD_BITS;
+			emu->wildcard_commits++;
+		}
+		else {
+			windows(io, &emu->wildcard[index], 1);
+			emu->wildcard_loads++;
+		}
+	}
+}
+
+
+static void read_hook(struct nf2_regio *io, unsigned reg, int n) {
+	struct nf2_emu *emu = io->mock_arg;
+	unsigned word;
+	int i;
+
+	for (i = 0; i < n; i++, reg += 4) {
+		if (reg < EXACT_BASE || reg >= EXACT_END)
+			continue;
+		word = (reg - EXACT_BASE) / 4 % NF2_EXACT_ENTRY_WORDS;
+		if (word == OPENFLOW_EXACT_ENTRY_COUNTERS_POS) {
+			*nf2_regio_mock_reg(io, reg) &= ~PKT_CLEARED_BITS;
+			emu->counter_clears++;
+		}
+		else if (word == OPENFLOW_EXACT_ENTRY_COUNTERS_POS + 1) {
+			*nf2_regio_mock_reg(io, reg) = 0;
+			emu->counter_clears++;
+		}
+	}
+}
+
+
+int nf2_emu_open(struct nf2_emu *emu, unsigned txn_ns, unsigned word_ns) {
+	memset(emu, 0, sizeof(*emu));
+	if (nf2_regio_open_mock(&emu->io, txn_ns, word_ns))
+		return -1;
+	emu->io.mock_read_hook = read_hook;
+	emu->io.mock_write_hook = write_hook;
+	emu->io.mock_arg = emu;
+	return 0;
+}
+
+
+void nf2_emu_close(struct nf2_emu *emu) {
+	nf2_regio_close(&emu->io);
+}
+
+
+//
+// nf2_emu_reset: what a reset or table_flush leaves: all of SRAM zero
+//    (do_reset of sram_arbiter) and every wildcard entry clear
+//
+void nf2_emu_reset(struct nf2_emu *emu) {
+	unsigned reg;
+
+	for (reg = EXACT_BASE; reg < EXACT_END; reg += 4)
+		*nf2_regio_mock_reg(&emu->io, reg) = 0;
+	memset(emu->wildcard, 0, sizeof(emu->wildcard));
+}
+
+
+void nf2_emu_exact_hit(struct nf2_emu *emu, int index, uint32_t bytes) {
+	uint32_t *cntrs = nf2_regio_mock_reg(&emu->io,
+					     NF2_EXACT_ADDR(index, OPENFLOW_EXACT_ENTRY_COUNTERS_POS));
+	uint32_t timer = *nf2_regio_mock_reg(&emu->io, OPENFLOW_LOOKUP_TIMER_REG);
+	uint32_t pkts = (*cntrs >> OPENFLOW_EXACT_ENTRY_PKT_COUNTER_POS) + 1;
+
+	*cntrs = ((pkts & NF2_EXACT_PKT_MASK) << OPENFLOW_EXACT_ENTRY_PKT_COUNTER_POS) |
+		 ((timer & NF2_EXACT_LAST_SEEN_MASK) << OPENFLOW_EXACT_ENTRY_LAST_SEEN_POS);
+	*nf2_regio_mock_reg(&emu->io, NF2_EXACT_ADDR(index, OPENFLOW_EXACT_ENTRY_COUNTERS_POS + 1))
+		+= bytes;
+	(*nf2_regio_mock_reg(&emu->io, OPENFLOW_LOOKUP_EXACT_HITS_REG))++;
+}
+
+
+void nf2_emu_wildcard_hit(struct nf2_emu *emu, int index, uint32_t bytes) {
+	(*nf2_regio_mock_reg(&emu->io, OPENFLOW_WILDCARD_LOOKUP_PKTS_HIT_0_REG + index * 4))++;
+	*nf2_regio_mock_reg(&emu->io, OPENFLOW_WILDCARD_LOOKUP_BYTES_HIT_0_REG + index * 4) += bytes;
+	(*nf2_regio_mock_reg(&emu->io, OPENFLOW_LOOKUP_WILDCARD_HITS_REG))++;
+}
+
+
+void nf2_emu_set_timer(struct nf2_emu *emu, uint32_t timer) {
+	*nf2_regio_mock_reg(&emu->io, OPENFLOW_LOOKUP_TIMER_REG) = timer;
+}
+
+
+int nf2_emu_wildcard_holds(const struct nf2_emu_wildcard *w, const nf2_of_entry_wrap *entry,
+			   const nf2_of_mask_wrap *mask, const nf2_of_action_wrap *action) {
+	int last = OPENFLOW_WILDCARD_NUM_CMP_WORDS_USED - 1;
+
+	return !memcmp(w->cmp, entry->raw, last * 4) && !memcmp(w->mask, mask->raw, last * 4) &&
+	       w->cmp[last] == (entry->raw[last] & CMP_LAST_WORD_BITS) &&
+	       w->mask[last] == (mask->raw[last] & CMP_LAST_WORD_BITS) &&
+	       !memcmp(w->action, action->raw, sizeof(w->action));
+}
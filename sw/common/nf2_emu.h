@@ -0,0 +1,79 @@
+/* ****************************************************************************
+ * Module: nf2_emu.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Register file emulator of the OpenFlow switch, to run and
+ *              measure the host code without a card.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_EMU_H_
+#define NF2_EMU_H_
+
+#include <stdint.h>
+
+#include "../../lib/C/reg_defines_openflow_switch.h"
+#include "nf2_regio.h"
+#include "nf2_of_hw.h"
+
+/*
+ * The emulator is the mock register file of nf2_regio with the semantics
+ * the host code depends on:
+ *
+ *  - writing an index to OPENFLOW_WILDCARD_LOOKUP_WRITE_ADDR_REG commits
+ *    the CMP, CMP_MASK and ACTION windows to that wildcard entry, writing
+ *    one to OPENFLOW_WILDCARD_LOOKUP_READ_ADDR_REG loads the windows with
+ *    it (unencoded_cam_lut_sm); the windows otherwise keep what was
+ *    written to them. The entry keeps only the key's bits of the last
+ *    CMP and CMP_MASK word and reads the top byte back as zero.
+ *  - the exact table lives in SRAM behind the arbiter, NF2_EXACT_ADDR;
+ *    reading the counter words clears them (the packet count bits [23:0]
+ *    of the first, all of the second), as in sram_arbiter.
+ *  - nf2_emu_reset clears SRAM and the wildcard table, as a reset or the
+ *    watchdog's table_flush does.
+ *
+ * Every access goes through emu->io, which counts transactions and words
+ * and charges the modelled PCI cost (txn_ns per transaction, word_ns per
+ * word) to io.model_ns. With the readReg/writeReg of nf2util_emu.c linked
+ * in place of nf2util, the ioctl backend and any tool built on it run on
+ * the emulator unchanged, one transaction per register.
+ */
+struct nf2_emu_wildcard {
+	uint32_t cmp[OPENFLOW_WILDCARD_NUM_CMP_WORDS_USED];
+	uint32_t mask[OPENFLOW_WILDCARD_NUM_CMP_WORDS_USED];
+	uint32_t action[OPENFLOW_WILDCARD_NUM_DATA_WORDS_USED];
+};
+
+struct nf2_emu {
+	struct nf2_regio io;
+	struct nf2_emu_wildcard wildcard[OPENFLOW_WILDCARD_TABLE_SIZE];
+	unsigned long wildcard_commits;
+	unsigned long wildcard_loads;
+	unsigned long counter_clears;	/* counter words cleared on read */
+};
+
+int nf2_emu_open(struct nf2_emu *, unsigned txn_ns, unsigned word_ns);
+void nf2_emu_close(struct nf2_emu *);
+void nf2_emu_reset(struct nf2_emu *);
+
+/*
+ * Traffic, as the lookup modules count it; not register traffic. An exact
+ * hit adds a packet (the 25-bit counter wraps) and its bytes and stamps
+ * last_seen with the timer register. A wildcard hit adds to the hit
+ * counters of the index.
+ */
+void nf2_emu_exact_hit(struct nf2_emu *, int index, uint32_t bytes);
+void nf2_emu_wildcard_hit(struct nf2_emu *, int index, uint32_t bytes);
+void nf2_emu_set_timer(struct nf2_emu *, uint32_t timer);
+
+/* Whether a wildcard entry holds entry, mask and action, as far as the
+ * TCAM keeps them */
+int nf2_emu_wildcard_holds(const struct nf2_emu_wildcard *, const nf2_of_entry_wrap *,
+			   const nf2_of_mask_wrap *, const nf2_of_action_wrap *);
+
+/* The emulator behind readReg/writeReg of nf2util_emu.c, opened by the
+ * first openDescriptor (or register access) */
+extern struct nf2_emu nf2util_emu;
+
+#endif
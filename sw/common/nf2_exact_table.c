@@ -0,0 +1,421 @@
+/* ****************************************************************************
+ * Module: nf2_exact_table.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host shadow of the exact match table with cuckoo placement.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nf2_hash.h"
+#include "nf2_exact_table.h"
+#include "nf2_tablesnap.h"
+
+/* Bytes of the entry that the hardware compares (the pad byte holds the
+ * valid bit) */
+#define ENTRY_KEY_LEN	(sizeof(struct nf2_of_entry) - 1)
+
+
+int nf2_exact_table_init(struct nf2_exact_table *tbl, struct nf2_regio *io,
+			 int max_kicks) {
+	memset(tbl, 0, sizeof(*tbl));
+	if (max_kicks < 0 || max_kicks > NF2_EXACT_MAX_KICKS)
+		return -1;
+
+	tbl->io = io;
+	tbl->size = OPENFLOW_NF2_EXACT_TABLE_SIZE;
+	tbl->max_kicks = max_kicks;
+	tbl->diff_writes = 1;
+	tbl->slots = calloc(tbl->size, sizeof(*tbl->slots));
+	tbl->visit_gen = calloc(tbl->size, sizeof(*tbl->visit_gen));
+	tbl->parent = calloc(tbl->size, sizeof(*tbl->parent));
+	tbl->queue = calloc(tbl->size, sizeof(*tbl->queue));
+	if (tbl->slots == NULL || tbl->visit_gen == NULL ||
+	    tbl->parent == NULL || tbl->queue == NULL) {
+		nf2_exact_table_free(tbl);
+		return -1;
+	}
+
+	nf2_hash_init();
+	return 0;
+}
+
+
+void nf2_exact_table_free(struct nf2_exact_table *tbl) {
+	free(tbl->slots);
+	free(tbl->visit_gen);
+	free(tbl->parent);
+	free(tbl->queue);
+	tbl->slots = NULL;
+	tbl->visit_gen = NULL;
+	tbl->parent = NULL;
+	tbl->queue = NULL;
+}
+
+
+static int same_flow(const nf2_of_entry_wrap *a, const nf2_of_entry_wrap *b) {
+	return memcmp(a, b, ENTRY_KEY_LEN) == 0;
+}
+
+
+//
+// hw_write: write the flow of a slot to the card. The slot must be free
+//    or invalidated on the card.
+//
+static int hw_write(struct nf2_exact_table *tbl, int idx, uint32_t last_seen) {
+	struct nf2_exact_slot *slot = &tbl->slots[idx];
+
+	tbl->stats.hw_writes++;
+	if (tbl->io != NULL &&
+	    nf2_of_exact_write(tbl->io, idx, &slot->entry, &slot->action, last_seen))
+		return -1;
+	if (tbl->snap != NULL)
+		nf2_tablesnap_exact(tbl->snap, idx, &slot->entry, &slot->action);
+	return 0;
+}
+
+
+static int hw_invalidate(struct nf2_exact_table *tbl, int idx) {
+	tbl->stats.hw_writes++;
+	if (tbl->io != NULL && nf2_of_exact_invalidate(tbl->io, idx))
+		return -1;
+	if (tbl->snap != NULL)
+		nf2_tablesnap_exact(tbl->snap, idx, NULL, NULL);
+	return 0;
+}
+
+
+//
+// carry_counters: add what slot src counted since the last read to the
+//    flow in slot dst.
+//
+static int carry_counters(struct nf2_exact_table *tbl, int src, int dst,
+			  uint32_t *last_seen) {
+	uint32_t pkts, bytes;
+
+	if (tbl->io == NULL)
+		return 0;
+	if (nf2_of_exact_read_counters(tbl->io, src, &pkts, &bytes, last_seen))
+		return -1;
+	tbl->slots[dst].carry_pkts += pkts;
+	tbl->slots[dst].carry_bytes += bytes;
+	return 0;
+}
+
+
+//
+// move: relocate the flow in slot src to the free slot dst, leaving src
+//    invalid on the card.
+//
+static int move(struct nf2_exact_table *tbl, int src, int dst) {
+	uint32_t last_seen = 0;
+
+	tbl->slots[dst] = tbl->slots[src];
+	if (carry_counters(tbl, src, dst, &last_seen) ||
+	    hw_write(tbl, dst, last_seen) ||
+	    hw_invalidate(tbl, src) ||
+	    carry_counters(tbl, src, dst, NULL))
+		return -1;
+	tbl->slots[src].used = 0;
+	tbl->stats.moves++;
+	return 0;
+}
+
+
+static int lookup(struct nf2_exact_table *tbl, nf2_of_entry_wrap *entry,
+		  uint32_t *hash) {
+	int i;
+
+	nf2_header_hash(entry, &hash[0], &hash[1]);
+	for (i = 0; i < 2; i++) {
+		if (tbl->slots[hash[i]].used &&
+		    same_flow(&tbl->slots[hash[i]].entry, entry))
+			return hash[i];
+	}
+	return -1;
+}
+
+
+//
+// find_path: breadth first search for the shortest chain of moves that
+//    frees one of the two root slots. Returns the free slot at the end of
+//    the chain (follow tbl->parent back to the root) and its length.
+//
+static int find_path(struct nf2_exact_table *tbl, const uint32_t *hash, int *len) {
+	int head = 0, tail = 0, level_end, level = 0;
+	int i, s, alt;
+
+	if (++tbl->gen == 0) {
+		memset(tbl->visit_gen, 0, tbl->size * sizeof(*tbl->visit_gen));
+		tbl->gen = 1;
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (tbl->visit_gen[hash[i]] == tbl->gen)
+			continue;
+		tbl->visit_gen[hash[i]] = tbl->gen;
+		tbl->parent[hash[i]] = -1;
+		tbl->queue[tail++] = hash[i];
+	}
+
+	while (head < tail && level < tbl->max_kicks) {
+		level_end = tail;
+		for (; head < level_end; head++) {
+			struct nf2_exact_slot *slot;
+
+			s = tbl->queue[head];
+			slot = &tbl->slots[s];
+			alt = slot->hash[0] == s ? slot->hash[1] : slot->hash[0];
+			if (tbl->visit_gen[alt] == tbl->gen)
+				continue;
+
+			tbl->visit_gen[alt] = tbl->gen;
+			tbl->parent[alt] = s;
+			if (!tbl->slots[alt].used) {
+				*len = level + 1;
+				return alt;
+			}
+			tbl->queue[tail++] = alt;
+		}
+		level++;
+	}
+	return -1;
+}
+
+
+//
+// insert: nf2_exact_insert, but returns -2 if the flow did not fit and -1
+//    only if a register access failed
+//
+static int insert(struct nf2_exact_table *tbl, nf2_of_entry_wrap *entry,
+		  nf2_of_action_wrap *action) {
+	uint32_t hash[2], timer = 0;
+	int idx, dst, src, len = 0;
+
+	idx = lookup(tbl, entry, hash);
+	if (idx >= 0) {
+		tbl->stats.updates++;
+		return nf2_exact_modify(tbl, entry, action);
+	}
+
+	if (!tbl->slots[hash[0]].used) {
+		idx = hash[0];
+	}
+	else if (!tbl->slots[hash[1]].used) {
+		idx = hash[1];
+	}
+	else {
+		tbl->stats.collisions++;
+		dst = find_path(tbl, hash, &len);
+		if (dst < 0) {
+			tbl->stats.failures++;
+			return -2;
+		}
+
+		/* Move the chain from its free end back to the root */
+		while ((src = tbl->parent[dst]) != -1) {
+			if (move(tbl, src, dst))
+				return -1;
+			dst = src;
+		}
+		idx = dst;
+	}
+
+	if (tbl->io != NULL &&
+	    nf2_regio_read(tbl->io, OPENFLOW_LOOKUP_TIMER_REG, &timer))
+		return -1;
+
+	memset(&tbl->slots[idx], 0, sizeof(tbl->slots[idx]));
+	tbl->slots[idx].entry = *entry;
+	tbl->slots[idx].action = *action;
+	tbl->slots[idx].hash[0] = hash[0];
+	tbl->slots[idx].hash[1] = hash[1];
+	tbl->slots[idx].used = 1;
+	if (hw_write(tbl, idx, timer))
+		return -1;
+
+	tbl->used++;
+	tbl->stats.inserts++;
+	tbl->stats.chain_len[len]++;
+	return idx;
+}
+
+
+int nf2_exact_insert(struct nf2_exact_table *tbl, nf2_of_entry_wrap *entry,
+		     nf2_of_action_wrap *action) {
+	int idx = insert(tbl, entry, action);
+
+	return idx < 0 ? -1 : idx;
+}
+
+
+//
+// write_batch: write the flows of n slots placed by nf2_exact_insert_batch
+//
+static int write_batch(struct nf2_exact_table *tbl, const int *slots, int n) {
+	nf2_of_entry_wrap entries[NF2_EXACT_BATCH];
+	nf2_of_action_wrap actions[NF2_EXACT_BATCH];
+	uint32_t timer = 0;
+	int i;
+
+	tbl->stats.hw_writes += n;
+	if (tbl->io != NULL) {
+		for (i = 0; i < n; i++) {
+			entries[i] = tbl->slots[slots[i]].entry;
+			actions[i] = tbl->slots[slots[i]].action;
+		}
+		if (nf2_regio_read(tbl->io, OPENFLOW_LOOKUP_TIMER_REG, &timer) ||
+		    nf2_of_exact_write_batch(tbl->io, slots, entries, actions, n, timer))
+			return -1;
+	}
+	if (tbl->snap != NULL) {
+		for (i = 0; i < n; i++)
+			nf2_tablesnap_exact(tbl->snap, slots[i], &tbl->slots[slots[i]].entry,
+					    &tbl->slots[slots[i]].action);
+	}
+	return 0;
+}
+
+
+int nf2_exact_insert_batch(struct nf2_exact_table *tbl, nf2_of_entry_wrap *entries,
+			   nf2_of_action_wrap *actions, int n, int *idx) {
+	struct nf2_exact_slot *slot;
+	int slots[NF2_EXACT_BATCH];
+	uint32_t hash[2];
+	int i, s, m = 0, failed = 0;
+
+	/* -2: needs moves, inserted after the batch */
+	for (i = 0; i < n; i++) {
+		idx[i] = lookup(tbl, &entries[i], hash);
+		if (idx[i] >= 0) {
+			tbl->stats.updates++;
+			idx[i] = nf2_exact_modify(tbl, &entries[i], &actions[i]);
+			if (idx[i] < 0)
+				return -1;
+			continue;
+		}
+		if (!tbl->slots[hash[0]].used)
+			s = hash[0];
+		else if (!tbl->slots[hash[1]].used)
+			s = hash[1];
+		else {
+			idx[i] = -2;
+			continue;
+		}
+
+		slot = &tbl->slots[s];
+		memset(slot, 0, sizeof(*slot));
+		slot->entry = entries[i];
+		slot->action = actions[i];
+		slot->hash[0] = hash[0];
+		slot->hash[1] = hash[1];
+		slot->used = 1;
+		tbl->used++;
+		tbl->stats.inserts++;
+		tbl->stats.chain_len[0]++;
+		idx[i] = s;
+		slots[m++] = s;
+		if (m == NF2_EXACT_BATCH) {
+			if (write_batch(tbl, slots, m))
+				return -1;
+			m = 0;
+		}
+	}
+	if (m && write_batch(tbl, slots, m))
+		return -1;
+
+	/* only a flow with no free slot within max_kicks moves did not fit */
+	for (i = 0; i < n; i++) {
+		if (idx[i] != -2)
+			continue;
+		idx[i] = insert(tbl, &entries[i], &actions[i]);
+		if (idx[i] == -1)
+			return -1;
+		if (idx[i] < 0) {
+			idx[i] = -1;
+			failed++;
+		}
+	}
+	return failed;
+}
+
+
+int nf2_exact_modify(struct nf2_exact_table *tbl, nf2_of_entry_wrap *entry,
+		     nf2_of_action_wrap *action) {
+	uint32_t hash[2];
+	int idx, ret;
+
+	idx = lookup(tbl, entry, hash);
+	if (idx < 0)
+		return -1;
+
+	tbl->stats.hw_writes++;
+	if (tbl->io != NULL) {
+		if (tbl->diff_writes)
+			ret = nf2_of_exact_modify_action(tbl->io, idx, &tbl->slots[idx].action,
+							 action);
+		else
+			ret = nf2_of_exact_write_action(tbl->io, idx, action);
+		if (ret)
+			return -1;
+	}
+	tbl->slots[idx].action = *action;
+	if (tbl->snap != NULL)
+		nf2_tablesnap_exact(tbl->snap, idx, entry, action);
+	return idx;
+}
+
+
+int nf2_exact_delete(struct nf2_exact_table *tbl, nf2_of_entry_wrap *entry) {
+	uint32_t hash[2];
+	int idx;
+
+	idx = lookup(tbl, entry, hash);
+	if (idx < 0)
+		return -1;
+
+	if (hw_invalidate(tbl, idx))
+		return -1;
+	memset(&tbl->slots[idx], 0, sizeof(tbl->slots[idx]));
+	tbl->used--;
+	tbl->stats.deletes++;
+	return idx;
+}
+
+
+int nf2_exact_find(struct nf2_exact_table *tbl, nf2_of_entry_wrap *entry) {
+	uint32_t hash[2];
+
+	return lookup(tbl, entry, hash);
+}
+
+
+double nf2_exact_load_factor(struct nf2_exact_table *tbl) {
+	return (double)tbl->used / tbl->size;
+}
+
+
+void nf2_exact_print_stats(struct nf2_exact_table *tbl, FILE *f) {
+	struct nf2_exact_stats *st = &tbl->stats;
+	int i;
+
+	fprintf(f, "entries:      %d/%d (load %.1f%%)\n", tbl->used, tbl->size,
+		100.0 * nf2_exact_load_factor(tbl));
+	fprintf(f, "inserts:      %lu (updates %lu, deletes %lu)\n",
+		st->inserts, st->updates, st->deletes);
+	fprintf(f, "collisions:   %lu (both candidate slots taken)\n", st->collisions);
+	fprintf(f, "failures:     %lu (no free slot within %d moves)\n",
+		st->failures, tbl->max_kicks);
+	fprintf(f, "moves:        %lu\n", st->moves);
+	fprintf(f, "table writes: %lu\n", st->hw_writes);
+	fprintf(f, "chain length:");
+	for (i = 0; i <= tbl->max_kicks; i++) {
+		if (st->chain_len[i])
+			fprintf(f, " %d:%lu", i, st->chain_len[i]);
+	}
+	fprintf(f, "\n");
+}
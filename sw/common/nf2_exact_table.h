@@ -0,0 +1,120 @@
+/* ****************************************************************************
+ * Module: nf2_exact_table.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host shadow of the exact match table with cuckoo placement.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_EXACT_TABLE_H_
+#define NF2_EXACT_TABLE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "nf2_regio.h"
+#include "nf2_of_hw.h"
+
+struct nf2_tablesnap;
+
+#define NF2_EXACT_DEFAULT_MAX_KICKS	8
+#define NF2_EXACT_MAX_KICKS		32
+
+struct nf2_exact_slot {
+	nf2_of_entry_wrap entry;
+	nf2_of_action_wrap action;
+	uint16_t hash[2];		/* the two candidate slots of the flow */
+	uint8_t used;
+
+	/* Counters the flow collected in the slots it was moved out of */
+	uint64_t carry_pkts;
+	uint64_t carry_bytes;
+};
+
+struct nf2_exact_stats {
+	unsigned long inserts;
+	unsigned long updates;		/* insert of a flow already present */
+	unsigned long deletes;
+	unsigned long failures;		/* no free slot within max_kicks moves */
+	unsigned long collisions;	/* both candidate slots were taken */
+	unsigned long moves;		/* flows relocated to their other slot */
+	unsigned long hw_writes;	/* entries (or actions) written */
+	unsigned long chain_len[NF2_EXACT_MAX_KICKS + 1];
+};
+
+/*
+ * The table places a flow in the slot of hash_0 or hash_1 (as computed by
+ * header_hash). When both are taken it searches, breadth first, for the
+ * shortest chain of at most max_kicks flows that can each move to their
+ * other slot, ending in a free slot.
+ *
+ * This does not reach the 90% occupancy of bucketized cuckoo tables.
+ * exact_match checks two slots of one entry each, and two choices with
+ * one entry per bucket saturate near 50% load, however long the chains:
+ * bench/cuckoobench has its first failure at 50% and tops out below 60%
+ * even with 32 kicks. A higher load needs buckets of several entries
+ * per hash (or more hash functions), which the hardware does not read;
+ * flows that do not fit go to the controller or the software fast path.
+ *
+ * The chain is written from its free end backwards: each flow is first
+ * copied to its other slot, and only then is its old slot invalidated and
+ * reused, so every flow stays reachable in one of its two slots during
+ * the insert and no packet matches a half written entry. The counters of
+ * the old slot are read once before the copy (to keep its last seen
+ * time) and once after the invalidation, and added to the moved flow's
+ * carry_pkts/carry_bytes.
+ *
+ * A modify writes only the action words that changed, unless diff_writes
+ * is cleared.
+ *
+ * With a NULL register handle the table only keeps the shadow and counts
+ * the writes it would have issued, which is useful for capacity planning.
+ *
+ * With snap set, every entry written or invalidated is recorded in the
+ * table image (see nf2_tablesnap.h).
+ */
+struct nf2_exact_table {
+	struct nf2_regio *io;
+	struct nf2_exact_slot *slots;
+	int size;
+	int used;
+	int max_kicks;
+	int diff_writes;
+	struct nf2_tablesnap *snap;
+	struct nf2_exact_stats stats;
+
+	/* breadth-first search state */
+	uint32_t *visit_gen;
+	int32_t *parent;
+	int32_t *queue;
+	uint32_t gen;
+};
+
+int nf2_exact_table_init(struct nf2_exact_table *, struct nf2_regio *, int max_kicks);
+void nf2_exact_table_free(struct nf2_exact_table *);
+
+int nf2_exact_insert(struct nf2_exact_table *, nf2_of_entry_wrap *, nf2_of_action_wrap *);
+int nf2_exact_modify(struct nf2_exact_table *, nf2_of_entry_wrap *, nf2_of_action_wrap *);
+
+/*
+ * Inserts n flows; idx[i] gets what nf2_exact_insert returns for flow i.
+ * The flows that have a free candidate slot are placed first and written
+ * together (nf2_of_exact_write_batch), NF2_EXACT_BATCH at a time with one
+ * read of the lookup timer each; the flows already present are modified
+ * and those that need moves are inserted one by one after them. Returns
+ * the number of flows that found no free slot within max_kicks moves
+ * (idx -1), or -1 if a register access failed, and then stops with idx
+ * filled in only up to the failure.
+ */
+#define NF2_EXACT_BATCH		64
+
+int nf2_exact_insert_batch(struct nf2_exact_table *, nf2_of_entry_wrap *entries,
+			   nf2_of_action_wrap *actions, int n, int *idx);
+int nf2_exact_delete(struct nf2_exact_table *, nf2_of_entry_wrap *);
+int nf2_exact_find(struct nf2_exact_table *, nf2_of_entry_wrap *);
+
+double nf2_exact_load_factor(struct nf2_exact_table *);
+void nf2_exact_print_stats(struct nf2_exact_table *, FILE *);
+
+#endif
@@ -0,0 +1,287 @@
+/* ****************************************************************************
+ * Module: nf2_expire.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Idle and hard timeouts of the exact entries.
+ *
+ *              Level l of the wheel holds deadlines less than 64^(l+1)
+ *              seconds ahead, in slots of 64^l seconds; a slot of level
+ *              l > 0 is cascaded down when the wheel reaches its start.
+ *              The lists are linked through per-entry index arrays, so
+ *              nothing is allocated after init. Entries found expired
+ *              on the wheel wait on the due list until a run has room
+ *              for them.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nf2_expire.h"
+#include "nf2_of_hw.h"
+
+#define NONE		(-1)
+#define DUE		(NF2_EXPIRE_LEVELS * NF2_EXPIRE_SLOTS)
+#define SLOT_MASK	(NF2_EXPIRE_SLOTS - 1)
+
+
+int nf2_expire_init(struct nf2_expire *e, struct nf2_harvest *h, uint32_t timer) {
+	int i;
+
+	memset(e, 0, sizeof(*e));
+	e->h = h;
+	e->now = timer;
+	e->next = malloc(NF2_HARVEST_ENTRIES * sizeof(*e->next));
+	e->prev = malloc(NF2_HARVEST_ENTRIES * sizeof(*e->prev));
+	e->list = malloc(NF2_HARVEST_ENTRIES * sizeof(*e->list));
+	e->idle_s = calloc(NF2_HARVEST_ENTRIES, sizeof(*e->idle_s));
+	e->hard_s = calloc(NF2_HARVEST_ENTRIES, sizeof(*e->hard_s));
+	e->install = calloc(NF2_HARVEST_ENTRIES, sizeof(*e->install));
+	if (e->next == NULL || e->prev == NULL || e->list == NULL || e->idle_s == NULL ||
+	    e->hard_s == NULL || e->install == NULL) {
+		nf2_expire_free(e);
+		return -1;
+	}
+
+	for (i = 0; i < NF2_HARVEST_ENTRIES; i++)
+		e->list[i] = NONE;
+	for (i = 0; i <= DUE; i++)
+		e->head[i] = NONE;
+	return 0;
+}
+
+
+void nf2_expire_free(struct nf2_expire *e) {
+	free(e->next);
+	free(e->prev);
+	free(e->list);
+	free(e->idle_s);
+	free(e->hard_s);
+	free(e->install);
+	e->next = e->prev = NULL;
+	e->list = NULL;
+	e->idle_s = e->hard_s = NULL;
+	e->install = NULL;
+}
+
+
+static void list_add(struct nf2_expire *e, int index, int list) {
+	e->list[index] = list;
+	e->prev[index] = NONE;
+	e->next[index] = e->head[list];
+	if (e->head[list] != NONE)
+		e->prev[e->head[list]] = index;
+	e->head[list] = index;
+}
+
+
+static void list_del(struct nf2_expire *e, int index) {
+	if (e->prev[index] != NONE)
+		e->next[e->prev[index]] = e->next[index];
+	else
+		e->head[e->list[index]] = e->next[index];
+	if (e->next[index] != NONE)
+		e->prev[e->next[index]] = e->prev[index];
+	e->list[index] = NONE;
+}
+
+
+/* the second an entry expires, by what is known of its last use */
+static uint32_t deadline(const struct nf2_expire *e, int index,
+			 enum nf2_expire_reason *reason) {
+	uint64_t idle_at = UINT64_MAX, hard_at = UINT64_MAX;
+	uint32_t used = e->h->flows[index].last_used;
+
+	if (e->idle_s[index])
+		idle_at = (uint64_t)(used > e->install[index] ? used : e->install[index]) +
+			  e->idle_s[index];
+	if (e->hard_s[index])
+		hard_at = (uint64_t)e->install[index] + e->hard_s[index];
+
+	*reason = hard_at <= idle_at ? NF2_EXPIRE_HARD : NF2_EXPIRE_IDLE;
+	return hard_at <= idle_at ? hard_at : idle_at;
+}
+
+
+//
+// schedule: put an entry in the wheel at second when, or in the slot
+//    being processed if that has passed
+//
+static void schedule(struct nf2_expire *e, int index, uint32_t when) {
+	uint32_t delta;
+	int level;
+
+	if ((int32_t)(when - e->now) < 0)
+		when = e->now;
+	delta = when - e->now;
+	if (delta >= NF2_EXPIRE_SPAN) {
+		/* fires early and goes back in */
+		delta = NF2_EXPIRE_SPAN - 1;
+		when = e->now + delta;
+	}
+
+	for (level = 0; delta >> ((level + 1) * NF2_EXPIRE_SLOT_BITS); level++)
+		;
+	list_add(e, index, level * NF2_EXPIRE_SLOTS +
+		 ((when >> (level * NF2_EXPIRE_SLOT_BITS)) & SLOT_MASK));
+}
+
+
+//
+// take: detach a list whole. Returns its first entry
+//
+static int take(struct nf2_expire *e, int list) {
+	int first = e->head[list];
+
+	e->head[list] = NONE;
+	return first;
+}
+
+
+//
+// tick: process second e->now: cascade the higher slots that start now,
+//    then check the entries of the level 0 slot
+//
+static void tick(struct nf2_expire *e) {
+	enum nf2_expire_reason reason;
+	uint32_t s = e->now, when;
+	int level, i, next;
+
+	for (level = NF2_EXPIRE_LEVELS - 1; level > 0; level--) {
+		if (s & ((1u << (level * NF2_EXPIRE_SLOT_BITS)) - 1))
+			continue;
+		for (i = take(e, level * NF2_EXPIRE_SLOTS +
+			      ((s >> (level * NF2_EXPIRE_SLOT_BITS)) & SLOT_MASK)); i != NONE; i = next) {
+			next = e->next[i];
+			schedule(e, i, deadline(e, i, &reason));
+			e->stats.cascaded++;
+		}
+	}
+
+	for (i = take(e, s & SLOT_MASK); i != NONE; i = next) {
+		next = e->next[i];
+		e->stats.fired++;
+		when = deadline(e, i, &reason);
+		if ((int32_t)(when - s) > 0) {
+			schedule(e, i, when);
+			e->stats.rescheduled++;
+		}
+		else {
+			list_add(e, i, DUE);
+		}
+	}
+}
+
+
+//
+// expire: invalidate an entry and collect its final counts
+//
+static int expire(struct nf2_expire *e, struct nf2_regio *io, int index,
+		  enum nf2_expire_reason reason, uint32_t timer, uint64_t now_ns,
+		  struct nf2_expired *out) {
+	struct nf2_flow_count *f = &e->h->flows[index];
+
+	if (nf2_of_exact_invalidate(io, index) ||
+	    nf2_harvest_entry(e->h, io, index, now_ns))
+		return -1;
+
+	out->index = index;
+	out->reason = reason;
+	out->duration_s = timer - e->install[index];
+	out->pkts = f->pkts;
+	out->bytes = f->bytes;
+	if (reason == NF2_EXPIRE_HARD)
+		e->stats.hard++;
+	else
+		e->stats.idle++;
+
+	nf2_harvest_reset(e->h, index, now_ns);
+	nf2_harvest_track(e->h, index, 0, now_ns);
+	list_del(e, index);
+	e->num--;
+	return 0;
+}
+
+
+int nf2_expire_run(struct nf2_expire *e, struct nf2_regio *io, uint64_t now_ns,
+		   struct nf2_expired *out, int max) {
+	enum nf2_expire_reason reason;
+	uint32_t timer, when;
+	int i, n = 0;
+
+	if (nf2_regio_read(io, OPENFLOW_LOOKUP_TIMER_REG, &timer))
+		return -1;
+	while ((int32_t)(timer - e->now) >= 0) {
+		tick(e);
+		e->now++;
+	}
+
+	while (n < max && (i = e->head[DUE]) != NONE) {
+		when = deadline(e, i, &reason);
+		if (reason == NF2_EXPIRE_IDLE && (int32_t)(when - timer) <= 0) {
+			/* anything since the harvester's last read? */
+			if (nf2_harvest_entry(e->h, io, i, now_ns))
+				return -1;
+			e->stats.rechecks++;
+			when = deadline(e, i, &reason);
+		}
+		/* used again while it waited here */
+		if ((int32_t)(when - timer) > 0) {
+			list_del(e, i);
+			schedule(e, i, when);
+			e->stats.rescheduled++;
+			continue;
+		}
+		if (expire(e, io, i, reason, timer, now_ns, &out[n]))
+			return -1;
+		n++;
+	}
+	return n;
+}
+
+
+int nf2_expire_add(struct nf2_expire *e, int index, uint16_t idle_s, uint16_t hard_s,
+		   uint32_t timer, uint64_t now_ns) {
+	enum nf2_expire_reason reason;
+
+	if (e->list[index] != NONE)
+		nf2_expire_remove(e, index);
+	if (idle_s == 0 && hard_s == 0)
+		return -1;
+
+	e->idle_s[index] = idle_s;
+	e->hard_s[index] = hard_s;
+	e->install[index] = timer;
+	nf2_harvest_reset(e->h, index, now_ns);
+	nf2_harvest_track(e->h, index, 1, now_ns);
+	schedule(e, index, deadline(e, index, &reason));
+	e->num++;
+	return 0;
+}
+
+
+void nf2_expire_remove(struct nf2_expire *e, int index) {
+	if (e->list[index] == NONE)
+		return;
+	list_del(e, index);
+	e->num--;
+}
+
+
+void nf2_expire_move(struct nf2_expire *e, int src, int dst, uint64_t pkts, uint64_t bytes,
+		     uint64_t now_ns) {
+	int list = e->list[src];
+
+	if (e->list[dst] != NONE)
+		nf2_expire_remove(e, dst);
+	nf2_harvest_move(e->h, src, dst, pkts, bytes, now_ns);
+	if (list == NONE)
+		return;
+
+	list_del(e, src);
+	e->idle_s[dst] = e->idle_s[src];
+	e->hard_s[dst] = e->hard_s[src];
+	e->install[dst] = e->install[src];
+	list_add(e, dst, list);
+}
@@ -0,0 +1,107 @@
+/* ****************************************************************************
+ * Module: nf2_expire.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Idle and hard timeouts of the exact entries.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_EXPIRE_H_
+#define NF2_EXPIRE_H_
+
+#include <stdint.h>
+
+#include "nf2_regio.h"
+#include "nf2_harvest.h"
+
+#define NF2_EXPIRE_LEVELS	3
+#define NF2_EXPIRE_SLOT_BITS	6
+#define NF2_EXPIRE_SLOTS	(1 << NF2_EXPIRE_SLOT_BITS)
+/* the wheel spans 262144 s; the OpenFlow timeouts are 16 bits */
+#define NF2_EXPIRE_SPAN		(1u << (NF2_EXPIRE_LEVELS * NF2_EXPIRE_SLOT_BITS))
+
+/*
+ * Time is OPENFLOW_LOOKUP_TIMER (seconds), the clock of the entries'
+ * last_seen. Each entry with a timeout sits in a hierarchical timer
+ * wheel at the earlier of install + hard and last use + idle, with the
+ * last use as the harvester last knew it (nf2_flow_count.last_used).
+ * That is never later than the truth, so a flow that was used since
+ * only fires early and goes back in the wheel at its new deadline; no
+ * register is read for it. When the wheel says a flow is idle, one read
+ * of its counters (nf2_harvest_entry) confirms it first.
+ *
+ * Expired entries are invalidated on the card, at most max per
+ * nf2_expire_run so that a mass expiry does not hold the registers for
+ * long; the rest wait for the next run. Their counters are read once
+ * after the invalidation for the final totals, which go out with the
+ * index for the flow removed message; the harvester's totals are then
+ * zeroed and the entry is no longer read.
+ *
+ * The harvester must be polled between runs: last_used is only as
+ * fresh as its reads.
+ */
+enum nf2_expire_reason {
+	NF2_EXPIRE_IDLE,
+	NF2_EXPIRE_HARD,
+};
+
+struct nf2_expired {
+	int index;
+	enum nf2_expire_reason reason;
+	uint32_t duration_s;	/* since install */
+	uint64_t pkts;
+	uint64_t bytes;
+};
+
+struct nf2_expire_stats {
+	unsigned long fired;		/* entries taken off the wheel */
+	unsigned long cascaded;		/* moved down a level */
+	unsigned long rescheduled;	/* used since they went in */
+	unsigned long rechecks;		/* counter reads to confirm idleness */
+	unsigned long idle;		/* expired */
+	unsigned long hard;
+};
+
+struct nf2_expire {
+	struct nf2_harvest *h;
+	uint32_t now;			/* next second to process */
+	int32_t head[NF2_EXPIRE_LEVELS * NF2_EXPIRE_SLOTS + 1];	/* last: due */
+	int32_t *next, *prev;		/* NF2_HARVEST_ENTRIES */
+	int16_t *list;			/* -1: no timeout */
+	uint16_t *idle_s, *hard_s;
+	uint32_t *install;
+	int num;			/* entries with a timeout */
+	struct nf2_expire_stats stats;
+};
+
+/* timer is OPENFLOW_LOOKUP_TIMER_REG now. Returns -1 if memory is short */
+int nf2_expire_init(struct nf2_expire *, struct nf2_harvest *, uint32_t timer);
+void nf2_expire_free(struct nf2_expire *);
+
+/*
+ * Starts the timeouts of a flow just written to an entry with last_seen
+ * timer (as nf2_exact_insert does), and zeroes and tracks its harvested
+ * counts. A timeout of 0 never expires. Returns -1 if both are 0, in
+ * which case the entry is left alone.
+ */
+int nf2_expire_add(struct nf2_expire *, int index, uint16_t idle_s, uint16_t hard_s,
+		   uint32_t timer, uint64_t now_ns);
+
+/* Forgets the timeouts of an entry deleted by the controller */
+void nf2_expire_remove(struct nf2_expire *, int index);
+
+/* The flow of src now lives in dst, e.g. after a cuckoo move: moves its
+ * timeouts and its harvested counts (nf2_harvest_move, which says what
+ * pkts and bytes are) */
+void nf2_expire_move(struct nf2_expire *, int src, int dst, uint64_t pkts, uint64_t bytes,
+		     uint64_t now_ns);
+
+/*
+ * Processes the wheel up to OPENFLOW_LOOKUP_TIMER_REG and expires at most
+ * max entries into out. Returns how many, or -1 on a register error.
+ */
+int nf2_expire_run(struct nf2_expire *, struct nf2_regio *, uint64_t now_ns,
+		   struct nf2_expired *out, int max);
+
+#endif
@@ -0,0 +1,479 @@
+/* ****************************************************************************
+ * Module: nf2_flowfile.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Text format for flow table contents.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../lib/C/reg_defines_openflow_switch.h"
+#include "nf2_flowfile.h"
+#include "nf2_flowkey.h"
+
+#define LINELEN		1024
+
+#define VLAN_VID_BITS	0x1fff		/* VID, and CFI which is 0 in any tag */
+#define VLAN_PCP_BITS	0xf000
+
+
+static int parse_num(const char *s, unsigned long max, unsigned long *v) {
+	char *end;
+
+	*v = strtoul(s, &end, 0);
+	return (end == s || *end || *v > max) ? -1 : 0;
+}
+
+
+//
+// parse_masked: a number with an optional /mask of the bits that must
+//    match (all of max without one)
+//
+static int parse_masked(const char *s, unsigned long max, unsigned long *v,
+			unsigned long *care) {
+	char buf[64], *slash;
+
+	snprintf(buf, sizeof(buf), "%s", s);
+	*care = max;
+	if ((slash = strchr(buf, '/')) != NULL) {
+		*slash = '\0';
+		if (parse_num(slash + 1, max, care))
+			return -1;
+	}
+	if (parse_num(buf, max, v))
+		return -1;
+	*v &= *care;
+	return 0;
+}
+
+
+static int parse_mac(const char *s, uint8_t mac[6]) {
+	unsigned b[6];
+	char c;
+	int i;
+
+	if (sscanf(s, "%x:%x:%x:%x:%x:%x%c", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5],
+		   &c) != 6)
+		return -1;
+	for (i = 0; i < 6; i++) {
+		if (b[i] > 0xff)
+			return -1;
+		mac[5 - i] = b[i];
+	}
+	return 0;
+}
+
+
+//
+// parse_ip: a.b.c.d with an optional /prefix_len or /a.b.c.d netmask.
+//    Returns the bits that must match in *care.
+//
+static int parse_ip(const char *s, uint32_t *ip, uint32_t *care) {
+	unsigned a[8];
+	int n, len;
+	char c;
+
+	n = sscanf(s, "%u.%u.%u.%u/%u.%u.%u.%u%c", &a[0], &a[1], &a[2], &a[3], &a[4],
+		   &a[5], &a[6], &a[7], &c);
+	if (n == 8) {
+		if ((a[4] | a[5] | a[6] | a[7]) > 0xff)
+			return -1;
+		*care = (a[4] << 24) | (a[5] << 16) | (a[6] << 8) | a[7];
+	}
+	else if (n == 5 && sscanf(s, "%*u.%*u.%*u.%*u/%d%c", &len, &c) == 1 &&
+		 len >= 0 && len <= 32)
+		*care = len ? 0xffffffff << (32 - len) : 0;
+	else if (n == 4 && !strchr(s, '/'))
+		*care = 0xffffffff;
+	else
+		return -1;
+	if ((a[0] | a[1] | a[2] | a[3]) > 0xff)
+		return -1;
+	*ip = (a[0] << 24) | (a[1] << 16) | (a[2] << 8) | a[3];
+	return 0;
+}
+
+
+static int parse_field(struct nf2_flowfile_rule *r, const char *name, const char *val) {
+	struct nf2_of_entry *e = &r->entry.entry, *m = &r->mask.entry;
+	unsigned long v, bits;
+	uint32_t ip, care;
+
+	if (!strcmp(name, "priority")) {
+		if (parse_num(val, 0xffff, &v))
+			return -1;
+		r->priority = v;
+	}
+	else if (!strcmp(name, "in_port")) {
+		if (parse_masked(val, 0xff, &v, &bits) || (r->exact && bits != 0xff))
+			return -1;
+		e->src_port = v;
+		m->src_port = ~bits;
+	}
+	else if (!strcmp(name, "dl_vlan")) {
+		if (!strcmp(val, "none")) {
+			e->vlan_id = NF2_VLAN_NONE;
+			m->vlan_id = 0;
+			return 0;
+		}
+		if (parse_num(val, 0xfff, &v))
+			return -1;
+		if (e->vlan_id == NF2_VLAN_NONE)
+			e->vlan_id = 0;
+		e->vlan_id = (e->vlan_id & ~VLAN_VID_BITS) | v;
+		m->vlan_id &= ~VLAN_VID_BITS;
+	}
+	else if (!strcmp(name, "dl_vlan_pcp")) {
+		if (parse_num(val, 7, &v))
+			return -1;
+		if (e->vlan_id == NF2_VLAN_NONE)
+			e->vlan_id = 0;
+		e->vlan_id = (e->vlan_id & ~VLAN_PCP_BITS) | (v << 13);
+		m->vlan_id &= ~VLAN_PCP_BITS;
+	}
+	else if (!strcmp(name, "dl_src")) {
+		if (parse_mac(val, e->eth_src))
+			return -1;
+		memset(m->eth_src, 0, sizeof(m->eth_src));
+	}
+	else if (!strcmp(name, "dl_dst")) {
+		if (parse_mac(val, e->eth_dst))
+			return -1;
+		memset(m->eth_dst, 0, sizeof(m->eth_dst));
+	}
+	else if (!strcmp(name, "dl_type")) {
+		if (parse_masked(val, 0xffff, &v, &bits) || (r->exact && bits != 0xffff))
+			return -1;
+		e->eth_type = v;
+		m->eth_type = ~bits;
+	}
+	else if (!strcmp(name, "nw_tos")) {
+		if (parse_masked(val, 0xff, &v, &bits) || (r->exact && bits != 0xff))
+			return -1;
+		e->ip_tos = v & 0xfc;
+		m->ip_tos = ~bits;
+	}
+	else if (!strcmp(name, "nw_proto")) {
+		if (parse_masked(val, 0xff, &v, &bits) || (r->exact && bits != 0xff))
+			return -1;
+		e->ip_proto = v;
+		m->ip_proto = ~bits;
+	}
+	else if (!strcmp(name, "nw_src") || !strcmp(name, "nw_dst")) {
+		if (parse_ip(val, &ip, &care) || (r->exact && care != 0xffffffff))
+			return -1;
+		if (name[3] == 's') {
+			e->ip_src = ip;
+			m->ip_src = ~care;
+		}
+		else {
+			e->ip_dst = ip;
+			m->ip_dst = ~care;
+		}
+	}
+	else if (!strcmp(name, "tp_src")) {
+		if (parse_masked(val, 0xffff, &v, &bits) || (r->exact && bits != 0xffff))
+			return -1;
+		e->transp_src = v;
+		m->transp_src = ~bits;
+	}
+	else if (!strcmp(name, "tp_dst")) {
+		if (parse_masked(val, 0xffff, &v, &bits) || (r->exact && bits != 0xffff))
+			return -1;
+		e->transp_dst = v;
+		m->transp_dst = ~bits;
+	}
+	else
+		return -1;
+	return 0;
+}
+
+
+static int parse_action(struct nf2_of_action *a, char *act) {
+	char *val = strchr(act, ':');
+	unsigned long v;
+	uint32_t ip, care;
+
+	if (val)
+		*val++ = '\0';
+
+	if (!strcmp(act, "drop"))
+		return val ? -1 : 0;
+	if (!strcmp(act, "strip_vlan")) {
+		a->nf2_action_flag |= NF2_OFPAT_STRIP_VLAN;
+		return val ? -1 : 0;
+	}
+	if (val == NULL)
+		return -1;
+
+	if (!strcmp(act, "mod_dl_src") || !strcmp(act, "mod_dl_dst")) {
+		if (act[7] == 's') {
+			a->nf2_action_flag |= NF2_OFPAT_SET_DL_SRC;
+			return parse_mac(val, a->eth_src);
+		}
+		a->nf2_action_flag |= NF2_OFPAT_SET_DL_DST;
+		return parse_mac(val, a->eth_dst);
+	}
+	if (!strcmp(act, "mod_nw_src") || !strcmp(act, "mod_nw_dst")) {
+		if (parse_ip(val, &ip, &care) || care != 0xffffffff)
+			return -1;
+		if (act[7] == 's') {
+			a->nf2_action_flag |= NF2_OFPAT_SET_NW_SRC;
+			a->ip_src = ip;
+		}
+		else {
+			a->nf2_action_flag |= NF2_OFPAT_SET_NW_DST;
+			a->ip_dst = ip;
+		}
+		return 0;
+	}
+
+	if (parse_num(val, 0xffff, &v))
+		return -1;
+	if (!strcmp(act, "output") && v < OPENFLOW_FORWARD_BITMASK_WIDTH)
+		a->forward_bitmask |= 1 << v;
+	else if (!strcmp(act, "mod_vlan_vid") && v <= 0xfff) {
+		a->nf2_action_flag |= NF2_OFPAT_SET_VLAN_VID;
+		a->vlan_id = v;
+	}
+	else if (!strcmp(act, "mod_vlan_pcp") && v <= 7) {
+		a->nf2_action_flag |= NF2_OFPAT_SET_VLAN_PCP;
+		a->vlan_pcp = v;
+	}
+	else if (!strcmp(act, "mod_nw_tos") && v <= 0xff) {
+		a->nf2_action_flag |= NF2_OFPAT_SET_NW_TOS;
+		a->ip_tos = v;
+	}
+	else if (!strcmp(act, "mod_tp_src")) {
+		a->nf2_action_flag |= NF2_OFPAT_SET_TP_SRC;
+		a->transp_src = v;
+	}
+	else if (!strcmp(act, "mod_tp_dst")) {
+		a->nf2_action_flag |= NF2_OFPAT_SET_TP_DST;
+		a->transp_dst = v;
+	}
+	else
+		return -1;
+	return 0;
+}
+
+
+//
+// nf2_flowfile_parse: returns 1 if the line holds a flow, 0 if it is
+//    empty or a comment, -1 if it does not parse.
+//
+int nf2_flowfile_parse(const char *line, struct nf2_flowfile_rule *r) {
+	char buf[LINELEN], *tok, *val, *act, *save, *save_act;
+	int i, have_actions = 0;
+
+	snprintf(buf, sizeof(buf), "%s", line);
+	if ((tok = strchr(buf, '#')) != NULL)
+		*tok = '\0';
+	tok = strtok_r(buf, " \t\r\n", &save);
+	if (tok == NULL)
+		return 0;
+
+	memset(r, 0, sizeof(*r));
+	if (!strcmp(tok, "exact")) {
+		r->exact = 1;
+		r->entry.entry.vlan_id = NF2_VLAN_NONE;
+	}
+	else if (strcmp(tok, "wildcard"))
+		return -1;
+	memset(&r->mask, 0xff, sizeof(r->mask));
+
+	while ((tok = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+		if ((val = strchr(tok, '=')) == NULL)
+			return -1;
+		*val++ = '\0';
+		if (!strcmp(tok, "actions")) {
+			for (act = strtok_r(val, ",", &save_act); act;
+			     act = strtok_r(NULL, ",", &save_act))
+				if (parse_action(&r->action.action, act))
+					return -1;
+			have_actions = 1;
+		}
+		else if (parse_field(r, tok, val))
+			return -1;
+	}
+	if (!have_actions)
+		return -1;
+
+	if (r->exact)
+		memset(&r->mask, 0, sizeof(r->mask));
+	for (i = 0; i < NF2_OF_ENTRY_WORD_LEN; i++)
+		r->entry.raw[i] &= ~r->mask.raw[i];
+	r->entry.entry.pad = 0;
+	return 1;
+}
+
+
+int nf2_flowfile_read(const char *path, struct nf2_flowfile_rule **rules) {
+	struct nf2_flowfile_rule *r = NULL, *tmp;
+	char line[LINELEN];
+	int n = 0, max = 0, lineno = 0, ret;
+	FILE *f;
+
+	if ((f = fopen(path, "r")) == NULL) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (n == max) {
+			max = max ? 2 * max : 256;
+			if ((tmp = realloc(r, max * sizeof(*r))) == NULL) {
+				fprintf(stderr, "Out of memory\n");
+				goto err;
+			}
+			r = tmp;
+		}
+		ret = nf2_flowfile_parse(line, &r[n]);
+		if (ret < 0) {
+			fprintf(stderr, "%s:%d: bad flow: %s", path, lineno, line);
+			goto err;
+		}
+		if (ret > 0)
+			r[n++].line = lineno;
+	}
+	fclose(f);
+	*rules = r;
+	return n;
+
+err:
+	fclose(f);
+	free(r);
+	return -1;
+}
+
+
+static void print_mac(FILE *f, const char *prefix, const uint8_t mac[6]) {
+	fprintf(f, "%s%02x:%02x:%02x:%02x:%02x:%02x", prefix, mac[5], mac[4], mac[3],
+		mac[2], mac[1], mac[0]);
+}
+
+
+static void print_ip(FILE *f, const char *prefix, uint32_t ip, uint32_t mask) {
+	uint32_t care = ~mask;
+	int len = __builtin_popcount(care);
+
+	fprintf(f, "%s%u.%u.%u.%u", prefix, ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff,
+		ip & 0xff);
+	if (care == 0xffffffff)
+		return;
+	if (care == (len ? 0xffffffff << (32 - len) : 0))
+		fprintf(f, "/%d", len);
+	else
+		fprintf(f, "/%u.%u.%u.%u", care >> 24, (care >> 16) & 0xff,
+			(care >> 8) & 0xff, care & 0xff);
+}
+
+
+//
+// print_masked: a field that is not all don't care, with the bits that
+//    must match if not all of them
+//
+static void print_masked(FILE *f, const char *name, const char *fmt, unsigned v,
+			 unsigned mask, unsigned bits) {
+	if ((mask & bits) == bits)
+		return;
+	fprintf(f, " %s=", name);
+	fprintf(f, fmt, v);
+	if (mask & bits)
+		fprintf(f, "/0x%x", ~mask & bits);
+}
+
+
+void nf2_flowfile_print(FILE *f, const struct nf2_flowfile_rule *r) {
+	const struct nf2_of_entry *e = &r->entry.entry, *m = &r->mask.entry;
+	const struct nf2_of_action *a = &r->action.action;
+	const char *sep = "";
+	int i;
+
+	if (r->exact)
+		fprintf(f, "exact");
+	else
+		fprintf(f, "wildcard priority=%u", r->priority);
+
+	print_masked(f, "in_port", "%u", e->src_port, m->src_port, 0xff);
+	if (!m->vlan_id && e->vlan_id == NF2_VLAN_NONE)
+		fprintf(f, " dl_vlan=none");
+	else {
+		if (!(m->vlan_id & VLAN_VID_BITS))
+			fprintf(f, " dl_vlan=%u", e->vlan_id & 0xfff);
+		if (!(m->vlan_id & VLAN_PCP_BITS))
+			fprintf(f, " dl_vlan_pcp=%u", e->vlan_id >> 13);
+	}
+	if (!m->eth_src[0])
+		print_mac(f, " dl_src=", e->eth_src);
+	if (!m->eth_dst[0])
+		print_mac(f, " dl_dst=", e->eth_dst);
+	print_masked(f, "dl_type", "0x%04x", e->eth_type, m->eth_type, 0xffff);
+	print_masked(f, "nw_tos", "%u", e->ip_tos, m->ip_tos, 0xff);
+	print_masked(f, "nw_proto", "%u", e->ip_proto, m->ip_proto, 0xff);
+	if (m->ip_src != 0xffffffff)
+		print_ip(f, " nw_src=", e->ip_src, m->ip_src);
+	if (m->ip_dst != 0xffffffff)
+		print_ip(f, " nw_dst=", e->ip_dst, m->ip_dst);
+	print_masked(f, "tp_src", "%u", e->transp_src, m->transp_src, 0xffff);
+	print_masked(f, "tp_dst", "%u", e->transp_dst, m->transp_dst, 0xffff);
+
+	fprintf(f, " actions=");
+	for (i = 0; i < OPENFLOW_FORWARD_BITMASK_WIDTH; i++) {
+		if (a->forward_bitmask & (1 << i)) {
+			fprintf(f, "%soutput:%d", sep, i);
+			sep = ",";
+		}
+	}
+	if (a->nf2_action_flag & NF2_OFPAT_SET_VLAN_VID) {
+		fprintf(f, "%smod_vlan_vid:%u", sep, a->vlan_id);
+		sep = ",";
+	}
+	if (a->nf2_action_flag & NF2_OFPAT_SET_VLAN_PCP) {
+		fprintf(f, "%smod_vlan_pcp:%u", sep, a->vlan_pcp);
+		sep = ",";
+	}
+	if (a->nf2_action_flag & NF2_OFPAT_STRIP_VLAN) {
+		fprintf(f, "%sstrip_vlan", sep);
+		sep = ",";
+	}
+	if (a->nf2_action_flag & NF2_OFPAT_SET_DL_SRC) {
+		fprintf(f, "%s", sep);
+		print_mac(f, "mod_dl_src:", a->eth_src);
+		sep = ",";
+	}
+	if (a->nf2_action_flag & NF2_OFPAT_SET_DL_DST) {
+		fprintf(f, "%s", sep);
+		print_mac(f, "mod_dl_dst:", a->eth_dst);
+		sep = ",";
+	}
+	if (a->nf2_action_flag & NF2_OFPAT_SET_NW_SRC) {
+		fprintf(f, "%s", sep);
+		print_ip(f, "mod_nw_src:", a->ip_src, 0);
+		sep = ",";
+	}
+	if (a->nf2_action_flag & NF2_OFPAT_SET_NW_DST) {
+		fprintf(f, "%s", sep);
+		print_ip(f, "mod_nw_dst:", a->ip_dst, 0);
+		sep = ",";
+	}
+	if (a->nf2_action_flag & NF2_OFPAT_SET_NW_TOS) {
+		fprintf(f, "%smod_nw_tos:%u", sep, a->ip_tos);
+		sep = ",";
+	}
+	if (a->nf2_action_flag & NF2_OFPAT_SET_TP_SRC) {
+		fprintf(f, "%smod_tp_src:%u", sep, a->transp_src);
+		sep = ",";
+	}
+	if (a->nf2_action_flag & NF2_OFPAT_SET_TP_DST) {
+		fprintf(f, "%smod_tp_dst:%u", sep, a->transp_dst);
+		sep = ",";
+	}
+	if (*sep == '\0')
+		fprintf(f, "drop");
+	fprintf(f, "\n");
+}
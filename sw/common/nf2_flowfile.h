@@ -0,0 +1,62 @@
+/* ****************************************************************************
+ * Module: nf2_flowfile.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Text format for flow table contents.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_FLOWFILE_H_
+#define NF2_FLOWFILE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "../../../../lib/C/common/nf2util.h"
+#include "../regdump/nf2_drv.h"
+
+/*
+ * One flow per line, '#' starts a comment:
+ *
+ *   exact in_port=0 dl_dst=00:4e:46:32:43:00 dl_type=0x0800 nw_proto=17
+ *         nw_src=10.0.0.1 nw_dst=10.0.0.2 tp_src=1024 tp_dst=53 actions=output:2
+ *   wildcard priority=100 dl_type=0x0800 nw_dst=10.1.0.0/16 actions=output:4,mod_nw_tos:32
+ *
+ * (each flow on a single line). Fields:
+ *   in_port       source port as in the I/O queue header: 2n for MAC
+ *                 port n, 2n+1 for CPU port n
+ *   dl_vlan       VLAN id, or "none" for untagged packets
+ *   dl_vlan_pcp   VLAN priority
+ *   dl_src, dl_dst, dl_type, nw_tos, nw_proto, nw_src, nw_dst, tp_src, tp_dst
+ *
+ * An exact flow matches the given fields and zero in the others (no tag
+ * if dl_vlan is not given), as header_parser leaves the fields a packet
+ * does not have. A wildcard rule matches any value of the fields not
+ * given; nw_src and nw_dst take a prefix length or a netmask, and in_port,
+ * dl_type, nw_tos, nw_proto, tp_src and tp_dst a /mask of the bits that
+ * must match (tp_dst=80/0xfffe matches ports 80 and 81). Rules of higher
+ * priority win.
+ *
+ * Actions: output:Q (output queue Q, 2n for MAC port n and 2n+1 for CPU
+ * port n), mod_vlan_vid, mod_vlan_pcp, strip_vlan, mod_dl_src, mod_dl_dst,
+ * mod_nw_src, mod_nw_dst, mod_nw_tos, mod_tp_src, mod_tp_dst. A flow
+ * without an output drops the packets.
+ */
+struct nf2_flowfile_rule {
+	int exact;
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;		/* all zero for exact flows */
+	nf2_of_action_wrap action;
+	uint16_t priority;
+	int line;
+};
+
+/* Reads the flows of a file into a malloc'ed array. Returns the number of
+ * flows or -1 (with a message naming the line) */
+int nf2_flowfile_read(const char *path, struct nf2_flowfile_rule **);
+
+int nf2_flowfile_parse(const char *line, struct nf2_flowfile_rule *);
+void nf2_flowfile_print(FILE *, const struct nf2_flowfile_rule *);
+
+#endif
@@ -0,0 +1,189 @@
+/* ****************************************************************************
+ * Module: nf2_flowkey.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host implementation of the flow entry built by
+ *              src/preprocessor/header_parser.v.
+ *
+ * Change history:
+ *
+ */
+
+#include <string.h>
+
+#include "nf2_flowkey.h"
+
+/* The farthest header byte header_parser looks at: the TCP/UDP
+ * destination port behind 40 bytes of IP options */
+#define HDR_LEN		(14 + 15 * 4 + 4)
+
+
+static inline uint16_t get16(const uint8_t *b) {
+	return (b[0] << 8) | b[1];
+}
+
+
+static inline uint32_t get32(const uint8_t *b) {
+	return ((uint32_t)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+
+void nf2_flowkey_extract(const uint8_t *frame, uint32_t caplen, int src_port,
+			 nf2_of_entry_wrap *key) {
+	struct nf2_of_entry *e = &key->entry;
+	uint8_t b[HDR_LEN];
+	uint16_t vlan = NF2_VLAN_NONE;
+	uint32_t n;
+	int i, l4;
+
+	/* the frame as header_parser sees it: tag removed, zero padded */
+	if (caplen >= 16 && get16(frame + 12) == NF2_ETH_TYPE_VLAN) {
+		vlan = get16(frame + 14) & NF2_VLAN_TCI_MASK;
+		n = caplen - 4 < HDR_LEN ? caplen - 4 : HDR_LEN;
+		memcpy(b, frame, 12);
+		memcpy(b + 12, frame + 16, n - 12);
+	}
+	else {
+		n = caplen < HDR_LEN ? caplen : HDR_LEN;
+		memcpy(b, frame, n);
+	}
+	memset(b + n, 0, HDR_LEN - n);
+
+	memset(key, 0, sizeof(*key));
+	e->vlan_id = vlan;
+	e->src_port = src_port;
+	for (i = 0; i < 6; i++) {
+		e->eth_dst[5 - i] = b[i];
+		e->eth_src[5 - i] = b[6 + i];
+	}
+	e->eth_type = get16(b + 12);
+
+	if (e->eth_type == NF2_ETH_TYPE_IP) {
+		if ((b[14] & 0xf) < 5) {
+			memset(key, 0, sizeof(*key));
+			e->vlan_id = NF2_VLAN_NONE;
+			return;
+		}
+		e->ip_tos = b[15] & 0xfc;
+		e->ip_proto = b[23];
+		e->ip_src = get32(b + 26);
+		e->ip_dst = get32(b + 30);
+
+		l4 = 14 + (b[14] & 0xf) * 4;
+		if (e->ip_proto == NF2_IP_PROTO_TCP || e->ip_proto == NF2_IP_PROTO_UDP) {
+			e->transp_src = get16(b + l4);
+			e->transp_dst = get16(b + l4 + 2);
+		}
+		else if (e->ip_proto == NF2_IP_PROTO_ICMP) {
+			e->transp_src = b[l4];
+			e->transp_dst = b[l4 + 1];
+		}
+	}
+	else if (e->eth_type == NF2_ETH_TYPE_ARP) {
+		e->ip_proto = b[21];
+		e->ip_src = get32(b + 28);
+		e->ip_dst = get32(b + 38);
+	}
+}
+
+
+/* packets ahead of the one parsed whose frames are prefetched */
+#define PREFETCH_AHEAD	8
+
+static inline uint64_t get48(const uint8_t *b) {
+	return ((uint64_t)get16(b) << 32) | get32(b + 2);
+}
+
+
+/* frames this long are looked at in place: tag, ethertype and IHL are
+ * within them, and the ARP addresses and the IP addresses and ports
+ * without options */
+#define MIN_IN_PLACE	(4 + 14 + 28)
+
+//
+// in_place_len: the bytes header_parser looks at in a frame of at least
+//    MIN_IN_PLACE bytes
+//
+static inline uint32_t in_place_len(const uint8_t *p) {
+	uint32_t tag = (get16(p + 12) == NF2_ETH_TYPE_VLAN) << 2;
+	uint32_t is_ip = get16(p + tag + 12) == NF2_ETH_TYPE_IP;
+	uint32_t l4_end = 14 + (p[tag + 14] & 0xf) * 4 + 4;
+
+	return tag + (is_ip ? l4_end : 14 + 28);
+}
+
+
+static inline void extract_one(const uint8_t *frame, uint32_t caplen, int src_port,
+			       nf2_of_entry_wrap *key) {
+	struct nf2_of_entry *e = &key->entry;
+	uint8_t pad[NF2_FLOWKEY_MAX_HDR];
+	const uint8_t *p = frame, *q;
+	uint64_t dst, src;
+	uint32_t tagged, is_ip, is_arp, tcpudp, icmp, m_ip, m_arp, m_tu, m_icmp;
+	uint32_t ihl, l4;
+	uint8_t proto;
+	int i;
+
+	/* the frame is read in place if it holds every header byte it
+	 * needs, up to the ARP target or to the TCP/UDP ports behind the IP
+	 * options (a captured frame has at least 60 bytes and seldom lacks
+	 * any); otherwise from a zero padded copy */
+	if (caplen < MIN_IN_PLACE || caplen < in_place_len(p)) {
+		memset(pad, 0, sizeof(pad));
+		memcpy(pad, frame, caplen < sizeof(pad) ? caplen : sizeof(pad));
+		p = pad;
+	}
+
+	/* q: the frame past the MACs as header_parser sees it, tag removed */
+	tagged = (get16(p + 12) == NF2_ETH_TYPE_VLAN) & (caplen >= 16);
+	q = p + (tagged << 2);
+
+	e->eth_type = get16(q + 12);
+	is_ip = e->eth_type == NF2_ETH_TYPE_IP;
+	is_arp = e->eth_type == NF2_ETH_TYPE_ARP;
+	ihl = q[14] & 0xf;
+	if (is_ip & (ihl < 5)) {
+		memset(key, 0, sizeof(*key));
+		e->vlan_id = NF2_VLAN_NONE;
+		return;
+	}
+	proto = q[23];
+	tcpudp = is_ip & ((proto == NF2_IP_PROTO_TCP) | (proto == NF2_IP_PROTO_UDP));
+	icmp = is_ip & (proto == NF2_IP_PROTO_ICMP);
+	m_ip = -is_ip;
+	m_arp = -is_arp;
+	m_tu = -tcpudp;
+	m_icmp = -icmp;
+	l4 = (14 + ihl * 4) & m_ip;	/* the IHL nibble of other frames is not read */
+
+	e->transp_dst = (get16(q + l4 + 2) & m_tu) | (q[l4 + 1] & m_icmp);
+	e->transp_src = (get16(q + l4) & m_tu) | (q[l4] & m_icmp);
+	e->ip_proto = (proto & m_ip) | (q[21] & m_arp);
+	e->ip_dst = (get32(q + 30) & m_ip) | (get32(q + 38) & m_arp);
+	e->ip_src = (get32(q + 26) & m_ip) | (get32(q + 28) & m_arp);
+	dst = get48(p);
+	src = get48(p + 6);
+	for (i = 0; i < 6; i++) {
+		e->eth_dst[i] = dst >> (8 * i);
+		e->eth_src[i] = src >> (8 * i);
+	}
+	e->src_port = src_port;
+	e->ip_tos = q[15] & 0xfc & m_ip;
+	e->vlan_id = tagged ? get16(p + 14) & NF2_VLAN_TCI_MASK : NF2_VLAN_NONE;
+	e->pad = 0;
+}
+
+
+void nf2_flowkey_extract_batch(const uint8_t *const *frames, const uint32_t *caplens,
+			       const int *src_ports, int n, nf2_of_entry_wrap *keys) {
+	int i;
+
+	for (i = 0; i < n && i < PREFETCH_AHEAD; i++)
+		__builtin_prefetch(frames[i]);
+	for (i = 0; i < n; i++) {
+		if (i + PREFETCH_AHEAD < n) {
+			__builtin_prefetch(frames[i + PREFETCH_AHEAD]);
+			__builtin_prefetch(frames[i + PREFETCH_AHEAD] + 63);
+		}
+		extract_one(frames[i], caplens[i], src_ports[i], &keys[i]);
+	}
+}
@@ -0,0 +1,66 @@
+/* ****************************************************************************
+ * Module: nf2_flowkey.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host implementation of the flow entry built by
+ *              src/preprocessor/header_parser.v.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_FLOWKEY_H_
+#define NF2_FLOWKEY_H_
+
+#include <stdint.h>
+
+#include "../../../../lib/C/common/nf2util.h"
+#include "../regdump/nf2_drv.h"
+
+#define NF2_ETH_TYPE_IP		0x0800
+#define NF2_ETH_TYPE_ARP	0x0806
+#define NF2_ETH_TYPE_VLAN	0x8100
+
+#define NF2_IP_PROTO_ICMP	1
+#define NF2_IP_PROTO_TCP	6
+#define NF2_IP_PROTO_UDP	17
+
+/* header_parser keeps PCP and VID of the tag and clears CFI; an untagged
+ * packet has vlan_id 0xffff */
+#define NF2_VLAN_TCI_MASK	0xefff
+#define NF2_VLAN_NONE		0xffff
+
+/*
+ * nf2_flowkey_extract builds the flow entry of an ethernet frame (as
+ * captured, with its 802.1Q tag if any) received on src_port, with the
+ * semantics of header_parser, which sees the frame after vlan_remover:
+ *
+ *   - the first tag is taken off the frame into vlan_id
+ *   - eth_dst, eth_src and eth_type are always set
+ *   - IP: ip_tos (the DSCP bits), ip_proto, ip_src and ip_dst; an IHL
+ *     below 5 resets the whole entry, src_port included, to the default
+ *   - TCP and UDP: the ports after the IP options; ICMP: type and code
+ *     in transp_src and transp_dst
+ *   - ARP: the low byte of the opcode in ip_proto, the sender and target
+ *     protocol addresses in ip_src and ip_dst
+ *
+ * Header bytes beyond caplen read as zero. The packet size header_parser
+ * passes on for the counters is the wire length of the frame, tag
+ * included.
+ */
+void nf2_flowkey_extract(const uint8_t *frame, uint32_t caplen, int src_port,
+			 nf2_of_entry_wrap *);
+
+/*
+ * nf2_flowkey_extract over n frames, with the same result. The fields are
+ * selected with masks rather than branches on the frame contents (tag,
+ * ethertype, protocol, header length), which mispredict on mixed
+ * traffic, and the frames of later packets are prefetched. A frame is
+ * read in place unless it is cut short of a header byte header_parser
+ * looks at; at most NF2_FLOWKEY_MAX_HDR bytes of it are read.
+ */
+#define NF2_FLOWKEY_MAX_HDR	(4 + 14 + 15 * 4 + 4)
+
+void nf2_flowkey_extract_batch(const uint8_t *const *frames, const uint32_t *caplens,
+			       const int *src_ports, int n, nf2_of_entry_wrap *keys);
+
+#endif
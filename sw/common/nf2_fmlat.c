@@ -0,0 +1,102 @@
+/* ****************************************************************************
+ * Module: nf2_fmlat.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Flow-mod latency instrumentation: how long each table
+ *              write waits, takes on the registers and takes to read
+ *              back, per operation and table.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdlib.h>
+
+#include "nf2_fmlat.h"
+
+static struct nf2_fmlat_set *sets;
+static __thread struct nf2_fmlat_set *mine;
+
+static const char *table_names[NF2_FMQ_TYPES] = {
+	"exact", "exact", "exact", "wildcard", "wildcard", "wildcard"
+};
+
+static const char *op_names[NF2_FMQ_TYPES] = {
+	"write", "modify", "delete", "write", "modify", "delete"
+};
+
+static const char *phase_names[NF2_FMLAT_PHASES] = {
+	"queue", "write", "verify", "total"
+};
+
+
+static struct nf2_fmlat_set *new_set(void) {
+	struct nf2_fmlat_set *s;
+	int t, p;
+
+	if ((s = malloc(sizeof(*s))) == NULL)
+		return NULL;
+	for (t = 0; t < NF2_FMQ_TYPES; t++)
+		for (p = 0; p < NF2_FMLAT_PHASES; p++)
+			nf2_hdr_init(&s->hist[t][p]);
+	s->next = __atomic_load_n(&sets, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&sets, &s->next, s, 1,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+	return s;
+}
+
+
+void nf2_fmlat_record(enum nf2_fmq_type type, enum nf2_fmlat_phase phase, uint64_t ns) {
+	if (mine == NULL && (mine = new_set()) == NULL)
+		return;
+	if (type < NF2_FMQ_TYPES && phase < NF2_FMLAT_PHASES)
+		nf2_hdr_record(&mine->hist[type][phase], ns);
+}
+
+
+void nf2_fmlat_merge(struct nf2_fmlat_set *out) {
+	struct nf2_fmlat_set *s;
+	int t, p;
+
+	for (t = 0; t < NF2_FMQ_TYPES; t++)
+		for (p = 0; p < NF2_FMLAT_PHASES; p++)
+			nf2_hdr_init(&out->hist[t][p]);
+	out->next = NULL;
+	for (s = __atomic_load_n(&sets, __ATOMIC_ACQUIRE); s != NULL; s = s->next)
+		for (t = 0; t < NF2_FMQ_TYPES; t++)
+			for (p = 0; p < NF2_FMLAT_PHASES; p++)
+				nf2_hdr_add(&out->hist[t][p], &s->hist[t][p]);
+}
+
+
+void nf2_fmlat_reset(void) {
+	struct nf2_fmlat_set *s;
+	int t, p;
+
+	for (s = __atomic_load_n(&sets, __ATOMIC_ACQUIRE); s != NULL; s = s->next)
+		for (t = 0; t < NF2_FMQ_TYPES; t++)
+			for (p = 0; p < NF2_FMLAT_PHASES; p++)
+				nf2_hdr_init(&s->hist[t][p]);
+}
+
+
+void nf2_fmlat_print(FILE *out, const struct nf2_fmlat_set *set) {
+	const struct nf2_hdr *h;
+	int t, p;
+
+	fprintf(out, "%-9s %-7s %-7s %9s %9s %9s %9s %9s %9s\n", "table", "op", "phase",
+		"count", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+	for (t = 0; t < NF2_FMQ_TYPES; t++) {
+		for (p = 0; p < NF2_FMLAT_PHASES; p++) {
+			h = &set->hist[t][p];
+			if (h->total == 0)
+				continue;
+			fprintf(out, "%-9s %-7s %-7s %9llu %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+				table_names[t], op_names[t], phase_names[p],
+				(unsigned long long)h->total,
+				nf2_hdr_value_at(h, 50) / 1e3, nf2_hdr_value_at(h, 90) / 1e3,
+				nf2_hdr_value_at(h, 99) / 1e3, nf2_hdr_value_at(h, 99.9) / 1e3,
+				h->max / 1e3);
+		}
+	}
+}
@@ -0,0 +1,52 @@
+/* ****************************************************************************
+ * Module: nf2_fmlat.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Flow-mod latency instrumentation: how long each table
+ *              write waits, takes on the registers and takes to read
+ *              back, per operation and table.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_FMLAT_H_
+#define NF2_FMLAT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "nf2_hdr.h"
+#include "nf2_fmq.h"
+
+enum nf2_fmlat_phase {
+	NF2_FMLAT_QUEUE,	/* submitted (or lock asked for) to written */
+	NF2_FMLAT_WRITE,	/* the register writes */
+	NF2_FMLAT_VERIFY,	/* the read-back check, when asked for */
+	NF2_FMLAT_TOTAL,	/* submitted to effective */
+	NF2_FMLAT_PHASES
+};
+
+/*
+ * The histograms of one thread. Each thread that records gets its own
+ * set on first use, linked on a global list without a lock, so recording
+ * never waits and never shares a cache line with another thread. Sets
+ * live until the process ends, as threads come and go.
+ */
+struct nf2_fmlat_set {
+	struct nf2_hdr hist[NF2_FMQ_TYPES][NF2_FMLAT_PHASES];
+	struct nf2_fmlat_set *next;
+};
+
+/* Records a latency of the calling thread; drops it if out of memory */
+void nf2_fmlat_record(enum nf2_fmq_type, enum nf2_fmlat_phase, uint64_t ns);
+
+/* Adds up the sets of every thread; any thread, any time */
+void nf2_fmlat_merge(struct nf2_fmlat_set *out);
+
+/* Clears every set; only while no thread records */
+void nf2_fmlat_reset(void);
+
+/* Prints the percentiles of each operation and phase that has values */
+void nf2_fmlat_print(FILE *, const struct nf2_fmlat_set *);
+
+#endif
@@ -0,0 +1,520 @@
+/* ****************************************************************************
+ * Module: nf2_fmq.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Flow-mod submission queue: any number of threads queue
+ *              table writes without a lock, and one register writer
+ *              applies them in coalesced batches.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "nf2_fmq.h"
+#include "nf2_exact_table.h"
+#include "nf2_fmlat.h"
+
+#define EXACT_SLOTS	OPENFLOW_NF2_EXACT_TABLE_SIZE
+#define NUM_SLOTS	(EXACT_SLOTS + OPENFLOW_WILDCARD_TABLE_SIZE)
+
+/* op->done: the writer swaps in OP_DONE and wakes the op only if it was
+ * OP_WAITING, and touches the op no more after that swap */
+#define OP_PENDING	0
+#define OP_WAITING	1
+#define OP_DONE		2
+
+/* what a batch writes to one slot */
+struct nf2_fmq_fold {
+	enum nf2_fmq_type type;
+	int index;
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;
+	nf2_of_action_wrap action;
+	struct nf2_fmq_op *ops, *last;
+	int result;
+	uint64_t write_ns;
+};
+
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void futex_wait(int *addr, int val) {
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+
+static void futex_wake(int *addr) {
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+
+static void push(struct nf2_fmq *q, struct nf2_fmq_op *op) {
+	struct nf2_fmq_op *prev;
+
+	__atomic_store_n(&op->next, NULL, __ATOMIC_RELAXED);
+	prev = __atomic_exchange_n(&q->tail, op, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&prev->next, op, __ATOMIC_RELEASE);
+}
+
+
+//
+// pop: the oldest op, or NULL with *busy set if a producer is between
+//    taking the tail and linking its op
+//
+static struct nf2_fmq_op *pop(struct nf2_fmq *q, int *busy) {
+	struct nf2_fmq_op *head = q->head;
+	struct nf2_fmq_op *next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+
+	*busy = 0;
+	if (head == &q->stub) {
+		if (next == NULL) {
+			*busy = __atomic_load_n(&q->tail, __ATOMIC_SEQ_CST) != head;
+			return NULL;
+		}
+		q->head = next;
+		head = next;
+		next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+	}
+	if (next != NULL) {
+		q->head = next;
+		return head;
+	}
+	if (__atomic_load_n(&q->tail, __ATOMIC_SEQ_CST) != head) {
+		*busy = 1;
+		return NULL;
+	}
+	/* head is the last op: put the stub behind it to take it off */
+	push(q, &q->stub);
+	next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+	if (next != NULL) {
+		q->head = next;
+		return head;
+	}
+	*busy = 1;
+	return NULL;
+}
+
+
+void nf2_fmq_submit(struct nf2_fmq *q, struct nf2_fmq_op *op) {
+	op->done = OP_PENDING;
+	op->coalesced = 0;
+	op->result = 0;
+	op->submit_ns = now_ns();
+	push(q, op);
+	if (__atomic_load_n(&q->sleeping, __ATOMIC_SEQ_CST) &&
+	    __atomic_exchange_n(&q->sleeping, 0, __ATOMIC_SEQ_CST))
+		futex_wake(&q->sleeping);
+}
+
+
+int nf2_fmq_done(const struct nf2_fmq_op *op) {
+	return __atomic_load_n(&op->done, __ATOMIC_ACQUIRE) == OP_DONE;
+}
+
+
+int nf2_fmq_wait(struct nf2_fmq_op *op) {
+	int pending = OP_PENDING;
+
+	/* fails if the writer is done with it already */
+	__atomic_compare_exchange_n(&op->done, &pending, OP_WAITING, 0,
+				    __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE);
+	while (__atomic_load_n(&op->done, __ATOMIC_ACQUIRE) != OP_DONE)
+		futex_wait(&op->done, OP_WAITING);
+	return op->result;
+}
+
+
+static int is_exact(enum nf2_fmq_type type) {
+	return type <= NF2_FMQ_EXACT_DELETE;
+}
+
+
+static void take(struct nf2_fmq_fold *f, const struct nf2_fmq_op *op) {
+	f->type = op->type;
+	f->entry = op->entry;
+	f->mask = op->mask;
+	f->action = op->action;
+}
+
+
+//
+// fold_op: adds an op to what the batch writes to its slot
+//
+static void fold_op(struct nf2_fmq_fold *f, struct nf2_fmq_op *op) {
+	enum nf2_fmq_type prev;
+
+	f->last->coalesced = 1;
+	f->last->batch_next = op;
+	f->last = op;
+
+	switch (op->type) {
+	case NF2_FMQ_EXACT_MODIFY:
+		if (f->type != NF2_FMQ_EXACT_DELETE)
+			f->action = op->action;
+		break;
+	case NF2_FMQ_WILDCARD_MODIFY:
+		prev = f->type;
+		take(f, op);
+		if (prev != NF2_FMQ_WILDCARD_MODIFY)
+			f->type = NF2_FMQ_WILDCARD_WRITE;
+		break;
+	default:
+		take(f, op);
+		break;
+	}
+}
+
+
+//
+// since: the time since t0 and, with pace, the modelled PCI time since
+//    model0, which the writer waits for once the batch is written
+//
+static uint64_t since(struct nf2_fmq *q, uint64_t t0, unsigned long long model0) {
+	uint64_t t = now_ns() - t0;
+
+	if (q->pace && q->io->type == NF2_REGIO_MOCK)
+		t += q->io->model_ns - model0;
+	return t;
+}
+
+
+static int write_exact(struct nf2_fmq *q, struct nf2_fmq_fold **w, int n) {
+	nf2_of_entry_wrap entries[NF2_EXACT_BATCH];
+	nf2_of_action_wrap actions[NF2_EXACT_BATCH];
+	int index[NF2_EXACT_BATCH];
+	unsigned long long model = q->io->model_ns;
+	uint64_t t0 = now_ns(), t;
+	uint32_t timer;
+	int i, r;
+
+	for (i = 0; i < n; i++) {
+		index[i] = w[i]->index;
+		entries[i] = w[i]->entry;
+		actions[i] = w[i]->action;
+	}
+	q->stats.exact_batches++;
+	r = nf2_regio_read(q->io, OPENFLOW_LOOKUP_TIMER_REG, &timer) ||
+	    nf2_of_exact_write_batch(q->io, index, entries, actions, n, timer) ? -1 : 0;
+	t = since(q, t0, model);
+	for (i = 0; i < n; i++) {
+		w[i]->result = r;
+		w[i]->write_ns += t;
+		/* a failed batch may have left the slot partly written: take it
+		 * to be valid and its action unknown, so that the next write
+		 * invalidates it and rewrites the whole action */
+		q->exact_valid[index[i]] = 1;
+		q->exact_known[index[i]] = !r;
+		if (!r)
+			q->exact_action[index[i]] = actions[i];
+	}
+	return r;
+}
+
+
+static int write_fold(struct nf2_fmq *q, struct nf2_fmq_fold *f) {
+	struct nf2_of_wildcard_stage *st = &q->stage;
+	int i = f->index, r;
+
+	switch (f->type) {
+	case NF2_FMQ_EXACT_MODIFY:
+		if (q->exact_known[i])
+			r = nf2_of_exact_modify_action(q->io, i, &q->exact_action[i], &f->action);
+		else
+			r = nf2_of_exact_write_action(q->io, i, &f->action);
+		q->exact_known[i] = !r;
+		if (r)
+			return -1;
+		q->exact_action[i] = f->action;
+		return 0;
+	case NF2_FMQ_EXACT_DELETE:
+		if (nf2_of_exact_invalidate(q->io, i))
+			return -1;
+		q->exact_valid[i] = 0;
+		return 0;
+	case NF2_FMQ_WILDCARD_WRITE:
+		return nf2_of_wildcard_write(q->io, st, i, &f->entry, &f->mask, &f->action);
+	case NF2_FMQ_WILDCARD_MODIFY:
+		return nf2_of_wildcard_modify(q->io, st, i, &f->entry, &f->mask, &f->action);
+	case NF2_FMQ_WILDCARD_DELETE:
+		return nf2_of_wildcard_clear(q->io, st, i);
+	default:
+		return -1;
+	}
+}
+
+
+static int verify_fold(struct nf2_fmq *q, struct nf2_fmq_fold *f) {
+	int i = f->index;
+
+	switch (f->type) {
+	case NF2_FMQ_EXACT_WRITE:
+		return nf2_of_exact_verify(q->io, i, &f->entry, &f->action);
+	case NF2_FMQ_EXACT_MODIFY:
+		return nf2_of_exact_verify(q->io, i, NULL, &f->action);
+	case NF2_FMQ_EXACT_DELETE:
+		return nf2_of_exact_verify(q->io, i, NULL, NULL);
+	case NF2_FMQ_WILDCARD_WRITE:
+	case NF2_FMQ_WILDCARD_MODIFY:
+		return nf2_of_wildcard_verify(q->io, &q->stage, i, &f->entry, &f->mask,
+					      &f->action);
+	case NF2_FMQ_WILDCARD_DELETE:
+		return nf2_of_wildcard_verify(q->io, &q->stage, i, NULL, NULL, NULL);
+	default:
+		return -1;
+	}
+}
+
+
+static int is_delete(enum nf2_fmq_type type) {
+	return type == NF2_FMQ_EXACT_DELETE || type == NF2_FMQ_WILDCARD_DELETE;
+}
+
+
+//
+// apply: folds a batch of ops per slot, writes it and completes the ops
+//
+static void apply(struct nf2_fmq *q, struct nf2_fmq_op **ops, int n) {
+	struct nf2_fmq_fold *folds = q->folds, *f, *w[NF2_EXACT_BATCH];
+	struct nf2_fmq_op *op, *next;
+	unsigned long long model = q->io->model_ns, model0;
+	struct timespec ts;
+	uint64_t now, wait, t0;
+	int i, s, m = 0, k = 0, pass, r;
+
+	now = now_ns();
+	for (i = 0; i < n; i++)
+		nf2_fmlat_record(ops[i]->type, NF2_FMLAT_QUEUE, now - ops[i]->submit_ns);
+
+	q->stats.batches++;
+	q->stats.ops += n;
+	if (++q->gen == 0) {
+		memset(q->fold_gen, 0, NUM_SLOTS * sizeof(*q->fold_gen));
+		q->gen = 1;
+	}
+	for (i = 0; i < n; i++) {
+		op = ops[i];
+		op->batch_next = NULL;
+		if (op->index < 0 ||
+		    op->index >= (is_exact(op->type) ? EXACT_SLOTS : OPENFLOW_WILDCARD_TABLE_SIZE) ||
+		    op->type >= NF2_FMQ_TYPES) {
+			/* a fold of its own, that fails */
+			f = &folds[m++];
+			f->index = -1;
+			f->ops = f->last = op;
+			f->result = -1;
+			f->write_ns = 0;
+			continue;
+		}
+		s = is_exact(op->type) ? op->index : EXACT_SLOTS + op->index;
+		if (q->fold_gen[s] == q->gen) {
+			fold_op(&folds[q->fold_of[s]], op);
+			q->stats.coalesced++;
+			continue;
+		}
+		q->fold_gen[s] = q->gen;
+		q->fold_of[s] = m;
+		f = &folds[m++];
+		take(f, op);
+		f->index = op->index;
+		f->ops = f->last = op;
+		f->result = 0;
+		f->write_ns = 0;
+	}
+
+	/* writes and modifies, then deletes */
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; i < m; i++) {
+			f = &folds[i];
+			if (f->index < 0 || is_delete(f->type) != pass)
+				continue;
+			q->stats.writes++;
+			t0 = now_ns();
+			model0 = q->io->model_ns;
+			if (f->type != NF2_FMQ_EXACT_WRITE) {
+				f->result = write_fold(q, f);
+				f->write_ns = since(q, t0, model0);
+				continue;
+			}
+			if (q->exact_valid[f->index] && nf2_of_exact_invalidate(q->io, f->index))
+				f->result = -1;
+			f->write_ns = since(q, t0, model0);
+			if (f->result)
+				continue;
+			w[k++] = f;
+			if (k == NF2_EXACT_BATCH) {
+				write_exact(q, w, k);
+				k = 0;
+			}
+		}
+		if (k) {
+			write_exact(q, w, k);
+			k = 0;
+		}
+	}
+
+	for (i = 0; i < m; i++) {
+		f = &folds[i];
+		if (f->index < 0)
+			continue;
+		nf2_fmlat_record(f->type, NF2_FMLAT_WRITE, f->write_ns);
+		if (!q->verify || f->result)
+			continue;
+		t0 = now_ns();
+		model0 = q->io->model_ns;
+		r = verify_fold(q, f);
+		nf2_fmlat_record(f->type, NF2_FMLAT_VERIFY, since(q, t0, model0));
+		if (r) {
+			f->result = -1;
+			if (r > 0)
+				q->stats.verify_failures++;
+		}
+	}
+
+	if (q->pace && q->io->type == NF2_REGIO_MOCK) {
+		wait = q->io->model_ns - model;
+		ts.tv_sec = wait / 1000000000ULL;
+		ts.tv_nsec = wait % 1000000000ULL;
+		nanosleep(&ts, NULL);
+		q->stats.pace_ns += wait;
+	}
+
+	now = now_ns();
+	for (i = 0; i < m; i++) {
+		if (folds[i].result)
+			q->stats.errors++;
+		for (op = folds[i].ops; op != NULL; op = next) {
+			next = op->batch_next;
+			op->result = folds[i].result;
+			op->apply_ns = now;
+			nf2_fmlat_record(op->type, NF2_FMLAT_TOTAL, now - op->submit_ns);
+			/* the op may be gone once it reads done: only its
+			 * address is left to wake */
+			if (__atomic_exchange_n(&op->done, OP_DONE, __ATOMIC_ACQ_REL) == OP_WAITING)
+				futex_wake(&op->done);
+		}
+	}
+}
+
+
+//
+// writer: takes the queued ops in batches until stopped with the queue
+//    empty, and sleeps on q->sleeping while there are none
+//
+static void *writer(void *arg) {
+	struct nf2_fmq *q = arg;
+	struct nf2_fmq_op *ops[NF2_FMQ_MAX_BATCH], *op;
+	int n, busy;
+
+	for (;;) {
+		n = 0;
+		busy = 0;
+		while (n < NF2_FMQ_MAX_BATCH && (op = pop(q, &busy)) != NULL)
+			ops[n++] = op;
+		if (n) {
+			apply(q, ops, n);
+			continue;
+		}
+		if (busy) {
+			sched_yield();
+			continue;
+		}
+		if (__atomic_load_n(&q->stop, __ATOMIC_SEQ_CST))
+			break;
+
+		/* a producer that queues after this sees sleeping set */
+		__atomic_store_n(&q->sleeping, 1, __ATOMIC_SEQ_CST);
+		op = pop(q, &busy);
+		if (op != NULL || busy || __atomic_load_n(&q->stop, __ATOMIC_SEQ_CST)) {
+			__atomic_store_n(&q->sleeping, 0, __ATOMIC_SEQ_CST);
+			if (op != NULL)
+				apply(q, &op, 1);
+			continue;
+		}
+		q->stats.sleeps++;
+		while (__atomic_load_n(&q->sleeping, __ATOMIC_SEQ_CST))
+			futex_wait(&q->sleeping, 1);
+	}
+	return NULL;
+}
+
+
+int nf2_fmq_init(struct nf2_fmq *q, struct nf2_regio *io, int pace) {
+	memset(q, 0, sizeof(*q));
+	q->io = io;
+	q->pace = pace;
+	q->head = q->tail = &q->stub;
+	q->fold_of = calloc(NUM_SLOTS, sizeof(*q->fold_of));
+	q->fold_gen = calloc(NUM_SLOTS, sizeof(*q->fold_gen));
+	q->exact_valid = calloc(EXACT_SLOTS, 1);
+	q->exact_known = calloc(EXACT_SLOTS, 1);
+	q->exact_action = calloc(EXACT_SLOTS, sizeof(*q->exact_action));
+	q->folds = calloc(NF2_FMQ_MAX_BATCH, sizeof(*q->folds));
+	if (q->fold_of == NULL || q->fold_gen == NULL || q->exact_valid == NULL ||
+	    q->exact_known == NULL || q->exact_action == NULL || q->folds == NULL)
+		goto fail;
+	nf2_of_wildcard_stage_invalidate(&q->stage);
+	if (pthread_create(&q->thread, NULL, writer, q)) {
+		perror("pthread_create");
+		goto fail;
+	}
+	return 0;
+
+fail:
+	free(q->folds);
+	free(q->fold_of);
+	free(q->fold_gen);
+	free(q->exact_valid);
+	free(q->exact_known);
+	free(q->exact_action);
+	return -1;
+}
+
+
+void nf2_fmq_free(struct nf2_fmq *q) {
+	__atomic_store_n(&q->stop, 1, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&q->sleeping, 0, __ATOMIC_SEQ_CST);
+	futex_wake(&q->sleeping);
+	pthread_join(q->thread, NULL);
+	free(q->folds);
+	free(q->fold_of);
+	free(q->fold_gen);
+	free(q->exact_valid);
+	free(q->exact_known);
+	free(q->exact_action);
+	q->folds = NULL;
+	q->fold_of = NULL;
+	q->fold_gen = NULL;
+	q->exact_valid = NULL;
+	q->exact_known = NULL;
+	q->exact_action = NULL;
+}
+
+
+void nf2_fmq_print_stats(struct nf2_fmq *q, FILE *out) {
+	struct nf2_fmq_stats *st = &q->stats;
+
+	fprintf(out, "ops:          %lu in %lu batches (%.1f per batch), writer slept %lu times\n",
+		st->ops, st->batches, st->batches ? (double)st->ops / st->batches : 0,
+		st->sleeps);
+	fprintf(out, "writes:       %lu (%lu ops coalesced), %lu exact write batches\n",
+		st->writes, st->coalesced, st->exact_batches);
+	fprintf(out, "registers:    %lu transactions, %lu words, %.1f ms modelled (waited %.1f ms)\n",
+		q->io->num_txns, q->io->num_words, q->io->model_ns / 1e6, st->pace_ns / 1e6);
+	fprintf(out, "errors:       %lu (%lu read back different)\n", st->errors,
+		st->verify_failures);
+}
@@ -0,0 +1,156 @@
+/* ****************************************************************************
+ * Module: nf2_fmq.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Flow-mod submission queue: any number of threads queue
+ *              table writes without a lock, and one register writer
+ *              applies them in coalesced batches.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_FMQ_H_
+#define NF2_FMQ_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "nf2_regio.h"
+#include "nf2_of_hw.h"
+
+/*
+ * The operations of nf2_write_of_exact, nf2_modify_write_of_exact,
+ * nf2_write_of_wildcard and nf2_modify_write_of_wildcard, and the
+ * deletes, on one slot of a table.
+ */
+enum nf2_fmq_type {
+	NF2_FMQ_EXACT_WRITE,		/* entry and action, counters zeroed */
+	NF2_FMQ_EXACT_MODIFY,		/* action only */
+	NF2_FMQ_EXACT_DELETE,
+	NF2_FMQ_WILDCARD_WRITE,		/* entry, mask and action, counters zeroed */
+	NF2_FMQ_WILDCARD_MODIFY,	/* entry, mask and action, counters kept */
+	NF2_FMQ_WILDCARD_DELETE,	/* cleared as after reset */
+	NF2_FMQ_TYPES
+};
+
+/*
+ * A queued operation, and its completion. The caller fills in type,
+ * index and what the type writes, and keeps the op in place until it is
+ * done. On completion, result is 0 or -1 (a register access failed or,
+ * with verify set, the card did not read back what was written),
+ * submit_ns and apply_ns (CLOCK_MONOTONIC) give its latency, and
+ * coalesced tells that a later op on the same slot, of the same batch,
+ * superseded or absorbed it, so it was written with that one.
+ */
+struct nf2_fmq_op {
+	enum nf2_fmq_type type;
+	int index;
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;
+	nf2_of_action_wrap action;
+
+	int result;
+	int coalesced;
+	uint64_t submit_ns;
+	uint64_t apply_ns;
+
+	/* the queue's */
+	struct nf2_fmq_op *next;
+	struct nf2_fmq_op *batch_next;	/* ops of the same slot in the batch */
+	int done;			/* pending, waited for or done, one word */
+};
+
+#define NF2_FMQ_MAX_BATCH	256	/* ops taken off the queue at once */
+
+struct nf2_fmq_fold;
+
+struct nf2_fmq_stats {
+	unsigned long ops;
+	unsigned long batches;
+	unsigned long writes;		/* folded ops written */
+	unsigned long coalesced;	/* ops folded into a later one */
+	unsigned long exact_batches;	/* nf2_of_exact_write_batch calls */
+	unsigned long errors;
+	unsigned long verify_failures;	/* read back different */
+	unsigned long sleeps;		/* the writer waited for ops */
+	uint64_t pace_ns;
+};
+
+/*
+ * The queue is an intrusive MPSC list: nf2_fmq_submit exchanges the tail
+ * pointer and links the op behind the old tail, so producers never wait
+ * for each other or for the writer. The writer takes up to
+ * NF2_FMQ_MAX_BATCH ops at a time and folds, per slot and in submission
+ * order, what the card would end up with:
+ *
+ *  - a write or delete replaces whatever came before it;
+ *  - a modify after a write is that write with the new action (and, for
+ *    a wildcard entry, the new entry and mask), after a modify it is the
+ *    new modify, and after a delete it changes nothing visible for an
+ *    exact entry (invalid) and is a write for a wildcard entry (the
+ *    delete zeroed its counters).
+ *
+ * It then writes the batch: the exact writes together with
+ * nf2_of_exact_write_batch, NF2_EXACT_BATCH at a time and after
+ * invalidating slots that held another entry, the exact modifies as
+ * differences from the actions it wrote last, the wildcard entries
+ * through one staging shadow, and the deletes last, so a flow moved
+ * between two slots in one batch is never missing from the card.
+ *
+ * Only the writer touches the registers, so io needs no lock; with an
+ * emulated card and pace set, the writer waits for the modelled PCI time
+ * of each batch as it would wait for the bus.
+ *
+ * With verify set (before the first submit), the writer reads back each
+ * slot it wrote once the batch is written. It records into nf2_fmlat, per
+ * op, how long it was queued and its total latency, and per slot written,
+ * under the type it was folded to, how long the register writes and the
+ * read-back took (with pace, counting the modelled PCI time); an exact
+ * write batch counts whole for each slot in it.
+ */
+struct nf2_fmq {
+	struct nf2_regio *io;
+	int pace;
+	int verify;
+
+	struct nf2_fmq_op *tail;	/* producers' end */
+	struct nf2_fmq_op *head;	/* writer's end */
+	struct nf2_fmq_op stub;
+	int sleeping;			/* futex: the writer waits for ops */
+	int stop;
+
+	/* writer state */
+	pthread_t thread;
+	struct nf2_fmq_fold *folds;	/* what the batch writes, per slot */
+	int32_t *fold_of;		/* per slot: its fold in the batch */
+	uint32_t *fold_gen;
+	uint32_t gen;
+	/* What the writer left in the card: exact_valid is set while a slot
+	 * may be valid, exact_known while exact_action is what it holds. A
+	 * failed write leaves the slot valid and its action unknown */
+	uint8_t *exact_valid;
+	uint8_t *exact_known;
+	nf2_of_action_wrap *exact_action;
+	struct nf2_of_wildcard_stage stage;
+
+	struct nf2_fmq_stats stats;
+};
+
+/* Starts the writer on io. The exact slots are taken to be invalid, as
+ * after a reset, and the first modify of each writes its whole action */
+int nf2_fmq_init(struct nf2_fmq *, struct nf2_regio *io, int pace);
+
+/* Stops the writer once every op submitted is done */
+void nf2_fmq_free(struct nf2_fmq *);
+
+/* Queues an op; any thread, never blocks */
+void nf2_fmq_submit(struct nf2_fmq *, struct nf2_fmq_op *);
+
+/* Whether the op is done, and waiting for it */
+int nf2_fmq_done(const struct nf2_fmq_op *);
+int nf2_fmq_wait(struct nf2_fmq_op *);
+
+void nf2_fmq_print_stats(struct nf2_fmq *, FILE *);
+
+#endif
@@ -0,0 +1,195 @@
+/* ****************************************************************************
+ * Module: nf2_harvest.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Harvesting of the exact entry counters into 64-bit host
+ *              counters.
+ *
+ *              A poll walks the due times of all entries once and reads
+ *              the due ones in index order, so that neighbours can share
+ *              a block read; 32K comparisons are cheap next to a single
+ *              register transaction.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nf2_harvest.h"
+
+/* bits of the packet counter word a read clears: bytes 0 to 2 (sram_bw 8'hf8) */
+#define CLEARED_BITS	0x00ffffff
+
+#define RUN_WORDS	((NF2_HARVEST_MAX_RUN - 1) * NF2_EXACT_ENTRY_WORDS + \
+			 NF2_OF_EXACT_COUNTERS_WORD_LEN)
+
+
+int nf2_harvest_init(struct nf2_harvest *h, const struct nf2_harvest_cfg *cfg,
+		     uint64_t now_ns) {
+	int i;
+
+	memset(h, 0, sizeof(*h));
+	if (cfg->hot_ns == 0 || cfg->hot_ns >= NF2_HARVEST_WRAP_NS ||
+	    cfg->idle_ns == 0 || cfg->idle_ns >= NF2_HARVEST_WRAP_NS || cfg->merge_words < 0)
+		return -1;
+
+	h->cfg = *cfg;
+	h->flows = calloc(NF2_HARVEST_ENTRIES, sizeof(*h->flows));
+	h->due_ns = malloc(NF2_HARVEST_ENTRIES * sizeof(*h->due_ns));
+	h->hot = calloc(NF2_HARVEST_ENTRIES, 1);
+	h->buf = malloc(RUN_WORDS * sizeof(*h->buf));
+	if (h->flows == NULL || h->due_ns == NULL || h->hot == NULL || h->buf == NULL) {
+		nf2_harvest_free(h);
+		return -1;
+	}
+
+	for (i = 0; i < NF2_HARVEST_ENTRIES; i++) {
+		h->flows[i].read_ns = now_ns;
+		h->due_ns[i] = now_ns + cfg->idle_ns * i / NF2_HARVEST_ENTRIES;
+	}
+	return 0;
+}
+
+
+void nf2_harvest_free(struct nf2_harvest *h) {
+	free(h->flows);
+	free(h->due_ns);
+	free(h->hot);
+	free(h->buf);
+	h->flows = NULL;
+	h->due_ns = NULL;
+	h->hot = NULL;
+	h->buf = NULL;
+}
+
+
+//
+// harvest: add the counter words of an entry, just read, to its totals
+//    and schedule its next read
+//
+static void harvest(struct nf2_harvest *h, int index, const uint32_t *cntrs, uint64_t now_ns) {
+	struct nf2_flow_count *f = &h->flows[index];
+	uint32_t pkts, delta;
+	int hot;
+
+	pkts = (cntrs[0] >> OPENFLOW_EXACT_ENTRY_PKT_COUNTER_POS) & NF2_EXACT_PKT_MASK;
+	delta = (pkts - f->residue) & NF2_EXACT_PKT_MASK;
+	f->pkts += delta;
+	f->bytes += cntrs[1];
+	f->residue = ((cntrs[0] & ~CLEARED_BITS) >> OPENFLOW_EXACT_ENTRY_PKT_COUNTER_POS) &
+		     NF2_EXACT_PKT_MASK;
+	f->last_seen = (cntrs[0] >> OPENFLOW_EXACT_ENTRY_LAST_SEEN_POS) & NF2_EXACT_LAST_SEEN_MASK;
+	f->read_ns = now_ns;
+
+	hot = delta != 0 || cntrs[1] != 0;
+	/* the timer may have ticked since it was read, so take the nearest */
+	if (hot)
+		f->last_used = h->timer + ((f->last_seen - h->timer + 64) & NF2_EXACT_LAST_SEEN_MASK) - 64;
+	h->stats.hot += hot - h->hot[index];
+	h->hot[index] = hot;
+	if (h->due_ns[index] != UINT64_MAX)
+		h->due_ns[index] = now_ns + (hot ? h->cfg.hot_ns : h->cfg.idle_ns);
+	h->stats.reads++;
+}
+
+
+//
+// harvest_due: read the entries due by limit_ns, merging neighbours
+//    into one block read where that adds at most merge_words words
+//
+static int harvest_due(struct nf2_harvest *h, struct nf2_regio *io, uint64_t limit_ns,
+		       uint64_t now_ns) {
+	int i, j, start, last, n = 0;
+
+	for (i = 0; i < NF2_HARVEST_ENTRIES; i++) {
+		if (h->due_ns[i] > limit_ns)
+			continue;
+		if (n == 0 && nf2_regio_read(io, OPENFLOW_LOOKUP_TIMER_REG, &h->timer))
+			return -1;
+
+		start = last = i;
+		for (j = i + 1; j < NF2_HARVEST_ENTRIES && j - start < NF2_HARVEST_MAX_RUN &&
+		     (j - last) * NF2_EXACT_ENTRY_WORDS - NF2_OF_EXACT_COUNTERS_WORD_LEN <=
+		     h->cfg.merge_words; j++)
+			if (h->due_ns[j] <= limit_ns)
+				last = j;
+
+		if (nf2_regio_read_block(io, NF2_EXACT_ADDR(start, OPENFLOW_EXACT_ENTRY_COUNTERS_POS),
+					 h->buf, (last - start) * NF2_EXACT_ENTRY_WORDS +
+					 NF2_OF_EXACT_COUNTERS_WORD_LEN))
+			return -1;
+		h->stats.blocks++;
+
+		/* the entries in between were cleared too */
+		for (j = start; j <= last; j++)
+			harvest(h, j, h->buf + (j - start) * NF2_EXACT_ENTRY_WORDS, now_ns);
+		n += last - start + 1;
+		i = last;
+	}
+	return n;
+}
+
+
+int nf2_harvest_poll(struct nf2_harvest *h, struct nf2_regio *io, uint64_t now_ns) {
+	h->stats.polls++;
+	return harvest_due(h, io, now_ns, now_ns);
+}
+
+
+int nf2_harvest_sweep(struct nf2_harvest *h, struct nf2_regio *io, uint64_t now_ns) {
+	return harvest_due(h, io, UINT64_MAX - 1, now_ns);
+}
+
+
+int nf2_harvest_entry(struct nf2_harvest *h, struct nf2_regio *io, int index,
+		      uint64_t now_ns) {
+	uint32_t cntrs[NF2_OF_EXACT_COUNTERS_WORD_LEN];
+
+	if (nf2_regio_read(io, OPENFLOW_LOOKUP_TIMER_REG, &h->timer))
+		return -1;
+	if (nf2_regio_read_block(io, NF2_EXACT_ADDR(index, OPENFLOW_EXACT_ENTRY_COUNTERS_POS),
+				 cntrs, NF2_OF_EXACT_COUNTERS_WORD_LEN))
+		return -1;
+	h->stats.blocks++;
+	harvest(h, index, cntrs, now_ns);
+	return 0;
+}
+
+
+void nf2_harvest_reset(struct nf2_harvest *h, int index, uint64_t now_ns) {
+	memset(&h->flows[index], 0, sizeof(h->flows[index]));
+	h->flows[index].read_ns = now_ns;
+}
+
+
+void nf2_harvest_move(struct nf2_harvest *h, int src, int dst, uint64_t pkts, uint64_t bytes,
+		      uint64_t now_ns) {
+	struct nf2_flow_count *f = &h->flows[dst];
+
+	nf2_harvest_track(h, dst, 0, now_ns);
+	*f = h->flows[src];
+	f->pkts += pkts;
+	f->bytes += bytes;
+	f->residue = 0;
+	if (pkts || bytes)
+		f->last_used = h->timer;
+	h->due_ns[dst] = h->due_ns[src];
+	h->hot[dst] = h->hot[src];
+	h->stats.hot += h->hot[dst];
+
+	nf2_harvest_track(h, src, 0, now_ns);
+	nf2_harvest_reset(h, src, now_ns);
+}
+
+
+void nf2_harvest_track(struct nf2_harvest *h, int index, int on, uint64_t now_ns) {
+	if (!on) {
+		h->stats.hot -= h->hot[index];
+		h->hot[index] = 0;
+		h->due_ns[index] = UINT64_MAX;
+	}
+	else if (h->due_ns[index] == UINT64_MAX) {
+		h->due_ns[index] = now_ns;
+	}
+}
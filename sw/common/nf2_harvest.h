@@ -0,0 +1,125 @@
+/* ****************************************************************************
+ * Module: nf2_harvest.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Harvesting of the exact entry counters into 64-bit host
+ *              counters.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_HARVEST_H_
+#define NF2_HARVEST_H_
+
+#include <stdint.h>
+
+#include "nf2_regio.h"
+#include "nf2_of_hw.h"
+
+#define NF2_HARVEST_ENTRIES	OPENFLOW_NF2_EXACT_TABLE_SIZE
+
+/*
+ * Shortest time a flow can take to wrap its entry's counters: at the
+ * 1.488 Mpps of minimum size frames on a 1 Gb/s port the 25-bit packet
+ * counter wraps in 22.5 s (the 32-bit byte counter takes 34 s at 125
+ * MB/s). Every entry must be read more often than this.
+ */
+#define NF2_HARVEST_WRAP_NS	22000000000ULL
+
+#define NF2_HARVEST_MAX_RUN	64	/* entries in one merged block read */
+
+/*
+ * Reading an entry's counter words clears them (sram_arbiter), except
+ * for the last seen time and bit 24 of the packet counter, so the
+ * harvester adds each read to the host totals: the packet count modulo
+ * 2^25 after subtracting the bit 24 the previous read left, and the
+ * whole byte count. The totals are exact as long as every entry is read
+ * within NF2_HARVEST_WRAP_NS and nothing else reads the counters (the
+ * drivers' nf2_get_exact_packet_count, or nf2_exact_table when it moves
+ * a flow).
+ *
+ * Entries that counted packets at their last read are hot and read
+ * again after cfg.hot_ns; the others after cfg.idle_ns, which must stay
+ * below NF2_HARVEST_WRAP_NS by more than the time between polls. At
+ * init the idle reads are spread over one idle_ns.
+ *
+ * Due entries are read two words each, unless reading the words in
+ * between as well (and harvesting those entries too) adds at most
+ * cfg.merge_words words, in which case they are read as one block. That
+ * pays with a high cost per transaction; with the ioctl backend, which
+ * has one ioctl per word anyway, leave it 0.
+ *
+ * Each batch of reads also reads OPENFLOW_LOOKUP_TIMER_REG (seconds), and
+ * an entry that counted packets since its previous read gets the whole
+ * timer value of its last packet in last_used: the 7-bit last_seen is
+ * unambiguous because the reads are far less than 64 s apart. last_used
+ * stays put while the flow is quiet, however long, and is 0 until the
+ * first packet.
+ */
+struct nf2_harvest_cfg {
+	uint64_t hot_ns;
+	uint64_t idle_ns;
+	int merge_words;
+};
+
+struct nf2_flow_count {
+	uint64_t pkts;
+	uint64_t bytes;
+	uint64_t read_ns;	/* time of the last read */
+	uint32_t last_seen;	/* OPENFLOW_LOOKUP_TIMER bits of the last packet */
+	uint32_t residue;	/* packet counter bits the last read left */
+	uint32_t last_used;	/* OPENFLOW_LOOKUP_TIMER of the last packet */
+};
+
+struct nf2_harvest_stats {
+	unsigned long polls;
+	unsigned long reads;	/* entries read */
+	unsigned long blocks;	/* block reads */
+	unsigned long hot;	/* entries hot now */
+};
+
+struct nf2_harvest {
+	struct nf2_harvest_cfg cfg;
+	struct nf2_flow_count *flows;		/* NF2_HARVEST_ENTRIES */
+	uint64_t *due_ns;			/* UINT64_MAX: not tracked */
+	uint8_t *hot;
+	uint32_t *buf;
+	uint32_t timer;				/* at the last read */
+	struct nf2_harvest_stats stats;
+};
+
+/* Returns -1 if the intervals are not below NF2_HARVEST_WRAP_NS or
+ * memory is short */
+int nf2_harvest_init(struct nf2_harvest *, const struct nf2_harvest_cfg *, uint64_t now_ns);
+void nf2_harvest_free(struct nf2_harvest *);
+
+/* Reads the entries due by now_ns. Returns how many were read, or -1 */
+int nf2_harvest_poll(struct nf2_harvest *, struct nf2_regio *, uint64_t now_ns);
+
+/* Reads every tracked entry now */
+int nf2_harvest_sweep(struct nf2_harvest *, struct nf2_regio *, uint64_t now_ns);
+
+/*
+ * Reads one entry now, e.g. to collect the last counts of a flow before
+ * its slot is invalidated or rewritten. nf2_harvest_reset then zeroes
+ * the totals for the next flow of the slot, once nf2_of_exact_write has
+ * zeroed its counters.
+ */
+int nf2_harvest_entry(struct nf2_harvest *, struct nf2_regio *, int index, uint64_t now_ns);
+void nf2_harvest_reset(struct nf2_harvest *, int index, uint64_t now_ns);
+
+/*
+ * The flow of src now lives in dst, e.g. after a cuckoo move: its totals,
+ * last_used and read schedule go with it, and src is zeroed and no longer
+ * read. Read src (nf2_harvest_entry) just before the move; pkts and bytes
+ * are what the move itself read out of src after that (nf2_exact_slot
+ * carry), and count as used at the time of that read. dst must have been
+ * written with zeroed counters.
+ */
+void nf2_harvest_move(struct nf2_harvest *, int src, int dst, uint64_t pkts, uint64_t bytes,
+		      uint64_t now_ns);
+
+/* Stops or resumes reading an entry; all entries are tracked after init */
+void nf2_harvest_track(struct nf2_harvest *, int index, int on, uint64_t now_ns);
+
+#endif
@@ -0,0 +1,394 @@
+/* ****************************************************************************
+ * Module: nf2_hash.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host implementation of the exact table hashes computed by
+ *              src/lookups/header_hash.v.
+ *
+ *              Both CRCs are linear with a zero initial value, so
+ *              CRC(key) is the xor of the CRCs of each key byte at its
+ *              position. The TABLE method keeps one 256-entry table per
+ *              byte position (both CRCs in one 64-bit entry) and does 32
+ *              independent lookups per key. The CLMUL method folds the
+ *              256-bit key into 64 bits with carry-less multiplies by
+ *              x^k mod P and finishes with a Barrett reduction.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#define HAVE_CLMUL	1
+#endif
+
+#include "nf2_hash.h"
+
+#define POLY_0		0x04c11db7	/* CRC_FUNC_0 */
+#define POLY_1		0x1edc6f41	/* CRC_FUNC_1 */
+
+/* Folding constants of one polynomial for the CLMUL method */
+struct clmul_consts {
+	uint64_t k[3];		/* x^(64*(3-j)+32) mod P for key word j */
+	uint64_t k64;		/* x^64 mod P */
+	uint64_t mu;		/* floor(x^64 / P) */
+	uint64_t p;		/* P including x^32 */
+};
+
+static uint64_t pos_table[NF2_HASH_KEY_LEN][256];
+static struct clmul_consts consts[2];
+static int initialized = 0;
+static enum nf2_hash_method method = NF2_HASH_TABLE;
+
+/* Golden vectors: the bytes of struct nf2_of_entry (without the pad byte)
+ * and hash_0/hash_1 as 32-bit CRCs, from the CRC_FUNC_0/CRC_FUNC_1
+ * equations in include/crc_func_[01]_d256.v. */
+static const struct {
+	uint8_t entry[NF2_HASH_KEY_LEN - 1];
+	uint32_t crc_0;
+	uint32_t crc_1;
+} golden[] = {
+	{ { 0 }, 0x00000000, 0x00000000 },
+	{ { 0x5c, 0x34, 0x60, 0xbe, 0x31, 0x20, 0x1e, 0x69, 0xfe, 0xda, 0xa0,
+	    0xee, 0xe8, 0xb9, 0x99, 0x7f, 0x5c, 0x7c, 0x29, 0x99, 0xfd, 0xaf,
+	    0xe5, 0x93, 0x25, 0x3c, 0xd6, 0x54, 0xaf, 0x4d, 0xfa },
+	  0x8c34082e, 0x0a002a62 },
+	{ { 0xd7, 0x14, 0x27, 0xa0, 0xae, 0xb3, 0xfe, 0xe9, 0x23, 0x2f, 0x8a,
+	    0xf2, 0x21, 0x1f, 0x9e, 0xe4, 0x91, 0xc5, 0xb1, 0x0b, 0xec, 0xb5,
+	    0x56, 0x3b, 0xfc, 0x1e, 0x6f, 0x93, 0x42, 0x7e, 0xcb },
+	  0x3710fca7, 0x0f018c95 },
+	{ { 0xc8, 0xfe, 0x29, 0x55, 0xe5, 0xcd, 0x8e, 0x46, 0xdc, 0x8e, 0xd4,
+	    0xb7, 0xc2, 0x76, 0x4d, 0x2a, 0x5a, 0x4d, 0x76, 0x77, 0x06, 0xf8,
+	    0x5d, 0x86, 0x90, 0x02, 0x4a, 0xd6, 0xbd, 0xa3, 0x40 },
+	  0x105270d5, 0xe0c63db4 },
+	{ { 0x1b, 0xe9, 0xc8, 0xcb, 0xcc, 0xc9, 0x35, 0xf6, 0xcd, 0x1f, 0x61,
+	    0x22, 0x6a, 0xe1, 0x53, 0x38, 0xae, 0x1a, 0x34, 0x00, 0x4d, 0x33,
+	    0xba, 0x0d, 0x24, 0x6a, 0xc0, 0x4c, 0x81, 0xb1, 0xba },
+	  0x5d2b1441, 0x9bec8954 },
+	{ { 0xf2, 0x3e, 0x3b, 0xf9, 0xee, 0xf5, 0xf7, 0x9f, 0x2b, 0x49, 0x34,
+	    0xaf, 0x87, 0xf5, 0x52, 0x0b, 0x69, 0xb9, 0x4b, 0x0d, 0x98, 0x2e,
+	    0x85, 0xbb, 0x55, 0xb6, 0x72, 0xa8, 0x72, 0x63, 0x7a },
+	  0xa98b26ea, 0x9ad2d909 },
+	{ { 0xcd, 0x74, 0x66, 0xfc, 0xb6, 0x0e, 0x0e, 0x8f, 0xf1, 0x84, 0x63,
+	    0xb0, 0xe4, 0xb2, 0xba, 0x29, 0x70, 0x34, 0x74, 0xf0, 0x64, 0xac,
+	    0x68, 0xf7, 0x00, 0xf5, 0xb0, 0x2b, 0x3d, 0xc6, 0x66 },
+	  0xfbbba8e4, 0xcf841a49 },
+	{ { 0xf4, 0x5b, 0xde, 0xaa, 0x2c, 0xca, 0xed, 0xcd, 0x2b, 0x51, 0x57,
+	    0x41, 0x0e, 0x4d, 0xee, 0x4a, 0xf2, 0xb3, 0x4f, 0x43, 0x0a, 0x07,
+	    0x34, 0x47, 0xde, 0x63, 0x6c, 0x0e, 0x80, 0x6c, 0x95 },
+	  0x839a4b77, 0x1dff953a },
+};
+
+/* header_hash_tester feeds the 256-bit word with byte i = i + 'h31 (so the
+ * first serial byte is 0x50) and watches hash_0 at 32 bits */
+#define TESTER_CRC_0	0x18e5fa0f
+#define TESTER_CRC_1	0xcf96cc9a
+
+
+static uint32_t crc_bitwise_one(const uint8_t *key, uint32_t poly) {
+	uint32_t crc = 0;
+	int i, j;
+
+	for (i = 0; i < NF2_HASH_KEY_LEN; i++) {
+		crc ^= (uint32_t)key[i] << 24;
+		for (j = 0; j < 8; j++)
+			crc = (crc << 1) ^ ((crc & 0x80000000) ? poly : 0);
+	}
+	return crc;
+}
+
+
+static void crc_bitwise(const uint8_t *key, uint32_t *crc_0, uint32_t *crc_1) {
+	*crc_0 = crc_bitwise_one(key, POLY_0);
+	*crc_1 = crc_bitwise_one(key, POLY_1);
+}
+
+
+static inline void crc_table(const uint8_t *key, uint32_t *crc_0, uint32_t *crc_1) {
+	uint64_t a = 0, b = 0;
+	int i;
+
+	/* two accumulators to keep the xor chain short */
+	for (i = 0; i < NF2_HASH_KEY_LEN; i += 2) {
+		a ^= pos_table[i][key[i]];
+		b ^= pos_table[i + 1][key[i + 1]];
+	}
+	a ^= b;
+	*crc_0 = (uint32_t)a;
+	*crc_1 = (uint32_t)(a >> 32);
+}
+
+
+static uint32_t xpow_mod(int n, uint32_t poly) {
+	uint32_t r = 1;
+
+	while (n-- > 0)
+		r = (r << 1) ^ ((r & 0x80000000) ? poly : 0);
+	return r;
+}
+
+
+static void clmul_consts_init(struct clmul_consts *c, uint32_t poly) {
+	unsigned __int128 rem = (unsigned __int128)1 << 64;
+	uint64_t p = (1ULL << 32) | poly;
+	uint64_t q = 0;
+	int i;
+
+	for (i = 0; i < 3; i++)
+		c->k[i] = xpow_mod(64 * (3 - i) + 32, poly);
+	c->k64 = xpow_mod(64, poly);
+	c->p = p;
+
+	/* mu = floor(x^64 / P) by long division */
+	for (i = 64; i >= 32; i--) {
+		if ((rem >> i) & 1) {
+			rem ^= (unsigned __int128)p << (i - 32);
+			q |= 1ULL << (i - 32);
+		}
+	}
+	c->mu = q;
+}
+
+
+#ifdef HAVE_CLMUL
+__attribute__((target("pclmul,sse2")))
+static inline __m128i clmul(uint64_t a, uint64_t b) {
+	return _mm_clmulepi64_si128(_mm_cvtsi64_si128(a), _mm_cvtsi64_si128(b), 0x00);
+}
+
+
+__attribute__((target("pclmul,sse2")))
+static inline uint32_t crc_clmul_one(const uint64_t *m, const struct clmul_consts *c) {
+	__m128i acc;
+	uint64_t lo, hi, a, q;
+
+	/* fold the four key words into a 96-bit value congruent to key * x^32 */
+	acc = _mm_xor_si128(clmul(m[0], c->k[0]), clmul(m[1], c->k[1]));
+	acc = _mm_xor_si128(acc, clmul(m[2], c->k[2]));
+	lo = _mm_cvtsi128_si64(acc) ^ (m[3] << 32);
+	hi = _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc)) ^ (m[3] >> 32);
+
+	/* fold the top 32 bits into the low 64 */
+	a = _mm_cvtsi128_si64(clmul(hi, c->k64)) ^ lo;
+
+	/* Barrett reduction of a 64-bit value */
+	q = _mm_cvtsi128_si64(clmul(a >> 32, c->mu)) >> 32;
+	return (uint32_t)(a ^ _mm_cvtsi128_si64(clmul(q, c->p)));
+}
+
+
+__attribute__((target("pclmul,sse2")))
+static inline void crc_clmul(const uint8_t *key, uint32_t *crc_0, uint32_t *crc_1) {
+	uint64_t m[4];
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		memcpy(&m[i], key + 8 * i, 8);
+		m[i] = __builtin_bswap64(m[i]);
+	}
+	*crc_0 = crc_clmul_one(m, &consts[0]);
+	*crc_1 = crc_clmul_one(m, &consts[1]);
+}
+
+
+/* kept separate so that the per-key code is inlined with the pclmul target */
+__attribute__((target("pclmul,sse2")))
+static void hash_batch_clmul(const nf2_of_entry_wrap *entries, int n, uint32_t mask,
+			     uint32_t *hash_0, uint32_t *hash_1) {
+	uint8_t key[NF2_HASH_KEY_LEN];
+	uint32_t crc_0, crc_1;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		nf2_hash_key(&entries[i], key);
+		crc_clmul(key, &crc_0, &crc_1);
+		hash_0[i] = crc_0 & mask;
+		hash_1[i] = crc_1 & mask;
+	}
+}
+#endif
+
+
+static int clmul_supported(void) {
+#ifdef HAVE_CLMUL
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("pclmul");
+#else
+	return 0;
+#endif
+}
+
+
+void nf2_hash_init(void) {
+	uint8_t key[NF2_HASH_KEY_LEN];
+	uint32_t crc_0, crc_1;
+	int i, b;
+
+	if (initialized)
+		return;
+
+	memset(key, 0, sizeof(key));
+	for (i = 0; i < NF2_HASH_KEY_LEN; i++) {
+		for (b = 0; b < 256; b++) {
+			key[i] = b;
+			crc_bitwise(key, &crc_0, &crc_1);
+			pos_table[i][b] = crc_0 | ((uint64_t)crc_1 << 32);
+		}
+		key[i] = 0;
+	}
+	clmul_consts_init(&consts[0], POLY_0);
+	clmul_consts_init(&consts[1], POLY_1);
+
+	method = clmul_supported() ? NF2_HASH_CLMUL : NF2_HASH_TABLE;
+	initialized = 1;
+}
+
+
+int nf2_hash_set_method(enum nf2_hash_method m) {
+	nf2_hash_init();
+
+	if (m == NF2_HASH_AUTO)
+		m = clmul_supported() ? NF2_HASH_CLMUL : NF2_HASH_TABLE;
+	if (m == NF2_HASH_CLMUL && !clmul_supported())
+		return -1;
+	method = m;
+	return 0;
+}
+
+
+enum nf2_hash_method nf2_hash_get_method(void) {
+	nf2_hash_init();
+	return method;
+}
+
+
+const char *nf2_hash_method_name(enum nf2_hash_method m) {
+	switch (m) {
+	case NF2_HASH_AUTO:	return "auto";
+	case NF2_HASH_BITWISE:	return "bitwise";
+	case NF2_HASH_TABLE:	return "table";
+	case NF2_HASH_CLMUL:	return "clmul";
+	}
+	return "?";
+}
+
+
+void nf2_hash_key(const nf2_of_entry_wrap *entry, uint8_t key[NF2_HASH_KEY_LEN]) {
+	/* the pad byte holds the valid bit in SRAM; header_hash sees a zero */
+	memcpy(key, entry, NF2_HASH_KEY_LEN - 1);
+	key[NF2_HASH_KEY_LEN - 1] = 0;
+}
+
+
+void nf2_hash_crc(const uint8_t key[NF2_HASH_KEY_LEN], uint32_t *crc_0,
+		  uint32_t *crc_1) {
+	nf2_hash_init();
+
+	switch (method) {
+#ifdef HAVE_CLMUL
+	case NF2_HASH_CLMUL:
+		crc_clmul(key, crc_0, crc_1);
+		break;
+#endif
+	case NF2_HASH_BITWISE:
+		crc_bitwise(key, crc_0, crc_1);
+		break;
+	default:
+		crc_table(key, crc_0, crc_1);
+		break;
+	}
+}
+
+
+void nf2_header_hash(const nf2_of_entry_wrap *entry, uint32_t *hash_0, uint32_t *hash_1) {
+	nf2_header_hash_batch(entry, 1, hash_0, hash_1);
+}
+
+
+//
+// hash_batch: the CRCs of n entries, masked
+//
+static void hash_batch(const nf2_of_entry_wrap *entries, int n, uint32_t mask,
+		       uint32_t *hash_0, uint32_t *hash_1) {
+	uint8_t key[NF2_HASH_KEY_LEN];
+	uint32_t crc_0, crc_1;
+	int i;
+
+	nf2_hash_init();
+
+	switch (method) {
+#ifdef HAVE_CLMUL
+	case NF2_HASH_CLMUL:
+		hash_batch_clmul(entries, n, mask, hash_0, hash_1);
+		break;
+#endif
+	case NF2_HASH_BITWISE:
+		for (i = 0; i < n; i++) {
+			nf2_hash_key(&entries[i], key);
+			crc_bitwise(key, &crc_0, &crc_1);
+			hash_0[i] = crc_0 & mask;
+			hash_1[i] = crc_1 & mask;
+		}
+		break;
+	default:
+		for (i = 0; i < n; i++) {
+			nf2_hash_key(&entries[i], key);
+			crc_table(key, &crc_0, &crc_1);
+			hash_0[i] = crc_0 & mask;
+			hash_1[i] = crc_1 & mask;
+		}
+		break;
+	}
+}
+
+
+void nf2_header_hash_batch(const nf2_of_entry_wrap *entries, int n, uint32_t *hash_0,
+			   uint32_t *hash_1) {
+	hash_batch(entries, n, NF2_HASH_INDEX_MASK, hash_0, hash_1);
+}
+
+
+void nf2_hash_crc_batch(const nf2_of_entry_wrap *entries, int n, uint32_t *crc_0,
+			uint32_t *crc_1) {
+	hash_batch(entries, n, 0xffffffff, crc_0, crc_1);
+}
+
+
+int nf2_hash_selftest(void) {
+	uint8_t key[NF2_HASH_KEY_LEN];
+	nf2_of_entry_wrap entry;
+	uint32_t crc_0, crc_1, hash_0, hash_1;
+	int i, failures = 0;
+
+	for (i = 0; i < NF2_HASH_KEY_LEN; i++)
+		key[i] = 0x50 - i;
+	nf2_hash_crc(key, &crc_0, &crc_1);
+	if (crc_0 != TESTER_CRC_0 || crc_1 != TESTER_CRC_1) {
+		fprintf(stderr, "nf2_hash: header_hash_tester vector: got %08x %08x, "
+			"expected %08x %08x\n", crc_0, crc_1, TESTER_CRC_0, TESTER_CRC_1);
+		failures++;
+	}
+
+	for (i = 0; i < sizeof(golden) / sizeof(golden[0]); i++) {
+		memset(&entry, 0, sizeof(entry));
+		memcpy(&entry, golden[i].entry, sizeof(golden[i].entry));
+		entry.entry.pad = 0x80;		/* must not be hashed */
+
+		nf2_hash_key(&entry, key);
+		nf2_hash_crc(key, &crc_0, &crc_1);
+		nf2_header_hash(&entry, &hash_0, &hash_1);
+		if (crc_0 != golden[i].crc_0 || crc_1 != golden[i].crc_1 ||
+		    hash_0 != (golden[i].crc_0 & NF2_HASH_INDEX_MASK) ||
+		    hash_1 != (golden[i].crc_1 & NF2_HASH_INDEX_MASK)) {
+			fprintf(stderr, "nf2_hash: golden vector %d: got %08x %08x, "
+				"expected %08x %08x\n", i, crc_0, crc_1,
+				golden[i].crc_0, golden[i].crc_1);
+			failures++;
+		}
+	}
+	return failures;
+}
@@ -0,0 +1,67 @@
+/* ****************************************************************************
+ * Module: nf2_hash.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host implementation of the exact table hashes computed by
+ *              src/lookups/header_hash.v.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_HASH_H_
+#define NF2_HASH_H_
+
+#include <stdint.h>
+
+#include "../../../../lib/C/common/nf2util.h"
+#include "../regdump/nf2_drv.h"
+
+/*
+ * header_hash pads the 248-bit flow entry with a zero byte, reverses the
+ * byte order and runs it through CRC_FUNC_0 and CRC_FUNC_1 with a zero
+ * initial value. The result is the same as feeding the bytes of
+ * struct nf2_of_entry (in memory order, the pad byte replaced by zero)
+ * MSB first through two 32-bit CRCs with no reflection and no final xor:
+ *   CRC_FUNC_0: 0x04c11db7 (the ethernet polynomial)
+ *   CRC_FUNC_1: 0x1edc6f41 (Castagnoli)
+ * The exact table indices are the low bits of each CRC.
+ *
+ * As in the driver, struct nf2_of_entry is assumed to be in the byte
+ * order of a little-endian host.
+ */
+#define NF2_HASH_KEY_LEN	32
+#define NF2_HASH_INDEX_MASK	(OPENFLOW_NF2_EXACT_TABLE_SIZE - 1)
+
+enum nf2_hash_method {
+	NF2_HASH_AUTO,		/* CLMUL if the CPU has it, else TABLE */
+	NF2_HASH_BITWISE,	/* bit-serial reference */
+	NF2_HASH_TABLE,		/* one table lookup per key byte */
+	NF2_HASH_CLMUL,		/* carry-less multiply folding (PCLMULQDQ) */
+};
+
+/*
+ * nf2_hash_init builds the tables and must be called before the hash
+ * functions are used from more than one thread. nf2_hash_set_method
+ * returns -1 if the method is not supported on this CPU.
+ */
+void nf2_hash_init(void);
+int nf2_hash_set_method(enum nf2_hash_method);
+enum nf2_hash_method nf2_hash_get_method(void);
+const char *nf2_hash_method_name(enum nf2_hash_method);
+
+void nf2_hash_key(const nf2_of_entry_wrap *, uint8_t key[NF2_HASH_KEY_LEN]);
+void nf2_hash_crc(const uint8_t key[NF2_HASH_KEY_LEN], uint32_t *crc_0,
+		  uint32_t *crc_1);
+
+void nf2_header_hash(const nf2_of_entry_wrap *, uint32_t *hash_0, uint32_t *hash_1);
+void nf2_header_hash_batch(const nf2_of_entry_wrap *, int n, uint32_t *hash_0,
+			   uint32_t *hash_1);
+
+/* The whole CRCs, for host tables of another size than the card's */
+void nf2_hash_crc_batch(const nf2_of_entry_wrap *, int n, uint32_t *crc_0,
+			uint32_t *crc_1);
+
+/* Checks the current method against golden vectors; returns the failures */
+int nf2_hash_selftest(void);
+
+#endif
@@ -0,0 +1,108 @@
+/* ****************************************************************************
+ * Module: nf2_hdr.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: High dynamic range histogram of latencies, recorded by one
+ *              thread and read by any.
+ *
+ * Change history:
+ *
+ */
+
+#include <string.h>
+
+#include "nf2_hdr.h"
+
+#define HALF		(1 << (NF2_HDR_SUB_BITS - 1))
+#define MAX_VALUE	((1ULL << NF2_HDR_MAX_BITS) - 1)
+
+
+static inline int bucket(uint64_t v) {
+	int shift;
+
+	if (v < 2 * HALF)
+		return v;
+	if (v > MAX_VALUE)
+		v = MAX_VALUE;
+	shift = 63 - __builtin_clzll(v) - NF2_HDR_SUB_BITS + 1;
+	return (shift << (NF2_HDR_SUB_BITS - 1)) + (v >> shift);
+}
+
+
+static uint64_t bucket_top(int b) {
+	int shift;
+
+	if (b < 2 * HALF)
+		return b;
+	shift = (b >> (NF2_HDR_SUB_BITS - 1)) - 1;
+	return (((uint64_t)(b - (shift << (NF2_HDR_SUB_BITS - 1))) + 1) << shift) - 1;
+}
+
+
+static inline uint64_t get(const uint64_t *p) {
+	return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+
+static inline void set(uint64_t *p, uint64_t v) {
+	__atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+
+
+void nf2_hdr_init(struct nf2_hdr *h) {
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+
+void nf2_hdr_record(struct nf2_hdr *h, uint64_t v) {
+	uint64_t *c = &h->counts[bucket(v)];
+
+	set(c, *c + 1);
+	set(&h->sum, h->sum + v);
+	if (v < h->min)
+		set(&h->min, v);
+	if (v > h->max)
+		set(&h->max, v);
+	/* last, so a reader never sees more values than counts */
+	__atomic_store_n(&h->total, h->total + 1, __ATOMIC_RELEASE);
+}
+
+
+void nf2_hdr_add(struct nf2_hdr *dst, const struct nf2_hdr *src) {
+	uint64_t v;
+	int i;
+
+	dst->total += __atomic_load_n(&src->total, __ATOMIC_ACQUIRE);
+	for (i = 0; i < NF2_HDR_BUCKETS; i++)
+		dst->counts[i] += get(&src->counts[i]);
+	dst->sum += get(&src->sum);
+	if ((v = get(&src->min)) < dst->min)
+		dst->min = v;
+	if ((v = get(&src->max)) > dst->max)
+		dst->max = v;
+}
+
+
+uint64_t nf2_hdr_value_at(const struct nf2_hdr *h, double pct) {
+	uint64_t want, sum = 0, top;
+	int b;
+
+	if (h->total == 0)
+		return 0;
+	want = (uint64_t)(pct / 100 * h->total + 0.5);
+	if (want == 0)
+		want = 1;
+	for (b = 0; b < NF2_HDR_BUCKETS; b++) {
+		sum += h->counts[b];
+		if (sum >= want) {
+			top = bucket_top(b);
+			return top < h->max ? top : h->max;
+		}
+	}
+	return h->max;
+}
+
+
+double nf2_hdr_mean(const struct nf2_hdr *h) {
+	return h->total ? (double)h->sum / h->total : 0;
+}
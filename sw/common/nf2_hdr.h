@@ -0,0 +1,52 @@
+/* ****************************************************************************
+ * Module: nf2_hdr.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: High dynamic range histogram of latencies, recorded by one
+ *              thread and read by any.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_HDR_H_
+#define NF2_HDR_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Values below 2^NF2_HDR_SUB_BITS are counted exactly; above, each power
+ * of two is cut in 2^(NF2_HDR_SUB_BITS - 1) buckets, so a value is known
+ * to within 1/64 (1.6%) of itself, from 1 ns to 2^NF2_HDR_MAX_BITS ns (18
+ * minutes; longer values count as that).
+ */
+#define NF2_HDR_SUB_BITS	7
+#define NF2_HDR_MAX_BITS	40
+#define NF2_HDR_BUCKETS		((NF2_HDR_MAX_BITS - NF2_HDR_SUB_BITS + 2) << (NF2_HDR_SUB_BITS - 1))
+
+/*
+ * Only one thread records into a histogram; it stores each count with a
+ * relaxed atomic store, so other threads can read or add up histograms
+ * at any time without a lock, and see each count whole (a read while the
+ * recorder runs may miss its latest values).
+ */
+struct nf2_hdr {
+	uint64_t counts[NF2_HDR_BUCKETS];
+	uint64_t total;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+};
+
+void nf2_hdr_init(struct nf2_hdr *);
+void nf2_hdr_record(struct nf2_hdr *, uint64_t value);
+
+/* Adds src to dst, which must not be recorded into meanwhile */
+void nf2_hdr_add(struct nf2_hdr *dst, const struct nf2_hdr *src);
+
+/* The value below which pct percent of the values fall: the upper end of
+ * its bucket, or the maximum if lower */
+uint64_t nf2_hdr_value_at(const struct nf2_hdr *, double pct);
+double nf2_hdr_mean(const struct nf2_hdr *);
+
+#endif
@@ -0,0 +1,269 @@
+/* ****************************************************************************
+ * Module: nf2_missq.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Packet-in front end: coalesces the misses of a flow until
+ *              its rule is installed.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nf2_missq.h"
+
+#define NS_PER_SEC	1000000000ULL
+
+
+int nf2_missq_init(struct nf2_missq *q, const struct nf2_missq_cfg *cfg) {
+	int i;
+
+	memset(q, 0, sizeof(*q));
+	if (cfg->max_flows <= 0 || cfg->per_flow <= 0 || cfg->per_flow > NF2_MISSQ_MAX_PER_FLOW ||
+	    cfg->pool_frames <= 0)
+		return -1;
+	q->cfg = *cfg;
+	if (nf2_swtable_init(&q->waiting_set, cfg->max_flows))
+		return -1;
+	q->waiting = calloc(cfg->max_flows, sizeof(*q->waiting));
+	q->pool = malloc((size_t)cfg->pool_frames * NF2_MISSQ_FRAME_SIZE);
+	q->len = calloc(cfg->pool_frames, sizeof(*q->len));
+	q->next = calloc(cfg->pool_frames, sizeof(*q->next));
+	if (q->waiting == NULL || q->pool == NULL || q->len == NULL || q->next == NULL) {
+		nf2_missq_free(q);
+		return -1;
+	}
+	for (i = 0; i < cfg->pool_frames; i++)
+		q->next[i] = i + 1 < cfg->pool_frames ? i + 1 : -1;
+	q->free_head = 0;
+	q->num_free = cfg->pool_frames;
+	return 0;
+}
+
+
+void nf2_missq_free(struct nf2_missq *q) {
+	nf2_swtable_free(&q->waiting_set);
+	free(q->waiting);
+	free(q->pool);
+	free(q->len);
+	free(q->next);
+	q->waiting = NULL;
+	q->pool = NULL;
+	q->len = NULL;
+	q->next = NULL;
+}
+
+
+static inline uint8_t *frame(struct nf2_missq *q, int32_t i) {
+	return q->pool + (size_t)i * NF2_MISSQ_FRAME_SIZE + NF2_ACTION_HEADROOM;
+}
+
+
+//
+// release_frames: puts the held frames of a flow back on the free list
+//
+static void release_frames(struct nf2_missq *q, struct nf2_missq_waiting *w) {
+	if (w->head < 0)
+		return;
+	q->next[w->tail] = q->free_head;
+	q->free_head = w->head;
+	q->num_free += w->held;
+	w->head = w->tail = -1;
+	w->held = 0;
+}
+
+
+static void count_punt(struct nf2_missq *q, uint64_t now_ns) {
+	struct nf2_missq_stats *st = &q->stats;
+
+	st->punts++;
+	if (now_ns - st->sec_start_ns >= NS_PER_SEC) {
+		if (st->sec_punts > st->peak_punt_rate)
+			st->peak_punt_rate = st->sec_punts;
+		st->sec_start_ns = now_ns;
+		st->sec_punts = 0;
+	}
+	st->sec_punts++;
+}
+
+
+enum nf2_missq_verdict nf2_missq_miss(struct nf2_missq *q, const nf2_of_entry_wrap *key,
+				      const uint8_t *data, uint32_t len, uint64_t now_ns) {
+	static const nf2_of_action_wrap none;
+	struct nf2_missq_waiting *w;
+	int32_t f;
+	int idx;
+
+	q->stats.misses++;
+	idx = nf2_swtable_find(&q->waiting_set, key);
+	if (idx < 0) {
+		idx = nf2_swtable_insert(&q->waiting_set, key, &none);
+		if (idx < 0) {
+			q->stats.punts_unqueued++;
+			count_punt(q, now_ns);
+			return NF2_MISSQ_PUNT;
+		}
+		w = &q->waiting[idx];
+		w->first_ns = now_ns;
+		w->head = w->tail = -1;
+		w->held = 0;
+		if (++q->num_waiting > q->stats.peak_waiting)
+			q->stats.peak_waiting = q->num_waiting;
+		count_punt(q, now_ns);
+		return NF2_MISSQ_PUNT;
+	}
+
+	w = &q->waiting[idx];
+	if (len > NF2_MISSQ_FRAME_SIZE - NF2_ACTION_HEADROOM) {
+		q->stats.drops_long++;
+		return NF2_MISSQ_DROP;
+	}
+	if (w->held == q->cfg.per_flow) {
+		q->stats.drops_flow++;
+		return NF2_MISSQ_DROP;
+	}
+	if (q->free_head < 0) {
+		q->stats.drops_pool++;
+		return NF2_MISSQ_DROP;
+	}
+
+	f = q->free_head;
+	q->free_head = q->next[f];
+	q->num_free--;
+	memcpy(frame(q, f), data, len);
+	q->len[f] = len;
+	q->next[f] = -1;
+	if (w->tail >= 0)
+		q->next[w->tail] = f;
+	else
+		w->head = f;
+	w->tail = f;
+	w->held++;
+	q->stats.held++;
+	return NF2_MISSQ_HELD;
+}
+
+
+static int lat_bucket(uint64_t ns) {
+	int e, b;
+
+	if (ns < 4)
+		return ns;
+	e = 63 - __builtin_clzll(ns);
+	b = 4 * e + ((ns >> (e - 2)) & 3);
+	return b < NF2_MISSQ_LAT_BUCKETS ? b : NF2_MISSQ_LAT_BUCKETS - 1;
+}
+
+
+static uint64_t lat_bucket_max(int b) {
+	if (b < 4)
+		return b;
+	return ((uint64_t)(4 + (b & 3) + 1) << (b / 4 - 2)) - 1;
+}
+
+
+int nf2_missq_install(struct nf2_missq *q, const nf2_of_entry_wrap *key, uint64_t now_ns,
+		      struct nf2_pkt *pkts) {
+	struct nf2_missq_stats *st = &q->stats;
+	struct nf2_missq_waiting *w;
+	uint64_t lat;
+	int32_t f;
+	int idx, n = 0;
+
+	idx = nf2_swtable_delete(&q->waiting_set, key);
+	if (idx < 0)
+		return 0;
+	w = &q->waiting[idx];
+	q->num_waiting--;
+
+	lat = now_ns - w->first_ns;
+	st->installs++;
+	st->lat_hist[lat_bucket(lat)]++;
+	st->lat_sum_ns += lat;
+	if (lat > st->lat_max_ns)
+		st->lat_max_ns = lat;
+
+	/* the frames go back on the free list but are not reused before
+	 * the next miss */
+	for (f = w->head; f >= 0; f = q->next[f]) {
+		pkts[n].data = frame(q, f);
+		pkts[n].len = q->len[f];
+		pkts[n].headroom = NF2_ACTION_HEADROOM;
+		n++;
+	}
+	st->released += n;
+	release_frames(q, w);
+	return n;
+}
+
+
+void nf2_missq_expire(struct nf2_missq *q, uint64_t now_ns) {
+	struct nf2_swtable *set = &q->waiting_set;
+	struct nf2_missq_waiting *w;
+	int i, way, b;
+
+	if (now_ns - q->last_expire_ns < q->cfg.timeout_ns / 8 || q->num_waiting == 0)
+		return;
+	q->last_expire_ns = now_ns;
+
+	for (b = 0; b <= (int)set->mask; b++) {
+		for (way = 0; way < NF2_SWTABLE_WAYS; way++) {
+			i = set->buckets[b].flow[way];
+			if (i < 0)
+				continue;
+			w = &q->waiting[i];
+			if (now_ns - w->first_ns < q->cfg.timeout_ns)
+				continue;
+			q->stats.expired++;
+			q->stats.expired_frames += w->held;
+			release_frames(q, w);
+			nf2_swtable_delete(set, &set->flows[i].entry);
+			q->num_waiting--;
+		}
+	}
+}
+
+
+uint64_t nf2_missq_latency(const struct nf2_missq *q, double pct) {
+	const struct nf2_missq_stats *st = &q->stats;
+	uint64_t sum = 0, want;
+	int b;
+
+	if (st->installs == 0)
+		return 0;
+	want = (uint64_t)(pct / 100 * st->installs + 0.5);
+	if (want == 0)
+		want = 1;
+	for (b = 0; b < NF2_MISSQ_LAT_BUCKETS; b++) {
+		sum += st->lat_hist[b];
+		if (sum >= want)
+			return lat_bucket_max(b) < st->lat_max_ns ? lat_bucket_max(b) : st->lat_max_ns;
+	}
+	return st->lat_max_ns;
+}
+
+
+void nf2_missq_print_stats(struct nf2_missq *q, FILE *out) {
+	struct nf2_missq_stats *st = &q->stats;
+	uint64_t peak = st->sec_punts > st->peak_punt_rate ? st->sec_punts : st->peak_punt_rate;
+
+	fprintf(out, "misses:       %llu\n", (unsigned long long)st->misses);
+	fprintf(out, "punts:        %llu (%.2f per miss, %llu with too many flows waiting),"
+		" peak %llu/s\n", (unsigned long long)st->punts,
+		st->misses ? (double)st->punts / st->misses : 0,
+		(unsigned long long)st->punts_unqueued, (unsigned long long)peak);
+	fprintf(out, "held:         %llu (released %llu)\n", (unsigned long long)st->held,
+		(unsigned long long)st->released);
+	fprintf(out, "drops:        %llu flow buffer full, %llu pool empty, %llu too long\n",
+		(unsigned long long)st->drops_flow, (unsigned long long)st->drops_pool,
+		(unsigned long long)st->drops_long);
+	fprintf(out, "installs:     %llu (waiting %d, peak %d; expired %llu with %llu frames)\n",
+		(unsigned long long)st->installs, q->num_waiting, st->peak_waiting,
+		(unsigned long long)st->expired, (unsigned long long)st->expired_frames);
+	fprintf(out, "miss to install: mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+		st->installs ? st->lat_sum_ns / 1e3 / st->installs : 0,
+		nf2_missq_latency(q, 50) / 1e3, nf2_missq_latency(q, 99) / 1e3,
+		st->lat_max_ns / 1e3);
+}
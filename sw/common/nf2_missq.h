@@ -0,0 +1,132 @@
+/* ****************************************************************************
+ * Module: nf2_missq.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Packet-in front end: coalesces the misses of a flow until
+ *              its rule is installed.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_MISSQ_H_
+#define NF2_MISSQ_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "nf2_swtable.h"
+#include "nf2_action.h"
+
+/* Bytes of a held frame, headroom for an action to add a tag included */
+#define NF2_MISSQ_FRAME_SIZE	2048
+
+/* miss to install latency histogram: 4 buckets per power of two of ns */
+#define NF2_MISSQ_LAT_BUCKETS	(4 * 40)
+
+struct nf2_missq_cfg {
+	int max_flows;			/* flows waiting for a rule at once */
+	int per_flow;			/* frames held per waiting flow, at most
+					 * NF2_MISSQ_MAX_PER_FLOW */
+	int pool_frames;		/* frames held in all */
+	uint64_t timeout_ns;		/* a flow waits this long before it is punted again */
+};
+
+#define NF2_MISSQ_MAX_PER_FLOW		256
+#define NF2_MISSQ_DEFAULT_PER_FLOW	16
+#define NF2_MISSQ_DEFAULT_TIMEOUT_MS	1000
+#define NF2_MISSQ_DEFAULT_CFG	{ 4096, NF2_MISSQ_DEFAULT_PER_FLOW, 1024 * NF2_MISSQ_DEFAULT_PER_FLOW, \
+				  NF2_MISSQ_DEFAULT_TIMEOUT_MS * 1000000ULL }
+
+enum nf2_missq_verdict {
+	NF2_MISSQ_PUNT,			/* first miss of the flow: send it to the controller */
+	NF2_MISSQ_HELD,			/* held until the flow's rule is installed */
+	NF2_MISSQ_DROP,			/* the flow's buffer or the pool is full */
+};
+
+struct nf2_missq_waiting {
+	uint64_t first_ns;		/* first miss, punted */
+	int32_t head, tail;		/* held frames, oldest first, linked through next */
+	int held;
+};
+
+struct nf2_missq_stats {
+	uint64_t misses;
+	uint64_t punts;
+	uint64_t punts_unqueued;	/* punted without dedup: too many flows waiting */
+	uint64_t held;
+	uint64_t drops_flow;		/* the flow had per_flow frames held */
+	uint64_t drops_pool;		/* no free frame in the pool */
+	uint64_t drops_long;		/* longer than a frame of the pool */
+	uint64_t installs;		/* rules installed for waiting flows */
+	uint64_t released;		/* held frames handed back on install */
+	uint64_t expired;		/* flows that waited timeout_ns */
+	uint64_t expired_frames;
+	int peak_waiting;
+
+	/* punts per second, over whole seconds */
+	uint64_t sec_start_ns;
+	uint64_t sec_punts;
+	uint64_t peak_punt_rate;
+
+	uint64_t lat_hist[NF2_MISSQ_LAT_BUCKETS];
+	uint64_t lat_max_ns;
+	uint64_t lat_sum_ns;
+};
+
+/*
+ * A new flow's first packets all miss and would each go to the
+ * controller, which answers each with its own install. The queue keeps
+ * the flows waiting for a rule, by flow entry, in a host cuckoo table
+ * (common/nf2_swtable.c): the first miss of a flow is punted and the
+ * next ones are copied into a bounded buffer of the flow, taken from a
+ * pool shared by all of them, until nf2_missq_install hands them back to
+ * be forwarded with the new rule. A flow with no rule after timeout_ns
+ * (nf2_missq_expire) loses its held frames and is punted again on its
+ * next miss.
+ *
+ * Each install records the time from the flow's first miss; the punt
+ * rate is tracked per second.
+ */
+struct nf2_missq {
+	struct nf2_missq_cfg cfg;
+	struct nf2_swtable waiting_set;	/* flow index: waiting[] */
+	struct nf2_missq_waiting *waiting;
+	int num_waiting;
+
+	uint8_t *pool;			/* pool_frames of NF2_MISSQ_FRAME_SIZE */
+	uint32_t *len;
+	int32_t *next;			/* held frames of a flow, and free frames */
+	int32_t free_head;
+	int num_free;
+
+	uint64_t last_expire_ns;
+	struct nf2_missq_stats stats;
+};
+
+int nf2_missq_init(struct nf2_missq *, const struct nf2_missq_cfg *);
+void nf2_missq_free(struct nf2_missq *);
+
+/* A frame of the flow of key missed */
+enum nf2_missq_verdict nf2_missq_miss(struct nf2_missq *, const nf2_of_entry_wrap *key,
+				      const uint8_t *data, uint32_t len, uint64_t now_ns);
+
+/*
+ * The rule of the flow of key was installed: returns the number of frames
+ * held for it, at most cfg.per_flow, in pkts in the order they missed,
+ * each with NF2_ACTION_HEADROOM. They stay valid until the next
+ * nf2_missq_miss. Returns 0 if the flow was not waiting.
+ */
+int nf2_missq_install(struct nf2_missq *, const nf2_of_entry_wrap *key, uint64_t now_ns,
+		      struct nf2_pkt *pkts);
+
+/* Drops the flows that have waited longer than timeout_ns; looks at most
+ * every timeout_ns / 8 */
+void nf2_missq_expire(struct nf2_missq *, uint64_t now_ns);
+
+/* Miss to install latency at pct percent of the installs, in ns (to the
+ * upper bound of its histogram bucket, the maximum is exact) */
+uint64_t nf2_missq_latency(const struct nf2_missq *, double pct);
+
+void nf2_missq_print_stats(struct nf2_missq *, FILE *);
+
+#endif
@@ -0,0 +1,306 @@
+/* ****************************************************************************
+ * Module: nf2_of_hw.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Register level access to the flow table entries, in the
+ *              layout written by regress/add_entry/OpenFlowLib.pm.
+ *
+ * Change history:
+ *
+ */
+
+#include <string.h>
+
+#include "nf2_of_hw.h"
+
+/* a batched write takes the counters and actions of an entry as one block */
+#if OPENFLOW_EXACT_ENTRY_ACTION_BASE_POS != OPENFLOW_EXACT_ENTRY_COUNTERS_POS + NF2_OF_EXACT_COUNTERS_WORD_LEN
+#error "exact entry counters and actions are not contiguous"
+#endif
+
+/* of the last compare and mask word of a wildcard entry, the key's bits */
+#define WILDCARD_LAST_WORD_BITS	0x00ffffff
+
+
+//
+// write_changed: write the words of cur that differ from old, one block
+//    per run of changed words.
+//
+static int write_changed(struct nf2_regio *io, unsigned reg, const uint32_t *old,
+			 const uint32_t *cur, int n) {
+	int i, start;
+
+	for (i = 0; i < n; ) {
+		if (old[i] == cur[i]) {
+			i++;
+			continue;
+		}
+		for (start = i; i < n && old[i] != cur[i]; i++)
+			;
+		if (nf2_regio_write_block(io, reg + start * 4, cur + start, i - start))
+			return -1;
+	}
+	return 0;
+}
+
+
+int nf2_of_exact_write(struct nf2_regio *io, int index, const nf2_of_entry_wrap *entry,
+		       const nf2_of_action_wrap *action, uint32_t last_seen) {
+	uint32_t cntrs[NF2_OF_EXACT_COUNTERS_WORD_LEN];
+	uint32_t last;
+
+	if (nf2_of_exact_write_action(io, index, action))
+		return -1;
+
+	cntrs[0] = (last_seen & NF2_EXACT_LAST_SEEN_MASK) << OPENFLOW_EXACT_ENTRY_LAST_SEEN_POS;
+	cntrs[1] = 0;
+	if (nf2_regio_write_block(io, NF2_EXACT_ADDR(index, OPENFLOW_EXACT_ENTRY_COUNTERS_POS),
+				  cntrs, NF2_OF_EXACT_COUNTERS_WORD_LEN))
+		return -1;
+
+	/* everything but the valid bit word, then the valid bit word */
+	if (nf2_regio_write_block(io, NF2_EXACT_ADDR(index, OPENFLOW_EXACT_ENTRY_HDR_BASE_POS),
+				  entry->raw, NF2_OF_ENTRY_WORD_LEN - 1))
+		return -1;
+	last = entry->raw[NF2_OF_ENTRY_WORD_LEN - 1] | NF2_EXACT_VALID_BIT;
+	return nf2_regio_write(io, NF2_EXACT_ADDR(index, OPENFLOW_EXACT_ENTRY_HDR_BASE_POS +
+						  NF2_OF_ENTRY_WORD_LEN - 1), last);
+}
+
+
+int nf2_of_exact_write_batch(struct nf2_regio *io, const int *index,
+			     const nf2_of_entry_wrap *entries, const nf2_of_action_wrap *actions,
+			     int n, uint32_t last_seen) {
+	uint32_t body[NF2_OF_EXACT_COUNTERS_WORD_LEN + NF2_OF_ACTION_WORD_LEN];
+	uint32_t hdr[NF2_OF_ENTRY_WORD_LEN];
+	int i;
+
+	body[0] = (last_seen & NF2_EXACT_LAST_SEEN_MASK) << OPENFLOW_EXACT_ENTRY_LAST_SEEN_POS;
+	body[1] = 0;
+	for (i = 0; i < n; i++) {
+		memcpy(body + NF2_OF_EXACT_COUNTERS_WORD_LEN, actions[i].raw,
+		       sizeof(actions[i].raw));
+		if (nf2_regio_write_block(io, NF2_EXACT_ADDR(index[i], OPENFLOW_EXACT_ENTRY_COUNTERS_POS),
+					  body, NF2_OF_EXACT_COUNTERS_WORD_LEN + NF2_OF_ACTION_WORD_LEN))
+			return -1;
+	}
+	for (i = 0; i < n; i++) {
+		memcpy(hdr, entries[i].raw, sizeof(hdr));
+		hdr[NF2_OF_ENTRY_WORD_LEN - 1] |= NF2_EXACT_VALID_BIT;
+		if (nf2_regio_write_block(io, NF2_EXACT_ADDR(index[i], OPENFLOW_EXACT_ENTRY_HDR_BASE_POS),
+					  hdr, NF2_OF_ENTRY_WORD_LEN))
+			return -1;
+	}
+	return 0;
+}
+
+
+int nf2_of_exact_invalidate(struct nf2_regio *io, int index) {
+	return nf2_regio_write(io, NF2_EXACT_ADDR(index, OPENFLOW_EXACT_ENTRY_HDR_BASE_POS +
+						  NF2_OF_ENTRY_WORD_LEN - 1), 0);
+}
+
+
+int nf2_of_exact_write_action(struct nf2_regio *io, int index,
+			      const nf2_of_action_wrap *action) {
+	return nf2_regio_write_block(io, NF2_EXACT_ADDR(index, OPENFLOW_EXACT_ENTRY_ACTION_BASE_POS),
+				     action->raw, NF2_OF_ACTION_WORD_LEN);
+}
+
+
+int nf2_of_exact_modify_action(struct nf2_regio *io, int index,
+			       const nf2_of_action_wrap *old, const nf2_of_action_wrap *action) {
+	unsigned reg = NF2_EXACT_ADDR(index, OPENFLOW_EXACT_ENTRY_ACTION_BASE_POS);
+	int clear_only, flag_word_changed;
+
+	/* raw[0] holds forward_bitmask and nf2_action_flag */
+	clear_only = (action->action.nf2_action_flag & ~old->action.nf2_action_flag) == 0;
+	flag_word_changed = action->raw[0] != old->raw[0];
+
+	if (clear_only && flag_word_changed &&
+	    nf2_regio_write(io, reg, action->raw[0]))
+		return -1;
+	if (write_changed(io, reg + 4, old->raw + 1, action->raw + 1,
+			  NF2_OF_ACTION_WORD_LEN - 1))
+		return -1;
+	if (!clear_only && flag_word_changed &&
+	    nf2_regio_write(io, reg, action->raw[0]))
+		return -1;
+	return 0;
+}
+
+
+int nf2_of_exact_read_counters(struct nf2_regio *io, int index, uint32_t *pkts,
+			       uint32_t *bytes, uint32_t *last_seen) {
+	uint32_t cntrs[NF2_OF_EXACT_COUNTERS_WORD_LEN];
+
+	if (nf2_regio_read_block(io, NF2_EXACT_ADDR(index, OPENFLOW_EXACT_ENTRY_COUNTERS_POS),
+				 cntrs, NF2_OF_EXACT_COUNTERS_WORD_LEN))
+		return -1;
+
+	if (pkts != NULL)
+		*pkts = (cntrs[0] >> OPENFLOW_EXACT_ENTRY_PKT_COUNTER_POS) & NF2_EXACT_PKT_MASK;
+	if (bytes != NULL)
+		*bytes = cntrs[1];
+	if (last_seen != NULL)
+		*last_seen = (cntrs[0] >> OPENFLOW_EXACT_ENTRY_LAST_SEEN_POS) &
+			     NF2_EXACT_LAST_SEEN_MASK;
+	return 0;
+}
+
+
+//
+// stage_commit: stage the entry, writing only what differs from the
+//    stage shadow, and commit it to the index.
+//
+static int stage_commit(struct nf2_regio *io, struct nf2_of_wildcard_stage *stage,
+			int index, const nf2_of_entry_wrap *entry,
+			const nf2_of_mask_wrap *mask, const nf2_of_action_wrap *action) {
+	if (stage != NULL && stage->valid) {
+		if (write_changed(io, OPENFLOW_WILDCARD_LOOKUP_CMP_0_REG, stage->entry.raw,
+				  entry->raw, NF2_OF_ENTRY_WORD_LEN) ||
+		    write_changed(io, OPENFLOW_WILDCARD_LOOKUP_CMP_MASK_0_REG, stage->mask.raw,
+				  mask->raw, NF2_OF_MASK_WORD_LEN) ||
+		    write_changed(io, OPENFLOW_WILDCARD_LOOKUP_ACTION_0_REG, stage->action.raw,
+				  action->raw, NF2_OF_ACTION_WORD_LEN))
+			goto err;
+	}
+	else {
+		if (nf2_regio_write_block(io, OPENFLOW_WILDCARD_LOOKUP_CMP_0_REG,
+					  entry->raw, NF2_OF_ENTRY_WORD_LEN) ||
+		    nf2_regio_write_block(io, OPENFLOW_WILDCARD_LOOKUP_CMP_MASK_0_REG,
+					  mask->raw, NF2_OF_MASK_WORD_LEN) ||
+		    nf2_regio_write_block(io, OPENFLOW_WILDCARD_LOOKUP_ACTION_0_REG,
+					  action->raw, NF2_OF_ACTION_WORD_LEN))
+			goto err;
+	}
+
+	if (stage != NULL) {
+		stage->entry = *entry;
+		stage->mask = *mask;
+		stage->action = *action;
+		stage->valid = 1;
+	}
+	return nf2_regio_write(io, OPENFLOW_WILDCARD_LOOKUP_WRITE_ADDR_REG, index);
+
+err:
+	/* some of the staging registers may have been written */
+	if (stage != NULL)
+		nf2_of_wildcard_stage_invalidate(stage);
+	return -1;
+}
+
+
+//
+// nf2_of_wildcard_write: stage the entry, commit it to the index and
+//    reset the hit counters of the index.
+//
+int nf2_of_wildcard_write(struct nf2_regio *io, struct nf2_of_wildcard_stage *stage,
+			  int index, const nf2_of_entry_wrap *entry,
+			  const nf2_of_mask_wrap *mask, const nf2_of_action_wrap *action) {
+	if (stage_commit(io, stage, index, entry, mask, action))
+		return -1;
+
+	if (nf2_regio_write(io, OPENFLOW_WILDCARD_LOOKUP_BYTES_HIT_0_REG + index * 4, 0) ||
+	    nf2_regio_write(io, OPENFLOW_WILDCARD_LOOKUP_PKTS_HIT_0_REG + index * 4, 0))
+		return -1;
+	return 0;
+}
+
+
+int nf2_of_wildcard_modify(struct nf2_regio *io, struct nf2_of_wildcard_stage *stage,
+			   int index, const nf2_of_entry_wrap *entry,
+			   const nf2_of_mask_wrap *mask, const nf2_of_action_wrap *action) {
+	return stage_commit(io, stage, index, entry, mask, action);
+}
+
+
+int nf2_of_wildcard_clear(struct nf2_regio *io, struct nf2_of_wildcard_stage *stage,
+			  int index) {
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;
+	nf2_of_action_wrap action;
+
+	memset(&entry, 0, sizeof(entry));
+	memset(&mask, 0, sizeof(mask));
+	memset(&action, 0, sizeof(action));
+	return nf2_of_wildcard_write(io, stage, index, &entry, &mask, &action);
+}
+
+
+int nf2_of_wildcard_read_counters(struct nf2_regio *io, int index, uint32_t *pkts,
+				  uint32_t *bytes) {
+	if (nf2_regio_read(io, OPENFLOW_WILDCARD_LOOKUP_PKTS_HIT_0_REG + index * 4, pkts) ||
+	    nf2_regio_read(io, OPENFLOW_WILDCARD_LOOKUP_BYTES_HIT_0_REG + index * 4, bytes))
+		return -1;
+	return 0;
+}
+
+
+int nf2_of_exact_verify(struct nf2_regio *io, int index, const nf2_of_entry_wrap *entry,
+			const nf2_of_action_wrap *action) {
+	nf2_of_entry_wrap hdr;
+	nf2_of_action_wrap act;
+
+	if (entry == NULL && action == NULL) {
+		if (nf2_regio_read(io, NF2_EXACT_ADDR(index, OPENFLOW_EXACT_ENTRY_HDR_BASE_POS +
+						      NF2_OF_ENTRY_WORD_LEN - 1),
+				   &hdr.raw[NF2_OF_ENTRY_WORD_LEN - 1]))
+			return -1;
+		return (hdr.raw[NF2_OF_ENTRY_WORD_LEN - 1] & NF2_EXACT_VALID_BIT) != 0;
+	}
+
+	if (entry != NULL) {
+		if (nf2_regio_read_block(io, NF2_EXACT_ADDR(index, OPENFLOW_EXACT_ENTRY_HDR_BASE_POS),
+					 hdr.raw, NF2_OF_ENTRY_WORD_LEN))
+			return -1;
+		if (!(hdr.raw[NF2_OF_ENTRY_WORD_LEN - 1] & NF2_EXACT_VALID_BIT))
+			return 1;
+		hdr.raw[NF2_OF_ENTRY_WORD_LEN - 1] &= ~NF2_EXACT_VALID_BIT;
+		if (memcmp(hdr.raw, entry->raw, sizeof(hdr.raw)) != 0)
+			return 1;
+	}
+	if (nf2_regio_read_block(io, NF2_EXACT_ADDR(index, OPENFLOW_EXACT_ENTRY_ACTION_BASE_POS),
+				 act.raw, NF2_OF_ACTION_WORD_LEN))
+		return -1;
+	return memcmp(act.raw, action->raw, sizeof(act.raw)) != 0;
+}
+
+
+int nf2_of_wildcard_verify(struct nf2_regio *io, struct nf2_of_wildcard_stage *stage,
+			   int index, const nf2_of_entry_wrap *entry,
+			   const nf2_of_mask_wrap *mask, const nf2_of_action_wrap *action) {
+	struct nf2_of_wildcard_stage got, want;
+
+	if (entry == NULL) {
+		/* as nf2_of_wildcard_clear leaves it */
+		memset(&want, 0, sizeof(want));
+		entry = &want.entry;
+		mask = &want.mask;
+		action = &want.action;
+	}
+	if (stage != NULL)
+		nf2_of_wildcard_stage_invalidate(stage);
+	if (nf2_regio_write(io, OPENFLOW_WILDCARD_LOOKUP_READ_ADDR_REG, index) ||
+	    nf2_regio_read_block(io, OPENFLOW_WILDCARD_LOOKUP_CMP_0_REG, got.entry.raw,
+				 NF2_OF_ENTRY_WORD_LEN) ||
+	    nf2_regio_read_block(io, OPENFLOW_WILDCARD_LOOKUP_CMP_MASK_0_REG, got.mask.raw,
+				 NF2_OF_MASK_WORD_LEN) ||
+	    nf2_regio_read_block(io, OPENFLOW_WILDCARD_LOOKUP_ACTION_0_REG, got.action.raw,
+				 NF2_OF_ACTION_WORD_LEN))
+		return -1;
+	if (stage != NULL) {
+		*stage = got;
+		stage->valid = 1;
+	}
+
+	/* the TCAM does not keep the bits past the key and reads them as 0 */
+	want.entry = *entry;
+	want.mask = *mask;
+	got.entry.raw[NF2_OF_ENTRY_WORD_LEN - 1] &= WILDCARD_LAST_WORD_BITS;
+	got.mask.raw[NF2_OF_MASK_WORD_LEN - 1] &= WILDCARD_LAST_WORD_BITS;
+	want.entry.raw[NF2_OF_ENTRY_WORD_LEN - 1] &= WILDCARD_LAST_WORD_BITS;
+	want.mask.raw[NF2_OF_MASK_WORD_LEN - 1] &= WILDCARD_LAST_WORD_BITS;
+	return memcmp(got.entry.raw, want.entry.raw, sizeof(got.entry.raw)) != 0 ||
+	       memcmp(got.mask.raw, want.mask.raw, sizeof(got.mask.raw)) != 0 ||
+	       memcmp(got.action.raw, action->raw, sizeof(got.action.raw)) != 0;
+}
@@ -0,0 +1,137 @@
+/* ****************************************************************************
+ * Module: nf2_of_hw.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Register level access to the flow table entries.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_OF_HW_H_
+#define NF2_OF_HW_H_
+
+#include <stdint.h>
+
+#include "../../lib/C/reg_defines_openflow_switch.h"
+#include "nf2_regio.h"
+#include "../regdump/nf2_drv.h"
+
+/*
+ * An exact entry takes 32 register words of SRAM (16 64-bit locations):
+ * the header at OPENFLOW_EXACT_ENTRY_HDR_BASE_POS, the packet counter and
+ * last seen time at OPENFLOW_EXACT_ENTRY_COUNTERS_POS, the byte counter
+ * right after it and the actions at OPENFLOW_EXACT_ENTRY_ACTION_BASE_POS.
+ * The MSb of the last header word is the valid bit.
+ *
+ * Reading the counter words through the register interface clears them
+ * (sram_arbiter): the first word loses its packet count bits [23:0], the
+ * second its byte count.
+ */
+#define NF2_EXACT_ENTRY_WORDS		32
+#define NF2_EXACT_VALID_BIT		0x80000000
+
+#define NF2_EXACT_ADDR(index, word) \
+	(SRAM_BASE_ADDR + (((unsigned)(index) * NF2_EXACT_ENTRY_WORDS) + (word)) * 4)
+
+#define NF2_EXACT_PKT_MASK \
+	((1u << OPENFLOW_EXACT_ENTRY_PKT_COUNTER_WIDTH) - 1)
+#define NF2_EXACT_LAST_SEEN_MASK \
+	((1u << OPENFLOW_EXACT_ENTRY_LAST_SEEN_WIDTH) - 1)
+
+/*
+ * nf2_of_exact_write writes the actions, zeroed counters with the given
+ * last seen time, and the header, with the word holding the valid bit
+ * last. The slot must not hold a valid entry of another flow; use
+ * nf2_of_exact_invalidate first.
+ */
+int nf2_of_exact_write(struct nf2_regio *, int index, const nf2_of_entry_wrap *,
+		       const nf2_of_action_wrap *, uint32_t last_seen);
+int nf2_of_exact_invalidate(struct nf2_regio *, int index);
+
+/*
+ * nf2_of_exact_write of n entries into free slots, with half the block
+ * writes: the counters and actions of every entry, one block each, and
+ * then the headers, one block each. The backends store the words of a
+ * block in ascending order, so the word with the valid bit, the last of
+ * the header, still lands after the rest of the entry.
+ */
+int nf2_of_exact_write_batch(struct nf2_regio *, const int *index, const nf2_of_entry_wrap *,
+			     const nf2_of_action_wrap *, int n, uint32_t last_seen);
+int nf2_of_exact_write_action(struct nf2_regio *, int index, const nf2_of_action_wrap *);
+
+/*
+ * nf2_of_exact_modify_action writes only the action words that differ
+ * from old (what the card holds). The word with nf2_action_flag and
+ * forward_bitmask goes last, so that a flag is never set before its
+ * fields, unless the modify only clears flags, in which case it goes
+ * first.
+ */
+int nf2_of_exact_modify_action(struct nf2_regio *, int index, const nf2_of_action_wrap *old,
+			       const nf2_of_action_wrap *);
+
+/* Reads (and so clears) the counters of an entry */
+int nf2_of_exact_read_counters(struct nf2_regio *, int index, uint32_t *pkts,
+			       uint32_t *bytes, uint32_t *last_seen);
+
+/*
+ * A wildcard entry is staged in the OPENFLOW_WILDCARD_LOOKUP_CMP_*,
+ * CMP_MASK_* and ACTION_* registers and committed, all at once, by
+ * writing its index to OPENFLOW_WILDCARD_LOOKUP_WRITE_ADDR_REG. Mask bits
+ * set to 1 are don't care. The lowest matching index wins. An all zero
+ * entry (as after reset) only matches an all zero header.
+ *
+ * The wildcard hit counters are not cleared by reading them.
+ *
+ * The staging registers keep their value after a commit, so only the
+ * words that differ from the last staged entry need to be written. The
+ * stage shadow tracks them; it must be invalidated whenever anything
+ * else writes the staging registers or OPENFLOW_WILDCARD_LOOKUP_READ_ADDR_REG
+ * (which loads them with the entry read), e.g. a snapshot of the
+ * wildcard table. A NULL stage always writes every word.
+ */
+#define NF2_WILDCARD_ENTRY_REGS \
+	(2 * NF2_OF_ENTRY_WORD_LEN + NF2_OF_ACTION_WORD_LEN + 1 + 2)
+
+struct nf2_of_wildcard_stage {
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;
+	nf2_of_action_wrap action;
+	int valid;
+};
+
+static inline void nf2_of_wildcard_stage_invalidate(struct nf2_of_wildcard_stage *stage) {
+	stage->valid = 0;
+}
+
+/* nf2_of_wildcard_write resets the hit counters, nf2_of_wildcard_modify
+ * keeps them */
+int nf2_of_wildcard_write(struct nf2_regio *, struct nf2_of_wildcard_stage *, int index,
+			  const nf2_of_entry_wrap *, const nf2_of_mask_wrap *,
+			  const nf2_of_action_wrap *);
+int nf2_of_wildcard_modify(struct nf2_regio *, struct nf2_of_wildcard_stage *, int index,
+			   const nf2_of_entry_wrap *, const nf2_of_mask_wrap *,
+			   const nf2_of_action_wrap *);
+int nf2_of_wildcard_clear(struct nf2_regio *, struct nf2_of_wildcard_stage *, int index);
+int nf2_of_wildcard_read_counters(struct nf2_regio *, int index, uint32_t *pkts,
+				  uint32_t *bytes);
+
+/*
+ * Read-back checks of a write. nf2_of_exact_verify reads the header and
+ * action words of an entry, not the counters (a read clears them), and
+ * compares them with entry and action and the valid bit set; with entry
+ * NULL it only compares the action, and with both NULL it only checks
+ * that the valid bit is clear. nf2_of_wildcard_verify loads the staging
+ * registers with the entry through OPENFLOW_WILDCARD_LOOKUP_READ_ADDR_REG
+ * and compares them, with all zeroes if entry is NULL (cleared), leaving
+ * out the top byte of the last entry and mask word, which the TCAM does
+ * not keep and reads back as zero; the stage shadow is left holding what
+ * was read. Both return 0 if the card
+ * holds what was expected, 1 if not and -1 if a register access failed.
+ */
+int nf2_of_exact_verify(struct nf2_regio *, int index, const nf2_of_entry_wrap *,
+			const nf2_of_action_wrap *);
+int nf2_of_wildcard_verify(struct nf2_regio *, struct nf2_of_wildcard_stage *, int index,
+			   const nf2_of_entry_wrap *, const nf2_of_mask_wrap *,
+			   const nf2_of_action_wrap *);
+
+#endif
@@ -0,0 +1,270 @@
+/* ****************************************************************************
+ * Module: nf2_opl_model.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Transaction level model of src/output_port_lookup.v.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nf2_opl_model.h"
+#include "nf2_hash.h"
+
+/* The pad byte above the 248-bit entry is not compared */
+#define LAST_WORD_BITS	0x00ffffff
+
+
+int nf2_opl_model_init(struct nf2_opl_model *m) {
+	memset(m, 0, sizeof(*m));
+	if (nf2_exact_table_init(&m->exact, NULL, NF2_EXACT_MAX_KICKS))
+		return -1;
+	nf2_wildcard_table_init(&m->wildcard, NULL);
+	m->exact_pkts = calloc(m->exact.size, sizeof(*m->exact_pkts));
+	m->exact_bytes = calloc(m->exact.size, sizeof(*m->exact_bytes));
+	if (m->exact_pkts == NULL || m->exact_bytes == NULL) {
+		nf2_opl_model_free(m);
+		return -1;
+	}
+	nf2_opl_model_compile(m);
+	return 0;
+}
+
+
+void nf2_opl_model_free(struct nf2_opl_model *m) {
+	nf2_exact_table_free(&m->exact);
+	free(m->exact_pkts);
+	free(m->exact_bytes);
+	m->exact_pkts = NULL;
+	m->exact_bytes = NULL;
+}
+
+
+int nf2_opl_model_load(struct nf2_opl_model *m, const struct nf2_flowfile_rule *rules,
+		       int n, FILE *err) {
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;
+	nf2_of_action_wrap action;
+	int i, ret, failed = 0;
+
+	for (i = 0; i < n; i++) {
+		entry = rules[i].entry;
+		mask = rules[i].mask;
+		action = rules[i].action;
+		if (rules[i].exact)
+			ret = nf2_exact_insert(&m->exact, &entry, &action);
+		else
+			ret = nf2_wildcard_insert(&m->wildcard, &entry, &mask, &action,
+						  rules[i].priority);
+		if (ret < 0) {
+			failed++;
+			if (err) {
+				fprintf(err, "line %d does not fit: ", rules[i].line);
+				nf2_flowfile_print(err, &rules[i]);
+			}
+		}
+	}
+	nf2_opl_model_compile(m);
+	return failed;
+}
+
+
+void nf2_opl_model_compile(struct nf2_opl_model *m) {
+	struct nf2_wildcard_rule *r;
+	int i, w;
+
+	m->num_wc_used = 0;
+	for (i = 0; i < OPENFLOW_WILDCARD_TABLE_SIZE; i++) {
+		r = &m->wildcard.rules[i];
+		for (w = 0; w < NF2_OF_ENTRY_WORD_LEN; w++) {
+			/* an unused entry is all zero and compares every bit */
+			m->wc_care[i][w] = r->used ? ~r->mask.raw[w] : 0xffffffff;
+			m->wc_value[i][w] = r->used ? r->entry.raw[w] & ~r->mask.raw[w] : 0;
+		}
+		m->wc_care[i][NF2_OF_ENTRY_WORD_LEN - 1] &= LAST_WORD_BITS;
+		m->wc_value[i][NF2_OF_ENTRY_WORD_LEN - 1] &= LAST_WORD_BITS;
+		if (r->used)
+			m->wc_used[m->num_wc_used++] = i;
+	}
+}
+
+
+void nf2_opl_model_clear_stats(struct nf2_opl_model *m) {
+	memset(&m->stats, 0, sizeof(m->stats));
+	memset(m->exact_pkts, 0, m->exact.size * sizeof(*m->exact_pkts));
+	memset(m->exact_bytes, 0, m->exact.size * sizeof(*m->exact_bytes));
+	memset(m->wildcard_pkts, 0, sizeof(m->wildcard_pkts));
+	memset(m->wildcard_bytes, 0, sizeof(m->wildcard_bytes));
+}
+
+
+static inline int exact_match(const nf2_of_entry_wrap *a, const nf2_of_entry_wrap *b) {
+	uint32_t diff = 0;
+	int w;
+
+	for (w = 0; w < NF2_OF_ENTRY_WORD_LEN - 1; w++)
+		diff |= a->raw[w] ^ b->raw[w];
+	diff |= (a->raw[w] ^ b->raw[w]) & LAST_WORD_BITS;
+	return diff == 0;
+}
+
+
+static inline int wildcard_entry_match(const struct nf2_opl_model *m, int i,
+				       const nf2_of_entry_wrap *key) {
+	uint32_t diff = 0;
+	int w;
+
+	for (w = 0; w < NF2_OF_ENTRY_WORD_LEN; w++)
+		diff |= (key->raw[w] & m->wc_care[i][w]) ^ m->wc_value[i][w];
+	return diff == 0;
+}
+
+
+//
+// wildcard_lookup: the lowest matching index, or -1. Only an all zero
+//    header can match an unused entry, so the others only scan the used
+//    ones.
+//
+static int wildcard_lookup(const struct nf2_opl_model *m, const nf2_of_entry_wrap *key) {
+	uint32_t any = 0;
+	int i, w;
+
+	for (w = 0; w < NF2_OF_ENTRY_WORD_LEN - 1; w++)
+		any |= key->raw[w];
+	any |= key->raw[w] & LAST_WORD_BITS;
+
+	if (any) {
+		for (i = 0; i < m->num_wc_used; i++)
+			if (wildcard_entry_match(m, m->wc_used[i], key))
+				return m->wc_used[i];
+	}
+	else {
+		for (i = 0; i < OPENFLOW_WILDCARD_TABLE_SIZE; i++)
+			if (wildcard_entry_match(m, i, key))
+				return i;
+	}
+	return -1;
+}
+
+
+void nf2_opl_model_lookup(struct nf2_opl_model *m, const nf2_of_entry_wrap *keys,
+			  const uint32_t *size, int n, const nf2_of_action_wrap **actions) {
+	static const nf2_of_action_wrap no_action;
+	struct nf2_opl_stats *st = &m->stats;
+	uint32_t hash_0[NF2_OPL_BATCH], hash_1[NF2_OPL_BATCH];
+	const nf2_of_action_wrap *action;
+	const struct nf2_exact_slot *slot;
+	int i, k, q, base, cnt, exact, wc, port;
+	unsigned fwd;
+
+	for (base = 0; base < n; base += NF2_OPL_BATCH) {
+		cnt = n - base < NF2_OPL_BATCH ? n - base : NF2_OPL_BATCH;
+		nf2_header_hash_batch(keys + base, cnt, hash_0, hash_1);
+
+		for (k = 0; k < cnt; k++) {
+			i = base + k;
+			exact = -1;
+			slot = &m->exact.slots[hash_0[k]];
+			if (slot->used && exact_match(&slot->entry, &keys[i]))
+				exact = hash_0[k];
+			else {
+				slot = &m->exact.slots[hash_1[k]];
+				if (slot->used && exact_match(&slot->entry, &keys[i]))
+					exact = hash_1[k];
+			}
+			wc = wildcard_lookup(m, &keys[i]);
+
+			port = keys[i].entry.src_port % NF2_OPL_NUM_QUEUES;
+			st->pkts++;
+			st->bytes += size[i];
+			st->in_pkts[port]++;
+
+			if (wc >= 0)
+				st->wildcard_hits++;
+			else
+				st->wildcard_misses++;
+
+			if (exact >= 0) {
+				st->exact_hits++;
+				st->exact_wins++;
+				m->exact_pkts[exact]++;
+				m->exact_bytes[exact] += size[i];
+				action = &m->exact.slots[exact].action;
+			}
+			else {
+				st->exact_misses++;
+				if (wc >= 0) {
+					st->wildcard_wins++;
+					m->wildcard_pkts[wc]++;
+					m->wildcard_bytes[wc] += size[i];
+					action = &m->wildcard.rules[wc].action;
+				}
+				else
+					action = &no_action;
+			}
+
+			fwd = action->action.forward_bitmask;
+			if (fwd == 0) {
+				if (exact < 0 && wc < 0)
+					st->drop_miss[port]++;
+				else
+					st->drop_action[port]++;
+				action = NULL;
+			}
+			for (q = 0; fwd; q++, fwd >>= 1) {
+				if ((fwd & 1) && q < NF2_OPL_NUM_QUEUES) {
+					st->out_pkts[q]++;
+					st->out_bytes[q] += size[i];
+				}
+			}
+			if (actions)
+				actions[i] = action;
+		}
+	}
+}
+
+
+static double pct(uint64_t a, uint64_t b) {
+	return b ? 100.0 * a / b : 0;
+}
+
+
+void nf2_opl_model_print_stats(struct nf2_opl_model *m, FILE *f) {
+	struct nf2_opl_stats *st = &m->stats;
+	uint64_t drops = 0, punts = 0;
+	int q;
+
+	for (q = 0; q < NF2_OPL_NUM_QUEUES; q++) {
+		drops += st->drop_miss[q] + st->drop_action[q];
+		if (q & 1)
+			punts += st->out_pkts[q];
+	}
+
+	fprintf(f, "packets:        %llu (%llu bytes)\n", (unsigned long long)st->pkts,
+		(unsigned long long)st->bytes);
+	fprintf(f, "exact table:    %d flows, %llu hits, %llu misses (%.2f%% hit)\n",
+		m->exact.used, (unsigned long long)st->exact_hits,
+		(unsigned long long)st->exact_misses, pct(st->exact_hits, st->pkts));
+	fprintf(f, "wildcard table: %d rules, %llu hits, %llu misses (%.2f%% hit)\n",
+		m->wildcard.used, (unsigned long long)st->wildcard_hits,
+		(unsigned long long)st->wildcard_misses, pct(st->wildcard_hits, st->pkts));
+	fprintf(f, "arbitration:    exact %llu, wildcard %llu, neither %llu\n",
+		(unsigned long long)st->exact_wins, (unsigned long long)st->wildcard_wins,
+		(unsigned long long)(st->pkts - st->exact_wins - st->wildcard_wins));
+	fprintf(f, "dropped:        %llu (%.2f%%), to CPU: %llu (%.2f%%)\n",
+		(unsigned long long)drops, pct(drops, st->pkts), (unsigned long long)punts,
+		pct(punts, st->pkts));
+
+	fprintf(f, "\n%-8s %12s %12s %12s %12s %14s\n", "queue", "in pkts", "no match",
+		"no output", "out pkts", "out bytes");
+	for (q = 0; q < NF2_OPL_NUM_QUEUES; q++)
+		fprintf(f, "%-3s %-4d %12llu %12llu %12llu %12llu %14llu\n",
+			q & 1 ? "cpu" : "mac", q / 2, (unsigned long long)st->in_pkts[q],
+			(unsigned long long)st->drop_miss[q],
+			(unsigned long long)st->drop_action[q],
+			(unsigned long long)st->out_pkts[q],
+			(unsigned long long)st->out_bytes[q]);
+}
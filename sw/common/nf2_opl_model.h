@@ -0,0 +1,105 @@
+/* ****************************************************************************
+ * Module: nf2_opl_model.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Transaction level model of src/output_port_lookup.v.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_OPL_MODEL_H_
+#define NF2_OPL_MODEL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "nf2_exact_table.h"
+#include "nf2_wildcard_table.h"
+#include "nf2_flowfile.h"
+
+#define NF2_OPL_NUM_QUEUES	8	/* even: MAC ports, odd: CPU ports */
+#define NF2_OPL_BATCH		64
+
+struct nf2_opl_stats {
+	uint64_t pkts;
+	uint64_t bytes;
+
+	/* every packet is looked up in both tables */
+	uint64_t exact_hits;
+	uint64_t exact_misses;
+	uint64_t wildcard_hits;
+	uint64_t wildcard_misses;
+	uint64_t exact_wins;		/* exact hit, wildcard result discarded */
+	uint64_t wildcard_wins;		/* exact miss, wildcard hit */
+
+	/* by source port */
+	uint64_t in_pkts[NF2_OPL_NUM_QUEUES];
+	uint64_t drop_miss[NF2_OPL_NUM_QUEUES];		/* no entry matched */
+	uint64_t drop_action[NF2_OPL_NUM_QUEUES];	/* matched, no output */
+
+	/* by output queue; a packet sent to n queues counts in each */
+	uint64_t out_pkts[NF2_OPL_NUM_QUEUES];
+	uint64_t out_bytes[NF2_OPL_NUM_QUEUES];
+};
+
+/*
+ * One lookup per packet, as the pipeline does it: header_parser's flow
+ * entry (common/nf2_flowkey.c) goes to exact_match, which checks the two
+ * slots of header_hash (hash_0 first), and to wildcard_match, where the
+ * lowest matching index wins. match_arbiter prefers an exact hit
+ * whatever its action; without a hit the action is all zero.
+ * opl_processor drops a packet whose forward_bitmask is zero and
+ * otherwise writes forward_bitmask to the I/O queue header unchanged, so
+ * a packet may go back out of its source port. The counters of the
+ * winning entry are updated; the losing table's are not.
+ *
+ * This is a functional model: there is no timing, FIFO backpressure or
+ * packet modification. An unused wildcard entry is an all zero entry
+ * with a zero action, as on the card after reset.
+ *
+ * The tables are placed as the host would place them (nf2_exact_table
+ * and nf2_wildcard_table, without a card), so flows that would not fit
+ * are reported at load time. After changing model->exact or
+ * model->wildcard directly, call nf2_opl_model_compile.
+ */
+struct nf2_opl_model {
+	struct nf2_exact_table exact;
+	struct nf2_wildcard_table wildcard;
+
+	/* wildcard entries in index order: the header bits compared and
+	 * their value */
+	uint32_t wc_care[OPENFLOW_WILDCARD_TABLE_SIZE][NF2_OF_ENTRY_WORD_LEN];
+	uint32_t wc_value[OPENFLOW_WILDCARD_TABLE_SIZE][NF2_OF_ENTRY_WORD_LEN];
+	int wc_used[OPENFLOW_WILDCARD_TABLE_SIZE];	/* indices of the used entries */
+	int num_wc_used;
+
+	/* per entry counters */
+	uint64_t *exact_pkts;
+	uint64_t *exact_bytes;
+	uint64_t wildcard_pkts[OPENFLOW_WILDCARD_TABLE_SIZE];
+	uint64_t wildcard_bytes[OPENFLOW_WILDCARD_TABLE_SIZE];
+
+	struct nf2_opl_stats stats;
+};
+
+int nf2_opl_model_init(struct nf2_opl_model *);
+void nf2_opl_model_free(struct nf2_opl_model *);
+
+/* Installs the flows; those that do not fit are printed to err (if not
+ * NULL). Returns the number that did not fit. */
+int nf2_opl_model_load(struct nf2_opl_model *, const struct nf2_flowfile_rule *, int n,
+		       FILE *err);
+void nf2_opl_model_compile(struct nf2_opl_model *);
+void nf2_opl_model_clear_stats(struct nf2_opl_model *);
+
+/*
+ * Looks up n flow entries and accounts for them; size[i] is the packet
+ * size header_parser reports. actions[i] (if actions is not NULL) is set
+ * to the action applied, or NULL if the packet is dropped.
+ */
+void nf2_opl_model_lookup(struct nf2_opl_model *, const nf2_of_entry_wrap *keys,
+			  const uint32_t *size, int n, const nf2_of_action_wrap **actions);
+
+void nf2_opl_model_print_stats(struct nf2_opl_model *, FILE *);
+
+#endif
@@ -0,0 +1,177 @@
+/* ****************************************************************************
+ * Module: nf2_pair.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Pairing scheduler for the XOR network coding stage.
+ *
+ *              An arrival pairs with any packet of the other direction,
+ *              so at most one direction has packets waiting at a time.
+ *              Each queue is a ring in arrival order; deadlines are
+ *              arrival + max_hold_ns, so the head of each ring expires
+ *              first. A partner taken from inside the window is removed
+ *              by moving the older packets up one slot.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nf2_pair.h"
+#include "nf2_xor.h"
+
+
+static inline struct nf2_pair_pkt *slot(struct nf2_pair *p, int dir, int i) {
+	return &p->queue[dir][(p->head[dir] + i) % p->cfg.queue_len];
+}
+
+
+int nf2_pair_init(struct nf2_pair *p, const struct nf2_pair_cfg *cfg) {
+	int d;
+
+	memset(p, 0, sizeof(*p));
+	if (cfg->queue_len < 1 || cfg->queue_len > NF2_PAIR_MAX_QUEUE || cfg->window < 1)
+		return -1;
+
+	p->cfg = *cfg;
+	for (d = 0; d < NF2_PAIR_DIRS; d++) {
+		p->queue[d] = calloc(cfg->queue_len, sizeof(*p->queue[d]));
+		if (p->queue[d] == NULL) {
+			nf2_pair_free(p);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+void nf2_pair_free(struct nf2_pair *p) {
+	int d;
+
+	for (d = 0; d < NF2_PAIR_DIRS; d++) {
+		free(p->queue[d]);
+		p->queue[d] = NULL;
+	}
+}
+
+
+/* the head of dir leaves uncoded */
+static void send_head(struct nf2_pair *p, int dir, enum nf2_pair_reason reason,
+		      uint64_t now_ns, struct nf2_pair_out *out) {
+	out->reason = reason;
+	out->num = 1;
+	out->pkt[0] = *slot(p, dir, 0);
+	out->depart_ns = now_ns;
+	p->head[dir] = (p->head[dir] + 1) % p->cfg.queue_len;
+	p->num[dir]--;
+
+	p->stats.tx++;
+	p->stats.tx_bytes += out->pkt[0].len;
+	if (reason == NF2_PAIR_TIMEOUT)
+		p->stats.timeouts++;
+	else if (reason == NF2_PAIR_FULL)
+		p->stats.full++;
+	else
+		p->stats.flushed++;
+}
+
+
+/* the direction whose head expires first, or -1 */
+static int earliest(const struct nf2_pair *p) {
+	uint64_t best = UINT64_MAX, t;
+	int d, dir = -1;
+
+	for (d = 0; d < NF2_PAIR_DIRS; d++) {
+		if (p->num[d] == 0)
+			continue;
+		t = p->queue[d][p->head[d]].arrival_ns;
+		if (t < best) {
+			best = t;
+			dir = d;
+		}
+	}
+	return dir;
+}
+
+
+uint64_t nf2_pair_next_deadline(const struct nf2_pair *p) {
+	int dir = earliest(p);
+
+	if (dir < 0)
+		return UINT64_MAX;
+	return p->queue[dir][p->head[dir]].arrival_ns + p->cfg.max_hold_ns;
+}
+
+
+int nf2_pair_advance(struct nf2_pair *p, uint64_t now_ns, struct nf2_pair_out *out, int max) {
+	uint64_t deadline;
+	int dir, n = 0;
+
+	while (n < max && (dir = earliest(p)) >= 0) {
+		deadline = nf2_pair_next_deadline(p);
+		if (deadline > now_ns)
+			break;
+		send_head(p, dir, NF2_PAIR_TIMEOUT, deadline, &out[n++]);
+	}
+	return n;
+}
+
+
+int nf2_pair_flush(struct nf2_pair *p, uint64_t now_ns, struct nf2_pair_out *out, int max) {
+	int dir, n = 0;
+
+	while (n < max && (dir = earliest(p)) >= 0)
+		send_head(p, dir, NF2_PAIR_FLUSH, now_ns, &out[n++]);
+	return n;
+}
+
+
+int nf2_pair_add(struct nf2_pair *p, int dir, uint64_t cookie, uint32_t len,
+		 uint64_t arrival_ns, struct nf2_pair_out *out) {
+	struct nf2_pair_pkt pkt, *w;
+	uint32_t diff, best_diff = UINT32_MAX;
+	int other = !dir, window, i, best = 0;
+
+	pkt.cookie = cookie;
+	pkt.arrival_ns = arrival_ns;
+	pkt.len = len;
+	pkt.dir = dir;
+	p->stats.pkts++;
+	p->stats.bytes += len;
+
+	if (p->num[other]) {
+		window = p->num[other] < p->cfg.window ? p->num[other] : p->cfg.window;
+		for (i = 0; i < window && best_diff; i++) {
+			w = slot(p, other, i);
+			diff = w->len > len ? w->len - len : len - w->len;
+			if (diff < best_diff) {
+				best_diff = diff;
+				best = i;
+			}
+		}
+
+		out->reason = NF2_PAIR_CODED;
+		out->num = 2;
+		out->pkt[0] = *slot(p, other, best);
+		out->pkt[1] = pkt;
+		out->depart_ns = arrival_ns;
+		for (i = best; i > 0; i--)
+			*slot(p, other, i) = *slot(p, other, i - 1);
+		p->head[other] = (p->head[other] + 1) % p->cfg.queue_len;
+		p->num[other]--;
+
+		p->stats.coded++;
+		p->stats.tx++;
+		p->stats.tx_bytes += nf2_xor_coded_len(out->pkt[0].len, len);
+		return 1;
+	}
+
+	i = 0;
+	if (p->num[dir] == p->cfg.queue_len) {
+		send_head(p, dir, NF2_PAIR_FULL, arrival_ns, out);
+		i = 1;
+	}
+	*slot(p, dir, p->num[dir]++) = pkt;
+	return i;
+}
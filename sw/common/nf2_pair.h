@@ -0,0 +1,114 @@
+/* ****************************************************************************
+ * Module: nf2_pair.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Pairing scheduler for the XOR network coding stage.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_PAIR_H_
+#define NF2_PAIR_H_
+
+#include <stdint.h>
+
+/*
+ * src/XOR_network_coding.v codes packets of MAC port 0 (source port 0)
+ * with packets of MAC port 1 (source port 2). After a packet of one of
+ * them it waits for one of the other, with no timeout, and only one
+ * packet can wait, so a port without traffic holds the other's packet
+ * forever.
+ *
+ * The scheduler keeps a queue per direction instead. A packet that
+ * arrives while packets of the other direction wait is coded with the
+ * one closest to it in length among the oldest cfg.window of them (the
+ * oldest on a tie), so little of the coded packet is padding; otherwise
+ * it waits. A packet that has waited cfg.max_hold_ns, or is the oldest
+ * of a full queue when another arrives, leaves uncoded.
+ *
+ * The scheduler has no clock of its own: the caller passes the time of
+ * each arrival, and nf2_pair_advance hands out the packets that timed
+ * out up to a time, each stamped with its deadline. Calling it with the
+ * arrival time before each nf2_pair_add keeps the departures in time
+ * order.
+ */
+#define NF2_PAIR_DIRS		2
+#define NF2_PAIR_MAX_QUEUE	4096
+
+/* direction of a source port, or -1 for ports that are not coded */
+static inline int nf2_pair_dir(int src_port) {
+	return src_port == 0 ? 0 : src_port == 2 ? 1 : -1;
+}
+
+struct nf2_pair_cfg {
+	uint64_t max_hold_ns;	/* 0: code only with packets already waiting */
+	int queue_len;		/* packets waiting per direction, at most NF2_PAIR_MAX_QUEUE */
+	int window;		/* waiting packets considered for a partner */
+};
+
+struct nf2_pair_pkt {
+	uint64_t cookie;	/* the caller's */
+	uint64_t arrival_ns;
+	uint32_t len;
+	int dir;
+};
+
+enum nf2_pair_reason {
+	NF2_PAIR_CODED,
+	NF2_PAIR_TIMEOUT,	/* waited max_hold_ns */
+	NF2_PAIR_FULL,		/* pushed out of a full queue */
+	NF2_PAIR_FLUSH,
+};
+
+/* A departure: one coded packet or one uncoded packet */
+struct nf2_pair_out {
+	enum nf2_pair_reason reason;
+	int num;		/* packets in pkt, 2 if coded */
+	struct nf2_pair_pkt pkt[2];	/* coded: the waiting one first */
+	uint64_t depart_ns;
+};
+
+struct nf2_pair_stats {
+	uint64_t pkts;
+	uint64_t bytes;
+	uint64_t coded;		/* pairs */
+	uint64_t timeouts;
+	uint64_t full;
+	uint64_t flushed;
+	uint64_t tx;		/* packets sent: coded and uncoded */
+	uint64_t tx_bytes;	/* coded ones with the nf2_xor header */
+};
+
+struct nf2_pair {
+	struct nf2_pair_cfg cfg;
+	struct nf2_pair_pkt *queue[NF2_PAIR_DIRS];	/* rings of cfg.queue_len */
+	int head[NF2_PAIR_DIRS];
+	int num[NF2_PAIR_DIRS];
+	struct nf2_pair_stats stats;
+};
+
+/* Returns -1 if the configuration is invalid or memory is short */
+int nf2_pair_init(struct nf2_pair *, const struct nf2_pair_cfg *);
+void nf2_pair_free(struct nf2_pair *);
+
+/*
+ * Up to max packets that timed out by now_ns, earliest deadline first.
+ * Returns how many; call again while it returns max.
+ */
+int nf2_pair_advance(struct nf2_pair *, uint64_t now_ns, struct nf2_pair_out *out, int max);
+
+/*
+ * A packet of direction dir arrives at arrival_ns. Returns 1 and the
+ * departure it caused (a coded pair, or the oldest of a full queue), or
+ * 0 if it only joined the queue.
+ */
+int nf2_pair_add(struct nf2_pair *, int dir, uint64_t cookie, uint32_t len,
+		 uint64_t arrival_ns, struct nf2_pair_out *out);
+
+/* Sends the waiting packets uncoded at now_ns, as nf2_pair_advance does */
+int nf2_pair_flush(struct nf2_pair *, uint64_t now_ns, struct nf2_pair_out *out, int max);
+
+/* Earliest deadline of the waiting packets, or UINT64_MAX if none wait */
+uint64_t nf2_pair_next_deadline(const struct nf2_pair *);
+
+#endif
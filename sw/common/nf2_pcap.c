@@ -0,0 +1,205 @@
+/* ****************************************************************************
+ * Module: nf2_pcap.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Minimal reader and writer for pcap trace files.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "nf2_pcap.h"
+
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_MAGIC_NSEC		0xa1b23c4d
+#define PCAP_FILE_HDR_LEN	24
+#define PCAP_PKT_HDR_LEN	16
+#define PCAP_VERSION_MAJOR	2
+#define PCAP_VERSION_MINOR	4
+#define PCAP_SNAPLEN		65535
+
+
+static uint32_t get32(const struct nf2_pcap *p, const uint8_t *b) {
+	uint32_t v;
+
+	memcpy(&v, b, sizeof(v));
+	return p->swapped ? __builtin_bswap32(v) : v;
+}
+
+
+int nf2_pcap_open(struct nf2_pcap *p, const char *path) {
+	struct stat st;
+	uint32_t magic;
+	void *map;
+	int fd;
+
+	memset(p, 0, sizeof(*p));
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < PCAP_FILE_HDR_LEN) {
+		fprintf(stderr, "%s: not a pcap file\n", path);
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror(path);
+		return -1;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	p->map = map;
+	p->len = st.st_size;
+
+	memcpy(&magic, p->map, sizeof(magic));
+	if (magic == PCAP_MAGIC || magic == PCAP_MAGIC_NSEC)
+		p->swapped = 0;
+	else if (__builtin_bswap32(magic) == PCAP_MAGIC ||
+		 __builtin_bswap32(magic) == PCAP_MAGIC_NSEC)
+		p->swapped = 1;
+	else {
+		fprintf(stderr, "%s: not a pcap file (pcapng is not supported)\n", path);
+		nf2_pcap_close(p);
+		return -1;
+	}
+	p->nsec = get32(p, p->map) == PCAP_MAGIC_NSEC;
+	p->snaplen = get32(p, p->map + 16);
+	p->linktype = get32(p, p->map + 20);
+	if (p->linktype != NF2_PCAP_LINKTYPE_ETHERNET) {
+		fprintf(stderr, "%s: link type %u is not ethernet\n", path, p->linktype);
+		nf2_pcap_close(p);
+		return -1;
+	}
+	p->pos = PCAP_FILE_HDR_LEN;
+	return 0;
+}
+
+
+void nf2_pcap_close(struct nf2_pcap *p) {
+	if (p->map)
+		munmap((void *)p->map, p->len);
+	p->map = NULL;
+}
+
+
+int nf2_pcap_next(struct nf2_pcap *p, struct nf2_pcap_pkt *pkt) {
+	const uint8_t *h = p->map + p->pos;
+	uint32_t frac;
+
+	if (p->pos == p->len)
+		return 0;
+	if (p->len - p->pos < PCAP_PKT_HDR_LEN)
+		return -1;
+
+	pkt->caplen = get32(p, h + 8);
+	pkt->len = get32(p, h + 12);
+	if (p->len - p->pos - PCAP_PKT_HDR_LEN < pkt->caplen)
+		return -1;
+
+	frac = get32(p, h + 4);
+	pkt->ts_ns = (uint64_t)get32(p, h) * 1000000000 + (p->nsec ? frac : frac * 1000ull);
+	pkt->data = h + PCAP_PKT_HDR_LEN;
+	p->pos += PCAP_PKT_HDR_LEN + pkt->caplen;
+	return 1;
+}
+
+
+static void put16(uint8_t *b, uint16_t v) {
+	memcpy(b, &v, sizeof(v));
+}
+
+
+static void put32(uint8_t *b, uint32_t v) {
+	memcpy(b, &v, sizeof(v));
+}
+
+
+static int flush(struct nf2_pcap_writer *w) {
+	size_t off = 0;
+	ssize_t n;
+
+	while (off < w->len) {
+		n = write(w->fd, w->buf + off, w->len - off);
+		if (n < 0) {
+			perror("write");
+			return -1;
+		}
+		off += n;
+	}
+	w->bytes += w->len;
+	w->len = 0;
+	return 0;
+}
+
+
+int nf2_pcap_create(struct nf2_pcap_writer *w, const char *path) {
+	uint8_t *h;
+
+	memset(w, 0, sizeof(*w));
+	w->buf = malloc(NF2_PCAP_WRITE_BUF);
+	if (w->buf == NULL) {
+		perror("malloc");
+		return -1;
+	}
+	w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (w->fd < 0) {
+		perror(path);
+		free(w->buf);
+		return -1;
+	}
+
+	h = w->buf;
+	put32(h, PCAP_MAGIC_NSEC);
+	put16(h + 4, PCAP_VERSION_MAJOR);
+	put16(h + 6, PCAP_VERSION_MINOR);
+	put32(h + 8, 0);		/* thiszone */
+	put32(h + 12, 0);		/* sigfigs */
+	put32(h + 16, PCAP_SNAPLEN);
+	put32(h + 20, NF2_PCAP_LINKTYPE_ETHERNET);
+	w->len = PCAP_FILE_HDR_LEN;
+	return 0;
+}
+
+
+uint8_t *nf2_pcap_append(struct nf2_pcap_writer *w, uint32_t caplen, uint32_t len,
+			 uint64_t ts_ns) {
+	uint8_t *h;
+
+	if (w->len + PCAP_PKT_HDR_LEN + caplen + NF2_PCAP_APPEND_SLACK > NF2_PCAP_WRITE_BUF &&
+	    flush(w))
+		return NULL;
+
+	h = w->buf + w->len;
+	put32(h, ts_ns / 1000000000);
+	put32(h + 4, ts_ns % 1000000000);
+	put32(h + 8, caplen);
+	put32(h + 12, len);
+	w->len += PCAP_PKT_HDR_LEN + caplen;
+	w->pkts++;
+	return h + PCAP_PKT_HDR_LEN;
+}
+
+
+int nf2_pcap_finish(struct nf2_pcap_writer *w) {
+	int ret = flush(w);
+
+	if (close(w->fd) < 0 && ret == 0) {
+		perror("close");
+		ret = -1;
+	}
+	free(w->buf);
+	w->buf = NULL;
+	return ret;
+}
@@ -0,0 +1,75 @@
+/* ****************************************************************************
+ * Module: nf2_pcap.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Minimal reader and writer for pcap trace files.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_PCAP_H_
+#define NF2_PCAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NF2_PCAP_LINKTYPE_ETHERNET	1
+
+/*
+ * Reads classic pcap files (microsecond or nanosecond timestamps, either
+ * byte order) of ethernet frames, without libpcap. The file is mapped
+ * and the packets are returned in place, so a trace of any size is read
+ * at memory speed. pcapng is not supported.
+ */
+struct nf2_pcap {
+	const uint8_t *map;
+	size_t len;
+	size_t pos;
+	int swapped;		/* file written on a host of the other byte order */
+	int nsec;		/* timestamps in nanoseconds */
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+struct nf2_pcap_pkt {
+	const uint8_t *data;
+	uint32_t caplen;	/* bytes in data */
+	uint32_t len;		/* length on the wire */
+	uint64_t ts_ns;
+};
+
+int nf2_pcap_open(struct nf2_pcap *, const char *path);
+void nf2_pcap_close(struct nf2_pcap *);
+
+/* Returns 1 and the next packet, 0 at the end of the file or -1 if the
+ * file is truncated */
+int nf2_pcap_next(struct nf2_pcap *, struct nf2_pcap_pkt *);
+
+/*
+ * Writes classic pcap files of ethernet frames with nanosecond
+ * timestamps, in host byte order. Packets are built in place in a large
+ * buffer (nf2_pcap_append returns room for caplen bytes) and written out
+ * with one write() per NF2_PCAP_WRITE_BUF bytes. The caller may write up
+ * to NF2_PCAP_APPEND_SLACK bytes past caplen, so that it can build the
+ * packet with fixed size copies; they are overwritten by the next packet
+ * or never written out.
+ */
+#define NF2_PCAP_WRITE_BUF	(4 << 20)
+#define NF2_PCAP_APPEND_SLACK	64
+
+struct nf2_pcap_writer {
+	int fd;
+	uint8_t *buf;
+	size_t len;
+	uint64_t pkts;
+	uint64_t bytes;		/* written to the file */
+};
+
+int nf2_pcap_create(struct nf2_pcap_writer *, const char *path);
+/* Returns NULL if the buffered packets could not be written */
+uint8_t *nf2_pcap_append(struct nf2_pcap_writer *, uint32_t caplen, uint32_t len,
+			 uint64_t ts_ns);
+/* Writes what is buffered and closes the file; -1 on a write error */
+int nf2_pcap_finish(struct nf2_pcap_writer *);
+
+#endif
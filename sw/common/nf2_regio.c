@@ -0,0 +1,232 @@
+/* ****************************************************************************
+ * Module: nf2_regio.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Register access backends used by the host tools.
+ *
+ *              IOCTL goes through readReg()/writeReg() of nf2util and
+ *              costs one ioctl per register word. MMAP maps the register
+ *              BAR of the card once (through sysfs) so that a block of
+ *              registers is read without entering the kernel. MOCK is a
+ *              sparse in-memory register file used to benchmark the host
+ *              code on a machine without the card.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "nf2_regio.h"
+
+#define PATHLEN		80
+
+/* The mock register file is allocated in 64KB pages on first access */
+#define MOCK_PAGE_BITS	16
+#define MOCK_PAGE_WORDS	(1 << (MOCK_PAGE_BITS - 2))
+#define MOCK_NUM_PAGES	(NF2_REG_SPACE_SIZE >> MOCK_PAGE_BITS)
+
+
+int nf2_regio_open_ioctl(struct nf2_regio *io, struct nf2device *nf2) {
+	memset(io, 0, sizeof(*io));
+	io->type = NF2_REGIO_IOCTL;
+	io->nf2 = nf2;
+	return 0;
+}
+
+
+int nf2_regio_open_mmap(struct nf2_regio *io, const char *iface) {
+	char path[PATHLEN];
+	struct stat st;
+	void *bar;
+	int fd;
+
+	memset(io, 0, sizeof(*io));
+	io->type = NF2_REGIO_MMAP;
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/device/resource0", iface);
+	fd = open(path, O_RDWR | O_SYNC);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < NF2_REG_SPACE_SIZE) {
+		fprintf(stderr, "%s: unexpected register BAR size\n", path);
+		close(fd);
+		return -1;
+	}
+
+	bar = mmap(NULL, NF2_REG_SPACE_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_SHARED, fd, 0);
+	close(fd);
+	if (bar == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+
+	io->bar = bar;
+	io->bar_len = NF2_REG_SPACE_SIZE;
+	return 0;
+}
+
+
+int nf2_regio_open_mock(struct nf2_regio *io, unsigned txn_ns, unsigned word_ns) {
+	memset(io, 0, sizeof(*io));
+	io->type = NF2_REGIO_MOCK;
+	io->mock_txn_ns = txn_ns;
+	io->mock_word_ns = word_ns;
+	io->mock_pages = calloc(MOCK_NUM_PAGES, sizeof(uint32_t *));
+	if (io->mock_pages == NULL)
+		return -1;
+	return 0;
+}
+
+
+void nf2_regio_close(struct nf2_regio *io) {
+	int i;
+
+	switch (io->type) {
+	case NF2_REGIO_MMAP:
+		munmap((void *)io->bar, io->bar_len);
+		break;
+	case NF2_REGIO_MOCK:
+		for (i = 0; i < MOCK_NUM_PAGES; i++)
+			free(io->mock_pages[i]);
+		free(io->mock_pages);
+		break;
+	default:
+		break;
+	}
+	io->bar = NULL;
+	io->mock_pages = NULL;
+}
+
+
+void nf2_regio_clear_stats(struct nf2_regio *io) {
+	io->num_txns = 0;
+	io->num_words = 0;
+	io->model_ns = 0;
+}
+
+
+uint32_t *nf2_regio_mock_reg(struct nf2_regio *io, unsigned reg) {
+	unsigned page = (reg & (NF2_REG_SPACE_SIZE - 1)) >> MOCK_PAGE_BITS;
+
+	if (io->mock_pages[page] == NULL) {
+		io->mock_pages[page] = calloc(MOCK_PAGE_WORDS, sizeof(uint32_t));
+		if (io->mock_pages[page] == NULL) {
+			perror("calloc");
+			exit(1);
+		}
+	}
+	return &io->mock_pages[page][(reg >> 2) & (MOCK_PAGE_WORDS - 1)];
+}
+
+
+//
+// nf2_regio_mock_fill: fill the registers touched so far with random values
+//
+void nf2_regio_mock_fill(struct nf2_regio *io, unsigned seed) {
+	int i, j;
+
+	srandom(seed);
+	for (i = 0; i < MOCK_NUM_PAGES; i++) {
+		if (io->mock_pages[i] == NULL)
+			continue;
+		for (j = 0; j < MOCK_PAGE_WORDS; j++)
+			io->mock_pages[i][j] = random();
+	}
+}
+
+
+static void account(struct nf2_regio *io, int n) {
+	io->num_txns++;
+	io->num_words += n;
+	if (io->type == NF2_REGIO_MOCK)
+		io->model_ns += io->mock_txn_ns + (unsigned long long)n * io->mock_word_ns;
+}
+
+
+int nf2_regio_read(struct nf2_regio *io, unsigned reg, uint32_t *val) {
+	return nf2_regio_read_block(io, reg, val, 1);
+}
+
+
+int nf2_regio_write(struct nf2_regio *io, unsigned reg, uint32_t val) {
+	return nf2_regio_write_block(io, reg, &val, 1);
+}
+
+
+//
+// nf2_regio_read_block: read n consecutive registers starting at reg.
+//    The mapped and mock backends do this as a single transaction; the
+//    ioctl backend has no batched call and issues one ioctl per word.
+//
+int nf2_regio_read_block(struct nf2_regio *io, unsigned reg, uint32_t *buf, int n) {
+	unsigned val;
+	int i;
+
+	switch (io->type) {
+	case NF2_REGIO_IOCTL:
+		for (i = 0; i < n; i++) {
+			if (readReg(io->nf2, reg + i * 4, &val))
+				return -1;
+			buf[i] = val;
+			account(io, 1);
+		}
+		break;
+
+	case NF2_REGIO_MMAP:
+		for (i = 0; i < n; i++)
+			buf[i] = io->bar[(reg >> 2) + i];
+		account(io, n);
+		break;
+
+	case NF2_REGIO_MOCK:
+		for (i = 0; i < n; i++)
+			buf[i] = *nf2_regio_mock_reg(io, reg + i * 4);
+		account(io, n);
+		if (io->mock_read_hook != NULL)
+			io->mock_read_hook(io, reg, n);
+		break;
+	}
+	return 0;
+}
+
+
+int nf2_regio_write_block(struct nf2_regio *io, unsigned reg,
+			  const uint32_t *buf, int n) {
+	int i;
+
+	switch (io->type) {
+	case NF2_REGIO_IOCTL:
+		for (i = 0; i < n; i++) {
+			if (writeReg(io->nf2, reg + i * 4, buf[i]))
+				return -1;
+			account(io, 1);
+		}
+		break;
+
+	case NF2_REGIO_MMAP:
+		for (i = 0; i < n; i++)
+			io->bar[(reg >> 2) + i] = buf[i];
+		account(io, n);
+		break;
+
+	case NF2_REGIO_MOCK:
+		for (i = 0; i < n; i++)
+			*nf2_regio_mock_reg(io, reg + i * 4) = buf[i];
+		account(io, n);
+		if (io->mock_write_hook != NULL)
+			io->mock_write_hook(io, reg, n);
+		break;
+	}
+	return 0;
+}
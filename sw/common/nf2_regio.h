@@ -0,0 +1,74 @@
+/* ****************************************************************************
+ * Module: nf2_regio.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Register access backends used by the host tools.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_REGIO_H_
+#define NF2_REGIO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../../../../lib/C/common/nf2util.h"
+
+/* Size of the NetFPGA register BAR (27-bit register address space) */
+#define NF2_REG_SPACE_SIZE	0x8000000
+
+enum nf2_regio_type {
+	NF2_REGIO_IOCTL,	/* readReg()/writeReg(): one ioctl per word */
+	NF2_REGIO_MMAP,		/* register BAR mapped through sysfs */
+	NF2_REGIO_MOCK,		/* in-memory register file, no card needed */
+};
+
+/*
+ * A register access handle. Every backend counts the transactions it
+ * issues (ioctls, or block accesses for the mapped and mock backends)
+ * and the words moved, so that callers can compare access strategies.
+ *
+ * The mock backend additionally charges a modelled cost of
+ * mock_txn_ns per transaction and mock_word_ns per word to model_ns.
+ */
+struct nf2_regio {
+	enum nf2_regio_type type;
+
+	struct nf2device *nf2;		/* NF2_REGIO_IOCTL */
+
+	volatile uint32_t *bar;		/* NF2_REGIO_MMAP */
+	size_t bar_len;
+
+	uint32_t **mock_pages;		/* NF2_REGIO_MOCK */
+	unsigned mock_txn_ns;
+	unsigned mock_word_ns;
+	/* called after each mock block read, e.g. to model clear on read,
+	 * and after each block write, e.g. to model a table commit
+	 * (common/nf2_emu.c) */
+	void (*mock_read_hook)(struct nf2_regio *, unsigned reg, int n);
+	void (*mock_write_hook)(struct nf2_regio *, unsigned reg, int n);
+	void *mock_arg;
+
+	unsigned long num_txns;
+	unsigned long num_words;
+	unsigned long long model_ns;
+};
+
+int nf2_regio_open_ioctl(struct nf2_regio *, struct nf2device *);
+int nf2_regio_open_mmap(struct nf2_regio *, const char *iface);
+int nf2_regio_open_mock(struct nf2_regio *, unsigned txn_ns, unsigned word_ns);
+void nf2_regio_close(struct nf2_regio *);
+void nf2_regio_clear_stats(struct nf2_regio *);
+
+int nf2_regio_read(struct nf2_regio *, unsigned reg, uint32_t *val);
+int nf2_regio_write(struct nf2_regio *, unsigned reg, uint32_t val);
+int nf2_regio_read_block(struct nf2_regio *, unsigned reg, uint32_t *buf, int n);
+int nf2_regio_write_block(struct nf2_regio *, unsigned reg,
+			  const uint32_t *buf, int n);
+
+/* Direct access to the mock register file, not counted as traffic */
+uint32_t *nf2_regio_mock_reg(struct nf2_regio *, unsigned reg);
+void nf2_regio_mock_fill(struct nf2_regio *, unsigned seed);
+
+#endif
@@ -0,0 +1,482 @@
+/* ****************************************************************************
+ * Module: nf2_rlnc.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host random linear network coding over GF(2^8).
+ *
+ *              All the work is in the multiply-accumulate over a row,
+ *              dst ^= c * src. The TABLE method looks each byte up in the
+ *              row of c of a 256x256 product table. The vector methods
+ *              split each byte in two nibbles: c * x = c * (x & 0xf) ^
+ *              c * (x & 0xf0), and both products come from 16-entry tables
+ *              of c with one PSHUFB each, 16 or 32 bytes at a time.
+ *
+ *              The decoder stores a row as its coefficients followed by
+ *              its symbol, so elimination runs the kernel once per row
+ *              over both.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD	1
+#endif
+
+#include "nf2_rlnc.h"
+
+static uint8_t gf_exp[512];
+static uint8_t gf_log[256];
+static uint8_t gf_inv[256];
+static uint8_t mul_table[256][256];
+static uint8_t split_table[256][2][16] __attribute__((aligned(16)));
+static int initialized = 0;
+static enum nf2_rlnc_method method = NF2_RLNC_TABLE;
+
+
+static inline uint16_t get16(const uint8_t *b) {
+	return (b[0] << 8) | b[1];
+}
+
+
+static inline uint32_t get32(const uint8_t *b) {
+	return ((uint32_t)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+
+static inline void put16(uint8_t *b, uint16_t v) {
+	b[0] = v >> 8;
+	b[1] = v;
+}
+
+
+static inline void put32(uint8_t *b, uint32_t v) {
+	put16(b, v >> 16);
+	put16(b + 2, v);
+}
+
+
+static void mul_add_table(uint8_t *dst, const uint8_t *src, uint8_t c, uint32_t n) {
+	const uint8_t *t = mul_table[c];
+	uint32_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] ^= t[src[i]];
+}
+
+
+static void scale_table(uint8_t *dst, uint8_t c, uint32_t n) {
+	const uint8_t *t = mul_table[c];
+	uint32_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = t[dst[i]];
+}
+
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("ssse3")))
+static inline __m128i mul_ssse3(__m128i x, __m128i lo, __m128i hi) {
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+
+	return _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(x, nibble)),
+			     _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(x, 4), nibble)));
+}
+
+
+__attribute__((target("ssse3")))
+static void mul_add_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c, uint32_t n) {
+	__m128i lo = _mm_load_si128((const __m128i *)split_table[c][0]);
+	__m128i hi = _mm_load_si128((const __m128i *)split_table[c][1]);
+	__m128i p;
+	uint32_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		p = mul_ssse3(_mm_loadu_si128((const __m128i *)(src + i)), lo, hi);
+		p = _mm_xor_si128(p, _mm_loadu_si128((const __m128i *)(dst + i)));
+		_mm_storeu_si128((__m128i *)(dst + i), p);
+	}
+	mul_add_table(dst + i, src + i, c, n - i);
+}
+
+
+__attribute__((target("ssse3")))
+static void scale_ssse3(uint8_t *dst, uint8_t c, uint32_t n) {
+	__m128i lo = _mm_load_si128((const __m128i *)split_table[c][0]);
+	__m128i hi = _mm_load_si128((const __m128i *)split_table[c][1]);
+	uint32_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 mul_ssse3(_mm_loadu_si128((const __m128i *)(dst + i)), lo, hi));
+	scale_table(dst + i, c, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static inline __m256i mul_avx2(__m256i x, __m256i lo, __m256i hi) {
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+	return _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(x, nibble)),
+				_mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(x, 4),
+									 nibble)));
+}
+
+
+__attribute__((target("avx2")))
+static void mul_add_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, uint32_t n) {
+	__m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)split_table[c][0]));
+	__m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)split_table[c][1]));
+	__m256i p;
+	uint32_t i = 0;
+
+	for (; i + 32 <= n; i += 32) {
+		p = mul_avx2(_mm256_loadu_si256((const __m256i *)(src + i)), lo, hi);
+		p = _mm256_xor_si256(p, _mm256_loadu_si256((const __m256i *)(dst + i)));
+		_mm256_storeu_si256((__m256i *)(dst + i), p);
+	}
+	/* the 16 byte step here rather than in mul_add_ssse3, whose legacy SSE
+	 * code would stall on the dirty upper halves */
+	if (i + 16 <= n) {
+		__m128i q = mul_ssse3(_mm_loadu_si128((const __m128i *)(src + i)),
+				      _mm256_castsi256_si128(lo), _mm256_castsi256_si128(hi));
+		q = _mm_xor_si128(q, _mm_loadu_si128((const __m128i *)(dst + i)));
+		_mm_storeu_si128((__m128i *)(dst + i), q);
+		i += 16;
+	}
+	_mm256_zeroupper();
+	mul_add_table(dst + i, src + i, c, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static void scale_avx2(uint8_t *dst, uint8_t c, uint32_t n) {
+	__m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)split_table[c][0]));
+	__m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)split_table[c][1]));
+	uint32_t i = 0;
+
+	for (; i + 32 <= n; i += 32)
+		_mm256_storeu_si256((__m256i *)(dst + i),
+				    mul_avx2(_mm256_loadu_si256((const __m256i *)(dst + i)), lo, hi));
+	if (i + 16 <= n) {
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 mul_ssse3(_mm_loadu_si128((const __m128i *)(dst + i)),
+					   _mm256_castsi256_si128(lo), _mm256_castsi256_si128(hi)));
+		i += 16;
+	}
+	_mm256_zeroupper();
+	scale_table(dst + i, c, n - i);
+}
+#endif
+
+
+static int supported(enum nf2_rlnc_method m) {
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (m == NF2_RLNC_AVX2)
+		return __builtin_cpu_supports("avx2");
+	if (m == NF2_RLNC_SSSE3)
+		return __builtin_cpu_supports("ssse3");
+#endif
+	return m == NF2_RLNC_TABLE;
+}
+
+
+void nf2_rlnc_init(void) {
+	int a, b, x;
+
+	if (initialized)
+		return;
+
+	x = 1;
+	for (a = 0; a < 255; a++) {
+		gf_exp[a] = x;
+		gf_log[x] = a;
+		x <<= 1;
+		if (x & 0x100)
+			x ^= NF2_RLNC_GF_POLY;
+	}
+	for (a = 255; a < 512; a++)
+		gf_exp[a] = gf_exp[a - 255];
+
+	for (a = 1; a < 256; a++) {
+		gf_inv[a] = gf_exp[255 - gf_log[a]];
+		for (b = 1; b < 256; b++)
+			mul_table[a][b] = gf_exp[gf_log[a] + gf_log[b]];
+	}
+	for (a = 0; a < 256; a++) {
+		for (b = 0; b < 16; b++) {
+			split_table[a][0][b] = mul_table[a][b];
+			split_table[a][1][b] = mul_table[a][b << 4];
+		}
+	}
+
+	method = supported(NF2_RLNC_AVX2) ? NF2_RLNC_AVX2 :
+		 supported(NF2_RLNC_SSSE3) ? NF2_RLNC_SSSE3 : NF2_RLNC_TABLE;
+	initialized = 1;
+}
+
+
+int nf2_rlnc_set_method(enum nf2_rlnc_method m) {
+	nf2_rlnc_init();
+
+	if (m == NF2_RLNC_AUTO)
+		m = supported(NF2_RLNC_AVX2) ? NF2_RLNC_AVX2 :
+		    supported(NF2_RLNC_SSSE3) ? NF2_RLNC_SSSE3 : NF2_RLNC_TABLE;
+	if (!supported(m))
+		return -1;
+	method = m;
+	return 0;
+}
+
+
+enum nf2_rlnc_method nf2_rlnc_get_method(void) {
+	nf2_rlnc_init();
+	return method;
+}
+
+
+const char *nf2_rlnc_method_name(enum nf2_rlnc_method m) {
+	switch (m) {
+	case NF2_RLNC_AUTO:	return "auto";
+	case NF2_RLNC_TABLE:	return "table";
+	case NF2_RLNC_SSSE3:	return "ssse3";
+	case NF2_RLNC_AVX2:	return "avx2";
+	}
+	return "?";
+}
+
+
+uint8_t nf2_gf_mul(uint8_t a, uint8_t b) {
+	nf2_rlnc_init();
+	return mul_table[a][b];
+}
+
+
+uint8_t nf2_gf_inv(uint8_t a) {
+	nf2_rlnc_init();
+	return gf_inv[a];
+}
+
+
+void nf2_gf_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, uint32_t n) {
+	nf2_rlnc_init();
+	if (c == 0)
+		return;
+
+	switch (method) {
+#ifdef HAVE_X86_SIMD
+	case NF2_RLNC_AVX2:
+		mul_add_avx2(dst, src, c, n);
+		break;
+	case NF2_RLNC_SSSE3:
+		mul_add_ssse3(dst, src, c, n);
+		break;
+#endif
+	default:
+		mul_add_table(dst, src, c, n);
+		break;
+	}
+}
+
+
+void nf2_gf_scale(uint8_t *dst, uint8_t c, uint32_t n) {
+	nf2_rlnc_init();
+	if (c == 1)
+		return;
+	if (c == 0) {
+		memset(dst, 0, n);
+		return;
+	}
+
+	switch (method) {
+#ifdef HAVE_X86_SIMD
+	case NF2_RLNC_AVX2:
+		scale_avx2(dst, c, n);
+		break;
+	case NF2_RLNC_SSSE3:
+		scale_ssse3(dst, c, n);
+		break;
+#endif
+	default:
+		scale_table(dst, c, n);
+		break;
+	}
+}
+
+
+/* xorshift64* */
+static uint8_t next_coeff(uint64_t *s) {
+	*s ^= *s >> 12;
+	*s ^= *s << 25;
+	*s ^= *s >> 27;
+	return (*s * 0x2545f4914f6cdd1dULL) >> 56;
+}
+
+
+int nf2_rlnc_enc_init(struct nf2_rlnc_enc *enc, int k, uint32_t max_len, uint64_t seed) {
+	nf2_rlnc_init();
+
+	if (k < 1 || k > NF2_RLNC_MAX_K || max_len > 0xffff)
+		return -1;
+	enc->k = k;
+	enc->sym_len = nf2_rlnc_sym_len(max_len);
+	enc->seed = seed ? seed : 1;
+	enc->symbols = malloc((size_t)k * enc->sym_len);
+	if (!enc->symbols)
+		return -1;
+	nf2_rlnc_enc_reset(enc, 0);
+	return 0;
+}
+
+
+void nf2_rlnc_enc_free(struct nf2_rlnc_enc *enc) {
+	free(enc->symbols);
+	enc->symbols = NULL;
+}
+
+
+void nf2_rlnc_enc_reset(struct nf2_rlnc_enc *enc, uint32_t gen_id) {
+	enc->gen_id = gen_id;
+	enc->n = 0;
+}
+
+
+int nf2_rlnc_enc_add(struct nf2_rlnc_enc *enc, const uint8_t *data, uint32_t len) {
+	uint8_t *sym;
+
+	if (enc->n == enc->k || len > enc->sym_len - 2)
+		return -1;
+
+	sym = enc->symbols + (size_t)enc->n++ * enc->sym_len;
+	put16(sym, len);
+	memcpy(sym + 2, data, len);
+	memset(sym + 2 + len, 0, enc->sym_len - 2 - len);
+	return 0;
+}
+
+
+int nf2_rlnc_encode(struct nf2_rlnc_enc *enc, uint8_t *coded, uint32_t room) {
+	uint32_t len = NF2_RLNC_HDR_LEN + enc->k + enc->sym_len;
+	uint8_t *coeffs = coded + NF2_RLNC_HDR_LEN;
+	uint8_t *payload = coeffs + enc->k;
+	int i, nonzero;
+
+	if (room < len || enc->n == 0)
+		return -1;
+
+	coded[0] = NF2_RLNC_VERSION;
+	coded[1] = enc->k;
+	put16(coded + 2, enc->sym_len);
+	put32(coded + 4, enc->gen_id);
+
+	do {
+		nonzero = 0;
+		for (i = 0; i < enc->n; i++)
+			nonzero |= coeffs[i] = next_coeff(&enc->seed);
+	} while (!nonzero);
+	memset(coeffs + enc->n, 0, enc->k - enc->n);
+
+	memset(payload, 0, enc->sym_len);
+	for (i = 0; i < enc->n; i++)
+		nf2_gf_mul_add(payload, enc->symbols + (size_t)i * enc->sym_len, coeffs[i],
+			       enc->sym_len);
+	return len;
+}
+
+
+int nf2_rlnc_dec_init(struct nf2_rlnc_dec *dec, int k, uint32_t max_len) {
+	nf2_rlnc_init();
+
+	if (k < 1 || k > NF2_RLNC_MAX_K || max_len > 0xffff)
+		return -1;
+	dec->k = k;
+	dec->sym_len = nf2_rlnc_sym_len(max_len);
+	dec->row_len = k + dec->sym_len;
+	dec->rows = malloc((size_t)k * dec->row_len);
+	dec->have = malloc(k);
+	dec->scratch = malloc(dec->row_len);
+	if (!dec->rows || !dec->have || !dec->scratch) {
+		nf2_rlnc_dec_free(dec);
+		return -1;
+	}
+	nf2_rlnc_dec_reset(dec, 0);
+	return 0;
+}
+
+
+void nf2_rlnc_dec_free(struct nf2_rlnc_dec *dec) {
+	free(dec->rows);
+	free(dec->have);
+	free(dec->scratch);
+	dec->rows = dec->have = dec->scratch = NULL;
+}
+
+
+void nf2_rlnc_dec_reset(struct nf2_rlnc_dec *dec, uint32_t gen_id) {
+	dec->gen_id = gen_id;
+	dec->rank = 0;
+	memset(dec->have, 0, dec->k);
+}
+
+
+int nf2_rlnc_dec_add(struct nf2_rlnc_dec *dec, const uint8_t *coded, uint32_t len) {
+	uint8_t *s = dec->scratch, *row;
+	int p, q;
+
+	if (len != NF2_RLNC_HDR_LEN + dec->row_len || coded[0] != NF2_RLNC_VERSION ||
+	    coded[1] != dec->k || get16(coded + 2) != dec->sym_len ||
+	    get32(coded + 4) != dec->gen_id)
+		return -1;
+	if (dec->rank == dec->k)
+		return 0;
+
+	/* take out the pivots we have; the rows are reduced, so one pass
+	 * clears every pivot column */
+	memcpy(s, coded + NF2_RLNC_HDR_LEN, dec->row_len);
+	for (p = 0; p < dec->k; p++)
+		if (dec->have[p] && s[p])
+			nf2_gf_mul_add(s, dec->rows + (size_t)p * dec->row_len, s[p],
+				       dec->row_len);
+
+	for (q = 0; q < dec->k && !s[q]; q++)
+		;
+	if (q == dec->k)
+		return 0;
+
+	/* new pivot in column q: normalize it and clear column q elsewhere */
+	nf2_gf_scale(s, gf_inv[s[q]], dec->row_len);
+	for (p = 0; p < dec->k; p++) {
+		row = dec->rows + (size_t)p * dec->row_len;
+		if (dec->have[p] && row[q])
+			nf2_gf_mul_add(row, s, row[q], dec->row_len);
+	}
+	memcpy(dec->rows + (size_t)q * dec->row_len, s, dec->row_len);
+	dec->have[q] = 1;
+	dec->rank++;
+	return 1;
+}
+
+
+int nf2_rlnc_dec_packet(const struct nf2_rlnc_dec *dec, int i, const uint8_t **data,
+			uint32_t *len) {
+	const uint8_t *row;
+	int j;
+
+	if (i < 0 || i >= dec->k || !dec->have[i])
+		return -1;
+	row = dec->rows + (size_t)i * dec->row_len;
+	for (j = 0; j < dec->k; j++)
+		if (j != i && row[j])
+			return -1;
+
+	*len = get16(row + dec->k);
+	if (*len > dec->sym_len - 2)
+		return -1;
+	*data = row + dec->k + 2;
+	return 0;
+}
@@ -0,0 +1,126 @@
+/* ****************************************************************************
+ * Module: nf2_rlnc.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host random linear network coding over GF(2^8), the
+ *              generalization of the pairwise XOR coding of nf2_xor.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_RLNC_H_
+#define NF2_RLNC_H_
+
+#include <stdint.h>
+
+/*
+ * Packets are coded in generations of k. Each source packet becomes a
+ * symbol of max_len + 2 bytes: its length (16 bits, network order) and
+ * its data, zero padded. A coded packet carries a random combination of
+ * the symbols of its generation, in GF(2^8) with the polynomial
+ * x^8 + x^4 + x^3 + x^2 + 1 (0x11d):
+ *
+ *   byte  0     version (NF2_RLNC_VERSION)
+ *   byte  1     k
+ *   bytes 2..3  symbol length
+ *   bytes 4..7  generation id
+ *   then        k coefficients, then the coded symbol
+ *
+ * With k = 2 and both coefficients 1 this is the XOR of nf2_xor. Any k
+ * linearly independent coded packets of a generation, in any order and
+ * with any losses, give back all k packets.
+ */
+#define NF2_RLNC_VERSION	1
+#define NF2_RLNC_HDR_LEN	8
+#define NF2_RLNC_MAX_K		255
+#define NF2_RLNC_GF_POLY	0x11d
+
+enum nf2_rlnc_method {
+	NF2_RLNC_AUTO,		/* the widest the CPU has */
+	NF2_RLNC_TABLE,		/* 64 KB product table, a byte at a time */
+	NF2_RLNC_SSSE3,		/* 4-bit split tables with PSHUFB */
+	NF2_RLNC_AVX2,		/* the same on 256-bit vectors */
+};
+
+/*
+ * nf2_rlnc_init builds the tables and must be called before the coding
+ * functions are used from more than one thread. nf2_rlnc_set_method
+ * returns -1 if the method is not supported on this CPU.
+ */
+void nf2_rlnc_init(void);
+int nf2_rlnc_set_method(enum nf2_rlnc_method);
+enum nf2_rlnc_method nf2_rlnc_get_method(void);
+const char *nf2_rlnc_method_name(enum nf2_rlnc_method);
+
+uint8_t nf2_gf_mul(uint8_t a, uint8_t b);
+uint8_t nf2_gf_inv(uint8_t a);		/* a != 0 */
+
+/* dst[i] ^= c * src[i], and dst[i] = c * dst[i], for i < n */
+void nf2_gf_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, uint32_t n);
+void nf2_gf_scale(uint8_t *dst, uint8_t c, uint32_t n);
+
+static inline uint32_t nf2_rlnc_sym_len(uint32_t max_len) {
+	return max_len + 2;
+}
+
+static inline uint32_t nf2_rlnc_coded_len(int k, uint32_t max_len) {
+	return NF2_RLNC_HDR_LEN + k + nf2_rlnc_sym_len(max_len);
+}
+
+struct nf2_rlnc_enc {
+	int k;
+	int n;			/* source packets added */
+	uint32_t sym_len;
+	uint32_t gen_id;
+	uint64_t seed;
+	uint8_t *symbols;	/* k * sym_len */
+};
+
+/*
+ * The encoder takes the packets of a generation with nf2_rlnc_enc_add
+ * and codes the ones added so far (the others get coefficient 0) with
+ * each nf2_rlnc_encode, so coding can start before the generation is
+ * full.
+ */
+int nf2_rlnc_enc_init(struct nf2_rlnc_enc *, int k, uint32_t max_len, uint64_t seed);
+void nf2_rlnc_enc_free(struct nf2_rlnc_enc *);
+void nf2_rlnc_enc_reset(struct nf2_rlnc_enc *, uint32_t gen_id);
+
+/* Returns -1 if the generation is full or the packet too long */
+int nf2_rlnc_enc_add(struct nf2_rlnc_enc *, const uint8_t *data, uint32_t len);
+
+/* Returns the length of the coded packet, or -1 if room is too small */
+int nf2_rlnc_encode(struct nf2_rlnc_enc *, uint8_t *coded, uint32_t room);
+
+struct nf2_rlnc_dec {
+	int k;
+	int rank;
+	uint32_t sym_len;
+	uint32_t gen_id;
+	uint32_t row_len;	/* k coefficients and a symbol */
+	uint8_t *rows;		/* k rows; row i has its pivot in column i */
+	uint8_t *have;		/* rows present */
+	uint8_t *scratch;
+};
+
+/*
+ * The decoder keeps the rows it has in reduced row echelon form, so a
+ * packet is available as soon as its row has no other coefficient, which
+ * can happen before rank k.
+ */
+int nf2_rlnc_dec_init(struct nf2_rlnc_dec *, int k, uint32_t max_len);
+void nf2_rlnc_dec_free(struct nf2_rlnc_dec *);
+void nf2_rlnc_dec_reset(struct nf2_rlnc_dec *, uint32_t gen_id);
+
+/*
+ * Returns 1 if the coded packet raised the rank, 0 if it did not, or -1
+ * if it is invalid or of another generation, k or symbol length.
+ */
+int nf2_rlnc_dec_add(struct nf2_rlnc_dec *, const uint8_t *coded, uint32_t len);
+
+/* Returns 0 and source packet i of the generation, or -1 if it is not
+ * decoded yet */
+int nf2_rlnc_dec_packet(const struct nf2_rlnc_dec *, int i, const uint8_t **data,
+			uint32_t *len);
+
+#endif
@@ -0,0 +1,233 @@
+/* ****************************************************************************
+ * Module: nf2_snapshot.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Bulk register snapshot of the OpenFlow switch state.
+ *
+ *              The registers making up a snapshot are listed once in
+ *              tables mapping a register address to a field of
+ *              struct nf2_snapshot. The first snapshot sorts each table
+ *              by address and splits it into runs of consecutive
+ *              registers, so that a snapshot costs one block access per
+ *              run instead of one access per register.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "nf2_snapshot.h"
+
+/* Longest run read in one go */
+#define MAX_RUN_LEN	64
+
+struct snap_reg {
+	unsigned reg;
+	size_t off;
+};
+
+struct snap_run {
+	unsigned reg;
+	int first;
+	int len;
+};
+
+struct snap_plan {
+	struct snap_reg *regs;
+	int num_regs;
+	struct snap_run *runs;
+	int num_runs;
+};
+
+#define SNAP(r, f)	{ r, offsetof(struct nf2_snapshot, f) }
+#define WC(r, f)	{ r, offsetof(struct nf2_wildcard_info, f) }
+
+#define PORT_REGS(p) \
+	SNAP(MAC_GRP_##p##_CONTROL_REG, mac_control[p]), \
+	SNAP(MAC_GRP_##p##_RX_QUEUE_NUM_PKTS_STORED_REG, port[p].rx_q_num_pkts_stored), \
+	SNAP(MAC_GRP_##p##_RX_QUEUE_NUM_PKTS_DROPPED_FULL_REG, port[p].rx_q_num_pkts_dropped_full), \
+	SNAP(MAC_GRP_##p##_RX_QUEUE_NUM_PKTS_DROPPED_BAD_REG, port[p].rx_q_num_pkts_dropped_bad), \
+	SNAP(MAC_GRP_##p##_RX_QUEUE_NUM_WORDS_PUSHED_REG, port[p].rx_q_num_words_pushed), \
+	SNAP(MAC_GRP_##p##_RX_QUEUE_NUM_BYTES_PUSHED_REG, port[p].rx_q_num_bytes_pushed), \
+	SNAP(MAC_GRP_##p##_RX_QUEUE_NUM_PKTS_DEQUEUED_REG, port[p].rx_q_num_pkts_dequeued), \
+	SNAP(MAC_GRP_##p##_RX_QUEUE_NUM_PKTS_IN_QUEUE_REG, port[p].rx_q_num_pkts_in_queue), \
+	SNAP(MAC_GRP_##p##_TX_QUEUE_NUM_PKTS_IN_QUEUE_REG, port[p].tx_q_num_pkts_in_queue), \
+	SNAP(MAC_GRP_##p##_TX_QUEUE_NUM_PKTS_SENT_REG, port[p].tx_q_num_pkts_sent), \
+	SNAP(MAC_GRP_##p##_TX_QUEUE_NUM_WORDS_PUSHED_REG, port[p].tx_q_num_words_pushed), \
+	SNAP(MAC_GRP_##p##_TX_QUEUE_NUM_BYTES_PUSHED_REG, port[p].tx_q_num_bytes_pushed), \
+	SNAP(MAC_GRP_##p##_TX_QUEUE_NUM_PKTS_ENQUEUED_REG, port[p].tx_q_num_pkts_enqueued)
+
+#define OQ_REGS(q) \
+	SNAP(BRAM_OQ_QUEUE_##q##_NUM_PKT_BYTES_RECEIVED_REG, oq[q].num_pkt_bytes_received), \
+	SNAP(BRAM_OQ_QUEUE_##q##_NUM_PKTS_RECEIVED_REG, oq[q].num_pkts_received), \
+	SNAP(BRAM_OQ_QUEUE_##q##_NUM_PKTS_DROPPED_REG, oq[q].num_pkts_dropped), \
+	SNAP(BRAM_OQ_QUEUE_##q##_NUM_WORDS_IN_QUEUE_REG, oq[q].num_words_in_queue)
+
+static struct snap_reg counter_regs[] = {
+	PORT_REGS(0), PORT_REGS(1), PORT_REGS(2), PORT_REGS(3),
+
+	SNAP(IN_ARB_NUM_PKTS_SENT_REG, in_arb.num_pkts_sent),
+	SNAP(IN_ARB_LAST_PKT_WORD_0_LO_REG, in_arb.last_pkt_word_0_lo),
+	SNAP(IN_ARB_LAST_PKT_WORD_0_HI_REG, in_arb.last_pkt_word_0_hi),
+	SNAP(IN_ARB_LAST_PKT_CTRL_0_REG, in_arb.last_pkt_ctrl_0),
+	SNAP(IN_ARB_LAST_PKT_WORD_1_LO_REG, in_arb.last_pkt_word_1_lo),
+	SNAP(IN_ARB_LAST_PKT_WORD_1_HI_REG, in_arb.last_pkt_word_1_hi),
+	SNAP(IN_ARB_LAST_PKT_CTRL_1_REG, in_arb.last_pkt_ctrl_1),
+	SNAP(IN_ARB_STATE_REG, in_arb.state),
+
+	SNAP(BRAM_OQ_DISABLE_QUEUES_REG, oq_disable),
+	OQ_REGS(0), OQ_REGS(1), OQ_REGS(2), OQ_REGS(3),
+	OQ_REGS(4), OQ_REGS(5), OQ_REGS(6), OQ_REGS(7),
+
+	SNAP(OPENFLOW_LOOKUP_WILDCARD_MISSES_REG, lookup.wildcard_misses),
+	SNAP(OPENFLOW_LOOKUP_WILDCARD_HITS_REG, lookup.wildcard_hits),
+	SNAP(OPENFLOW_LOOKUP_EXACT_MISSES_REG, lookup.exact_misses),
+	SNAP(OPENFLOW_LOOKUP_EXACT_HITS_REG, lookup.exact_hits),
+	SNAP(OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_0_REG, lookup.num_pkts_dropped[0]),
+	SNAP(OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_1_REG, lookup.num_pkts_dropped[1]),
+	SNAP(OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_2_REG, lookup.num_pkts_dropped[2]),
+	SNAP(OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_3_REG, lookup.num_pkts_dropped[3]),
+	SNAP(OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_4_REG, lookup.num_pkts_dropped[4]),
+	SNAP(OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_5_REG, lookup.num_pkts_dropped[5]),
+	SNAP(OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_6_REG, lookup.num_pkts_dropped[6]),
+	SNAP(OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_7_REG, lookup.num_pkts_dropped[7]),
+	SNAP(OPENFLOW_LOOKUP_TIMER_REG, lookup.timer),
+
+	SNAP(WDT_ENABLE_FLG_REG, wdt_enable_flg),
+	SNAP(WDT_COUNTER_REG, wdt_counter),
+};
+
+/* Filled in by plan_init(): the wildcard window of one entry */
+static struct snap_reg wildcard_regs[OPENFLOW_WILDCARD_NUM_CMP_WORDS_USED * 2 +
+				     OPENFLOW_WILDCARD_NUM_DATA_WORDS_USED];
+
+static struct snap_plan counter_plan;
+static struct snap_plan wildcard_plan;
+
+
+static int cmp_reg(const void *a, const void *b) {
+	const struct snap_reg *ra = a, *rb = b;
+
+	if (ra->reg < rb->reg)
+		return -1;
+	return ra->reg > rb->reg;
+}
+
+
+static void plan_build(struct snap_plan *plan, struct snap_reg *regs, int n) {
+	int i;
+
+	qsort(regs, n, sizeof(*regs), cmp_reg);
+	plan->regs = regs;
+	plan->num_regs = n;
+	plan->runs = calloc(n, sizeof(*plan->runs));
+	if (plan->runs == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+
+	plan->num_runs = 0;
+	for (i = 0; i < n; i++) {
+		struct snap_run *run;
+
+		if (plan->num_runs > 0) {
+			run = &plan->runs[plan->num_runs - 1];
+			if (run->len < MAX_RUN_LEN &&
+			    regs[i].reg == run->reg + run->len * 4) {
+				run->len++;
+				continue;
+			}
+		}
+		run = &plan->runs[plan->num_runs++];
+		run->reg = regs[i].reg;
+		run->first = i;
+		run->len = 1;
+	}
+}
+
+
+static void plan_init(void) {
+	int i, n = 0;
+
+	if (counter_plan.regs != NULL)
+		return;
+
+	for (i = 0; i < OPENFLOW_WILDCARD_NUM_CMP_WORDS_USED; i++) {
+		wildcard_regs[n].reg = OPENFLOW_WILDCARD_LOOKUP_CMP_0_REG + i * 4;
+		wildcard_regs[n++].off = offsetof(struct nf2_wildcard_info, entry.raw[i]);
+		wildcard_regs[n].reg = OPENFLOW_WILDCARD_LOOKUP_CMP_MASK_0_REG + i * 4;
+		wildcard_regs[n++].off = offsetof(struct nf2_wildcard_info, mask.raw[i]);
+	}
+	for (i = 0; i < OPENFLOW_WILDCARD_NUM_DATA_WORDS_USED; i++) {
+		wildcard_regs[n].reg = OPENFLOW_WILDCARD_LOOKUP_ACTION_0_REG + i * 4;
+		wildcard_regs[n++].off = offsetof(struct nf2_wildcard_info, action.raw[i]);
+	}
+
+	plan_build(&counter_plan, counter_regs,
+		   sizeof(counter_regs) / sizeof(counter_regs[0]));
+	plan_build(&wildcard_plan, wildcard_regs, n);
+}
+
+
+static int plan_read(struct nf2_regio *io, const struct snap_plan *plan, void *base) {
+	uint32_t buf[MAX_RUN_LEN];
+	int i, j;
+
+	for (i = 0; i < plan->num_runs; i++) {
+		const struct snap_run *run = &plan->runs[i];
+
+		if (nf2_regio_read_block(io, run->reg, buf, run->len))
+			return -1;
+		for (j = 0; j < run->len; j++)
+			*(uint32_t *)((char *)base + plan->regs[run->first + j].off) = buf[j];
+	}
+	return 0;
+}
+
+
+static int plan_read_regs(struct nf2_regio *io, const struct snap_plan *plan, void *base) {
+	int i;
+
+	for (i = 0; i < plan->num_regs; i++) {
+		if (nf2_regio_read(io, plan->regs[i].reg,
+				   (uint32_t *)((char *)base + plan->regs[i].off)))
+			return -1;
+	}
+	return 0;
+}
+
+
+static int snapshot_read(struct nf2_regio *io, struct nf2_snapshot *snap, int what,
+			 int (*read)(struct nf2_regio *, const struct snap_plan *, void *)) {
+	int i;
+
+	plan_init();
+
+	if (what & NF2_SNAP_COUNTERS) {
+		if (read(io, &counter_plan, snap))
+			return -1;
+	}
+
+	if (what & NF2_SNAP_WILDCARD) {
+		for (i = 0; i < OPENFLOW_WILDCARD_TABLE_SIZE; i++) {
+			if (nf2_regio_write(io, OPENFLOW_WILDCARD_LOOKUP_READ_ADDR_REG, i))
+				return -1;
+			if (read(io, &wildcard_plan, &snap->wildcard[i]))
+				return -1;
+		}
+	}
+	return 0;
+}
+
+
+int nf2_snapshot_read(struct nf2_regio *io, struct nf2_snapshot *snap, int what) {
+	return snapshot_read(io, snap, what, plan_read);
+}
+
+
+int nf2_snapshot_read_regs(struct nf2_regio *io, struct nf2_snapshot *snap, int what) {
+	return snapshot_read(io, snap, what, plan_read_regs);
+}
@@ -0,0 +1,83 @@
+/* ****************************************************************************
+ * Module: nf2_snapshot.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Bulk register snapshot of the OpenFlow switch state.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_SNAPSHOT_H_
+#define NF2_SNAPSHOT_H_
+
+#include <stdint.h>
+
+#include "../../lib/C/reg_defines_openflow_switch.h"
+#include "nf2_regio.h"
+#include "../regdump/nf2_drv.h"
+
+#define NF2_OQ_NUM	8
+
+struct nf2_queue_info {
+	uint32_t num_pkt_bytes_received;
+	uint32_t num_pkts_received;
+	uint32_t num_pkts_dropped;
+	uint32_t num_words_in_queue;
+};
+
+struct nf2_in_arb_info {
+	uint32_t num_pkts_sent;
+	uint32_t last_pkt_word_0_lo;
+	uint32_t last_pkt_word_0_hi;
+	uint32_t last_pkt_ctrl_0;
+	uint32_t last_pkt_word_1_lo;
+	uint32_t last_pkt_word_1_hi;
+	uint32_t last_pkt_ctrl_1;
+	uint32_t state;
+};
+
+struct nf2_lookup_info {
+	uint32_t wildcard_misses;
+	uint32_t wildcard_hits;
+	uint32_t exact_misses;
+	uint32_t exact_hits;
+	uint32_t num_pkts_dropped[NF2_OQ_NUM];
+	uint32_t timer;
+};
+
+struct nf2_wildcard_info {
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;
+	nf2_of_action_wrap action;
+};
+
+struct nf2_snapshot {
+	uint32_t mac_control[NF2_PORT_NUM];
+	struct nf2_port_info port[NF2_PORT_NUM];
+	struct nf2_in_arb_info in_arb;
+	uint32_t oq_disable;
+	struct nf2_queue_info oq[NF2_OQ_NUM];
+	struct nf2_lookup_info lookup;
+	uint32_t wdt_enable_flg;
+	uint32_t wdt_counter;
+	struct nf2_wildcard_info wildcard[OPENFLOW_WILDCARD_TABLE_SIZE];
+};
+
+/* Parts of the snapshot to read */
+#define NF2_SNAP_COUNTERS	0x1
+#define NF2_SNAP_WILDCARD	0x2
+#define NF2_SNAP_ALL		(NF2_SNAP_COUNTERS | NF2_SNAP_WILDCARD)
+
+/*
+ * nf2_snapshot_read coalesces the registers into runs of consecutive
+ * addresses and reads each run with one block access. Each wildcard
+ * entry costs one write of OPENFLOW_WILDCARD_LOOKUP_READ_ADDR_REG plus
+ * the block reads of its CMP/MASK/ACTION window.
+ *
+ * nf2_snapshot_read_regs reads the same registers one at a time, the
+ * way regdump used to; it is kept for comparison.
+ */
+int nf2_snapshot_read(struct nf2_regio *, struct nf2_snapshot *, int what);
+int nf2_snapshot_read_regs(struct nf2_regio *, struct nf2_snapshot *, int what);
+
+#endif
@@ -0,0 +1,539 @@
+/* ****************************************************************************
+ * Module: nf2_sram_model.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Cycle level model of the SRAM slot schedule of
+ *              src/sram/sram_arbiter.v, the lookups exact_match.v runs in
+ *              it and the host register accesses it serves.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "nf2_sram_model.h"
+
+/* exact_match's cycle is the arbiter's counter plus this */
+#define EXACT_LAG		2
+
+/* cycles of exact_match at which it takes flow 0 and flow 1, and at
+ * which their exact_data_vld goes out */
+#define FLOW_0_TAKE		1
+#define FLOW_1_TAKE		9
+#define FLOW_0_DONE		28
+#define FLOW_1_DONE		5
+
+/* exact_data_vld to the result in opl_processor (match_arbiter and its
+ * result_fifo) */
+#define RESULT_CYCLES		3
+
+/* sram_reg_req to sram_reg_ack, through the arbiter's pipeline */
+#define REG_ACK_CYCLES		4
+
+#define FCS_BYTES		4
+
+/* Which flow the SRAM access of exact_match's cycle is for: header reads
+ * of the two hash slots, then the counters, actions and write-back */
+static const signed char owner[NF2_SRAM_ROUND] = {
+	1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1,
+	1, 1, 0, 0, 0, 0, 0, 0, 0, -1, -1, 1, 1, 1, 1, 1
+};
+
+static const char *job_names[NF2_SRAM_JOBS] = { "sweep", "install" };
+
+
+static uint32_t next_rand(uint32_t *s) {
+	/* xorshift32 */
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+	return *s;
+}
+
+
+/* uniform in (0, 1] */
+static double unit(struct nf2_sram_model *m) {
+	return ((next_rand(&m->rand) >> 8) + 1) / 16777216.0;
+}
+
+
+static double pct(uint64_t part, uint64_t whole) {
+	return whole ? 100.0 * part / whole : 0.0;
+}
+
+
+static double per_sec(const struct nf2_sram_model *m, double n) {
+	return m->stats.cycles ? n * 1e9 / (m->stats.cycles * NF2_SRAM_CLOCK_NS) : 0.0;
+}
+
+
+void nf2_sram_model_defaults(struct nf2_sram_cfg *cfg) {
+	int p;
+
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->num_ports = NF2_SRAM_MAX_PORTS;
+	for (p = 0; p < NF2_SRAM_MAX_PORTS; p++)
+		cfg->load[p] = 1.0;
+	cfg->num_sizes = 1;
+	cfg->sizes[0] = 64;
+	cfg->weights[0] = 1;
+	cfg->rx_queue_bytes = 4096;
+	cfg->word_ns = 500;
+	cfg->seed = 1;
+}
+
+
+int nf2_sram_model_parse_mix(struct nf2_sram_cfg *cfg, const char *s) {
+	char *end;
+	long size;
+	double weight;
+	int n = 0;
+
+	while (*s) {
+		size = strtol(s, &end, 10);
+		if (end == s || size < 64 || size > 9000 || n == NF2_SRAM_MAX_SIZES)
+			return -1;
+		weight = 1;
+		s = end;
+		if (*s == ':') {
+			weight = strtod(s + 1, &end);
+			if (end == s + 1 || weight <= 0)
+				return -1;
+			s = end;
+		}
+		cfg->sizes[n] = size;
+		cfg->weights[n++] = weight;
+		if (*s == ',')
+			s++;
+		else if (*s)
+			return -1;
+	}
+	if (n == 0)
+		return -1;
+	cfg->num_sizes = n;
+	return 0;
+}
+
+
+//
+// next_arrival: draw the size of port p's next frame and when its last
+//    byte arrives: back to back at the line rate after an idle time with
+//    the mean that makes up the port's load
+//
+static void next_arrival(struct nf2_sram_model *m, int p) {
+	struct nf2_sram_rxq *q = &m->rxq[p];
+	double load = m->cfg.load[p], total = 0, r;
+	uint64_t wire;
+	int i;
+
+	if (load <= 0) {
+		q->next_ns = UINT64_MAX;
+		return;
+	}
+	if (load > 1)
+		load = 1;
+	for (i = 0; i < m->cfg.num_sizes; i++)
+		total += m->cfg.weights[i];
+	r = unit(m) * total;
+	for (i = 0; i < m->cfg.num_sizes - 1 && r > m->cfg.weights[i]; i++)
+		r -= m->cfg.weights[i];
+	q->next_size = m->cfg.sizes[i];
+	wire = (uint64_t)(q->next_size + NF2_SRAM_WIRE_OVERHEAD) * NF2_SRAM_LINE_NS_PER_BYTE;
+	q->next_ns += wire;
+	if (load < 1)
+		q->next_ns += (uint64_t)(-log(unit(m)) * wire * (1 - load) / load);
+}
+
+
+int nf2_sram_model_init(struct nf2_sram_model *m, const struct nf2_sram_cfg *cfg) {
+	int c, p, t;
+
+	memset(m, 0, sizeof(*m));
+	m->cfg = *cfg;
+	if (m->cfg.num_ports > NF2_SRAM_MAX_PORTS)
+		m->cfg.num_ports = NF2_SRAM_MAX_PORTS;
+	m->rand = cfg->seed ? cfg->seed : 1;
+
+	for (c = 0; c < NF2_SRAM_ROUND; c++)
+		m->schedule[c] = NF2_SRAM_SLOT_READ;
+	m->schedule[22] = NF2_SRAM_SLOT_WRITE;
+	m->schedule[23] = NF2_SRAM_SLOT_REG;
+	m->schedule[24] = NF2_SRAM_SLOT_CLEAR;
+	m->schedule[31] = NF2_SRAM_SLOT_WRITE;
+
+	for (p = 0; p < m->cfg.num_ports; p++) {
+		m->rxq[p].cap = cfg->rx_queue_bytes / (64 - FCS_BYTES) + 1;
+		m->rxq[p].pkts = calloc(m->rxq[p].cap, sizeof(*m->rxq[p].pkts));
+		if (m->rxq[p].pkts == NULL) {
+			nf2_sram_model_free(m);
+			return -1;
+		}
+		next_arrival(m, p);
+	}
+	m->jobs = calloc(NF2_SRAM_MAX_HOST_JOBS, sizeof(*m->jobs));
+	if (m->jobs == NULL) {
+		nf2_sram_model_free(m);
+		return -1;
+	}
+	m->next_sweep_ns = cfg->sweep_rate > 0 ? 0 : UINT64_MAX;
+	m->next_install_ns = cfg->install_rate > 0 ?
+		(uint64_t)(-log(unit(m)) * 1e9 / cfg->install_rate) : UINT64_MAX;
+
+	m->in_rdy = 1;
+	m->flow[0] = m->flow[1] = -1;
+	nf2_hdr_init(&m->stats.in_fifo);
+	nf2_hdr_init(&m->stats.lookup_ns);
+	nf2_hdr_init(&m->stats.pkt_ns);
+	nf2_hdr_init(&m->stats.word_wait_ns);
+	for (t = 0; t < NF2_SRAM_JOBS; t++)
+		nf2_hdr_init(&m->stats.job_ns[t]);
+	return 0;
+}
+
+
+void nf2_sram_model_free(struct nf2_sram_model *m) {
+	int p;
+
+	for (p = 0; p < NF2_SRAM_MAX_PORTS; p++) {
+		free(m->rxq[p].pkts);
+		m->rxq[p].pkts = NULL;
+	}
+	free(m->jobs);
+	m->jobs = NULL;
+}
+
+
+double nf2_sram_model_lookup_capacity(void) {
+	return NF2_SRAM_FLOWS_PER_ROUND * 1e9 / (NF2_SRAM_ROUND * NF2_SRAM_CLOCK_NS);
+}
+
+
+static void arrivals(struct nf2_sram_model *m) {
+	uint64_t ns = m->now * NF2_SRAM_CLOCK_NS;
+	struct nf2_sram_rxq *q;
+	struct nf2_sram_pkt *pkt;
+	int p, size;
+
+	for (p = 0; p < m->cfg.num_ports; p++) {
+		q = &m->rxq[p];
+		while (q->next_ns <= ns) {
+			size = q->next_size - FCS_BYTES;
+			m->stats.offered_pkts++;
+			m->stats.offered_bytes += q->next_size;
+			if (q->bytes + size > m->cfg.rx_queue_bytes || q->num == q->cap) {
+				m->stats.drops[p]++;
+			} else {
+				pkt = &q->pkts[(q->head + q->num++) % q->cap];
+				memset(pkt, 0, sizeof(*pkt));
+				pkt->arrive = m->now;
+				pkt->port = p;
+				pkt->size = q->next_size;
+				pkt->words = 1 + (size + 7) / 8;
+				q->bytes += size;
+				if (q->bytes > m->stats.max_rx_queue_bytes[p])
+					m->stats.max_rx_queue_bytes[p] = q->bytes;
+			}
+			next_arrival(m, p);
+		}
+	}
+}
+
+
+//
+// exact_match: one cycle of its state machine; e is its cycle_num and c
+//    the arbiter's counter
+//
+static void exact_match(struct nf2_sram_model *m, int e, int c) {
+	struct nf2_sram_pkt *pkt;
+	int f = owner[e];
+
+	if (f >= 0 && m->flow[f] >= 0) {
+		m->stats.slots[c]++;
+		if (m->schedule[c] == NF2_SRAM_SLOT_WRITE)
+			m->stats.writes_used++;
+		else
+			m->stats.reads_used++;
+	}
+
+	f = -1;
+	if (e == FLOW_0_TAKE)
+		f = 0;
+	else if (e == FLOW_1_TAKE)
+		f = 1;
+	if (f >= 0 && m->flow_num) {
+		pkt = &m->pipe[m->flow_fifo[m->flow_head] % NF2_SRAM_MAX_PIPE];
+		if (pkt->parsed < m->now) {
+			m->flow[f] = m->flow_fifo[m->flow_head];
+			m->flow_head = (m->flow_head + 1) % NF2_SRAM_FLOW_FIFO;
+			m->flow_num--;
+		}
+	}
+
+	f = -1;
+	if (e == FLOW_0_DONE)
+		f = 0;
+	else if (e == FLOW_1_DONE)
+		f = 1;
+	if (f >= 0 && m->flow[f] >= 0) {
+		pkt = &m->pipe[m->flow[f] % NF2_SRAM_MAX_PIPE];
+		pkt->result = m->now + RESULT_CYCLES;
+		nf2_hdr_record(&m->stats.lookup_ns, (pkt->result - pkt->parsed) * NF2_SRAM_CLOCK_NS);
+		m->stats.lookups++;
+		m->flow[f] = -1;
+	}
+}
+
+
+static void host_jobs(struct nf2_sram_model *m) {
+	uint64_t ns = m->now * NF2_SRAM_CLOCK_NS;
+	struct nf2_sram_host_job *j;
+	int type;
+
+	while (m->next_sweep_ns <= ns || m->next_install_ns <= ns) {
+		type = m->next_sweep_ns <= m->next_install_ns ? NF2_SRAM_JOB_SWEEP
+			: NF2_SRAM_JOB_INSTALL;
+		if (m->num_jobs == NF2_SRAM_MAX_HOST_JOBS) {
+			m->stats.jobs_lost++;
+		} else {
+			j = &m->jobs[(m->job_head + m->num_jobs++) % NF2_SRAM_MAX_HOST_JOBS];
+			j->type = type;
+			j->arrive = ns;
+			j->words = type == NF2_SRAM_JOB_SWEEP ? NF2_SRAM_SWEEP_WORDS
+				: NF2_SRAM_INSTALL_WORDS;
+		}
+		if (type == NF2_SRAM_JOB_SWEEP)
+			m->next_sweep_ns += (uint64_t)(1e9 / m->cfg.sweep_rate);
+		else
+			m->next_install_ns += (uint64_t)(-log(unit(m)) * 1e9 / m->cfg.install_rate) + 1;
+	}
+}
+
+
+//
+// host: the host's register words, one at a time: issued, served in the
+//    register slot (and the counters cleared in the next one if it read
+//    them), acked REG_ACK_CYCLES later
+//
+static void host(struct nf2_sram_model *m, int c) {
+	struct nf2_sram_host_job *j;
+	uint64_t gap;
+
+	host_jobs(m);
+
+	if (!m->word_busy && m->num_jobs && m->now >= m->next_word) {
+		j = &m->jobs[m->job_head];
+		m->word_busy = 1;
+		m->word_issued = m->now;
+		m->word_ack = 0;
+		m->word_counter_read = j->type == NF2_SRAM_JOB_SWEEP;
+		return;
+	}
+	if (!m->word_busy)
+		return;
+
+	if (m->schedule[c] == NF2_SRAM_SLOT_REG && m->word_ack == 0 &&
+	    m->word_issued < m->now) {
+		m->word_ack = m->now + REG_ACK_CYCLES;
+		m->stats.slots[c]++;
+		m->stats.reg_used++;
+		nf2_hdr_record(&m->stats.word_wait_ns,
+			       (m->now - m->word_issued) * NF2_SRAM_CLOCK_NS);
+	} else if (m->schedule[c] == NF2_SRAM_SLOT_CLEAR && m->word_ack == m->now + REG_ACK_CYCLES - 1 &&
+		   m->word_counter_read) {
+		m->stats.slots[c]++;
+		m->stats.clears++;
+	} else if (m->word_ack && m->now >= m->word_ack) {
+		j = &m->jobs[m->job_head];
+		m->stats.host_words++;
+		m->word_busy = 0;
+		gap = (m->cfg.word_ns + NF2_SRAM_CLOCK_NS - 1) / NF2_SRAM_CLOCK_NS;
+		m->next_word = m->word_issued + gap > m->now ? m->word_issued + gap : m->now;
+		if (--j->words == 0) {
+			nf2_hdr_record(&m->stats.job_ns[j->type],
+				       m->now * NF2_SRAM_CLOCK_NS - j->arrive);
+			m->stats.jobs_done[j->type]++;
+			m->job_head = (m->job_head + 1) % NF2_SRAM_MAX_HOST_JOBS;
+			m->num_jobs--;
+		}
+	}
+}
+
+
+//
+// drain: opl_processor reads the head packet out of the input fifo, a
+//    word per cycle, once its result is in
+//
+static void drain(struct nf2_sram_model *m) {
+	struct nf2_sram_pkt *pkt;
+
+	if (m->pipe_head == m->pipe_tail)
+		return;
+	pkt = &m->pipe[m->pipe_head % NF2_SRAM_MAX_PIPE];
+	if (pkt->result == 0 || pkt->result > m->now || pkt->out == pkt->in)
+		return;
+	pkt->out++;
+	m->in_fifo--;
+	if (pkt->out < pkt->words)
+		return;
+	m->stats.out_pkts++;
+	m->stats.out_bytes += pkt->size;
+	nf2_hdr_record(&m->stats.pkt_ns, (m->now - pkt->arrive) * NF2_SRAM_CLOCK_NS);
+	m->pipe_head++;
+}
+
+
+//
+// intake: the input arbiter writes a word of the current packet, or
+//    starts the next port's, into the input fifo while in_rdy is up;
+//    header_parser writes the flow entry once the ports have passed
+//
+static void intake(struct nf2_sram_model *m) {
+	struct nf2_sram_pkt *pkt = NULL;
+	struct nf2_sram_rxq *q;
+	int i, p = 0;
+
+	if (!m->in_rdy || m->in_fifo == NF2_SRAM_IN_FIFO_WORDS)
+		return;
+	if (m->pipe_tail > m->pipe_head) {
+		pkt = &m->pipe[(m->pipe_tail - 1) % NF2_SRAM_MAX_PIPE];
+		if (pkt->in == pkt->words)
+			pkt = NULL;
+	}
+	if (pkt == NULL) {
+		if (m->pipe_tail - m->pipe_head == NF2_SRAM_MAX_PIPE)
+			return;
+		for (i = 0; i < m->cfg.num_ports; i++) {
+			p = (m->rr + i) % m->cfg.num_ports;
+			if (m->rxq[p].num)
+				break;
+		}
+		if (i == m->cfg.num_ports)
+			return;
+		q = &m->rxq[p];
+		m->rr = (p + 1) % m->cfg.num_ports;
+		pkt = &m->pipe[m->pipe_tail++ % NF2_SRAM_MAX_PIPE];
+		*pkt = q->pkts[q->head];
+		q->head = (q->head + 1) % q->cap;
+		q->num--;
+	}
+
+	pkt->in++;
+	m->in_fifo++;
+	if (pkt->in == pkt->words)
+		m->rxq[pkt->port].bytes -= pkt->size - FCS_BYTES;
+	if (pkt->in != NF2_SRAM_PARSE_WORDS)
+		return;
+
+	pkt->parsed = m->now + 1;
+	if (m->flow_num == NF2_SRAM_FLOW_FIFO) {
+		/* exact_match_rdy is tied high: the card would lose this flow
+		 * entry and pair the next result with this packet; the model
+		 * lets the packet through so the run goes on */
+		m->stats.flow_fifo_overruns++;
+		pkt->result = pkt->parsed;
+		return;
+	}
+	m->flow_fifo[(m->flow_head + m->flow_num++) % NF2_SRAM_FLOW_FIFO] = m->pipe_tail - 1;
+	if (m->flow_num > m->stats.max_flow_fifo)
+		m->stats.max_flow_fifo = m->flow_num;
+}
+
+
+void nf2_sram_model_run(struct nf2_sram_model *m, uint64_t cycles) {
+	uint64_t end = m->now + cycles;
+	int e, c;
+
+	for (; m->now < end; m->now++) {
+		e = m->now % NF2_SRAM_ROUND;
+		c = (e + NF2_SRAM_ROUND - EXACT_LAG) % NF2_SRAM_ROUND;
+		if (e == 0)
+			m->stats.rounds++;
+
+		arrivals(m);
+		exact_match(m, e, c);
+		host(m, c);
+		drain(m);
+		intake(m);
+
+		/* in_rdy is registered: it follows the fifo a cycle late */
+		m->in_rdy = m->in_fifo < NF2_SRAM_IN_FIFO_WORDS - 1;
+		nf2_hdr_record(&m->stats.in_fifo, m->in_fifo);
+	}
+	m->stats.cycles = m->now;
+	m->stats.jobs_left = m->num_jobs;
+}
+
+
+void nf2_sram_model_print_stats(const struct nf2_sram_model *m, FILE *f) {
+	const struct nf2_sram_stats *st = &m->stats;
+	const struct nf2_hdr *h;
+	uint64_t drops = 0, rounds = st->rounds ? st->rounds : 1;
+	int reads = 0, writes = 0, p, t;
+
+	for (p = 0; p < m->cfg.num_ports; p++)
+		drops += st->drops[p];
+	for (p = 0; p < NF2_SRAM_ROUND; p++) {
+		if (m->schedule[p] == NF2_SRAM_SLOT_READ)
+			reads++;
+		else if (m->schedule[p] == NF2_SRAM_SLOT_WRITE)
+			writes++;
+	}
+
+	fprintf(f, "simulated:      %.3f ms, %llu rounds of %d cycles\n",
+		st->cycles * NF2_SRAM_CLOCK_NS / 1e6, (unsigned long long)st->rounds,
+		NF2_SRAM_ROUND);
+	fprintf(f, "offered:        %.3f Mpps, %.3f Gb/s\n", per_sec(m, st->offered_pkts) / 1e6,
+		per_sec(m, st->offered_bytes) * 8 / 1e9);
+	fprintf(f, "forwarded:      %.3f Mpps, %.3f Gb/s\n", per_sec(m, st->out_pkts) / 1e6,
+		per_sec(m, st->out_bytes) * 8 / 1e9);
+	fprintf(f, "lookups:        %.3f M/s of %.3f M/s (%.1f%% of the flow slots)\n",
+		per_sec(m, st->lookups) / 1e6, nf2_sram_model_lookup_capacity() / 1e6,
+		pct(st->lookups, rounds * NF2_SRAM_FLOWS_PER_ROUND));
+	fprintf(f, "dropped:        %llu (%.2f%%):", (unsigned long long)drops,
+		pct(drops, st->offered_pkts));
+	for (p = 0; p < m->cfg.num_ports; p++)
+		fprintf(f, " port %d %llu", p, (unsigned long long)st->drops[p]);
+	fprintf(f, "\nrx queue max:  ");
+	for (p = 0; p < m->cfg.num_ports; p++)
+		fprintf(f, " %u", st->max_rx_queue_bytes[p]);
+	fprintf(f, " of %u bytes\n", m->cfg.rx_queue_bytes);
+	h = &st->in_fifo;
+	fprintf(f, "input fifo:     p50 %llu, p99 %llu, max %llu of %d words\n",
+		(unsigned long long)nf2_hdr_value_at(h, 50),
+		(unsigned long long)nf2_hdr_value_at(h, 99), (unsigned long long)h->max,
+		NF2_SRAM_IN_FIFO_WORDS);
+	fprintf(f, "flow fifo:      max %d of %d, %llu overruns\n", st->max_flow_fifo,
+		NF2_SRAM_FLOW_FIFO, (unsigned long long)st->flow_fifo_overruns);
+	h = &st->lookup_ns;
+	fprintf(f, "lookup ns:      p50 %llu, p99 %llu, max %llu\n",
+		(unsigned long long)nf2_hdr_value_at(h, 50),
+		(unsigned long long)nf2_hdr_value_at(h, 99), (unsigned long long)h->max);
+	h = &st->pkt_ns;
+	fprintf(f, "packet ns:      p50 %llu, p99 %llu, max %llu\n",
+		(unsigned long long)nf2_hdr_value_at(h, 50),
+		(unsigned long long)nf2_hdr_value_at(h, 99), (unsigned long long)h->max);
+
+	fprintf(f, "slots/round:    reads %.1f of %d, writes %.2f of %d, register %.3f of 1, "
+		"clear %.3f of 1\n", (double)st->reads_used / rounds, reads,
+		(double)st->writes_used / rounds, writes, (double)st->reg_used / rounds,
+		(double)st->clears / rounds);
+	fprintf(f, "host words:     %.3f M/s of %.3f M/s (register slot %.1f%% busy), "
+		"wait p50 %llu ns, p99 %llu ns\n", per_sec(m, st->host_words) / 1e6,
+		1e3 / (NF2_SRAM_ROUND * NF2_SRAM_CLOCK_NS), pct(st->reg_used, rounds),
+		(unsigned long long)nf2_hdr_value_at(&st->word_wait_ns, 50),
+		(unsigned long long)nf2_hdr_value_at(&st->word_wait_ns, 99));
+	for (t = 0; t < NF2_SRAM_JOBS; t++) {
+		h = &st->job_ns[t];
+		if (h->total == 0)
+			continue;
+		fprintf(f, "host %-8s   %.0f/s done, us p50 %.1f, p99 %.1f, max %.1f\n",
+			job_names[t], per_sec(m, st->jobs_done[t]),
+			nf2_hdr_value_at(h, 50) / 1e3, nf2_hdr_value_at(h, 99) / 1e3, h->max / 1e3);
+	}
+	if (st->jobs_left || st->jobs_lost)
+		fprintf(f, "host backlog:   %llu jobs queued at the end, %llu lost\n",
+			(unsigned long long)st->jobs_left, (unsigned long long)st->jobs_lost);
+}
@@ -0,0 +1,216 @@
+/* ****************************************************************************
+ * Module: nf2_sram_model.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Cycle level model of the SRAM slot schedule of
+ *              src/sram/sram_arbiter.v, the lookups exact_match.v runs in
+ *              it and the host register accesses it serves.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_SRAM_MODEL_H_
+#define NF2_SRAM_MODEL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "nf2_of_hw.h"
+#include "nf2_hdr.h"
+
+#define NF2_SRAM_CLOCK_NS	8	/* 125 MHz core clock */
+#define NF2_SRAM_ROUND		32	/* cycles of the arbiter's schedule */
+#define NF2_SRAM_FLOWS_PER_ROUND	2	/* exact_match's flow 0 and flow 1 */
+
+#define NF2_SRAM_MAX_PORTS	4	/* MAC ports */
+#define NF2_SRAM_MAX_SIZES	8
+#define NF2_SRAM_LINE_NS_PER_BYTE	8	/* 1 Gb/s */
+#define NF2_SRAM_WIRE_OVERHEAD	20	/* preamble and inter-frame gap, bytes */
+
+/* output_port_lookup's input_fifo (MAX_DEPTH_BITS 4); in_rdy drops when
+ * it holds one word short of that */
+#define NF2_SRAM_IN_FIFO_WORDS	16
+#define NF2_SRAM_FLOW_FIFO	4	/* exact_match's flow_entry_fifo */
+#define NF2_SRAM_PARSE_WORDS	6	/* module header and Eth, IP, TCP ports */
+#define NF2_SRAM_MAX_PIPE	64	/* packets between rx queue and out */
+
+/* Host register words of an exact flow install and of a counter read */
+#define NF2_SRAM_INSTALL_WORDS \
+	(NF2_OF_ENTRY_WORD_LEN + NF2_OF_EXACT_COUNTERS_WORD_LEN + NF2_OF_ACTION_WORD_LEN)
+#define NF2_SRAM_SWEEP_WORDS	NF2_OF_EXACT_COUNTERS_WORD_LEN
+#define NF2_SRAM_MAX_HOST_JOBS	65536
+
+/* What sram_arbiter does with the SRAM at each value of its counter */
+enum nf2_sram_slot {
+	NF2_SRAM_SLOT_READ,		/* rd_0: exact_match's reads */
+	NF2_SRAM_SLOT_WRITE,		/* wr_0: exact_match's counter write-back */
+	NF2_SRAM_SLOT_REG,		/* one host register word */
+	NF2_SRAM_SLOT_CLEAR,		/* clear of the counters the host read */
+};
+
+enum nf2_sram_job {
+	NF2_SRAM_JOB_SWEEP,		/* read (and clear) an entry's counters */
+	NF2_SRAM_JOB_INSTALL,		/* write an exact entry */
+	NF2_SRAM_JOBS
+};
+
+struct nf2_sram_cfg {
+	int num_ports;
+	double load[NF2_SRAM_MAX_PORTS];	/* share of the line rate offered */
+	int num_sizes;
+	int sizes[NF2_SRAM_MAX_SIZES];	/* frame bytes, without the FCS */
+	double weights[NF2_SRAM_MAX_SIZES];
+	unsigned rx_queue_bytes;	/* per port, ahead of the pipeline */
+
+	double sweep_rate;		/* exact entries the host reads per second */
+	double install_rate;		/* exact flows it installs per second */
+	unsigned word_ns;		/* least time per register word on PCI */
+	unsigned seed;
+};
+
+struct nf2_sram_stats {
+	uint64_t cycles;
+	uint64_t rounds;
+
+	/* packets */
+	uint64_t offered_pkts;
+	uint64_t offered_bytes;
+	uint64_t drops[NF2_SRAM_MAX_PORTS];	/* rx queue full */
+	uint64_t out_pkts;
+	uint64_t out_bytes;
+	uint64_t lookups;
+	uint64_t flow_fifo_overruns;	/* flow entry written to a full fifo */
+	unsigned max_rx_queue_bytes[NF2_SRAM_MAX_PORTS];
+	int max_flow_fifo;
+	struct nf2_hdr in_fifo;		/* words, sampled every cycle */
+	struct nf2_hdr lookup_ns;	/* flow entry written to result */
+	struct nf2_hdr pkt_ns;		/* arrival to last word out */
+
+	/* SRAM slots */
+	uint64_t slots[NF2_SRAM_ROUND];	/* per counter value, used */
+	uint64_t reads_used;
+	uint64_t writes_used;
+	uint64_t reg_used;
+	uint64_t clears;
+
+	/* host */
+	uint64_t host_words;
+	uint64_t jobs_done[NF2_SRAM_JOBS];
+	uint64_t jobs_lost;		/* arrived to a full job queue */
+	uint64_t jobs_left;		/* queued at the end */
+	struct nf2_hdr job_ns[NF2_SRAM_JOBS];	/* arrival to last word acked */
+	struct nf2_hdr word_wait_ns;	/* word issued to its slot */
+};
+
+struct nf2_sram_pkt {
+	uint64_t arrive;		/* cycle its last byte arrived */
+	int port;
+	int size;
+	int words;			/* in the pipeline, with the module header */
+	int in;				/* words written to the input fifo */
+	int out;			/* words read out of it */
+	uint64_t parsed;		/* cycle its flow entry was written */
+	uint64_t result;		/* cycle its result reaches opl_processor,
+					 * 0 until known */
+};
+
+struct nf2_sram_rxq {
+	struct nf2_sram_pkt *pkts;
+	int cap, head, num;
+	unsigned bytes;
+	uint64_t next_ns;		/* of the next arrival's last byte */
+	int next_size;
+};
+
+struct nf2_sram_host_job {
+	uint64_t arrive;
+	int type;
+	int words;			/* left */
+};
+
+/*
+ * The model runs the pipeline one core clock at a time against the
+ * fixed 32 cycle schedule of sram_arbiter:
+ *
+ *   counter  0..21  read          22  write (wr_0)
+ *           23      register      24  clear if the register access
+ *                                     was a counter read
+ *           25..30  read (rd_0_ack at 29)    31  write (wr_0)
+ *
+ * exact_match waits for rd_0_ack and from then on runs its own 32 cycle
+ * loop two cycles behind the counter: at its cycle 1 it takes flow 0
+ * from flow_entry_fifo and at cycle 9 flow 1, if there is one, reads 4
+ * header words from each of the two hash slots of each flow, then the
+ * counter word and the 5 action words of the one that matched, and
+ * writes the counters back. Flow 0's result is valid at cycle 28 and
+ * flow 1's at cycle 5 of the next loop, so at most two lookups finish
+ * per round whatever the load, and a flow entry that misses cycle 9
+ * waits for cycle 1. The host's register accesses take the register
+ * slot and the clear slot, which no lookup uses: they cannot take read
+ * or write slots from the lookups, only each other's.
+ *
+ * Packets arrive at the ports at the configured share of 1 Gb/s, with
+ * random gaps and sizes from the mix, wait in a per port rx queue
+ * (dropped if it is full), and are moved one word per cycle, port by
+ * port, into output_port_lookup's 16 word input_fifo while in_rdy is
+ * up. header_parser writes the flow entry once the TCP/UDP ports have
+ * passed; opl_processor reads the packet out, one word per cycle, once
+ * its result is in, so a packet's words and the next packets' headers
+ * wait in the input fifo for the lookup. Every flow is taken to hit
+ * (its counters are written back), the wildcard lookup to be done in
+ * time and the output queues to take every word.
+ *
+ * The host issues its register words one at a time: a counter read of
+ * NF2_SRAM_SWEEP_WORDS words per swept entry, at even intervals, and an
+ * install of NF2_SRAM_INSTALL_WORDS words per flow, at random times. A
+ * word waits for the register slot and its ack (sram_reg_ack, 4 cycles
+ * later), and the next one goes no sooner than word_ns after it.
+ */
+struct nf2_sram_model {
+	struct nf2_sram_cfg cfg;
+	enum nf2_sram_slot schedule[NF2_SRAM_ROUND];
+	uint64_t now;			/* cycles */
+	uint32_t rand;
+
+	struct nf2_sram_rxq rxq[NF2_SRAM_MAX_PORTS];
+	int rr;				/* input arbiter's next port */
+
+	struct nf2_sram_pkt pipe[NF2_SRAM_MAX_PIPE];	/* in order */
+	uint64_t pipe_head, pipe_tail;	/* sequence numbers */
+	int in_fifo;			/* words */
+	int in_rdy;
+
+	uint64_t flow_fifo[NF2_SRAM_FLOW_FIFO];
+	int flow_head, flow_num;
+	int64_t flow[NF2_SRAM_FLOWS_PER_ROUND];	/* pipe sequence, or -1 */
+	int64_t flow_done;		/* whose result is on its way, or -1 */
+
+	struct nf2_sram_host_job *jobs;
+	int job_head, num_jobs;
+	uint64_t next_sweep_ns, next_install_ns;
+	int word_busy;			/* a word waits for its slot or ack */
+	int word_counter_read;
+	uint64_t word_issued, word_ack, next_word;
+
+	struct nf2_sram_stats stats;
+};
+
+/* Sets cfg to 4 ports at line rate of the given mix, no host accesses */
+void nf2_sram_model_defaults(struct nf2_sram_cfg *);
+
+/* Parses a size mix, "64:7,576:4,1500:1" (IMIX) or "64"; returns 0 or -1 */
+int nf2_sram_model_parse_mix(struct nf2_sram_cfg *, const char *);
+
+/* Returns 0 or -1 if out of memory */
+int nf2_sram_model_init(struct nf2_sram_model *, const struct nf2_sram_cfg *);
+void nf2_sram_model_free(struct nf2_sram_model *);
+
+/* Runs for the given number of cycles */
+void nf2_sram_model_run(struct nf2_sram_model *, uint64_t cycles);
+
+/* Lookups per second the schedule allows, at most */
+double nf2_sram_model_lookup_capacity(void);
+
+void nf2_sram_model_print_stats(const struct nf2_sram_model *, FILE *);
+
+#endif
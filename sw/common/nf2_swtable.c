@@ -0,0 +1,358 @@
+/* ****************************************************************************
+ * Module: nf2_swtable.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host table of the exact flows forwarded in software, for
+ *              the flows that do not fit in the card's tables.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nf2_hash.h"
+#include "nf2_swtable.h"
+
+/* entries hashed and prefetched together by nf2_swtable_lookup_batch */
+#define LOOKUP_CHUNK	64
+
+struct kick {
+	uint32_t bucket;
+	int way;
+	int32_t flow;
+	uint32_t sig;
+};
+
+
+static inline uint32_t make_sig(uint32_t crc_0, uint32_t crc_1) {
+	return crc_0 ^ ((crc_1 << 16) | (crc_1 >> 16));
+}
+
+
+//
+// same_flow: the bytes the hardware compares; the pad byte holds the
+//    valid bit
+//
+static inline int same_flow(const nf2_of_entry_wrap *a, const nf2_of_entry_wrap *b) {
+	uint32_t d = 0;
+	int i;
+
+	for (i = 0; i < NF2_OF_ENTRY_WORD_LEN - 1; i++)
+		d |= a->raw[i] ^ b->raw[i];
+	d |= (a->raw[NF2_OF_ENTRY_WORD_LEN - 1] ^ b->raw[NF2_OF_ENTRY_WORD_LEN - 1]) & 0x00ffffff;
+	return d == 0;
+}
+
+
+static uint32_t rnd(struct nf2_swtable *t) {
+	uint64_t z = (t->rng += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return (z ^ (z >> 31)) >> 32;
+}
+
+
+static void hash(const struct nf2_swtable *t, const nf2_of_entry_wrap *entry,
+		 uint32_t *bucket, uint32_t *sig) {
+	uint32_t crc_0, crc_1;
+
+	nf2_hash_crc_batch(entry, 1, &crc_0, &crc_1);
+	bucket[0] = crc_0 & t->mask;
+	bucket[1] = crc_1 & t->mask;
+	*sig = make_sig(crc_0, crc_1);
+}
+
+
+//
+// find_way: the bucket and way of a flow, or -1
+//
+static int find_way(const struct nf2_swtable *t, const nf2_of_entry_wrap *entry,
+		    const uint32_t *bucket, uint32_t sig, uint32_t *b_found) {
+	const struct nf2_swtable_bucket *b;
+	int i, w;
+
+	for (i = 0; i < 2; i++) {
+		b = &t->buckets[bucket[i]];
+		for (w = 0; w < NF2_SWTABLE_WAYS; w++) {
+			if (b->flow[w] >= 0 && b->sig[w] == sig &&
+			    same_flow(&t->flows[b->flow[w]].entry, entry)) {
+				*b_found = bucket[i];
+				return w;
+			}
+		}
+	}
+	return -1;
+}
+
+
+static int free_way(const struct nf2_swtable_bucket *b) {
+	int w;
+
+	for (w = 0; w < NF2_SWTABLE_WAYS; w++) {
+		if (b->flow[w] < 0)
+			return w;
+	}
+	return -1;
+}
+
+
+//
+// place: puts a flow in one of its buckets, moving others along a random
+//    walk if both are full. The walk is undone if it does not end in a
+//    free way within NF2_SWTABLE_MAX_KICKS moves.
+//
+static int place(struct nf2_swtable *t, int32_t flow, uint32_t sig) {
+	struct kick path[NF2_SWTABLE_MAX_KICKS];
+	struct nf2_swtable_bucket *b;
+	uint32_t cur_b;
+	int i, k, w;
+
+	for (i = 0; i < 2; i++) {
+		b = &t->buckets[t->flows[flow].bucket[i]];
+		w = free_way(b);
+		if (w >= 0) {
+			b->flow[w] = flow;
+			b->sig[w] = sig;
+			return 0;
+		}
+	}
+
+	cur_b = t->flows[flow].bucket[rnd(t) & 1];
+	for (k = 0; k < NF2_SWTABLE_MAX_KICKS; k++) {
+		b = &t->buckets[cur_b];
+		w = rnd(t) % NF2_SWTABLE_WAYS;
+		path[k].bucket = cur_b;
+		path[k].way = w;
+		path[k].flow = b->flow[w];
+		path[k].sig = b->sig[w];
+		b->flow[w] = flow;
+		b->sig[w] = sig;
+
+		/* the flow moved out goes to its other bucket */
+		flow = path[k].flow;
+		sig = path[k].sig;
+		cur_b = t->flows[flow].bucket[0] == cur_b ? t->flows[flow].bucket[1] :
+							    t->flows[flow].bucket[0];
+		b = &t->buckets[cur_b];
+		w = free_way(b);
+		if (w >= 0) {
+			b->flow[w] = flow;
+			b->sig[w] = sig;
+			t->stats.moves += k + 1;
+			return 0;
+		}
+	}
+
+	for (k = NF2_SWTABLE_MAX_KICKS - 1; k >= 0; k--) {
+		b = &t->buckets[path[k].bucket];
+		b->flow[path[k].way] = path[k].flow;
+		b->sig[path[k].way] = path[k].sig;
+	}
+	return -1;
+}
+
+
+int nf2_swtable_init(struct nf2_swtable *t, int max_flows) {
+	uint32_t num_buckets = 1, i;
+	int w;
+
+	memset(t, 0, sizeof(*t));
+	if (max_flows <= 0)
+		return -1;
+	while (num_buckets * NF2_SWTABLE_WAYS * 3 / 4 < (uint32_t)max_flows)
+		num_buckets <<= 1;
+
+	t->mask = num_buckets - 1;
+	t->max_flows = max_flows;
+	t->rng = 1;
+	/* a bucket within one cache line */
+	if (posix_memalign((void **)&t->buckets, 64, num_buckets * sizeof(*t->buckets)))
+		t->buckets = NULL;
+	t->flows = malloc((size_t)max_flows * sizeof(*t->flows));
+	t->free_list = malloc(max_flows * sizeof(*t->free_list));
+	if (t->buckets == NULL || t->flows == NULL || t->free_list == NULL) {
+		nf2_swtable_free(t);
+		return -1;
+	}
+	for (i = 0; i < num_buckets; i++) {
+		for (w = 0; w < NF2_SWTABLE_WAYS; w++) {
+			t->buckets[i].sig[w] = 0;
+			t->buckets[i].flow[w] = -1;
+		}
+	}
+	memset(t->flows, 0, (size_t)max_flows * sizeof(*t->flows));
+	/* handed out from index 0 up */
+	for (w = 0; w < max_flows; w++)
+		t->free_list[w] = max_flows - 1 - w;
+	t->num_free = max_flows;
+
+	nf2_hash_init();
+	return 0;
+}
+
+
+void nf2_swtable_free(struct nf2_swtable *t) {
+	free(t->buckets);
+	free(t->flows);
+	free(t->free_list);
+	t->buckets = NULL;
+	t->flows = NULL;
+	t->free_list = NULL;
+}
+
+
+int nf2_swtable_insert(struct nf2_swtable *t, const nf2_of_entry_wrap *entry,
+		       const nf2_of_action_wrap *action) {
+	struct nf2_swtable_flow *f;
+	uint32_t bucket[2], sig, b;
+	int32_t idx;
+	int w;
+
+	hash(t, entry, bucket, &sig);
+	w = find_way(t, entry, bucket, sig, &b);
+	if (w >= 0) {
+		f = &t->flows[t->buckets[b].flow[w]];
+		f->action = *action;
+		nf2_action_compile(action, &f->plan);
+		t->stats.updates++;
+		return t->buckets[b].flow[w];
+	}
+	if (t->num_free == 0) {
+		t->stats.failures++;
+		return -1;
+	}
+
+	idx = t->free_list[--t->num_free];
+	f = &t->flows[idx];
+	memset(f, 0, sizeof(*f));
+	f->entry = *entry;
+	f->entry.entry.pad = 0;
+	f->action = *action;
+	nf2_action_compile(action, &f->plan);
+	f->bucket[0] = bucket[0];
+	f->bucket[1] = bucket[1];
+	if (place(t, idx, sig)) {
+		t->free_list[t->num_free++] = idx;
+		t->stats.failures++;
+		return -1;
+	}
+	t->used++;
+	t->stats.inserts++;
+	return idx;
+}
+
+
+int nf2_swtable_delete(struct nf2_swtable *t, const nf2_of_entry_wrap *entry) {
+	uint32_t bucket[2], sig, b;
+	int32_t idx;
+	int w;
+
+	hash(t, entry, bucket, &sig);
+	w = find_way(t, entry, bucket, sig, &b);
+	if (w < 0)
+		return -1;
+	idx = t->buckets[b].flow[w];
+	t->buckets[b].flow[w] = -1;
+	t->buckets[b].sig[w] = 0;
+	t->free_list[t->num_free++] = idx;
+	t->used--;
+	t->stats.deletes++;
+	return idx;
+}
+
+
+int nf2_swtable_find(struct nf2_swtable *t, const nf2_of_entry_wrap *entry) {
+	uint32_t bucket[2], sig, b;
+	int w;
+
+	hash(t, entry, bucket, &sig);
+	w = find_way(t, entry, bucket, sig, &b);
+	return w < 0 ? -1 : t->buckets[b].flow[w];
+}
+
+
+//
+// candidate: the first flow of the two buckets with the signature, or -1
+//
+static inline int32_t candidate(const struct nf2_swtable *t, uint32_t b0, uint32_t b1,
+				uint32_t sig) {
+	const struct nf2_swtable_bucket *b;
+	int w;
+
+	b = &t->buckets[b0];
+	for (w = 0; w < NF2_SWTABLE_WAYS; w++) {
+		if (b->sig[w] == sig && b->flow[w] >= 0)
+			return b->flow[w];
+	}
+	b = &t->buckets[b1];
+	for (w = 0; w < NF2_SWTABLE_WAYS; w++) {
+		if (b->sig[w] == sig && b->flow[w] >= 0)
+			return b->flow[w];
+	}
+	return -1;
+}
+
+
+void nf2_swtable_lookup_batch(struct nf2_swtable *t, const nf2_of_entry_wrap *keys,
+			      const uint32_t *size, int n, int *flows) {
+	uint32_t crc_0[LOOKUP_CHUNK], crc_1[LOOKUP_CHUNK], sig[LOOKUP_CHUNK];
+	uint32_t bucket[2];
+	struct nf2_swtable_flow *f;
+	int base, m, i, w;
+	uint32_t b;
+
+	for (base = 0; base < n; base += LOOKUP_CHUNK) {
+		m = n - base < LOOKUP_CHUNK ? n - base : LOOKUP_CHUNK;
+
+		nf2_hash_crc_batch(keys + base, m, crc_0, crc_1);
+		for (i = 0; i < m; i++) {
+			sig[i] = make_sig(crc_0[i], crc_1[i]);
+			crc_0[i] &= t->mask;
+			crc_1[i] &= t->mask;
+			__builtin_prefetch(&t->buckets[crc_0[i]]);
+			__builtin_prefetch(&t->buckets[crc_1[i]]);
+		}
+		for (i = 0; i < m; i++) {
+			flows[base + i] = candidate(t, crc_0[i], crc_1[i], sig[i]);
+			if (flows[base + i] >= 0)
+				__builtin_prefetch(&t->flows[flows[base + i]]);
+		}
+		for (i = 0; i < m; i++) {
+			if (flows[base + i] < 0)
+				continue;
+			if (!same_flow(&t->flows[flows[base + i]].entry, &keys[base + i])) {
+				/* another flow with the signature: look at every way */
+				bucket[0] = crc_0[i];
+				bucket[1] = crc_1[i];
+				w = find_way(t, &keys[base + i], bucket, sig[i], &b);
+				flows[base + i] = w < 0 ? -1 : t->buckets[b].flow[w];
+				if (w < 0)
+					continue;
+			}
+			f = &t->flows[flows[base + i]];
+			f->pkts++;
+			f->bytes += size[base + i];
+			t->stats.hits++;
+		}
+	}
+	t->stats.lookups += n;
+}
+
+
+void nf2_swtable_print_stats(struct nf2_swtable *t, FILE *out) {
+	struct nf2_swtable_stats *st = &t->stats;
+
+	fprintf(out, "flows:        %d/%d in %u buckets of %d (load %.1f%%)\n", t->used,
+		t->max_flows, t->mask + 1, NF2_SWTABLE_WAYS,
+		100.0 * t->used / ((t->mask + 1) * NF2_SWTABLE_WAYS));
+	fprintf(out, "inserts:      %lu (updates %lu, deletes %lu)\n",
+		st->inserts, st->updates, st->deletes);
+	fprintf(out, "failures:     %lu (no free way within %d moves)\n",
+		st->failures, NF2_SWTABLE_MAX_KICKS);
+	fprintf(out, "moves:        %lu\n", st->moves);
+	fprintf(out, "lookups:      %llu (hits %llu)\n", (unsigned long long)st->lookups,
+		(unsigned long long)st->hits);
+}
@@ -0,0 +1,93 @@
+/* ****************************************************************************
+ * Module: nf2_swtable.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host table of the exact flows forwarded in software, for
+ *              the flows that do not fit in the card's tables.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_SWTABLE_H_
+#define NF2_SWTABLE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "nf2_action.h"
+
+#define NF2_SWTABLE_WAYS	4	/* flows per bucket */
+#define NF2_SWTABLE_MAX_KICKS	256
+
+struct nf2_swtable_flow {
+	nf2_of_entry_wrap entry;
+	nf2_of_action_wrap action;
+	struct nf2_action_plan plan;	/* the action, compiled */
+	uint32_t bucket[2];
+	uint64_t pkts;
+	uint64_t bytes;
+};
+
+/* signatures and flow indices of NF2_SWTABLE_WAYS flows: half a cache
+ * line; a flow index of -1 is a free way */
+struct nf2_swtable_bucket {
+	uint32_t sig[NF2_SWTABLE_WAYS];
+	int32_t flow[NF2_SWTABLE_WAYS];
+};
+
+struct nf2_swtable_stats {
+	unsigned long inserts;
+	unsigned long updates;		/* insert of a flow already present */
+	unsigned long deletes;
+	unsigned long failures;		/* no free way within NF2_SWTABLE_MAX_KICKS moves */
+	unsigned long moves;		/* flows relocated to their other bucket */
+	uint64_t lookups;
+	uint64_t hits;
+};
+
+/*
+ * Bucketized cuckoo hash of exact flows: a flow lives in one of the two
+ * buckets picked by the header_hash CRCs of its entry (the whole CRCs,
+ * not the card's 15-bit indices), so the table holds any number of flows
+ * and a lookup reads at most two buckets. Inserts that find both buckets
+ * full move flows to their other bucket along a random walk of at most
+ * NF2_SWTABLE_MAX_KICKS moves, undone if it ends without a free way.
+ *
+ * The flows are kept apart from the buckets, by index, with the action
+ * compiled for nf2_action_apply and per flow counters that count as the
+ * card's do: packets and header_parser's packet size.
+ */
+struct nf2_swtable {
+	struct nf2_swtable_bucket *buckets;
+	uint32_t mask;			/* buckets - 1 */
+	struct nf2_swtable_flow *flows;
+	int max_flows;
+	int used;
+	int32_t *free_list;
+	int num_free;
+	uint64_t rng;
+	struct nf2_swtable_stats stats;
+};
+
+/* Room for max_flows flows, at a load of at most 3/4 of the ways */
+int nf2_swtable_init(struct nf2_swtable *, int max_flows);
+void nf2_swtable_free(struct nf2_swtable *);
+
+/* Return the flow index, or -1 if the table is full (insert) or the flow
+ * is not in it (delete, find) */
+int nf2_swtable_insert(struct nf2_swtable *, const nf2_of_entry_wrap *,
+		       const nf2_of_action_wrap *);
+int nf2_swtable_delete(struct nf2_swtable *, const nf2_of_entry_wrap *);
+int nf2_swtable_find(struct nf2_swtable *, const nf2_of_entry_wrap *);
+
+/*
+ * Looks up n entries: hashes them together, prefetches their buckets and
+ * then their candidate flows before comparing any. flows[i] is the flow
+ * index or -1; the counters of the flows found are updated with size[i].
+ */
+void nf2_swtable_lookup_batch(struct nf2_swtable *, const nf2_of_entry_wrap *keys,
+			      const uint32_t *size, int n, int *flows);
+
+void nf2_swtable_print_stats(struct nf2_swtable *, FILE *);
+
+#endif
@@ -0,0 +1,289 @@
+/* ****************************************************************************
+ * Module: nf2_tablesnap.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Mapped image of the flow tables, to restore them after a
+ *              watchdog flush or a card reset.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "nf2_hash.h"
+#include "nf2_tablesnap.h"
+
+/* a restore writes header, counters and actions of an entry as one block */
+#if OPENFLOW_EXACT_ENTRY_COUNTERS_POS != OPENFLOW_EXACT_ENTRY_HDR_BASE_POS + NF2_OF_ENTRY_WORD_LEN || \
+    OPENFLOW_EXACT_ENTRY_ACTION_BASE_POS != OPENFLOW_EXACT_ENTRY_COUNTERS_POS + NF2_OF_EXACT_COUNTERS_WORD_LEN
+#error "exact entry words are not contiguous"
+#endif
+#define BLOCK_WORDS	(NF2_OF_ENTRY_WORD_LEN + NF2_OF_EXACT_COUNTERS_WORD_LEN + \
+			 NF2_OF_ACTION_WORD_LEN)
+
+/* reads of a record being written, yielding in between, before it counts
+ * as torn (its writer may have died in the middle) */
+#define READ_TRIES	1000
+
+
+static void init_hdr(struct nf2_tablesnap_hdr *hdr) {
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = NF2_TABLESNAP_MAGIC;
+	hdr->version = NF2_TABLESNAP_VERSION;
+	hdr->hdr_size = sizeof(struct nf2_tablesnap_hdr);
+	hdr->exact_size = OPENFLOW_NF2_EXACT_TABLE_SIZE;
+	hdr->exact_rec_size = sizeof(struct nf2_tablesnap_exact);
+	hdr->wildcard_size = OPENFLOW_WILDCARD_TABLE_SIZE;
+	hdr->wildcard_rec_size = sizeof(struct nf2_tablesnap_wildcard);
+}
+
+
+int nf2_tablesnap_open(struct nf2_tablesnap *s, const char *path) {
+	struct nf2_tablesnap_hdr hdr;
+	struct stat st;
+	void *p;
+
+	s->file = NULL;
+	s->fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (s->fd < 0 || fstat(s->fd, &st) < 0) {
+		perror(path);
+		goto err;
+	}
+	if (st.st_size != 0 && st.st_size != sizeof(*s->file)) {
+		fprintf(stderr, "%s: not a flow table image of this layout\n", path);
+		goto err;
+	}
+	if (st.st_size == 0 && ftruncate(s->fd, sizeof(*s->file)) < 0) {
+		perror(path);
+		goto err;
+	}
+
+	p = mmap(NULL, sizeof(*s->file), PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		goto err;
+	}
+	s->file = p;
+
+	init_hdr(&hdr);
+	if (st.st_size == 0) {
+		hdr.magic = 0;
+		s->file->hdr = hdr;
+		__atomic_store_n(&s->file->hdr.magic, NF2_TABLESNAP_MAGIC, __ATOMIC_RELEASE);
+	}
+	else if (memcmp(&s->file->hdr, &hdr, sizeof(hdr))) {
+		fprintf(stderr, "%s: not a flow table image of this layout\n", path);
+		goto err;
+	}
+	return 0;
+
+err:
+	nf2_tablesnap_close(s);
+	return -1;
+}
+
+
+void nf2_tablesnap_close(struct nf2_tablesnap *s) {
+	if (s->file != NULL)
+		munmap(s->file, sizeof(*s->file));
+	if (s->fd >= 0)
+		close(s->fd);
+	s->file = NULL;
+	s->fd = -1;
+}
+
+
+static void begin(uint32_t *gen) {
+	__atomic_store_n(gen, *gen + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+static void end(uint32_t *gen) {
+	__atomic_store_n(gen, *gen + 1, __ATOMIC_RELEASE);
+}
+
+
+void nf2_tablesnap_exact(struct nf2_tablesnap *s, int index, const nf2_of_entry_wrap *entry,
+			 const nf2_of_action_wrap *action) {
+	struct nf2_tablesnap_exact *r = &s->file->exact[index];
+
+	begin(&r->gen);
+	if (entry != NULL) {
+		r->entry = *entry;
+		r->action = *action;
+	}
+	r->used = entry != NULL;
+	end(&r->gen);
+}
+
+
+void nf2_tablesnap_wildcard(struct nf2_tablesnap *s, int index, const nf2_of_entry_wrap *entry,
+			    const nf2_of_mask_wrap *mask, const nf2_of_action_wrap *action,
+			    uint16_t priority) {
+	struct nf2_tablesnap_wildcard *r = &s->file->wildcard[index];
+
+	begin(&r->gen);
+	if (entry != NULL) {
+		r->entry = *entry;
+		r->mask = *mask;
+		r->action = *action;
+		r->priority = priority;
+	}
+	r->used = entry != NULL;
+	end(&r->gen);
+}
+
+
+//
+// read_exact: copy a record, unless it is being written. Returns 0 if
+//    the copy is whole.
+//
+static int read_exact(const struct nf2_tablesnap_exact *r, struct nf2_tablesnap_exact *copy) {
+	uint32_t gen;
+	int tries;
+
+	for (tries = 0; tries < READ_TRIES; tries++) {
+		if (tries)
+			sched_yield();
+		gen = __atomic_load_n(&r->gen, __ATOMIC_ACQUIRE);
+		*copy = *r;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (!(gen & 1) && gen == __atomic_load_n(&r->gen, __ATOMIC_RELAXED))
+			return 0;
+	}
+	return 1;
+}
+
+
+static int read_wildcard(const struct nf2_tablesnap_wildcard *r,
+			 struct nf2_tablesnap_wildcard *copy) {
+	uint32_t gen;
+	int tries;
+
+	for (tries = 0; tries < READ_TRIES; tries++) {
+		if (tries)
+			sched_yield();
+		gen = __atomic_load_n(&r->gen, __ATOMIC_ACQUIRE);
+		*copy = *r;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (!(gen & 1) && gen == __atomic_load_n(&r->gen, __ATOMIC_RELAXED))
+			return 0;
+	}
+	return 1;
+}
+
+
+int nf2_tablesnap_restore(struct nf2_tablesnap *s, struct nf2_regio *io, uint32_t timer,
+			  struct nf2_tablesnap_stats *stats) {
+	struct nf2_tablesnap_exact e;
+	struct nf2_tablesnap_wildcard w;
+	struct nf2_of_wildcard_stage stage;
+	struct timespec t0, t1;
+	uint32_t block[BLOCK_WORDS];
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	/* the counters of every entry start at zero, last seen now */
+	block[NF2_OF_ENTRY_WORD_LEN] = (timer & NF2_EXACT_LAST_SEEN_MASK) <<
+				       OPENFLOW_EXACT_ENTRY_LAST_SEEN_POS;
+	block[NF2_OF_ENTRY_WORD_LEN + 1] = 0;
+	for (i = 0; i < OPENFLOW_NF2_EXACT_TABLE_SIZE; i++) {
+		if (!s->file->exact[i].used)
+			continue;
+		if (read_exact(&s->file->exact[i], &e)) {
+			stats->torn++;
+			continue;
+		}
+		if (!e.used)
+			continue;
+
+		memcpy(block, e.entry.raw, sizeof(e.entry.raw));
+		block[NF2_OF_ENTRY_WORD_LEN - 1] |= NF2_EXACT_VALID_BIT;
+		memcpy(block + NF2_OF_ENTRY_WORD_LEN + NF2_OF_EXACT_COUNTERS_WORD_LEN,
+		       e.action.raw, sizeof(e.action.raw));
+		if (nf2_regio_write_block(io, NF2_EXACT_ADDR(i, OPENFLOW_EXACT_ENTRY_HDR_BASE_POS),
+					  block, BLOCK_WORDS))
+			return -1;
+		stats->exact++;
+	}
+
+	/* the staging registers were not necessarily cleared */
+	nf2_of_wildcard_stage_invalidate(&stage);
+	for (i = 0; i < OPENFLOW_WILDCARD_TABLE_SIZE; i++) {
+		if (read_wildcard(&s->file->wildcard[i], &w)) {
+			stats->torn++;
+			continue;
+		}
+		if (!w.used)
+			continue;
+		if (nf2_of_wildcard_modify(io, &stage, i, &w.entry, &w.mask, &w.action))
+			return -1;
+		stats->wildcard++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	stats->elapsed_ns = (t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec;
+	return 0;
+}
+
+
+int nf2_tablesnap_load(struct nf2_tablesnap *s, struct nf2_exact_table *exact,
+		       struct nf2_wildcard_table *wildcard) {
+	struct nf2_tablesnap_exact e;
+	struct nf2_tablesnap_wildcard w;
+	struct nf2_exact_slot *slot;
+	struct nf2_wildcard_rule *rule;
+	uint32_t hash[2];
+	int i, torn = 0;
+
+	if (exact->used || wildcard->used)
+		return -1;
+
+	for (i = 0; i < exact->size; i++) {
+		if (!s->file->exact[i].used)
+			continue;
+		if (read_exact(&s->file->exact[i], &e)) {
+			torn++;
+			continue;
+		}
+		if (!e.used)
+			continue;
+		slot = &exact->slots[i];
+		memset(slot, 0, sizeof(*slot));
+		slot->entry = e.entry;
+		slot->action = e.action;
+		nf2_header_hash(&e.entry, &hash[0], &hash[1]);
+		slot->hash[0] = hash[0];
+		slot->hash[1] = hash[1];
+		slot->used = 1;
+		exact->used++;
+	}
+
+	for (i = 0; i < wildcard->size; i++) {
+		if (read_wildcard(&s->file->wildcard[i], &w)) {
+			torn++;
+			continue;
+		}
+		if (!w.used)
+			continue;
+		rule = &wildcard->rules[i];
+		memset(rule, 0, sizeof(*rule));
+		rule->entry = w.entry;
+		rule->mask = w.mask;
+		rule->action = w.action;
+		rule->priority = w.priority;
+		rule->used = 1;
+		wildcard->used++;
+	}
+	return torn;
+}
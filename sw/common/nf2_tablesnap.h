@@ -0,0 +1,115 @@
+/* ****************************************************************************
+ * Module: nf2_tablesnap.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Mapped image of the flow tables, to restore them after a
+ *              watchdog flush or a card reset.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_TABLESNAP_H_
+#define NF2_TABLESNAP_H_
+
+#include <stdint.h>
+
+#include "nf2_regio.h"
+#include "nf2_of_hw.h"
+#include "nf2_exact_table.h"
+#include "nf2_wildcard_table.h"
+
+#define NF2_TABLESNAP_MAGIC	0x4e463254	/* "NF2T" */
+#define NF2_TABLESNAP_VERSION	1
+
+/*
+ * The file is a header, the wildcard records and the exact records, each
+ * at the index it holds on the card, in host byte order. The tables keep
+ * it current: with tbl->snap set, nf2_exact_table and nf2_wildcard_table
+ * update the record of every entry they write, right after writing the
+ * card, so the file holds what the card holds, give or take the write in
+ * progress.
+ *
+ * A record's gen is odd while it is being written; a reader that finds
+ * it odd, or changed after reading the record, reads it again, and skips
+ * it as torn only if it is still being written after many tries. The
+ * file outlives the process that writes it: a new process that opens it
+ * finds the tables as they were and can load its shadows from it.
+ */
+struct nf2_tablesnap_exact {
+	uint32_t gen;
+	uint32_t used;
+	nf2_of_entry_wrap entry;
+	nf2_of_action_wrap action;
+};
+
+struct nf2_tablesnap_wildcard {
+	uint32_t gen;
+	uint16_t used;
+	uint16_t priority;
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;
+	nf2_of_action_wrap action;
+};
+
+struct nf2_tablesnap_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t hdr_size;
+	uint32_t exact_size;		/* records */
+	uint32_t exact_rec_size;
+	uint32_t wildcard_size;
+	uint32_t wildcard_rec_size;
+	uint32_t pad[9];
+};
+
+struct nf2_tablesnap_file {
+	struct nf2_tablesnap_hdr hdr;
+	struct nf2_tablesnap_wildcard wildcard[OPENFLOW_WILDCARD_TABLE_SIZE];
+	struct nf2_tablesnap_exact exact[OPENFLOW_NF2_EXACT_TABLE_SIZE];
+};
+
+struct nf2_tablesnap {
+	struct nf2_tablesnap_file *file;	/* mapped */
+	int fd;
+};
+
+struct nf2_tablesnap_stats {
+	int exact;			/* entries written to the card */
+	int wildcard;
+	int torn;			/* records skipped, still being written after
+					 * the retries */
+	uint64_t elapsed_ns;		/* wall time of the restore */
+};
+
+/* Opens or creates the image. A file of another layout is an error
+ * rather than overwritten. Returns -1 with a message */
+int nf2_tablesnap_open(struct nf2_tablesnap *, const char *path);
+void nf2_tablesnap_close(struct nf2_tablesnap *);
+
+/* Record an entry as written to the card; NULL entry: the index is free */
+void nf2_tablesnap_exact(struct nf2_tablesnap *, int index, const nf2_of_entry_wrap *,
+			 const nf2_of_action_wrap *);
+void nf2_tablesnap_wildcard(struct nf2_tablesnap *, int index, const nf2_of_entry_wrap *,
+			    const nf2_of_mask_wrap *, const nf2_of_action_wrap *,
+			    uint16_t priority);
+
+/*
+ * Writes every entry of the image to a card whose tables were just
+ * flushed, as the watchdog and a reset leave them: all of SRAM zero,
+ * every wildcard entry clear. Each exact entry is one block write of its
+ * header, counters (last seen timer) and actions, in address order; the
+ * valid bit goes first, but a packet that matches before the actions
+ * land finds them zero and is dropped, as it would have been without
+ * the entry. Only the used wildcard entries are written, differentially
+ * staged. The card's shadows, if any, are not touched.
+ */
+int nf2_tablesnap_restore(struct nf2_tablesnap *, struct nf2_regio *, uint32_t timer,
+			  struct nf2_tablesnap_stats *);
+
+/* Fills empty table shadows with the image, without writing the card.
+ * Returns the number of torn records skipped, or -1 if a shadow was not
+ * empty */
+int nf2_tablesnap_load(struct nf2_tablesnap *, struct nf2_exact_table *,
+		       struct nf2_wildcard_table *);
+
+#endif
@@ -0,0 +1,450 @@
+/* ****************************************************************************
+ * Module: nf2_trafgen.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Seeded generator of test traffic and of the flow table
+ *              that matches it.
+ *
+ *              Every flow keeps its headers as a ready frame prefix, so
+ *              a packet is one copy of the prefix, the length fields and
+ *              the IP checksum patched in, and a payload cut from a pool
+ *              of random bytes. The TCP or UDP checksum comes from
+ *              prefix sums of the pool, so its cost does not grow with
+ *              the payload.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "nf2_flowkey.h"
+#include "nf2_trafgen.h"
+
+#define PAYLOAD_POOL_BITS	20
+#define PAYLOAD_POOL		(1 << PAYLOAD_POOL_BITS)
+
+#define MIN_LEN			60	/* without FCS */
+#define WIRE_OVERHEAD		(4 + 8 + 12)	/* FCS, preamble, inter frame gap */
+
+#define IP_HDR_LEN		20
+#define UDP_HDR_LEN		8
+#define TCP_HDR_LEN		20
+#define MAX_IPOPT_WORDS		10
+
+/* bytes of the payload pool, and prefix sums of its 16 bit words */
+#define POOL_BYTES		(PAYLOAD_POOL + NF2_TRAFGEN_MAX_LEN + 4 + NF2_TRAFGEN_SLACK)
+#define POOL_SUMS		(PAYLOAD_POOL + NF2_TRAFGEN_MAX_LEN + 4 + 1)
+
+
+//
+// rnd: splitmix64, so that a seed gives the same stream everywhere
+//
+static uint64_t rnd(struct nf2_trafgen *g) {
+	uint64_t z = (g->rng += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+
+static uint32_t rnd_below(struct nf2_trafgen *g, uint32_t n) {
+	return ((rnd(g) >> 32) * n) >> 32;
+}
+
+
+static double rnd_unit(struct nf2_trafgen *g) {
+	return (rnd(g) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+static void put16(uint8_t *b, uint16_t v) {
+	b[0] = v >> 8;
+	b[1] = v;
+}
+
+
+static void put32(uint8_t *b, uint32_t v) {
+	put16(b, v >> 16);
+	put16(b + 2, v);
+}
+
+
+static uint32_t sum16(const uint8_t *b, int len) {
+	uint32_t sum = 0;
+	int i;
+
+	for (i = 0; i < len; i += 2)
+		sum += (b[i] << 8) | b[i + 1];
+	return sum;
+}
+
+
+static void rnd_mac(struct nf2_trafgen *g, uint8_t *mac) {
+	uint64_t r = rnd(g);
+	int i;
+
+	for (i = 0; i < 6; i++)
+		mac[i] = r >> (8 * i);
+	mac[0] = (mac[0] & 0xfc) | 0x02;	/* unicast, locally administered */
+}
+
+
+//
+// make_hdr: the frame prefix of a flow. The IP total length, the IP
+//    checksum, the UDP length and the TCP or UDP checksum are left zero;
+//    ip_sum is the IP checksum sum without the total length, l4_sum the
+//    TCP or UDP one without the lengths and the payload.
+//
+static void make_hdr(struct nf2_trafgen_flow *f, const uint8_t *dst, const uint8_t *src,
+		     int tci, int tos, int optw, uint32_t ip_src, uint32_t ip_dst,
+		     uint16_t tp_src, uint16_t tp_dst, uint32_t seq) {
+	uint8_t *h = f->hdr;
+	int ihl = IP_HDR_LEN / 4 + optw;
+
+	memset(h, 0, sizeof(f->hdr));
+	memcpy(h, dst, 6);
+	memcpy(h + 6, src, 6);
+	f->ip_off = 14;
+	if (tci >= 0) {
+		put16(h + 12, NF2_ETH_TYPE_VLAN);
+		put16(h + 14, tci);
+		f->ip_off += 4;
+	}
+	put16(h + f->ip_off - 2, NF2_ETH_TYPE_IP);
+
+	h += f->ip_off;
+	h[0] = 0x40 | ihl;
+	h[1] = tos;
+	put16(h + 6, 0x4000);			/* don't fragment */
+	h[8] = 64;
+	h[9] = f->tcp ? NF2_IP_PROTO_TCP : NF2_IP_PROTO_UDP;
+	put32(h + 12, ip_src);
+	put32(h + 16, ip_dst);
+	memset(h + IP_HDR_LEN, 0x01, optw * 4);	/* NOP options */
+	f->ip_sum = sum16(h, ihl * 4);
+
+	f->l4_off = f->ip_off + ihl * 4;
+	h = f->hdr + f->l4_off;
+	put16(h, tp_src);
+	put16(h + 2, tp_dst);
+	if (f->tcp) {
+		put32(h + 4, seq);
+		h[12] = (TCP_HDR_LEN / 4) << 4;
+		h[13] = 0x10;			/* ACK */
+		put16(h + 14, 0xffff);
+		f->hdr_len = f->l4_off + TCP_HDR_LEN;
+	}
+	else {
+		f->hdr_len = f->l4_off + UDP_HDR_LEN;
+	}
+
+	/* the pseudo header but for its length, and the header */
+	f->l4_sum = (ip_src >> 16) + (ip_src & 0xffff) + (ip_dst >> 16) + (ip_dst & 0xffff) +
+		    (f->tcp ? NF2_IP_PROTO_TCP : NF2_IP_PROTO_UDP) +
+		    sum16(h, f->hdr_len - f->l4_off);
+}
+
+
+//
+// make_flows: draw the flows; paired, flow 2i + 1 is the reverse of
+//    flow 2i with the same tag, options and DSCP
+//
+static void make_flows(struct nf2_trafgen *g) {
+	const struct nf2_trafgen_cfg *cfg = &g->cfg;
+	struct nf2_trafgen_flow *f;
+	uint8_t mac_a[6], mac_b[6];
+	uint32_t ip_a, ip_b, seq;
+	uint16_t tp_a, tp_b;
+	int i, tci, tos, optw, tcp, m;
+
+	for (i = 0; i < cfg->num_flows; i++) {
+		rnd_mac(g, mac_a);
+		rnd_mac(g, mac_b);
+		ip_a = 0x0a000000 | rnd_below(g, 1 << 24);
+		ip_b = 0x0a000000 | rnd_below(g, 1 << 24);
+		tp_a = 1024 + rnd_below(g, 65536 - 1024);
+		tp_b = 1024 + rnd_below(g, 65536 - 1024);
+		seq = rnd(g);
+		tos = rnd_below(g, 64) << 2;
+		tcp = rnd_unit(g) < cfg->tcp_frac;
+		tci = -1;
+		if (rnd_unit(g) < cfg->vlan_frac)
+			tci = (rnd_below(g, 8) << 13) | (1 + rnd_below(g, 4094));
+		optw = 0;
+		if (rnd_unit(g) < cfg->ipopt_frac)
+			optw = 1 + rnd_below(g, MAX_IPOPT_WORDS);
+
+		if (cfg->pair == NF2_TRAFGEN_PAIR_NONE) {
+			f = &g->flows[i];
+			f->tcp = tcp;
+			f->port = cfg->ports[rnd_below(g, cfg->num_ports)];
+			m = rnd_below(g, NF2_PORT_NUM - 1);
+			f->out_port = 2 * (m >= f->port / 2 ? m + 1 : m);
+			make_hdr(f, mac_b, mac_a, tci, tos, optw, ip_a, ip_b, tp_a, tp_b, seq);
+			continue;
+		}
+
+		f = &g->flows[2 * i];
+		f->tcp = tcp;
+		f->port = 0;
+		f->out_port = 2;
+		make_hdr(f, mac_b, mac_a, tci, tos, optw, ip_a, ip_b, tp_a, tp_b, seq);
+		f++;
+		f->tcp = tcp;
+		f->port = 2;
+		f->out_port = 0;
+		make_hdr(f, mac_a, mac_b, tci, tos, optw, ip_b, ip_a, tp_b, tp_a, ~seq);
+	}
+}
+
+
+//
+// make_alias: Vose's alias tables for drawing flow ranks with weights
+//    1/rank^s in constant time
+//
+static int make_alias(struct nf2_trafgen *g, int n, double s) {
+	double *p, sum = 0;
+	int *small, *large, ns = 0, nl = 0, i, a, b;
+
+	p = malloc(n * sizeof(*p));
+	small = malloc(n * sizeof(*small));
+	large = malloc(n * sizeof(*large));
+	g->alias_prob = malloc(n * sizeof(*g->alias_prob));
+	g->alias = malloc(n * sizeof(*g->alias));
+	if (p == NULL || small == NULL || large == NULL || g->alias_prob == NULL ||
+	    g->alias == NULL) {
+		free(p);
+		free(small);
+		free(large);
+		return -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		p[i] = s == 0 ? 1 : pow(i + 1, -s);
+		sum += p[i];
+	}
+	for (i = 0; i < n; i++) {
+		p[i] *= n / sum;
+		if (p[i] < 1)
+			small[ns++] = i;
+		else
+			large[nl++] = i;
+	}
+	while (ns && nl) {
+		a = small[--ns];
+		b = large[nl - 1];
+		g->alias_prob[a] = p[a] * 4294967296.0;
+		g->alias[a] = b;
+		p[b] -= 1 - p[a];
+		if (p[b] < 1) {
+			nl--;
+			small[ns++] = b;
+		}
+	}
+	/* what is left has probability 1, give or take rounding */
+	while (nl) {
+		b = large[--nl];
+		g->alias_prob[b] = 0xffffffff;
+		g->alias[b] = b;
+	}
+	while (ns) {
+		a = small[--ns];
+		g->alias_prob[a] = 0xffffffff;
+		g->alias[a] = a;
+	}
+
+	free(p);
+	free(small);
+	free(large);
+	return 0;
+}
+
+
+int nf2_trafgen_init(struct nf2_trafgen *g, const struct nf2_trafgen_cfg *cfg) {
+	int i;
+
+	memset(g, 0, sizeof(*g));
+	if (cfg->num_flows <= 0 || cfg->rate_mbps == 0 || cfg->zipf_s < 0 ||
+	    (cfg->len_min != NF2_TRAFGEN_IMIX &&
+	     (cfg->len_min < MIN_LEN || cfg->len_max < cfg->len_min ||
+	      cfg->len_max > NF2_TRAFGEN_MAX_LEN))) {
+		fprintf(stderr, "Invalid traffic configuration\n");
+		return -1;
+	}
+	if (cfg->pair == NF2_TRAFGEN_PAIR_NONE) {
+		if (cfg->num_ports <= 0 || cfg->num_ports > NF2_TRAFGEN_MAX_PORTS) {
+			fprintf(stderr, "Invalid traffic configuration\n");
+			return -1;
+		}
+		for (i = 0; i < cfg->num_ports; i++) {
+			if (cfg->ports[i] < 0 || cfg->ports[i] >= 2 * NF2_PORT_NUM ||
+			    cfg->ports[i] & 1) {
+				fprintf(stderr, "Source port %d is not a MAC port\n", cfg->ports[i]);
+				return -1;
+			}
+		}
+	}
+
+	g->cfg = *cfg;
+	g->rng = cfg->seed;
+	g->num_flows = cfg->pair == NF2_TRAFGEN_PAIR_NONE ? cfg->num_flows : 2 * cfg->num_flows;
+	g->flows = calloc(g->num_flows, sizeof(*g->flows));
+	g->payload = malloc(POOL_BYTES);
+	g->payload_sum = malloc(POOL_SUMS * sizeof(*g->payload_sum));
+	if (g->flows == NULL || g->payload == NULL || g->payload_sum == NULL ||
+	    make_alias(g, cfg->num_flows, cfg->zipf_s)) {
+		fprintf(stderr, "Out of memory\n");
+		nf2_trafgen_free(g);
+		return -1;
+	}
+
+	for (i = 0; i < POOL_BYTES; i++)
+		g->payload[i] = rnd(g);
+
+	/* payload_sum[i] - payload_sum[j], i and j of one parity, is the sum
+	 * of the words from j up to i, modulo 0xffff as the one's complement
+	 * sum is */
+	g->payload_sum[0] = g->payload_sum[1] = 0;
+	for (i = 2; i < POOL_SUMS; i++)
+		g->payload_sum[i] = (g->payload_sum[i - 2] +
+				     ((g->payload[i - 2] << 8) | g->payload[i - 1])) % 0xffff;
+	make_flows(g);
+	return 0;
+}
+
+
+void nf2_trafgen_free(struct nf2_trafgen *g) {
+	free(g->flows);
+	free(g->payload);
+	free(g->payload_sum);
+	free(g->alias_prob);
+	free(g->alias);
+	g->flows = NULL;
+	g->payload = NULL;
+	g->payload_sum = NULL;
+	g->alias_prob = NULL;
+	g->alias = NULL;
+}
+
+
+void nf2_trafgen_rule(const struct nf2_trafgen *g, int i, struct nf2_flowfile_rule *r) {
+	const struct nf2_trafgen_flow *f = &g->flows[i];
+
+	memset(r, 0, sizeof(*r));
+	r->exact = 1;
+	nf2_flowkey_extract(f->hdr, f->hdr_len, f->port, &r->entry);
+	r->action.action.forward_bitmask = 1 << f->out_port;
+}
+
+
+static uint32_t draw_len(struct nf2_trafgen *g) {
+	uint32_t r;
+
+	if (g->cfg.len_min == NF2_TRAFGEN_IMIX) {
+		r = rnd_below(g, 12);
+		return r < 7 ? 60 : r < 11 ? 590 : 1514;
+	}
+	return g->cfg.len_min + rnd_below(g, g->cfg.len_max - g->cfg.len_min + 1);
+}
+
+
+//
+// frame_len: a drawn length for a flow: a tag adds to it, and it is never
+//    shorter than the headers
+//
+static uint32_t frame_len(const struct nf2_trafgen_flow *f, uint32_t len) {
+	if (f->ip_off != 14)
+		len += 4;
+	return len < f->hdr_len ? f->hdr_len : len;
+}
+
+
+static uint64_t wire_ns(const struct nf2_trafgen *g, uint32_t len) {
+	return (uint64_t)(len + WIRE_OVERHEAD) * 8000 / g->cfg.rate_mbps;
+}
+
+
+void nf2_trafgen_next(struct nf2_trafgen *g, struct nf2_trafgen_pkt *pkt) {
+	struct nf2_trafgen_pkt *p = &g->partner;
+	uint64_t r;
+	uint32_t len;
+	int rank;
+
+	if (g->have_partner) {
+		*pkt = *p;
+		g->have_partner = 0;
+		return;
+	}
+
+	r = rnd(g);
+	rank = ((r >> 32) * g->cfg.num_flows) >> 32;
+	if ((uint32_t)r >= g->alias_prob[rank])
+		rank = g->alias[rank];
+
+	len = draw_len(g);
+	pkt->flow = g->cfg.pair == NF2_TRAFGEN_PAIR_NONE ? rank : 2 * rank;
+	pkt->port = g->flows[pkt->flow].port;
+	pkt->len = frame_len(&g->flows[pkt->flow], len);
+	pkt->ts_ns = g->clock_ns[pkt->port];
+	g->clock_ns[pkt->port] += wire_ns(g, pkt->len);
+	if (g->cfg.pair == NF2_TRAFGEN_PAIR_NONE)
+		return;
+
+	/* the reverse flow on port 2, no earlier than its partner */
+	if (g->cfg.pair == NF2_TRAFGEN_PAIR_UNEQUAL)
+		len = draw_len(g);
+	p->flow = pkt->flow + 1;
+	p->port = g->flows[p->flow].port;
+	p->len = frame_len(&g->flows[p->flow], len);
+	p->ts_ns = g->clock_ns[p->port] > pkt->ts_ns ? g->clock_ns[p->port] : pkt->ts_ns;
+	g->clock_ns[p->port] = p->ts_ns + wire_ns(g, p->len);
+	g->have_partner = 1;
+}
+
+
+void nf2_trafgen_build(const struct nf2_trafgen *g, const struct nf2_trafgen_pkt *pkt,
+		       uint8_t *frame) {
+	const struct nf2_trafgen_flow *f = &g->flows[pkt->flow];
+	const uint8_t *payload;
+	uint32_t ip_len = pkt->len - f->ip_off, l4_len = pkt->len - f->l4_off;
+	uint32_t sum, off, end, i;
+
+	/* fixed size copies, past the end of a short frame: the lengths
+	 * vary from packet to packet and a memcpy of a varying size costs
+	 * more than the bytes */
+	memcpy(frame, f->hdr, NF2_TRAFGEN_MAX_HDR);
+	put16(frame + f->ip_off + 2, ip_len);
+	sum = f->ip_sum + ip_len;
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	put16(frame + f->ip_off + 10, ~sum);
+	if (!f->tcp)
+		put16(frame + f->l4_off + 4, l4_len);
+
+	/* a payload offset that depends on the packet only, not on the order
+	 * the packets are built in */
+	off = ((pkt->ts_ns ^ (uint64_t)pkt->flow << 40) * 0x9e3779b97f4a7c15ULL) >>
+	      (64 - PAYLOAD_POOL_BITS);
+	payload = g->payload + off;
+	for (i = f->hdr_len; i < pkt->len; i += NF2_TRAFGEN_SLACK)
+		memcpy(frame + i, payload + i, NF2_TRAFGEN_SLACK);
+
+	/* the TCP or UDP checksum: the length is in the pseudo header, and
+	 * once more in the UDP header; an odd last byte is padded with zero */
+	end = off + f->hdr_len + ((pkt->len - f->hdr_len) & ~1);
+	sum = f->l4_sum + (f->tcp ? l4_len : 2 * l4_len) +
+	      g->payload_sum[end] + 0xffff - g->payload_sum[off + f->hdr_len];
+	if ((pkt->len - f->hdr_len) & 1)
+		sum += g->payload[end] << 8;
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = ~sum & 0xffff;
+	if (f->tcp)
+		put16(frame + f->l4_off + 16, sum);
+	else
+		put16(frame + f->l4_off + 6, sum ? sum : 0xffff);	/* 0 is none */
+}
@@ -0,0 +1,109 @@
+/* ****************************************************************************
+ * Module: nf2_trafgen.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Seeded generator of test traffic and of the flow table
+ *              that matches it.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_TRAFGEN_H_
+#define NF2_TRAFGEN_H_
+
+#include <stdint.h>
+
+#include "nf2_flowfile.h"
+
+#define NF2_TRAFGEN_MAX_PORTS	8	/* source ports 0..7, 2n for MAC port n */
+#define NF2_TRAFGEN_MAX_HDR	(14 + 4 + 60 + 20)	/* eth, tag, IP, TCP */
+#define NF2_TRAFGEN_MAX_LEN	1514			/* untagged, without FCS */
+#define NF2_TRAFGEN_IMIX	-1
+#define NF2_TRAFGEN_SLACK	64	/* written past the frame, at most */
+
+enum nf2_trafgen_pair {
+	NF2_TRAFGEN_PAIR_NONE,
+	NF2_TRAFGEN_PAIR_EQUAL,		/* partner packet of the same length */
+	NF2_TRAFGEN_PAIR_UNEQUAL,	/* partner length drawn on its own */
+};
+
+/*
+ * Flows are drawn once from the seed: addresses, protocol (TCP or UDP),
+ * ports, DSCP, an 802.1Q tag for a fraction of them, 1 to 10 words of IP
+ * options (NOPs) for another fraction. Each packet then picks its flow
+ * with probability proportional to 1/rank^zipf_s (0: all equally likely)
+ * and a frame length: fixed (len_min == len_max), uniform in
+ * [len_min, len_max], or NF2_TRAFGEN_IMIX in len_min (7:4:1 of 60, 590
+ * and 1514 bytes). Lengths are without FCS, as captured; a tag adds 4.
+ *
+ * Unpaired flows are spread over the given source ports and output to
+ * another MAC port. Paired: every flow is a flow of port 0 output to
+ * port 2 and its reverse on port 2 output to port 0, and each packet on
+ * port 0 is followed by one of the reverse flow on port 2, of the same
+ * length (EQUAL) or not (UNEQUAL), as the XOR coding stage pairs them.
+ *
+ * Timestamps run per port at rate_mbps, counting preamble, FCS and the
+ * inter frame gap. The same configuration and seed give the same flows
+ * and packets.
+ */
+struct nf2_trafgen_cfg {
+	uint64_t seed;
+	int num_flows;			/* paired: pairs */
+	int ports[NF2_TRAFGEN_MAX_PORTS];
+	int num_ports;
+	double zipf_s;
+	int len_min, len_max;
+	double vlan_frac;
+	double ipopt_frac;
+	double tcp_frac;
+	enum nf2_trafgen_pair pair;
+	unsigned rate_mbps;
+};
+
+struct nf2_trafgen_flow {
+	uint8_t hdr[NF2_TRAFGEN_MAX_HDR];	/* frame up to the payload */
+	uint8_t hdr_len;
+	uint8_t ip_off;
+	uint8_t l4_off;
+	uint8_t port;
+	uint8_t out_port;
+	uint8_t tcp;
+	uint32_t ip_sum;		/* IP header sum without total length */
+	uint32_t l4_sum;		/* TCP/UDP sum without lengths and payload */
+};
+
+struct nf2_trafgen_pkt {
+	int flow;
+	int port;
+	uint32_t len;
+	uint64_t ts_ns;
+};
+
+struct nf2_trafgen {
+	struct nf2_trafgen_cfg cfg;
+	struct nf2_trafgen_flow *flows;	/* paired: flow 2i on port 0, 2i+1 its reverse */
+	int num_flows;
+	uint32_t *alias_prob;		/* Zipf rank sampling, Vose alias tables */
+	int *alias;
+	uint64_t rng;
+	uint64_t clock_ns[NF2_TRAFGEN_MAX_PORTS];
+	struct nf2_trafgen_pkt partner;	/* paired: next packet, if have_partner */
+	int have_partner;
+	uint8_t *payload;		/* random bytes the payloads are cut from */
+	uint32_t *payload_sum;		/* prefix sums of its 16 bit words */
+};
+
+/* Returns -1 with a message if the configuration is invalid */
+int nf2_trafgen_init(struct nf2_trafgen *, const struct nf2_trafgen_cfg *);
+void nf2_trafgen_free(struct nf2_trafgen *);
+
+/* The exact flow table entry that matches flow i */
+void nf2_trafgen_rule(const struct nf2_trafgen *, int i, struct nf2_flowfile_rule *);
+
+/* Draws the next packet; nf2_trafgen_build writes its pkt->len bytes and
+ * may write up to NF2_TRAFGEN_SLACK bytes more (see nf2_pcap_append) */
+void nf2_trafgen_next(struct nf2_trafgen *, struct nf2_trafgen_pkt *);
+void nf2_trafgen_build(const struct nf2_trafgen *, const struct nf2_trafgen_pkt *,
+		       uint8_t *frame);
+
+#endif
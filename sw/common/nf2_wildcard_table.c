@@ -0,0 +1,277 @@
+/* ****************************************************************************
+ * Module: nf2_wildcard_table.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host shadow of the wildcard table with priority ordered,
+ *              minimal write placement.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "nf2_wildcard_table.h"
+#include "nf2_tablesnap.h"
+
+
+void nf2_wildcard_table_init(struct nf2_wildcard_table *tbl, struct nf2_regio *io) {
+	memset(tbl, 0, sizeof(*tbl));
+	tbl->io = io;
+	tbl->size = OPENFLOW_WILDCARD_TABLE_SIZE;
+	tbl->diff_writes = 1;
+}
+
+
+static int same_rule(const struct nf2_wildcard_rule *r, const nf2_of_entry_wrap *entry,
+		     const nf2_of_mask_wrap *mask, uint16_t priority) {
+	int i;
+
+	if (!r->used || r->priority != priority)
+		return 0;
+	for (i = 0; i < NF2_OF_ENTRY_WORD_LEN; i++) {
+		if (r->mask.raw[i] != mask->raw[i] ||
+		    ((r->entry.raw[i] ^ entry->raw[i]) & ~mask->raw[i]))
+			return 0;
+	}
+	return 1;
+}
+
+
+static int hw_write(struct nf2_wildcard_table *tbl, int idx, int keep_counters) {
+	struct nf2_wildcard_rule *r = &tbl->rules[idx];
+	struct nf2_of_wildcard_stage *stage = tbl->diff_writes ? &tbl->stage : NULL;
+	int ret;
+
+	tbl->stats.hw_writes++;
+	if (tbl->io != NULL) {
+		if (!r->used)
+			ret = nf2_of_wildcard_clear(tbl->io, stage, idx);
+		else if (keep_counters)
+			ret = nf2_of_wildcard_modify(tbl->io, stage, idx, &r->entry, &r->mask,
+						     &r->action);
+		else
+			ret = nf2_of_wildcard_write(tbl->io, stage, idx, &r->entry, &r->mask,
+						    &r->action);
+		if (ret)
+			return -1;
+	}
+
+	if (tbl->snap != NULL && r->used)
+		nf2_tablesnap_wildcard(tbl->snap, idx, &r->entry, &r->mask, &r->action,
+				       r->priority);
+	else if (tbl->snap != NULL)
+		nf2_tablesnap_wildcard(tbl->snap, idx, NULL, NULL, NULL, 0);
+	return 0;
+}
+
+
+//
+// carry_counters: add the hits counted at idx to the rule now at dst,
+//    just before idx is reused.
+//
+static int carry_counters(struct nf2_wildcard_table *tbl, int idx, int dst) {
+	uint32_t pkts, bytes;
+
+	if (tbl->io == NULL || dst < 0)
+		return 0;
+	if (nf2_of_wildcard_read_counters(tbl->io, idx, &pkts, &bytes))
+		return -1;
+	tbl->rules[dst].carry_pkts += pkts;
+	tbl->rules[dst].carry_bytes += bytes;
+	return 0;
+}
+
+
+//
+// plan_up: pull the free index f down to hi (the first rule of lower
+//    priority). Fills the indices of the rules to move, in order; each
+//    goes to the hole left by the previous one. Returns the number.
+//
+static int plan_up(struct nf2_wildcard_table *tbl, int f, int hi, int *chain) {
+	int hole = f, n = 0, k;
+
+	while (hole > hi) {
+		k = hole - 1;
+		while (k > hi && tbl->rules[k - 1].priority == tbl->rules[hole - 1].priority)
+			k--;
+		chain[n++] = k;
+		hole = k;
+	}
+	return n;
+}
+
+
+//
+// plan_down: pull the free index f up to lo - 1 (the last rule of higher
+//    priority).
+//
+static int plan_down(struct nf2_wildcard_table *tbl, int f, int lo, int *chain) {
+	int hole = f, n = 0, k;
+
+	while (hole < lo - 1) {
+		k = hole + 1;
+		while (k < lo - 1 && tbl->rules[k + 1].priority == tbl->rules[hole + 1].priority)
+			k++;
+		chain[n++] = k;
+		hole = k;
+	}
+	return n;
+}
+
+
+int nf2_wildcard_insert(struct nf2_wildcard_table *tbl, nf2_of_entry_wrap *entry,
+			nf2_of_mask_wrap *mask, nf2_of_action_wrap *action,
+			uint16_t priority) {
+	int chain_up[OPENFLOW_WILDCARD_TABLE_SIZE], chain_down[OPENFLOW_WILDCARD_TABLE_SIZE];
+	int *chain = NULL;
+	int lo = 0, hi = tbl->size, up = -1, down = -1, n_up = 0, n_down = 0;
+	int i, n, idx, hole, prev, num_free = 0;
+
+	if (nf2_wildcard_find(tbl, entry, mask, priority) >= 0)
+		return nf2_wildcard_modify(tbl, entry, mask, action, priority);
+	if (tbl->used == tbl->size) {
+		tbl->stats.failures++;
+		return -1;
+	}
+
+	/* The rule may go anywhere in [lo, hi) */
+	for (i = 0; i < tbl->size; i++) {
+		if (!tbl->rules[i].used)
+			continue;
+		if (tbl->rules[i].priority > priority)
+			lo = i + 1;
+		else if (tbl->rules[i].priority < priority && hi == tbl->size)
+			hi = i;
+	}
+
+	/* Prefer the middle free index in range, leaving room on both sides */
+	for (i = lo; i < hi; i++)
+		num_free += !tbl->rules[i].used;
+	if (num_free) {
+		num_free = (num_free + 1) / 2;
+		for (idx = lo; ; idx++)
+			if (!tbl->rules[idx].used && --num_free == 0)
+				break;
+	}
+	else {
+		for (i = hi; i < tbl->size && up < 0; i++)
+			if (!tbl->rules[i].used)
+				up = i;
+		for (i = lo - 1; i >= 0 && down < 0; i--)
+			if (!tbl->rules[i].used)
+				down = i;
+		if (up >= 0)
+			n_up = plan_up(tbl, up, hi, chain_up);
+		if (down >= 0)
+			n_down = plan_down(tbl, down, lo, chain_down);
+
+		if (up >= 0 && (down < 0 || n_up <= n_down)) {
+			hole = up;
+			chain = chain_up;
+			n = n_up;
+		}
+		else {
+			hole = down;
+			chain = chain_down;
+			n = n_down;
+		}
+
+		/* Write each rule at the hole before its old index is reused */
+		prev = -1;
+		for (i = 0; i < n; i++) {
+			if (carry_counters(tbl, hole, prev))
+				return -1;
+			tbl->rules[hole] = tbl->rules[chain[i]];
+			if (hw_write(tbl, hole, 0))
+				return -1;
+			tbl->stats.moves++;
+			prev = hole;
+			hole = chain[i];
+		}
+		if (carry_counters(tbl, hole, prev))
+			return -1;
+		idx = hole;
+	}
+
+	memset(&tbl->rules[idx], 0, sizeof(tbl->rules[idx]));
+	tbl->rules[idx].entry = *entry;
+	tbl->rules[idx].mask = *mask;
+	tbl->rules[idx].action = *action;
+	tbl->rules[idx].priority = priority;
+	tbl->rules[idx].used = 1;
+	if (hw_write(tbl, idx, 0))
+		return -1;
+
+	tbl->used++;
+	tbl->stats.inserts++;
+	return idx;
+}
+
+
+int nf2_wildcard_modify(struct nf2_wildcard_table *tbl, nf2_of_entry_wrap *entry,
+			nf2_of_mask_wrap *mask, nf2_of_action_wrap *action,
+			uint16_t priority) {
+	int idx;
+
+	idx = nf2_wildcard_find(tbl, entry, mask, priority);
+	if (idx < 0)
+		return -1;
+
+	tbl->rules[idx].action = *action;
+	tbl->stats.modifies++;
+	return hw_write(tbl, idx, 1) ? -1 : idx;
+}
+
+
+int nf2_wildcard_delete(struct nf2_wildcard_table *tbl, nf2_of_entry_wrap *entry,
+			nf2_of_mask_wrap *mask, uint16_t priority) {
+	int idx;
+
+	idx = nf2_wildcard_find(tbl, entry, mask, priority);
+	if (idx < 0)
+		return -1;
+
+	memset(&tbl->rules[idx], 0, sizeof(tbl->rules[idx]));
+	if (hw_write(tbl, idx, 0))
+		return -1;
+	tbl->used--;
+	tbl->stats.deletes++;
+	return idx;
+}
+
+
+int nf2_wildcard_find(struct nf2_wildcard_table *tbl, nf2_of_entry_wrap *entry,
+		      nf2_of_mask_wrap *mask, uint16_t priority) {
+	int i;
+
+	for (i = 0; i < tbl->size; i++)
+		if (same_rule(&tbl->rules[i], entry, mask, priority))
+			return i;
+	return -1;
+}
+
+
+int nf2_wildcard_check_order(struct nf2_wildcard_table *tbl) {
+	int i, last = -1;
+
+	for (i = 0; i < tbl->size; i++) {
+		if (!tbl->rules[i].used)
+			continue;
+		if (last >= 0 && tbl->rules[i].priority > tbl->rules[last].priority)
+			return -1;
+		last = i;
+	}
+	return 0;
+}
+
+
+void nf2_wildcard_print_stats(struct nf2_wildcard_table *tbl, FILE *f) {
+	struct nf2_wildcard_stats *st = &tbl->stats;
+
+	fprintf(f, "entries:      %d/%d\n", tbl->used, tbl->size);
+	fprintf(f, "inserts:      %lu (modifies %lu, deletes %lu, full %lu)\n",
+		st->inserts, st->modifies, st->deletes, st->failures);
+	fprintf(f, "moves:        %lu\n", st->moves);
+	fprintf(f, "table writes: %lu\n", st->hw_writes);
+}
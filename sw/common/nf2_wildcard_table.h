@@ -0,0 +1,100 @@
+/* ****************************************************************************
+ * Module: nf2_wildcard_table.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host shadow of the wildcard table with priority ordered,
+ *              minimal write placement.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_WILDCARD_TABLE_H_
+#define NF2_WILDCARD_TABLE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "nf2_regio.h"
+#include "nf2_of_hw.h"
+
+struct nf2_tablesnap;
+
+struct nf2_wildcard_rule {
+	nf2_of_entry_wrap entry;
+	nf2_of_mask_wrap mask;
+	nf2_of_action_wrap action;
+	uint16_t priority;		/* higher wins, as in OpenFlow */
+	uint8_t used;
+
+	/* Counters the rule collected at the indices it was moved out of */
+	uint64_t carry_pkts;
+	uint64_t carry_bytes;
+};
+
+struct nf2_wildcard_stats {
+	unsigned long inserts;
+	unsigned long modifies;
+	unsigned long deletes;
+	unsigned long failures;		/* table full */
+	unsigned long moves;		/* rules rewritten at another index */
+	unsigned long hw_writes;	/* entries committed */
+};
+
+/*
+ * The wildcard table resolves overlaps by index: the lowest matching
+ * index wins. The table keeps the used entries ordered by non increasing
+ * priority, with free entries anywhere in between.
+ *
+ * A new rule of priority p may go to any index between the last rule of
+ * higher priority and the first rule of lower priority. If none of those
+ * is free, a hole is pulled in from the nearest free index above or
+ * below. Rules of one priority may be in any order among themselves, so
+ * pulling a hole across a run of equal priority rules only moves one of
+ * them: one move per priority level crossed. The direction with fewer
+ * moves is taken.
+ *
+ * Every move writes the rule at the hole first and only then reuses its
+ * old index, so a rule is never missing from the card and the order on
+ * the card is valid after every write. Deletes only clear the entry,
+ * leaving the hole for later inserts.
+ *
+ * Entries are staged differentially (see nf2_of_hw.h) unless diff_writes
+ * is cleared. Call nf2_of_wildcard_stage_invalidate(&tbl->stage) after
+ * reading the wildcard table through the card's read window.
+ *
+ * With a NULL register handle the table only keeps the shadow and counts
+ * the writes it would have issued.
+ *
+ * With snap set, every entry written is recorded in the table image (see
+ * nf2_tablesnap.h).
+ */
+struct nf2_wildcard_table {
+	struct nf2_regio *io;
+	struct nf2_wildcard_rule rules[OPENFLOW_WILDCARD_TABLE_SIZE];
+	int size;
+	int used;
+	int diff_writes;
+	struct nf2_of_wildcard_stage stage;
+	struct nf2_tablesnap *snap;
+	struct nf2_wildcard_stats stats;
+};
+
+void nf2_wildcard_table_init(struct nf2_wildcard_table *, struct nf2_regio *);
+
+/* An insert of a rule already present (same entry, mask and priority)
+ * only updates its action and keeps its counters. All return the index
+ * or -1. */
+int nf2_wildcard_insert(struct nf2_wildcard_table *, nf2_of_entry_wrap *,
+			nf2_of_mask_wrap *, nf2_of_action_wrap *, uint16_t priority);
+int nf2_wildcard_modify(struct nf2_wildcard_table *, nf2_of_entry_wrap *,
+			nf2_of_mask_wrap *, nf2_of_action_wrap *, uint16_t priority);
+int nf2_wildcard_delete(struct nf2_wildcard_table *, nf2_of_entry_wrap *,
+			nf2_of_mask_wrap *, uint16_t priority);
+int nf2_wildcard_find(struct nf2_wildcard_table *, nf2_of_entry_wrap *,
+		      nf2_of_mask_wrap *, uint16_t priority);
+
+/* Returns 0 if the used rules are in priority order */
+int nf2_wildcard_check_order(struct nf2_wildcard_table *);
+void nf2_wildcard_print_stats(struct nf2_wildcard_table *, FILE *);
+
+#endif
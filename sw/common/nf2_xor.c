@@ -0,0 +1,278 @@
+/* ****************************************************************************
+ * Module: nf2_xor.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host XOR network coding of packet pairs.
+ *
+ *              The work is one pass over max(len_a, len_b) bytes: XOR
+ *              where both packets have data, then a copy of the rest of
+ *              the longer one. Each method runs its widest loads and
+ *              stores over the bulk and finishes the tail with narrower
+ *              ones; nothing is read past the end of either packet.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD	1
+#endif
+
+#include "nf2_xor.h"
+
+typedef void (*xor_fn)(uint8_t *out, const uint8_t *a, const uint8_t *b, uint32_t n);
+
+static enum nf2_xor_method method = NF2_XOR_AUTO;
+
+
+static inline uint16_t get16(const uint8_t *b) {
+	return (b[0] << 8) | b[1];
+}
+
+
+static inline uint32_t get32(const uint8_t *b) {
+	return ((uint32_t)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+
+static inline void put16(uint8_t *b, uint16_t v) {
+	b[0] = v >> 8;
+	b[1] = v;
+}
+
+
+static inline void put32(uint8_t *b, uint32_t v) {
+	put16(b, v >> 16);
+	put16(b + 2, v);
+}
+
+
+static inline void xor_tail(uint8_t *out, const uint8_t *a, const uint8_t *b, uint32_t n) {
+	uint64_t x, y;
+	uint32_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		memcpy(&x, a + i, 8);
+		memcpy(&y, b + i, 8);
+		x ^= y;
+		memcpy(out + i, &x, 8);
+	}
+	for (; i < n; i++)
+		out[i] = a[i] ^ b[i];
+}
+
+
+static void xor_scalar(uint8_t *out, const uint8_t *a, const uint8_t *b, uint32_t n) {
+	uint64_t x[4], y[4];
+	uint32_t i = 0;
+	int j;
+
+	/* four words at a time to keep the loads independent */
+	for (; i + 32 <= n; i += 32) {
+		memcpy(x, a + i, 32);
+		memcpy(y, b + i, 32);
+		for (j = 0; j < 4; j++)
+			x[j] ^= y[j];
+		memcpy(out + i, x, 32);
+	}
+	xor_tail(out + i, a + i, b + i, n - i);
+}
+
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse2")))
+static void xor_sse2(uint8_t *out, const uint8_t *a, const uint8_t *b, uint32_t n) {
+	__m128i x0, x1;
+	uint32_t i = 0;
+
+	for (; i + 32 <= n; i += 32) {
+		x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i)),
+				   _mm_loadu_si128((const __m128i *)(b + i)));
+		x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i + 16)),
+				   _mm_loadu_si128((const __m128i *)(b + i + 16)));
+		_mm_storeu_si128((__m128i *)(out + i), x0);
+		_mm_storeu_si128((__m128i *)(out + i + 16), x1);
+	}
+	if (i + 16 <= n) {
+		x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i)),
+				   _mm_loadu_si128((const __m128i *)(b + i)));
+		_mm_storeu_si128((__m128i *)(out + i), x0);
+		i += 16;
+	}
+	xor_tail(out + i, a + i, b + i, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static void xor_avx2(uint8_t *out, const uint8_t *a, const uint8_t *b, uint32_t n) {
+	__m256i x0, x1;
+	uint32_t i = 0;
+
+	for (; i + 64 <= n; i += 64) {
+		x0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)),
+				      _mm256_loadu_si256((const __m256i *)(b + i)));
+		x1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i + 32)),
+				      _mm256_loadu_si256((const __m256i *)(b + i + 32)));
+		_mm256_storeu_si256((__m256i *)(out + i), x0);
+		_mm256_storeu_si256((__m256i *)(out + i + 32), x1);
+	}
+	if (i + 32 <= n) {
+		x0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)),
+				      _mm256_loadu_si256((const __m256i *)(b + i)));
+		_mm256_storeu_si256((__m256i *)(out + i), x0);
+		i += 32;
+	}
+	if (i + 16 <= n) {
+		__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i)),
+					  _mm_loadu_si128((const __m128i *)(b + i)));
+		_mm_storeu_si128((__m128i *)(out + i), x);
+		i += 16;
+	}
+	xor_tail(out + i, a + i, b + i, n - i);
+}
+#endif
+
+
+static int supported(enum nf2_xor_method m) {
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (m == NF2_XOR_AVX2)
+		return __builtin_cpu_supports("avx2");
+	if (m == NF2_XOR_SSE2)
+		return __builtin_cpu_supports("sse2");
+#endif
+	return m == NF2_XOR_SCALAR;
+}
+
+
+int nf2_xor_set_method(enum nf2_xor_method m) {
+	if (m == NF2_XOR_AUTO)
+		m = supported(NF2_XOR_AVX2) ? NF2_XOR_AVX2 :
+		    supported(NF2_XOR_SSE2) ? NF2_XOR_SSE2 : NF2_XOR_SCALAR;
+	if (!supported(m))
+		return -1;
+	method = m;
+	return 0;
+}
+
+
+enum nf2_xor_method nf2_xor_get_method(void) {
+	if (method == NF2_XOR_AUTO)
+		nf2_xor_set_method(NF2_XOR_AUTO);
+	return method;
+}
+
+
+const char *nf2_xor_method_name(enum nf2_xor_method m) {
+	switch (m) {
+	case NF2_XOR_AUTO:	return "auto";
+	case NF2_XOR_SCALAR:	return "scalar";
+	case NF2_XOR_SSE2:	return "sse2";
+	case NF2_XOR_AVX2:	return "avx2";
+	}
+	return "?";
+}
+
+
+void nf2_xor_pad(uint8_t *out, uint32_t n, const uint8_t *a, uint32_t len_a,
+		 const uint8_t *b, uint32_t len_b) {
+	const uint8_t *rest;
+	uint32_t common, rest_len;
+	xor_fn fn;
+
+	if (len_a > n)
+		len_a = n;
+	if (len_b > n)
+		len_b = n;
+	common = len_a < len_b ? len_a : len_b;
+	rest = len_a > len_b ? a : b;
+	rest_len = (len_a > len_b ? len_a : len_b) - common;
+
+	switch (nf2_xor_get_method()) {
+#ifdef HAVE_X86_SIMD
+	case NF2_XOR_AVX2:
+		fn = xor_avx2;
+		break;
+	case NF2_XOR_SSE2:
+		fn = xor_sse2;
+		break;
+#endif
+	default:
+		fn = xor_scalar;
+		break;
+	}
+	fn(out, a, b, common);
+	if (out != rest)
+		memmove(out + common, rest + common, rest_len);
+	memset(out + common + rest_len, 0, n - common - rest_len);
+}
+
+
+int nf2_xor_encode(const struct nf2_xor_pkt *p0, const struct nf2_xor_pkt *p1,
+		   uint8_t *coded, uint32_t room) {
+	uint32_t len;
+
+	if (p0->len > NF2_XOR_MAX_LEN || p1->len > NF2_XOR_MAX_LEN)
+		return -1;
+	len = nf2_xor_coded_len(p0->len, p1->len);
+	if (room < len)
+		return -1;
+
+	coded[0] = NF2_XOR_VERSION;
+	coded[1] = 0;
+	coded[2] = p0->port;
+	coded[3] = p1->port;
+	put16(coded + 4, p0->len);
+	put16(coded + 6, p1->len);
+	put32(coded + 8, p0->id);
+	put32(coded + 12, p1->id);
+	nf2_xor_pad(coded + NF2_XOR_HDR_LEN, len - NF2_XOR_HDR_LEN, p0->data, p0->len,
+		    p1->data, p1->len);
+	return len;
+}
+
+
+int nf2_xor_parse(const uint8_t *coded, uint32_t coded_len, struct nf2_xor_hdr *hdr) {
+	if (coded_len < NF2_XOR_HDR_LEN || coded[0] != NF2_XOR_VERSION)
+		return -1;
+
+	hdr->version = coded[0];
+	hdr->flags = coded[1];
+	hdr->port[0] = coded[2];
+	hdr->port[1] = coded[3];
+	hdr->len[0] = get16(coded + 4);
+	hdr->len[1] = get16(coded + 6);
+	hdr->id[0] = get32(coded + 8);
+	hdr->id[1] = get32(coded + 12);
+	if (coded_len != nf2_xor_coded_len(hdr->len[0], hdr->len[1]))
+		return -1;
+	return 0;
+}
+
+
+int nf2_xor_decode(const uint8_t *coded, uint32_t coded_len, const struct nf2_xor_pkt *known,
+		   uint8_t *buf, uint32_t room, struct nf2_xor_pkt *out) {
+	struct nf2_xor_hdr hdr;
+	int k;
+
+	if (nf2_xor_parse(coded, coded_len, &hdr))
+		return -1;
+	for (k = 0; k < 2; k++)
+		if (hdr.port[k] == known->port && hdr.id[k] == known->id &&
+		    hdr.len[k] == known->len)
+			break;
+	if (k == 2 || room < hdr.len[!k])
+		return -1;
+
+	nf2_xor_pad(buf, hdr.len[!k], coded + NF2_XOR_HDR_LEN, coded_len - NF2_XOR_HDR_LEN,
+		    known->data, known->len);
+	out->data = buf;
+	out->len = hdr.len[!k];
+	out->id = hdr.id[!k];
+	out->port = hdr.port[!k];
+	return 0;
+}
@@ -0,0 +1,97 @@
+/* ****************************************************************************
+ * Module: nf2_xor.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Host XOR network coding of packet pairs, the coding that
+ *              src/XOR_network_coding.v is meant to do.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_XOR_H_
+#define NF2_XOR_H_
+
+#include <stdint.h>
+
+/*
+ * A coded packet is a header followed by the XOR of the two original
+ * packets, the shorter one padded with zeros to the length of the
+ * longer. The header, in network byte order:
+ *
+ *   byte  0     version (NF2_XOR_VERSION)
+ *   byte  1     flags, 0
+ *   bytes 2..3  input port of packet 0 and of packet 1
+ *   bytes 4..7  length of packet 0 and of packet 1, 16 bits each
+ *   bytes 8..15 id of packet 0 and of packet 1, 32 bits each
+ *
+ * The ids are chosen by the sender, e.g. a sequence number per input
+ * port. A receiver holding one of the two packets recovers the other.
+ * Coded packets sent in ethernet frames use NF2_XOR_ETH_TYPE (the IEEE
+ * local experimental ethertype).
+ */
+#define NF2_XOR_VERSION		1
+#define NF2_XOR_HDR_LEN		16
+#define NF2_XOR_MAX_LEN		0xffff
+#define NF2_XOR_ETH_TYPE	0x88b5
+
+struct nf2_xor_pkt {
+	const uint8_t *data;
+	uint32_t len;
+	uint32_t id;
+	uint8_t port;
+};
+
+struct nf2_xor_hdr {
+	uint8_t version;
+	uint8_t flags;
+	uint8_t port[2];
+	uint16_t len[2];
+	uint32_t id[2];
+};
+
+enum nf2_xor_method {
+	NF2_XOR_AUTO,		/* the widest the CPU has */
+	NF2_XOR_SCALAR,		/* 64-bit words */
+	NF2_XOR_SSE2,		/* 128-bit vectors */
+	NF2_XOR_AVX2,		/* 256-bit vectors */
+};
+
+/* nf2_xor_set_method returns -1 if the method is not supported on this CPU */
+int nf2_xor_set_method(enum nf2_xor_method);
+enum nf2_xor_method nf2_xor_get_method(void);
+const char *nf2_xor_method_name(enum nf2_xor_method);
+
+/*
+ * out[i] = a[i] ^ b[i] for i < n, with a and b read as zero from len_a
+ * and len_b on. out may be a or b.
+ */
+void nf2_xor_pad(uint8_t *out, uint32_t n, const uint8_t *a, uint32_t len_a,
+		 const uint8_t *b, uint32_t len_b);
+
+/* Length of the coded packet of two packets of these lengths */
+static inline uint32_t nf2_xor_coded_len(uint32_t len_0, uint32_t len_1) {
+	return NF2_XOR_HDR_LEN + (len_0 > len_1 ? len_0 : len_1);
+}
+
+/*
+ * Codes p0 and p1 into coded, which has room bytes. Returns the length
+ * of the coded packet, or -1 if a packet is longer than NF2_XOR_MAX_LEN
+ * or room is too small.
+ */
+int nf2_xor_encode(const struct nf2_xor_pkt *p0, const struct nf2_xor_pkt *p1,
+		   uint8_t *coded, uint32_t room);
+
+/* Returns 0, or -1 if the header is not a valid one for coded_len bytes */
+int nf2_xor_parse(const uint8_t *coded, uint32_t coded_len, struct nf2_xor_hdr *);
+
+/*
+ * Recovers the packet coded with known (matched by port and id) into
+ * buf, which has room bytes; out gets its data, length, id and port.
+ * buf may be the coded packet itself. Returns 0, or -1 if the coded
+ * packet is invalid, known is not one of its packets (or not of its
+ * length) or room is too small.
+ */
+int nf2_xor_decode(const uint8_t *coded, uint32_t coded_len, const struct nf2_xor_pkt *known,
+		   uint8_t *buf, uint32_t room, struct nf2_xor_pkt *out);
+
+#endif
@@ -0,0 +1,85 @@
+/* ****************************************************************************
+ * Module: nf2util_emu.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: The register calls of nf2util on the emulator
+ *              (common/nf2_emu.h), for linking a tool in place of
+ *              nf2util.o and nf2util_proxy_common.o to run it without a
+ *              card. Every readReg and writeReg is one transaction.
+ *
+ *              The modelled cost comes from NF2_EMU_TXN_NS and
+ *              NF2_EMU_WORD_NS in the environment (default 1500 and
+ *              500 ns); closeDescriptor reports the traffic on stderr.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../../../lib/C/common/nf2util.h"
+#include "nf2_emu.h"
+
+#define DEFAULT_TXN_NS	1500
+#define DEFAULT_WORD_NS	500
+
+struct nf2_emu nf2util_emu;
+static int emu_open;
+
+static unsigned env_ns(const char *name, unsigned def) {
+	const char *s = getenv(name);
+
+	return s != NULL ? (unsigned)atoi(s) : def;
+}
+
+
+static int emu(void) {
+	if (emu_open)
+		return 0;
+	if (nf2_emu_open(&nf2util_emu, env_ns("NF2_EMU_TXN_NS", DEFAULT_TXN_NS),
+			 env_ns("NF2_EMU_WORD_NS", DEFAULT_WORD_NS))) {
+		fprintf(stderr, "Could not allocate the emulated register file\n");
+		return -1;
+	}
+	emu_open = 1;
+	return 0;
+}
+
+
+int check_iface(struct nf2device *nf2) {
+	nf2->net_iface = 1;
+	return 0;
+}
+
+
+int openDescriptor(struct nf2device *nf2) {
+	nf2->fd = -1;
+	return emu();
+}
+
+
+int closeDescriptor(struct nf2device *nf2) {
+	if (emu_open) {
+		fprintf(stderr, "%s (emulated): %lu register transactions, %.3f ms modelled\n",
+			nf2->device_name, nf2util_emu.io.num_txns,
+			nf2util_emu.io.model_ns / 1e6);
+	}
+	return 0;
+}
+
+
+int readReg(struct nf2device *nf2, unsigned reg, unsigned *val) {
+	uint32_t v;
+
+	if (emu() || nf2_regio_read(&nf2util_emu.io, reg, &v))
+		return -1;
+	*val = v;
+	return 0;
+}
+
+
+int writeReg(struct nf2device *nf2, unsigned reg, unsigned val) {
+	if (emu())
+		return -1;
+	return nf2_regio_write(&nf2util_emu.io, reg, val);
+}
@@ -0,0 +1,580 @@
+/* ****************************************************************************
+ * Module: exporter.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Counter exporter daemon.
+ *
+ *              Samples the port, output queue and OPENFLOW_LOOKUP_*
+ *              counters with one bulk snapshot per interval, widens them
+ *              to 64 bits and publishes every sample
+ *               - as Prometheus text on http://127.0.0.1:<port>/metrics
+ *               - as a record in a binary ring file (see nf2_export.h)
+ *                 that other processes can mmap.
+ *              With a flows file it also harvests the exact entry
+ *              counters (common/nf2_harvest.c) at each sample and
+ *              publishes the 64-bit totals of every entry there.
+ *              Scrapes are served from the last sample and never touch
+ *              the card.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+
+#include <time.h>
+
+#include "../common/nf2_regio.h"
+#include "../common/nf2_snapshot.h"
+#include "../common/nf2_counter.h"
+#include "../common/nf2_harvest.h"
+#include "nf2_export.h"
+
+#define DEFAULT_IFACE		"nf2c0"
+#define DEFAULT_PORT		9101
+#define DEFAULT_INTERVAL	1000	/* ms */
+#define DEFAULT_RING_RECORDS	4096
+#define DEFAULT_HOT		1000	/* ms */
+#define DEFAULT_IDLE		10000	/* ms */
+
+#define DERIVED			((size_t)-1)
+
+/*
+ * One exported value: where it comes from in the snapshot and where it
+ * goes in the ring record. Entries of the same metric are adjacent so
+ * that the Prometheus HELP/TYPE lines are printed once per metric.
+ */
+struct metric {
+	const char *name;
+	const char *help;
+	int gauge;
+	const char *label;
+	int label_val;
+	size_t snap_off;
+	size_t rec_off;
+};
+
+#define M_SNAP(f)	offsetof(struct nf2_snapshot, f)
+#define M_REC(f)	offsetof(struct nf2_export_record, f)
+
+#define PORT_METRIC(name, help, gauge, sf, rf) \
+	{ name, help, gauge, "port", 0, M_SNAP(port[0].sf), M_REC(port[0].rf) }, \
+	{ name, help, gauge, "port", 1, M_SNAP(port[1].sf), M_REC(port[1].rf) }, \
+	{ name, help, gauge, "port", 2, M_SNAP(port[2].sf), M_REC(port[2].rf) }, \
+	{ name, help, gauge, "port", 3, M_SNAP(port[3].sf), M_REC(port[3].rf) }
+
+#define QUEUE_METRIC(name, help, gauge, sf, rf) \
+	{ name, help, gauge, "queue", 0, M_SNAP(sf[0]), M_REC(rf[0]) }, \
+	{ name, help, gauge, "queue", 1, M_SNAP(sf[1]), M_REC(rf[1]) }, \
+	{ name, help, gauge, "queue", 2, M_SNAP(sf[2]), M_REC(rf[2]) }, \
+	{ name, help, gauge, "queue", 3, M_SNAP(sf[3]), M_REC(rf[3]) }, \
+	{ name, help, gauge, "queue", 4, M_SNAP(sf[4]), M_REC(rf[4]) }, \
+	{ name, help, gauge, "queue", 5, M_SNAP(sf[5]), M_REC(rf[5]) }, \
+	{ name, help, gauge, "queue", 6, M_SNAP(sf[6]), M_REC(rf[6]) }, \
+	{ name, help, gauge, "queue", 7, M_SNAP(sf[7]), M_REC(rf[7]) }
+
+#define OQ_METRIC(name, help, gauge, sf, rf) \
+	{ name, help, gauge, "queue", 0, M_SNAP(oq[0].sf), M_REC(oq[0].rf) }, \
+	{ name, help, gauge, "queue", 1, M_SNAP(oq[1].sf), M_REC(oq[1].rf) }, \
+	{ name, help, gauge, "queue", 2, M_SNAP(oq[2].sf), M_REC(oq[2].rf) }, \
+	{ name, help, gauge, "queue", 3, M_SNAP(oq[3].sf), M_REC(oq[3].rf) }, \
+	{ name, help, gauge, "queue", 4, M_SNAP(oq[4].sf), M_REC(oq[4].rf) }, \
+	{ name, help, gauge, "queue", 5, M_SNAP(oq[5].sf), M_REC(oq[5].rf) }, \
+	{ name, help, gauge, "queue", 6, M_SNAP(oq[6].sf), M_REC(oq[6].rf) }, \
+	{ name, help, gauge, "queue", 7, M_SNAP(oq[7].sf), M_REC(oq[7].rf) }
+
+static const struct metric metrics[] = {
+	PORT_METRIC("nf2_port_rx_packets_total", "Packets stored in the rx queue", 0,
+		    rx_q_num_pkts_stored, rx_pkts),
+	PORT_METRIC("nf2_port_rx_bytes_total", "Bytes pushed out of the rx queue", 0,
+		    rx_q_num_bytes_pushed, rx_bytes),
+	PORT_METRIC("nf2_port_rx_words_total", "Words pushed out of the rx queue", 0,
+		    rx_q_num_words_pushed, rx_words),
+	PORT_METRIC("nf2_port_rx_dequeued_total", "Packets dequeued from the rx queue", 0,
+		    rx_q_num_pkts_dequeued, rx_dequeued),
+	PORT_METRIC("nf2_port_rx_dropped_full_total", "Packets dropped, rx queue full", 0,
+		    rx_q_num_pkts_dropped_full, rx_dropped_full),
+	PORT_METRIC("nf2_port_rx_dropped_bad_total", "Packets dropped, bad FCS", 0,
+		    rx_q_num_pkts_dropped_bad, rx_dropped_bad),
+	PORT_METRIC("nf2_port_rx_queue_packets", "Packets in the rx queue", 1,
+		    rx_q_num_pkts_in_queue, rx_in_queue),
+	PORT_METRIC("nf2_port_tx_packets_total", "Packets sent from the tx queue", 0,
+		    tx_q_num_pkts_sent, tx_pkts),
+	PORT_METRIC("nf2_port_tx_bytes_total", "Bytes pushed out of the tx queue", 0,
+		    tx_q_num_bytes_pushed, tx_bytes),
+	PORT_METRIC("nf2_port_tx_words_total", "Words pushed out of the tx queue", 0,
+		    tx_q_num_words_pushed, tx_words),
+	PORT_METRIC("nf2_port_tx_enqueued_total", "Packets enqueued to the tx queue", 0,
+		    tx_q_num_pkts_enqueued, tx_enqueued),
+	PORT_METRIC("nf2_port_tx_queue_packets", "Packets in the tx queue", 1,
+		    tx_q_num_pkts_in_queue, tx_in_queue),
+
+	OQ_METRIC("nf2_oq_packets_total", "Packets received by the output queue", 0,
+		  num_pkts_received, pkts),
+	OQ_METRIC("nf2_oq_bytes_total", "Bytes received by the output queue", 0,
+		  num_pkt_bytes_received, bytes),
+	OQ_METRIC("nf2_oq_dropped_total", "Packets dropped by the output queue", 0,
+		  num_pkts_dropped, dropped),
+	OQ_METRIC("nf2_oq_words", "Words in the output queue", 1,
+		  num_words_in_queue, words_in_queue),
+
+	{ "nf2_lookup_exact_hits_total", "Exact table hits", 0, NULL, 0,
+	  M_SNAP(lookup.exact_hits), M_REC(exact_hits) },
+	{ "nf2_lookup_exact_misses_total", "Exact table misses", 0, NULL, 0,
+	  M_SNAP(lookup.exact_misses), M_REC(exact_misses) },
+	{ "nf2_lookup_wildcard_hits_total", "Wildcard table hits", 0, NULL, 0,
+	  M_SNAP(lookup.wildcard_hits), M_REC(wildcard_hits) },
+	{ "nf2_lookup_wildcard_misses_total", "Wildcard table misses", 0, NULL, 0,
+	  M_SNAP(lookup.wildcard_misses), M_REC(wildcard_misses) },
+	QUEUE_METRIC("nf2_lookup_dropped_total", "Packets dropped by the lookup", 0,
+		     lookup.num_pkts_dropped, lookup_dropped),
+	{ "nf2_lookup_matched_total", "Exact and wildcard hits", 0, NULL, 0,
+	  DERIVED, M_REC(matched) },
+	{ "nf2_lookup_missed_total", "Exact and wildcard misses", 0, NULL, 0,
+	  DERIVED, M_REC(missed) },
+	{ "nf2_lookup_timer", "OpenFlow lookup timer", 1, NULL, 0,
+	  M_SNAP(lookup.timer), M_REC(timer) },
+};
+
+#define NUM_METRICS	(sizeof(metrics) / sizeof(metrics[0]))
+
+/* Global vars */
+static struct nf2device nf2;
+static struct nf2_regio regio;
+static struct nf2_snapshot snap;
+static struct nf2_counter64 counters[NUM_METRICS];
+static struct nf2_export_record last;
+static struct nf2_export_ring *ring;
+static size_t ring_len;
+static struct nf2_harvest harvest;
+static struct nf2_export_flows *flows;
+static size_t flows_len;
+static volatile sig_atomic_t done = 0;
+
+/* Function declarations */
+void usage (void);
+void sighandler (int);
+int ring_open (const char *, int, int);
+int flows_open (const char *);
+void *map_file (const char *, size_t);
+int listen_local (int);
+void sample (void);
+void serve (int);
+size_t render (char *, size_t);
+uint64_t now_ns (clockid_t);
+
+int main(int argc, char *argv[]) {
+	const char *ring_path = NULL, *flows_path = NULL;
+	struct nf2_harvest_cfg hcfg;
+	int hot_ms = DEFAULT_HOT, idle_ms = DEFAULT_IDLE;
+	int port = DEFAULT_PORT;
+	int interval_ms = DEFAULT_INTERVAL;
+	int num_records = DEFAULT_RING_RECORDS;
+	int use_mmap = 0, use_mock = 0, daemonize = 0;
+	int lfd = -1, c, i;
+	uint64_t next, t;
+	struct pollfd pfd;
+
+	nf2.device_name = DEFAULT_IFACE;
+
+	while ((c = getopt(argc, argv, "i:mMt:p:r:n:x:H:I:dh")) != -1) {
+		switch (c) {
+		case 'i':
+			nf2.device_name = optarg;
+			break;
+		case 'm':
+			use_mmap = 1;
+			break;
+		case 'M':
+			use_mock = 1;
+			break;
+		case 't':
+			interval_ms = atoi(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'r':
+			ring_path = optarg;
+			break;
+		case 'n':
+			num_records = atoi(optarg);
+			break;
+		case 'x':
+			flows_path = optarg;
+			break;
+		case 'H':
+			hot_ms = atoi(optarg);
+			break;
+		case 'I':
+			idle_ms = atoi(optarg);
+			break;
+		case 'd':
+			daemonize = 1;
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (interval_ms <= 0 || num_records <= 0 || port < 0 || hot_ms <= 0 || idle_ms <= 0) {
+		usage();
+		exit(1);
+	}
+	/* an entry may wait a whole interval past its due time */
+	if (flows_path != NULL &&
+	    (hot_ms > idle_ms || (idle_ms + interval_ms) * 1000000ULL >= NF2_HARVEST_WRAP_NS)) {
+		fprintf(stderr, "The idle interval plus the sampling interval must stay "
+			"below %llu ms\n", NF2_HARVEST_WRAP_NS / 1000000);
+		exit(1);
+	}
+
+	if (use_mock) {
+		if (nf2_regio_open_mock(&regio, 0, 0))
+			exit(1);
+	}
+	else {
+		if (check_iface(&nf2)) {
+			exit(1);
+		}
+		if (openDescriptor(&nf2)) {
+			exit(1);
+		}
+		if (use_mmap) {
+			if (nf2_regio_open_mmap(&regio, nf2.device_name))
+				exit(1);
+		}
+		else {
+			nf2_regio_open_ioctl(&regio, &nf2);
+		}
+	}
+
+	for (i = 0; i < NUM_METRICS; i++)
+		nf2_counter64_init(&counters[i], 32);
+
+	if (ring_path != NULL && ring_open(ring_path, num_records, interval_ms))
+		exit(1);
+	if (flows_path != NULL) {
+		hcfg.hot_ns = hot_ms * 1000000ULL;
+		hcfg.idle_ns = idle_ms * 1000000ULL;
+		hcfg.merge_words = 0;
+		if (nf2_harvest_init(&harvest, &hcfg, now_ns(CLOCK_MONOTONIC)) ||
+		    flows_open(flows_path))
+			exit(1);
+	}
+	if (port > 0 && (lfd = listen_local(port)) < 0)
+		exit(1);
+
+	if (daemonize && daemon(0, 0) < 0) {
+		perror("daemon");
+		exit(1);
+	}
+
+	signal(SIGINT, sighandler);
+	signal(SIGTERM, sighandler);
+	signal(SIGPIPE, SIG_IGN);
+
+	sample();
+	next = now_ns(CLOCK_MONOTONIC) + interval_ms * 1000000ULL;
+	while (!done) {
+		t = now_ns(CLOCK_MONOTONIC);
+		if (t >= next) {
+			sample();
+			next += interval_ms * 1000000ULL;
+			if (next <= t)	/* fell behind, don't burst */
+				next = t + interval_ms * 1000000ULL;
+			continue;
+		}
+
+		pfd.fd = lfd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, lfd >= 0, (next - t + 999999) / 1000000) > 0)
+			serve(lfd);
+	}
+
+	if (lfd >= 0)
+		close(lfd);
+	if (ring != NULL)
+		munmap(ring, ring_len);
+	if (flows != NULL) {
+		munmap(flows, flows_len);
+		nf2_harvest_free(&harvest);
+	}
+	nf2_regio_close(&regio);
+	if (!use_mock)
+		closeDescriptor(&nf2);
+	return 0;
+}
+
+
+void usage(void) {
+	printf("Usage: nf2_exporter [-i interface] [-m] [-M] [-t interval_ms]\n");
+	printf("                    [-p port] [-r ring_file] [-n records]\n");
+	printf("                    [-x flows_file] [-H hot_ms] [-I idle_ms] [-d]\n");
+	printf("  -i  interface of the card (default %s)\n", DEFAULT_IFACE);
+	printf("  -m  read the registers through a mapping of the register BAR\n");
+	printf("  -M  sample the mock register file instead of a card\n");
+	printf("  -t  sampling interval (default %d ms)\n", DEFAULT_INTERVAL);
+	printf("  -p  serve Prometheus text on 127.0.0.1:port (default %d, 0 = off)\n",
+	       DEFAULT_PORT);
+	printf("  -r  write every sample to this ring file\n");
+	printf("  -n  records in the ring file (default %d)\n", DEFAULT_RING_RECORDS);
+	printf("  -x  harvest the exact entry counters into this flows file\n");
+	printf("  -H  re-read entries that counted after (default %d ms)\n", DEFAULT_HOT);
+	printf("  -I  re-read the other entries after (default %d ms)\n", DEFAULT_IDLE);
+	printf("  -d  run as a daemon\n");
+}
+
+
+void sighandler(int sig) {
+	done = 1;
+}
+
+
+uint64_t now_ns(clockid_t clk) {
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+//
+// map_file: create (or truncate) the file with len bytes and map it
+//
+void *map_file(const char *path, size_t len) {
+	void *p;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		return NULL;
+	}
+	if (ftruncate(fd, len) < 0) {
+		perror(path);
+		close(fd);
+		return NULL;
+	}
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+	return p;
+}
+
+
+int ring_open(const char *path, int num_records, int interval_ms) {
+	ring_len = sizeof(struct nf2_export_ring) +
+		   (size_t)num_records * sizeof(struct nf2_export_record);
+	ring = map_file(path, ring_len);
+	if (ring == NULL)
+		return -1;
+
+	ring->version = NF2_EXPORT_VERSION;
+	ring->hdr_size = sizeof(struct nf2_export_ring);
+	ring->record_size = sizeof(struct nf2_export_record);
+	ring->num_records = num_records;
+	ring->interval_ns = interval_ms * 1000000ULL;
+	ring->head = 0;
+	__atomic_store_n(&ring->magic, NF2_EXPORT_MAGIC, __ATOMIC_RELEASE);
+	return 0;
+}
+
+
+int flows_open(const char *path) {
+	flows_len = sizeof(struct nf2_export_flows) +
+		    (size_t)NF2_HARVEST_ENTRIES * sizeof(struct nf2_export_flow);
+	flows = map_file(path, flows_len);
+	if (flows == NULL)
+		return -1;
+
+	flows->version = NF2_EXPORT_FLOWS_VERSION;
+	flows->hdr_size = sizeof(struct nf2_export_flows);
+	flows->flow_size = sizeof(struct nf2_export_flow);
+	flows->num_flows = NF2_HARVEST_ENTRIES;
+	flows->seq = 0;
+	__atomic_store_n(&flows->magic, NF2_EXPORT_FLOWS_MAGIC, __ATOMIC_RELEASE);
+	return 0;
+}
+
+
+int listen_local(int port) {
+	struct sockaddr_in addr;
+	int fd, one = 1;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(fd, 16) < 0) {
+		perror("bind");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+
+//
+// publish_flows: copy the harvested totals to the flows file
+//
+static void publish_flows(void) {
+	uint64_t seq = flows->seq;
+	int i;
+
+	__atomic_store_n(&flows->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	for (i = 0; i < NF2_HARVEST_ENTRIES; i++) {
+		flows->flows[i].pkts = harvest.flows[i].pkts;
+		flows->flows[i].bytes = harvest.flows[i].bytes;
+		flows->flows[i].read_ns = harvest.flows[i].read_ns;
+	}
+	flows->timestamp_ns = now_ns(CLOCK_REALTIME);
+	__atomic_store_n(&flows->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+
+//
+// sample: take one snapshot, widen the counters and publish the record
+//
+void sample(void) {
+	struct nf2_export_record *rec;
+	uint64_t seq;
+	int i;
+
+	if (nf2_snapshot_read(&regio, &snap, NF2_SNAP_COUNTERS)) {
+		fprintf(stderr, "Error reading registers from %s\n", nf2.device_name);
+		return;
+	}
+
+	for (i = 0; i < NUM_METRICS; i++) {
+		const struct metric *m = &metrics[i];
+		uint64_t *val = (uint64_t *)((char *)&last + m->rec_off);
+		uint32_t raw;
+
+		if (m->snap_off == DERIVED)
+			continue;
+		raw = *(uint32_t *)((char *)&snap + m->snap_off);
+		if (m->gauge) {
+			*val = raw;
+		}
+		else {
+			nf2_counter64_update(&counters[i], raw);
+			*val = counters[i].total;
+		}
+	}
+	last.matched = last.exact_hits + last.wildcard_hits;
+	last.missed = last.exact_misses + last.wildcard_misses;
+	last.timestamp_ns = now_ns(CLOCK_REALTIME);
+
+	if (flows != NULL) {
+		if (nf2_harvest_poll(&harvest, &regio, now_ns(CLOCK_MONOTONIC)) < 0)
+			fprintf(stderr, "Error reading exact counters from %s\n",
+				nf2.device_name);
+		else
+			publish_flows();
+	}
+
+	if (ring == NULL)
+		return;
+
+	seq = ring->head;
+	rec = &ring->records[seq % ring->num_records];
+	__atomic_store_n(&rec->seq_begin, seq, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	last.seq_begin = seq;
+	last.seq_end = seq;
+	memcpy((char *)rec + sizeof(rec->seq_begin), (char *)&last + sizeof(last.seq_begin),
+	       offsetof(struct nf2_export_record, seq_end) - sizeof(rec->seq_begin));
+	__atomic_store_n(&rec->seq_end, seq, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->head, seq + 1, __ATOMIC_RELEASE);
+}
+
+
+size_t render(char *buf, size_t len) {
+	const char *prev = NULL;
+	size_t n = 0;
+	int i;
+
+	for (i = 0; i < NUM_METRICS && n < len; i++) {
+		const struct metric *m = &metrics[i];
+		unsigned long long val = *(uint64_t *)((char *)&last + m->rec_off);
+
+		if (prev == NULL || strcmp(prev, m->name) != 0) {
+			n += snprintf(buf + n, len - n, "# HELP %s %s\n# TYPE %s %s\n",
+				      m->name, m->help, m->name,
+				      m->gauge ? "gauge" : "counter");
+			prev = m->name;
+		}
+		if (n >= len)
+			break;
+		if (m->label != NULL)
+			n += snprintf(buf + n, len - n, "%s{%s=\"%d\"} %llu\n",
+				      m->name, m->label, m->label_val, val);
+		else
+			n += snprintf(buf + n, len - n, "%s %llu\n", m->name, val);
+	}
+	return n < len ? n : len;
+}
+
+
+//
+// serve: answer one scrape with the last sample. Any request gets the
+//    metrics; the request itself is not parsed.
+//
+void serve(int lfd) {
+	static char body[32768];
+	char hdr[160], req[1024];
+	struct pollfd pfd;
+	size_t len;
+	int fd;
+
+	fd = accept(lfd, NULL, NULL);
+	if (fd < 0)
+		return;
+
+	/* Don't let a client that never sends its request stall sampling */
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 100) <= 0 || read(fd, req, sizeof(req)) <= 0) {
+		close(fd);
+		return;
+	}
+
+	len = render(body, sizeof(body));
+	snprintf(hdr, sizeof(hdr),
+		 "HTTP/1.0 200 OK\r\n"
+		 "Content-Type: text/plain; version=0.0.4\r\n"
+		 "Content-Length: %zu\r\n\r\n", len);
+	if (write(fd, hdr, strlen(hdr)) < 0 || write(fd, body, len) < 0)
+		perror("write");
+	close(fd);
+}
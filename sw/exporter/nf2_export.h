@@ -0,0 +1,108 @@
+/* ****************************************************************************
+ * Module: nf2_export.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Layout of the binary counter ring written by nf2_exporter.
+ *
+ *              The ring file is a header followed by num_records records.
+ *              Sample n is stored in record n % num_records and the
+ *              header's head is n + 1 once it is complete. The writer
+ *              stores seq_begin, then the counters, then seq_end. Readers
+ *              load seq_end, copy the record, then load seq_begin: the
+ *              copy is consistent if both equal the sample number.
+ *
+ *              Counters are 64-bit totals widened on the host from the
+ *              32-bit hardware counters; queue occupancies are gauges.
+ *
+ *              The flows file (-x) holds the harvested totals of every
+ *              exact entry, by index. The writer makes seq odd, updates
+ *              the flows, then makes seq even again. Readers load seq,
+ *              copy what they need, then load seq again: the copy is
+ *              consistent if both are the same even number.
+ *
+ * Change history:
+ *
+ */
+
+#ifndef NF2_EXPORT_H_
+#define NF2_EXPORT_H_
+
+#include <stdint.h>
+
+#define NF2_EXPORT_MAGIC	0x4e463245	/* "NF2E" */
+#define NF2_EXPORT_VERSION	1
+
+#define NF2_EXPORT_PORT_NUM	4
+#define NF2_EXPORT_OQ_NUM	8
+
+struct nf2_export_port {
+	uint64_t rx_pkts;
+	uint64_t rx_bytes;
+	uint64_t rx_words;
+	uint64_t rx_dequeued;
+	uint64_t rx_dropped_full;
+	uint64_t rx_dropped_bad;
+	uint64_t rx_in_queue;		/* gauge */
+	uint64_t tx_pkts;
+	uint64_t tx_bytes;
+	uint64_t tx_words;
+	uint64_t tx_enqueued;
+	uint64_t tx_in_queue;		/* gauge */
+};
+
+struct nf2_export_oq {
+	uint64_t pkts;
+	uint64_t bytes;
+	uint64_t dropped;
+	uint64_t words_in_queue;	/* gauge */
+};
+
+struct nf2_export_record {
+	uint64_t seq_begin;
+	uint64_t timestamp_ns;		/* CLOCK_REALTIME */
+	struct nf2_export_port port[NF2_EXPORT_PORT_NUM];
+	struct nf2_export_oq oq[NF2_EXPORT_OQ_NUM];
+	uint64_t exact_hits;
+	uint64_t exact_misses;
+	uint64_t wildcard_hits;
+	uint64_t wildcard_misses;
+	uint64_t lookup_dropped[NF2_EXPORT_OQ_NUM];
+	uint64_t matched;		/* as nf2_get_matched_count() */
+	uint64_t missed;		/* as nf2_get_missed_count() */
+	uint64_t timer;			/* gauge: OPENFLOW_LOOKUP_TIMER_REG */
+	uint64_t seq_end;
+};
+
+struct nf2_export_ring {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t hdr_size;
+	uint32_t record_size;
+	uint32_t num_records;
+	uint64_t interval_ns;
+	uint64_t head;			/* number of samples written */
+	uint8_t pad[32];
+	struct nf2_export_record records[];
+};
+
+#define NF2_EXPORT_FLOWS_MAGIC	0x4e463246	/* "NF2F" */
+#define NF2_EXPORT_FLOWS_VERSION	1
+
+struct nf2_export_flow {
+	uint64_t pkts;
+	uint64_t bytes;
+	uint64_t read_ns;		/* CLOCK_MONOTONIC of the last read */
+};
+
+struct nf2_export_flows {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t hdr_size;
+	uint32_t flow_size;
+	uint32_t num_flows;
+	uint64_t seq;
+	uint64_t timestamp_ns;		/* CLOCK_REALTIME of the last update */
+	uint8_t pad[32];
+	struct nf2_export_flow flows[];
+};
+
+#endif
@@ -0,0 +1,673 @@
+/* ****************************************************************************
+ * Module: fastpath.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Software forwarding of the exact flows that overflow the
+ *              card's tables.
+ *
+ *              Packets that miss both tables of the card go to the CPU
+ *              queues and arrive on nf2c0..3. fastpath receives them on
+ *              memory mapped TPACKET_V3 rings (common/nf2_afpacket.c), in
+ *              blocks rather than one syscall each, builds their flow
+ *              entries in batches (nf2_flowkey_extract_batch), looks them
+ *              up in a host cuckoo table of the exact flows of a flow file
+ *              (common/nf2_swtable.c), applies the flows' actions as
+ *              opl_processor does (common/nf2_action.c) and sends them out
+ *              of the interfaces of their output ports through the rings'
+ *              transmit halves, with one send() per round over the ports.
+ *              Misses and packets for the CPU ports are passed to a miss
+ *              interface for the software switch, or dropped and counted.
+ *
+ *              With a control FIFO ("-c") the misses go through the
+ *              packet-in front end (common/nf2_missq.c): only the first
+ *              miss of a flow is passed on, the next ones are held until
+ *              its rule comes back on the FIFO, as a flow file line. The
+ *              rules that arrive together are installed together: in the
+ *              host table, and with "-d" in the card's exact table with
+ *              batched writes (nf2_exact_insert_batch); the frames held
+ *              for them are then forwarded.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <time.h>
+#include <sys/stat.h>
+
+#include "../common/nf2_afpacket.h"
+#include "../common/nf2_flowkey.h"
+#include "../common/nf2_flowfile.h"
+#include "../common/nf2_swtable.h"
+#include "../common/nf2_action.h"
+#include "../common/nf2_missq.h"
+#include "../common/nf2_exact_table.h"
+#include "../common/nf2_regio.h"
+
+#define MAX_PORTS		4	/* MAC ports of the card */
+#define BATCH			64
+#define DEFAULT_MAX_FLOWS	(1 << 16)
+#define POLL_MS			100
+#define CONTROL_BUF		(64 << 10)
+#define MOCK_TXN_NS		1500
+#define MOCK_WORD_NS		500
+
+#define MAC_QUEUES		0x5555	/* even output queues */
+#define CPU_QUEUES		0xaaaa	/* odd output queues */
+
+#if NF2_AFP_HEADROOM < NF2_ACTION_HEADROOM + 4
+#error "no room left for an action to add a tag to a frame the kernel untagged"
+#endif
+
+struct fp_stats {
+	uint64_t pkts;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t punts;			/* to the CPU ports by a flow's action */
+	uint64_t drops;			/* no output, or no headroom for a tag */
+	uint64_t out_pkts;
+	uint64_t miss_pkts;		/* passed to the miss interface */
+	uint64_t miss_drops;		/* misses and punts without a miss interface */
+	uint64_t rules;			/* read from the control FIFO */
+	uint64_t bad_rules;		/* unreadable, or wildcard */
+	uint64_t install_batches;
+	uint64_t card_installs;
+	uint64_t card_full;		/* left to the host table only */
+	uint64_t host_full;
+};
+
+static struct nf2_afp_port ports[MAX_PORTS];
+static int num_ports;
+static struct nf2_afp_port miss_port;
+static int have_miss_port;
+static struct nf2_swtable table;
+static struct fp_stats stats;
+static volatile sig_atomic_t stop;
+
+/* packet-in front end and the rules coming back */
+static struct nf2_missq missq;
+static int control_fd = -1;
+static char control_buf[CONTROL_BUF];
+static int control_len;
+static nf2_of_entry_wrap rule_entries[NF2_EXACT_BATCH];
+static nf2_of_action_wrap rule_actions[NF2_EXACT_BATCH];
+static int num_rules;
+
+static struct nf2_regio io;
+static struct nf2_exact_table exact;
+static int have_card;
+
+void usage (void);
+void on_signal (int);
+int load_flows (const char *path, int *wildcards);
+int open_card (const char *name);
+int open_control (const char *path);
+int forward_port (int i);
+void output (const struct nf2_pkt *, const int *fwd, int n);
+void punt (const uint8_t *data, uint32_t len);
+int read_control (void);
+void install_rules (void);
+void send_copy (struct nf2_afp_port *, const uint8_t *data, uint32_t len);
+void flush_all (void);
+void print_stats (double secs);
+void print_port (struct nf2_afp_port *);
+double now_secs (void);
+uint64_t now_ns (void);
+
+int main(int argc, char *argv[]) {
+	static const char *default_ifs[MAX_PORTS] = { "nf2c0", "nf2c1", "nf2c2", "nf2c3" };
+	struct nf2_afp_cfg cfg = NF2_AFP_DEFAULT_CFG;
+	struct nf2_missq_cfg missq_cfg = NF2_MISSQ_DEFAULT_CFG;
+	struct pollfd pfd[MAX_PORTS + 1];
+	struct fp_stats last;
+	const char *flowfile = NULL, *miss_if = NULL, *control = NULL, *card = NULL;
+	int max_flows = DEFAULT_MAX_FLOWS, interval = 0, wildcards = 0;
+	int c, i, work, num_pfd, num_flows = 0;
+	uint64_t last_punts = 0;
+	double start, last_print, t;
+
+	while ((c = getopt(argc, argv, "f:m:n:s:c:d:b:t:h")) != -1) {
+		switch (c) {
+		case 'f':
+			flowfile = optarg;
+			break;
+		case 'm':
+			miss_if = optarg;
+			break;
+		case 'n':
+			max_flows = atoi(optarg);
+			break;
+		case 's':
+			interval = atoi(optarg);
+			break;
+		case 'c':
+			control = optarg;
+			break;
+		case 'd':
+			card = optarg;
+			break;
+		case 'b':
+			missq_cfg.per_flow = atoi(optarg);
+			missq_cfg.pool_frames = 1024 * missq_cfg.per_flow;
+			break;
+		case 't':
+			missq_cfg.timeout_ns = strtoull(optarg, NULL, 0) * 1000000;
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (argc - optind > MAX_PORTS || max_flows <= 0 || interval < 0 ||
+	    missq_cfg.per_flow <= 0 || missq_cfg.per_flow > NF2_MISSQ_MAX_PER_FLOW ||
+	    missq_cfg.timeout_ns == 0 || (card && !control)) {
+		usage();
+		exit(1);
+	}
+
+	if (nf2_swtable_init(&table, max_flows)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	if (flowfile) {
+		num_flows = load_flows(flowfile, &wildcards);
+		if (num_flows < 0)
+			exit(1);
+	}
+	if (control) {
+		if (nf2_missq_init(&missq, &missq_cfg)) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		if (open_control(control))
+			exit(1);
+	}
+	if (card && open_card(card))
+		exit(1);
+
+	/* port i is MAC port i: source port 2i, output queue 2i */
+	num_ports = optind < argc ? argc - optind : MAX_PORTS;
+	for (i = 0; i < num_ports; i++) {
+		if (nf2_afp_open(&ports[i], optind < argc ? argv[optind + i] : default_ifs[i],
+				 &cfg))
+			exit(1);
+		pfd[i].fd = ports[i].fd;
+		pfd[i].events = POLLIN;
+	}
+	num_pfd = num_ports;
+	if (control_fd >= 0) {
+		pfd[num_pfd].fd = control_fd;
+		pfd[num_pfd++].events = POLLIN;
+	}
+	if (miss_if) {
+		if (nf2_afp_open(&miss_port, miss_if, &cfg))
+			exit(1);
+		have_miss_port = 1;
+	}
+
+	printf("%d exact flows", num_flows);
+	if (wildcards)
+		printf(" (%d wildcard rules skipped: they stay in the card's table)", wildcards);
+	printf(", %d ports%s%s%s%s%s%s\n", num_ports, miss_if ? ", misses to " : "",
+	       miss_if ? miss_if : "", control ? ", rules from " : "", control ? control : "",
+	       card ? ", installed in " : "", card ? card : "");
+	fflush(stdout);
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	start = last_print = now_secs();
+	last = stats;
+	while (!stop) {
+		work = 0;
+		for (i = 0; i < num_ports; i++)
+			work += forward_port(i);
+		if (control_fd >= 0) {
+			work += read_control();
+			nf2_missq_expire(&missq, now_ns());
+		}
+		flush_all();
+
+		if (interval && (t = now_secs()) - last_print >= interval) {
+			printf("%.1f s: %.3f Mpps in, %.3f Mpps out, %llu misses, %llu drops",
+			       t - start, (stats.pkts - last.pkts) / (t - last_print) / 1e6,
+			       (stats.out_pkts - last.out_pkts) / (t - last_print) / 1e6,
+			       (unsigned long long)(stats.misses - last.misses),
+			       (unsigned long long)(stats.drops - last.drops));
+			if (control_fd >= 0) {
+				printf(", %.0f punts/s, %d flows waiting",
+				       (missq.stats.punts - last_punts) / (t - last_print),
+				       missq.num_waiting);
+				last_punts = missq.stats.punts;
+			}
+			printf("\n");
+			fflush(stdout);
+			last = stats;
+			last_print = t;
+		}
+		if (!work)
+			poll(pfd, num_pfd, POLL_MS);
+	}
+
+	print_stats(now_secs() - start);
+	for (i = 0; i < num_ports; i++)
+		nf2_afp_close(&ports[i]);
+	if (have_miss_port)
+		nf2_afp_close(&miss_port);
+	if (control_fd >= 0) {
+		close(control_fd);
+		nf2_missq_free(&missq);
+	}
+	if (have_card) {
+		nf2_exact_table_free(&exact);
+		nf2_regio_close(&io);
+	}
+	nf2_swtable_free(&table);
+	return 0;
+}
+
+
+void usage(void) {
+	printf("Usage: fastpath [-f flowfile] [-m miss_if] [-n max_flows] [-s secs]\n"
+	       "                [if0 [if1 [if2 [if3]]]]\n");
+	printf("  Interface n is MAC port n: its packets have source port 2n and\n"
+	       "  output queue 2n sends out of it (default nf2c0 nf2c1 nf2c2 nf2c3).\n");
+	printf("  -f  exact flows to forward (format in common/nf2_flowfile.h);\n"
+	       "      wildcard rules are skipped\n");
+	printf("  -m  interface to pass misses and packets for the CPU ports to\n"
+	       "      (default: drop and count them)\n");
+	printf("  -n  room for this many flows (default %d)\n", DEFAULT_MAX_FLOWS);
+	printf("  -s  print the rates every secs seconds\n");
+	printf("  -c  FIFO (made if missing) to read the rules of the flows that\n"
+	       "      missed from, as flow file lines; only the first miss of a\n"
+	       "      flow is passed on and the next ones are held for its rule\n");
+	printf("  -d  also install the rules in the exact table of this card, or of\n"
+	       "      the register file emulator (\"mock\"); fastpath owns the table\n");
+	printf("  -b  frames held per flow waiting for its rule, at most %d\n"
+	       "      (default %d)\n", NF2_MISSQ_MAX_PER_FLOW, NF2_MISSQ_DEFAULT_PER_FLOW);
+	printf("  -t  ms a flow waits for its rule before it is passed on again\n"
+	       "      (default %d)\n", NF2_MISSQ_DEFAULT_TIMEOUT_MS);
+}
+
+
+void on_signal(int sig) {
+	stop = 1;
+}
+
+
+//
+// load_flows: inserts the exact flows of a flow file. Returns the number
+//    of flows or -1
+//
+int load_flows(const char *path, int *wildcards) {
+	struct nf2_flowfile_rule *rules;
+	int i, n, num = 0;
+
+	n = nf2_flowfile_read(path, &rules);
+	if (n < 0)
+		return -1;
+	for (i = 0; i < n; i++) {
+		if (!rules[i].exact) {
+			(*wildcards)++;
+			continue;
+		}
+		if (nf2_swtable_insert(&table, &rules[i].entry, &rules[i].action) < 0) {
+			fprintf(stderr, "%s:%d: the table is full (-n %d)\n", path,
+				rules[i].line, table.max_flows);
+			free(rules);
+			return -1;
+		}
+		num++;
+	}
+	free(rules);
+	return num;
+}
+
+
+//
+// forward_port: forwards the packets of the block being read on port i,
+//    a batch at a time, and hands the block back once it is used up.
+//    Returns the number of packets forwarded
+//
+int forward_port(int i) {
+	struct nf2_afp_port *p = &ports[i];
+	struct nf2_afp_pkt rx[BATCH];
+	const uint8_t *frames[BATCH];
+	uint32_t caplens[BATCH], sizes[BATCH];
+	int src_ports[BATCH], flows[BATCH], fwd[BATCH];
+	nf2_of_entry_wrap keys[BATCH];
+	const struct nf2_action_plan *plans[BATCH];
+	struct nf2_pkt pkts[BATCH];
+	uint64_t now = 0;
+	int n, k, m, total = 0;
+
+	for (;;) {
+		for (n = 0; n < BATCH && nf2_afp_rx_next(p, &rx[n]); n++) {
+			frames[n] = rx[n].data;
+			caplens[n] = rx[n].caplen;
+			sizes[n] = rx[n].len;
+			src_ports[n] = 2 * i;
+		}
+		if (n) {
+			nf2_flowkey_extract_batch(frames, caplens, src_ports, n, keys);
+			nf2_swtable_lookup_batch(&table, keys, sizes, n, flows);
+
+			/* the hits are rewritten in place in the ring, together */
+			for (k = 0, m = 0; k < n; k++) {
+				if (flows[k] < 0) {
+					stats.misses++;
+					if (control_fd >= 0) {
+						if (now == 0)
+							now = now_ns();
+						if (nf2_missq_miss(&missq, &keys[k], rx[k].data,
+								   rx[k].caplen, now) != NF2_MISSQ_PUNT)
+							continue;
+					}
+					punt(rx[k].data, rx[k].caplen);
+					continue;
+				}
+				plans[m] = &table.flows[flows[k]].plan;
+				pkts[m].data = rx[k].data;
+				pkts[m].len = rx[k].caplen;
+				pkts[m].headroom = rx[k].headroom;
+				m++;
+			}
+			nf2_action_apply_batch(plans, pkts, m, fwd);
+			output(pkts, fwd, m);
+			stats.pkts += n;
+			stats.hits += m;
+			total += n;
+		}
+		/* one block per round, so that no port waits on a busy one */
+		if (p->cur && p->left == 0) {
+			nf2_afp_rx_release(p);
+			return total;
+		}
+		if (n < BATCH)
+			return total;
+	}
+}
+
+
+//
+// output: sends rewritten packets out of the ports of their forward
+//    bitmasks
+//
+void output(const struct nf2_pkt *pkts, const int *fwd, int n) {
+	unsigned bits;
+	int k, j;
+
+	for (k = 0; k < n; k++) {
+		if (fwd[k] <= 0) {
+			stats.drops++;
+			continue;
+		}
+		bits = fwd[k] & MAC_QUEUES;
+		for (j = 0; j < num_ports; j++) {
+			if (bits & (1 << (2 * j)))
+				send_copy(&ports[j], pkts[k].data, pkts[k].len);
+		}
+		if (fwd[k] & CPU_QUEUES) {
+			stats.punts++;
+			punt(pkts[k].data, pkts[k].len);
+		}
+	}
+}
+
+
+void punt(const uint8_t *data, uint32_t len) {
+	if (have_miss_port)
+		send_copy(&miss_port, data, len);
+	else
+		stats.miss_drops++;
+}
+
+
+int open_control(const char *path) {
+	struct stat st;
+
+	if (stat(path, &st) && mkfifo(path, 0600)) {
+		perror(path);
+		return -1;
+	}
+	/* read and write, so that the FIFO has a writer between controllers */
+	control_fd = open(path, O_RDWR | O_NONBLOCK);
+	if (control_fd < 0) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+
+int open_card(const char *name) {
+	static struct nf2device nf2;
+
+	if (!strcmp(name, "mock")) {
+		if (nf2_regio_open_mock(&io, MOCK_TXN_NS, MOCK_WORD_NS))
+			return -1;
+	}
+	else {
+		nf2.device_name = (char *)name;
+		if (check_iface(&nf2) || openDescriptor(&nf2) ||
+		    nf2_regio_open_mmap(&io, nf2.device_name))
+			return -1;
+	}
+	if (nf2_exact_table_init(&exact, &io, NF2_EXACT_DEFAULT_MAX_KICKS)) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+	have_card = 1;
+	return 0;
+}
+
+
+//
+// read_control: reads the rules written to the control FIFO and installs
+//    them, NF2_EXACT_BATCH at a time. Returns the number of rules
+//
+int read_control(void) {
+	struct nf2_flowfile_rule r;
+	char *line, *end;
+	ssize_t got;
+	int n = 0;
+
+	got = read(control_fd, control_buf + control_len, sizeof(control_buf) - 1 - control_len);
+	if (got <= 0) {
+		if (got < 0 && errno != EAGAIN)
+			perror("control FIFO");
+		return 0;
+	}
+	control_len += got;
+	control_buf[control_len] = '\0';
+
+	for (line = control_buf; (end = strchr(line, '\n')) != NULL; line = end + 1) {
+		*end = '\0';
+		switch (nf2_flowfile_parse(line, &r)) {
+		case 0:
+			continue;
+		case 1:
+			if (r.exact)
+				break;
+			/* fall through */
+		default:
+			stats.bad_rules++;
+			continue;
+		}
+		stats.rules++;
+		rule_entries[num_rules] = r.entry;
+		rule_actions[num_rules] = r.action;
+		if (++num_rules == NF2_EXACT_BATCH)
+			install_rules();
+		n++;
+	}
+	install_rules();
+
+	/* a line cut short stays for the next read; a line longer than the
+	 * buffer is dropped */
+	control_len -= line - control_buf;
+	memmove(control_buf, line, control_len);
+	if (control_len == sizeof(control_buf) - 1) {
+		stats.bad_rules++;
+		control_len = 0;
+	}
+	return n;
+}
+
+
+//
+// install_rules: installs the rules read, in the card (all together) and
+//    in the host table, and forwards the frames held for them
+//
+void install_rules(void) {
+	struct nf2_pkt held[NF2_MISSQ_MAX_PER_FLOW];
+	const struct nf2_action_plan *plans[NF2_MISSQ_MAX_PER_FLOW];
+	int idx[NF2_EXACT_BATCH], fwd[NF2_MISSQ_MAX_PER_FLOW];
+	uint64_t now;
+	struct nf2_swtable_flow *f;
+	int i, j, n, flow;
+
+	if (num_rules == 0)
+		return;
+	stats.install_batches++;
+	if (have_card) {
+		if (nf2_exact_insert_batch(&exact, rule_entries, rule_actions, num_rules, idx) < 0) {
+			fprintf(stderr, "Error writing the exact table\n");
+			stop = 1;
+		}
+		for (i = 0; i < num_rules; i++) {
+			if (idx[i] >= 0)
+				stats.card_installs++;
+			else
+				stats.card_full++;
+		}
+	}
+
+	now = now_ns();
+	for (i = 0; i < num_rules; i++) {
+		flow = nf2_swtable_insert(&table, &rule_entries[i], &rule_actions[i]);
+		if (flow < 0)
+			stats.host_full++;
+		n = nf2_missq_install(&missq, &rule_entries[i], now, held);
+		if (n == 0)
+			continue;
+		if (flow < 0) {
+			stats.drops += n;
+			continue;
+		}
+		f = &table.flows[flow];
+		for (j = 0; j < n; j++) {
+			plans[j] = &f->plan;
+			f->pkts++;
+			f->bytes += held[j].len;
+		}
+		nf2_action_apply_batch(plans, held, n, fwd);
+		output(held, fwd, n);
+	}
+	num_rules = 0;
+}
+
+
+//
+// send_copy: copies a frame into the transmit ring of a port
+//
+void send_copy(struct nf2_afp_port *p, const uint8_t *data, uint32_t len) {
+	uint8_t *frame = nf2_afp_tx_frame(p, len);
+
+	if (frame == NULL)
+		return;
+	memcpy(frame, data, len);
+	nf2_afp_tx_commit(p, len);
+	if (p == &miss_port)
+		stats.miss_pkts++;
+	else
+		stats.out_pkts++;
+}
+
+
+void flush_all(void) {
+	int i;
+
+	for (i = 0; i < num_ports; i++)
+		nf2_afp_tx_flush(&ports[i]);
+	if (have_miss_port)
+		nf2_afp_tx_flush(&miss_port);
+}
+
+
+void print_stats(double secs) {
+	int i;
+
+	printf("\n%.1f s: %llu packets, %.3f Mpps\n", secs, (unsigned long long)stats.pkts,
+	       stats.pkts / secs / 1e6);
+	printf("hits:         %llu\n", (unsigned long long)stats.hits);
+	printf("misses:       %llu\n", (unsigned long long)stats.misses);
+	printf("punts:        %llu (to the CPU ports)\n", (unsigned long long)stats.punts);
+	printf("drops:        %llu (no output or no headroom)\n", (unsigned long long)stats.drops);
+	printf("sent:         %llu (to the miss interface %llu, dropped without one %llu)\n",
+	       (unsigned long long)stats.out_pkts, (unsigned long long)stats.miss_pkts,
+	       (unsigned long long)stats.miss_drops);
+	for (i = 0; i < num_ports; i++)
+		print_port(&ports[i]);
+	if (have_miss_port)
+		print_port(&miss_port);
+	nf2_swtable_print_stats(&table, stdout);
+
+	if (control_fd < 0)
+		return;
+	printf("\nrules:        %llu in %llu batches (%llu unreadable or wildcard)\n",
+	       (unsigned long long)stats.rules, (unsigned long long)stats.install_batches,
+	       (unsigned long long)stats.bad_rules);
+	nf2_missq_print_stats(&missq, stdout);
+	if (stats.host_full)
+		printf("host table full: %llu rules\n", (unsigned long long)stats.host_full);
+	if (have_card) {
+		printf("\ncard:         %llu installed, %llu did not fit (host table only)\n",
+		       (unsigned long long)stats.card_installs, (unsigned long long)stats.card_full);
+		nf2_exact_print_stats(&exact, stdout);
+		printf("registers:    %lu transactions, %lu words", io.num_txns, io.num_words);
+		if (stats.card_installs)
+			printf(" (%.1f transactions per install)",
+			       (double)io.num_txns / stats.card_installs);
+		if (io.type == NF2_REGIO_MOCK)
+			printf(", %.1f ms modelled", io.model_ns / 1e6);
+		printf("\n");
+	}
+}
+
+
+void print_port(struct nf2_afp_port *p) {
+	struct nf2_afp_stats *st = &p->stats;
+
+	nf2_afp_update_stats(p);
+	printf("%-13s rx %llu pkts in %llu blocks, tx %llu pkts in %llu sends,\n"
+	       "              ring full %llu, too long %llu, kernel drops %u\n", p->name,
+	       (unsigned long long)st->rx_pkts, (unsigned long long)st->rx_blocks,
+	       (unsigned long long)st->tx_pkts, (unsigned long long)st->tx_sends,
+	       (unsigned long long)st->tx_full, (unsigned long long)st->tx_too_long,
+	       st->kernel_drops);
+}
+
+
+uint64_t now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+double now_secs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
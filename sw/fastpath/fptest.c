@@ -0,0 +1,575 @@
+/* ****************************************************************************
+ * Module: fptest.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: End to end test of fastpath over veth pairs.
+ *
+ *              Sends pcap traces, one per source port, into fastpath
+ *              through the peers of the interfaces it forwards between,
+ *              receives what it sends out of every one of them and checks
+ *              it against what the flow file says: each frame, rewritten
+ *              by its flow's actions, out of each port of its forward
+ *              bitmask, and the misses and the frames for the CPU ports out
+ *              of the miss interface. The expected frames are computed
+ *              with the host models (common/nf2_flowkey.c, nf2_swtable.c,
+ *              nf2_action.c) and compared as multisets of frames per port.
+ *
+ *              With "-c" it also plays the controller for fastpath's
+ *              packet-in front end: it answers the first frame of a flow
+ *              of its own flow file that comes out of the miss interface
+ *              by writing the flow's rule to fastpath's control FIFO,
+ *              after a round trip delay. The first frame of such a flow
+ *              is then expected out of the miss interface and the others,
+ *              held by fastpath until the rule lands, out of the flow's
+ *              ports.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include <time.h>
+
+#include "../common/nf2_afpacket.h"
+#include "../common/nf2_pcap.h"
+#include "../common/nf2_flowkey.h"
+#include "../common/nf2_flowfile.h"
+#include "../common/nf2_swtable.h"
+#include "../common/nf2_action.h"
+
+#define MAX_PORTS		4
+#define MAX_TRACES		MAX_PORTS
+#define MISS			MAX_PORTS	/* index of the miss interface */
+#define DEFAULT_WINDOW		256
+#define DEFAULT_WAIT_MS		1000
+#define FLUSH_EVERY		32
+#define MAX_FRAME		2048
+
+#define MAC_QUEUES		0x5555
+#define CPU_QUEUES		0xaaaa
+
+/* frames by their hashes */
+struct frame_set {
+	uint64_t *hash;
+	unsigned long num;
+	unsigned long size;
+};
+
+struct peer {
+	const char *name;
+	struct nf2_afp_port port;
+	int open;
+	struct frame_set expected;
+	struct frame_set received;
+	unsigned long other;		/* received frames that are not IPv4 */
+};
+
+static struct peer peers[MAX_PORTS + 1];
+static int num_peers;
+static struct nf2_swtable table;
+
+/* the controller, with the rule of each flow of its table */
+struct ctrl_install {
+	double due_ms;
+	int rule;
+};
+
+static FILE *ctrl_out;
+static struct nf2_swtable ctrl_table;
+static struct nf2_flowfile_rule *ctrl_rules;
+static int *ctrl_rule;
+static uint8_t *ctrl_punted;		/* first frame expected out of the miss interface */
+static uint8_t *ctrl_answered;
+static struct ctrl_install *ctrl_queue;
+static int ctrl_head, ctrl_tail;
+static double ctrl_delay_ms;
+static unsigned long packet_ins, ctrl_installs;
+
+void usage (void);
+int split_peers (char *);
+int load_flows (const char *path, struct nf2_swtable *, struct nf2_flowfile_rule **keep,
+		int **rule_of);
+int open_controller (const char *fifo, const char *flowfile);
+void packet_in (const uint8_t *, uint32_t);
+void controller (void);
+int expect (const struct nf2_pcap_pkt *, int src_port);
+void set_add (struct frame_set *, uint64_t);
+uint64_t frame_hash (const uint8_t *, uint32_t);
+int is_ipv4 (const uint8_t *, uint32_t);
+unsigned long receive (void);
+int compare (struct peer *);
+int cmp_hash (const void *, const void *);
+double now_ms (void);
+
+int main(int argc, char *argv[]) {
+	struct nf2_pcap pcap[MAX_TRACES];
+	struct nf2_pcap_pkt pkt;
+	int trace_port[MAX_TRACES], done[MAX_TRACES];
+	char *peer_list = NULL, *colon;
+	const char *flowfile = NULL, *miss = NULL, *fifo = NULL, *ctrl_flows = NULL;
+	int window = DEFAULT_WINDOW, wait_ms = DEFAULT_WAIT_MS;
+	int c, i, num_traces = 0, left, failed = 0, since_flush = 0;
+	unsigned long sent = 0, expected = 0, received = 0, got;
+	struct nf2_afp_cfg cfg = NF2_AFP_DEFAULT_CFG;
+	struct pollfd pfd[MAX_PORTS + 1];
+	struct peer *p;
+	uint8_t *frame;
+	double last;
+
+	while ((c = getopt(argc, argv, "f:i:m:w:t:c:C:D:h")) != -1) {
+		switch (c) {
+		case 'f':
+			flowfile = optarg;
+			break;
+		case 'i':
+			peer_list = optarg;
+			break;
+		case 'm':
+			miss = optarg;
+			break;
+		case 'w':
+			window = atoi(optarg);
+			break;
+		case 't':
+			wait_ms = atoi(optarg);
+			break;
+		case 'c':
+			fifo = optarg;
+			break;
+		case 'C':
+			ctrl_flows = optarg;
+			break;
+		case 'D':
+			ctrl_delay_ms = atof(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (flowfile == NULL || peer_list == NULL || split_peers(peer_list) ||
+	    optind == argc || argc - optind > MAX_TRACES || window <= 0 || wait_ms <= 0 ||
+	    !fifo != !ctrl_flows || (fifo && !miss) || ctrl_delay_ms < 0) {
+		usage();
+		exit(1);
+	}
+	peers[MISS].name = miss;
+
+	if (nf2_swtable_init(&table, 1 << 20)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	if (load_flows(flowfile, &table, NULL, NULL) < 0)
+		exit(1);
+	if (fifo && open_controller(fifo, ctrl_flows))
+		exit(1);
+
+	for (i = 0; i <= MISS; i++) {
+		p = &peers[i];
+		if (p->name == NULL)
+			continue;
+		if (nf2_afp_open(&p->port, p->name, &cfg))
+			exit(1);
+		p->open = 1;
+	}
+	for (i = 0; i < argc - optind; i++) {
+		colon = strchr(argv[optind + i], ':');
+		if (colon == NULL || atoi(argv[optind + i]) % 2 ||
+		    atoi(argv[optind + i]) / 2 >= num_peers) {
+			fprintf(stderr, "%s: not port:trace, port 2n with a peer n\n",
+				argv[optind + i]);
+			exit(1);
+		}
+		trace_port[i] = atoi(argv[optind + i]);
+		if (nf2_pcap_open(&pcap[i], colon + 1))
+			exit(1);
+		done[i] = 0;
+		num_traces++;
+	}
+
+	/* the traces in turn, a frame at a time, with at most window
+	 * frames expected and not received yet */
+	last = now_ms();
+	for (left = num_traces; left; ) {
+		for (i = 0; i < num_traces; i++) {
+			if (done[i])
+				continue;
+			if (nf2_pcap_next(&pcap[i], &pkt) != 1) {
+				done[i] = 1;
+				left--;
+				continue;
+			}
+			p = &peers[trace_port[i] / 2];
+			while ((frame = nf2_afp_tx_frame(&p->port, pkt.caplen)) == NULL) {
+				if (p->port.stats.tx_too_long) {
+					fprintf(stderr, "%s: frame of %u bytes too long\n",
+						argv[optind + i], pkt.caplen);
+					exit(1);
+				}
+				received += receive();
+			}
+			memcpy(frame, pkt.data, pkt.caplen);
+			nf2_afp_tx_commit(&p->port, pkt.caplen);
+			expected += expect(&pkt, trace_port[i]);
+			sent++;
+			if (++since_flush == FLUSH_EVERY) {
+				for (c = 0; c < num_peers; c++)
+					nf2_afp_tx_flush(&peers[c].port);
+				since_flush = 0;
+			}
+		}
+		while (expected > received + window) {
+			for (c = 0; c < num_peers; c++)
+				nf2_afp_tx_flush(&peers[c].port);
+			got = receive();
+			received += got;
+			if (got)
+				last = now_ms();
+			else if (now_ms() - last > wait_ms)
+				break;
+		}
+	}
+	for (c = 0; c < num_peers; c++)
+		nf2_afp_tx_flush(&peers[c].port);
+	for (i = 0; i < num_traces; i++)
+		nf2_pcap_close(&pcap[i]);
+
+	/* what is still on the way, until nothing has come for wait_ms */
+	for (i = 0, c = 0; i <= MISS; i++) {
+		if (peers[i].open) {
+			pfd[c].fd = peers[i].port.fd;
+			pfd[c++].events = POLLIN;
+		}
+	}
+	last = now_ms();
+	while (received < expected && now_ms() - last < wait_ms) {
+		got = receive();
+		received += got;
+		if (got)
+			last = now_ms();
+		else
+			poll(pfd, c, 10);
+	}
+
+	printf("%lu frames sent, %lu expected out, %lu received\n", sent, expected, received);
+	if (fifo)
+		printf("controller: %lu packet-ins, %lu rules installed\n", packet_ins,
+		       ctrl_installs);
+	for (i = 0; i <= MISS; i++) {
+		if (peers[i].open)
+			failed += compare(&peers[i]);
+	}
+	printf(failed ? "FAILED\n" : "ok\n");
+	return failed ? 1 : 0;
+}
+
+
+void usage(void) {
+	printf("Usage: fptest -f flowfile -i peer0[,peer1...] [-m miss_peer] [-w window]\n"
+	       "              [-t wait_ms] [-c fifo -C flowfile [-D ms]] port:trace.pcap ...\n");
+	printf("  The frames of the trace of source port 2n are sent on peer n, the\n"
+	       "  peer of fastpath's interface n.\n");
+	printf("  -f  fastpath's flow file\n");
+	printf("  -i  peers of fastpath's interfaces, in its order\n");
+	printf("  -m  peer of fastpath's miss interface\n");
+	printf("  -w  frames expected and not received yet at most (default %d)\n",
+	       DEFAULT_WINDOW);
+	printf("  -t  ms to wait for frames still on the way (default %d)\n",
+	       DEFAULT_WAIT_MS);
+	printf("  -c  fastpath's control FIFO: answer its packet-ins with the rules\n"
+	       "      of the flow file of -C, after -D ms\n");
+}
+
+
+int split_peers(char *list) {
+	char *name;
+
+	for (name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+		if (num_peers == MAX_PORTS)
+			return -1;
+		peers[num_peers++].name = name;
+	}
+	return num_peers ? 0 : -1;
+}
+
+
+//
+// load_flows: inserts the exact flows of a flow file into a table; with
+//    keep, returns the rules and the rule of each flow of the table.
+//    Returns the number of rules
+//
+int load_flows(const char *path, struct nf2_swtable *t, struct nf2_flowfile_rule **keep,
+	       int **rule_of) {
+	struct nf2_flowfile_rule *rules;
+	int i, n, flow;
+
+	n = nf2_flowfile_read(path, &rules);
+	if (n < 0)
+		return -1;
+	if (keep && (*rule_of = malloc((n + 1) * sizeof(**rule_of))) == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		free(rules);
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		if (!rules[i].exact)
+			continue;
+		flow = nf2_swtable_insert(t, &rules[i].entry, &rules[i].action);
+		if (flow < 0) {
+			fprintf(stderr, "%s:%d: the table is full\n", path, rules[i].line);
+			free(rules);
+			return -1;
+		}
+		if (keep)
+			(*rule_of)[flow] = i;
+	}
+	if (keep)
+		*keep = rules;
+	else
+		free(rules);
+	return n;
+}
+
+
+int open_controller(const char *fifo, const char *flowfile) {
+	int n;
+
+	if (nf2_swtable_init(&ctrl_table, 1 << 20)) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+	n = load_flows(flowfile, &ctrl_table, &ctrl_rules, &ctrl_rule);
+	if (n < 0)
+		return -1;
+	ctrl_punted = calloc(n + 1, 1);
+	ctrl_answered = calloc(n + 1, 1);
+	ctrl_queue = calloc(n + 1, sizeof(*ctrl_queue));
+	if (ctrl_punted == NULL || ctrl_answered == NULL || ctrl_queue == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+	ctrl_out = fopen(fifo, "w");
+	if (ctrl_out == NULL) {
+		perror(fifo);
+		return -1;
+	}
+	return 0;
+}
+
+
+//
+// packet_in: a frame out of the miss interface. The frame does not tell
+//    its source port: the rule of any port with a peer is taken, unless
+//    fastpath had it from the start (a frame sent to a CPU port)
+//
+void packet_in(const uint8_t *data, uint32_t len) {
+	nf2_of_entry_wrap key;
+	int j, flow, rule;
+
+	packet_ins++;
+	for (j = 0; j < num_peers; j++) {
+		nf2_flowkey_extract(data, len, 2 * j, &key);
+		if (nf2_swtable_find(&table, &key) >= 0)
+			continue;
+		flow = nf2_swtable_find(&ctrl_table, &key);
+		if (flow < 0)
+			continue;
+		rule = ctrl_rule[flow];
+		if (ctrl_answered[rule])
+			continue;
+		ctrl_answered[rule] = 1;
+		ctrl_queue[ctrl_tail].due_ms = now_ms() + ctrl_delay_ms;
+		ctrl_queue[ctrl_tail++].rule = rule;
+	}
+}
+
+
+//
+// controller: writes the rules whose round trip is over
+//
+void controller(void) {
+	double now = now_ms();
+	int n = 0;
+
+	while (ctrl_head < ctrl_tail && ctrl_queue[ctrl_head].due_ms <= now) {
+		nf2_flowfile_print(ctrl_out, &ctrl_rules[ctrl_queue[ctrl_head++].rule]);
+		n++;
+	}
+	if (n) {
+		fflush(ctrl_out);
+		ctrl_installs += n;
+	}
+}
+
+
+//
+// expect: adds the frames fastpath sends for one packet to the peers
+//    that receive them. Returns how many
+//
+int expect(const struct nf2_pcap_pkt *pkt, int src_port) {
+	uint8_t buf[NF2_ACTION_HEADROOM + MAX_FRAME];
+	nf2_of_entry_wrap key;
+	struct nf2_swtable *t = &table;
+	struct nf2_pkt out;
+	int flow, fwd, j, n = 0;
+
+	if (pkt->caplen > MAX_FRAME || !is_ipv4(pkt->data, pkt->caplen))
+		return 0;
+	nf2_flowkey_extract(pkt->data, pkt->caplen, src_port, &key);
+	flow = nf2_swtable_find(t, &key);
+	if (flow < 0 && ctrl_out) {
+		/* the first frame goes to the controller, the others take
+		 * its rule */
+		t = &ctrl_table;
+		flow = nf2_swtable_find(t, &key);
+		if (flow >= 0 && !ctrl_punted[ctrl_rule[flow]]) {
+			ctrl_punted[ctrl_rule[flow]] = 1;
+			flow = -1;
+		}
+	}
+	if (flow < 0) {
+		if (peers[MISS].name == NULL)
+			return 0;
+		set_add(&peers[MISS].expected, frame_hash(pkt->data, pkt->caplen));
+		return 1;
+	}
+
+	memcpy(buf + NF2_ACTION_HEADROOM, pkt->data, pkt->caplen);
+	out.data = buf + NF2_ACTION_HEADROOM;
+	out.len = pkt->caplen;
+	out.headroom = NF2_ACTION_HEADROOM;
+	fwd = nf2_action_apply(&t->flows[flow].plan, &out);
+	if (fwd <= 0)
+		return 0;
+	for (j = 0; j < num_peers; j++) {
+		if (fwd & MAC_QUEUES & (1 << (2 * j))) {
+			set_add(&peers[j].expected, frame_hash(out.data, out.len));
+			n++;
+		}
+	}
+	if ((fwd & CPU_QUEUES) && peers[MISS].name) {
+		set_add(&peers[MISS].expected, frame_hash(out.data, out.len));
+		n++;
+	}
+	return n;
+}
+
+
+void set_add(struct frame_set *s, uint64_t hash) {
+	if (s->num == s->size) {
+		s->size = s->size ? 2 * s->size : 4096;
+		s->hash = realloc(s->hash, s->size * sizeof(*s->hash));
+		if (s->hash == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+	s->hash[s->num++] = hash;
+}
+
+
+// FNV-1a over the bytes, and the length
+uint64_t frame_hash(const uint8_t *data, uint32_t len) {
+	uint64_t h = 0xcbf29ce484222325ULL;
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ data[i]) * 0x100000001b3ULL;
+	return (h ^ len) * 0x100000001b3ULL;
+}
+
+
+// IPv4, tagged or not: what fastpath forwards, as opposed to the
+// interfaces' own traffic
+int is_ipv4(const uint8_t *d, uint32_t len) {
+	if (len >= 18 && d[12] == 0x81 && d[13] == 0x00)
+		d += 4, len -= 4;
+	return len >= 14 && d[12] == 0x08 && d[13] == 0x00;
+}
+
+
+//
+// receive: takes the frames ready on the peers, and answers the
+//    packet-ins. Returns how many frames are IPv4
+//
+unsigned long receive(void) {
+	struct nf2_afp_pkt pkt;
+	struct peer *p;
+	unsigned long n = 0;
+	int i;
+
+	for (i = 0; i <= MISS; i++) {
+		p = &peers[i];
+		if (!p->open)
+			continue;
+		for (;;) {
+			while (nf2_afp_rx_next(&p->port, &pkt)) {
+				if (!is_ipv4(pkt.data, pkt.caplen)) {
+					p->other++;
+					continue;
+				}
+				set_add(&p->received, frame_hash(pkt.data, pkt.caplen));
+				if (i == MISS && ctrl_out)
+					packet_in(pkt.data, pkt.caplen);
+				n++;
+			}
+			if (p->port.cur == NULL)
+				break;
+			nf2_afp_rx_release(&p->port);
+		}
+	}
+	if (ctrl_out)
+		controller();
+	return n;
+}
+
+
+//
+// compare: the frames a peer received against those expected. Returns 1
+//    if any is missing or was not expected
+//
+int compare(struct peer *p) {
+	struct frame_set *e = &p->expected, *r = &p->received;
+	unsigned long i = 0, j = 0, missing = 0, unexpected = 0;
+
+	qsort(e->hash, e->num, sizeof(*e->hash), cmp_hash);
+	qsort(r->hash, r->num, sizeof(*r->hash), cmp_hash);
+	while (i < e->num || j < r->num) {
+		if (j == r->num || (i < e->num && e->hash[i] < r->hash[j])) {
+			missing++;
+			i++;
+		}
+		else if (i == e->num || r->hash[j] < e->hash[i]) {
+			unexpected++;
+			j++;
+		}
+		else {
+			i++;
+			j++;
+		}
+	}
+	printf("  %-12s expected %lu, received %lu: missing %lu, unexpected %lu"
+	       " (and %lu frames not IPv4)\n", p->name, e->num, r->num, missing, unexpected,
+	       p->other);
+	return missing || unexpected;
+}
+
+
+int cmp_hash(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+double now_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
@@ -0,0 +1,72 @@
+#!/bin/bash
+
+# Execute this shell as a super user
+# Runs fastpath between veth pairs and checks what it forwards with fptest:
+# fp0..fp3 stand for nf2c0..nf2c3 and fpm for the miss interface, and the
+# test sends and receives on their peers fp0p..fp3p and fpmp. No card is
+# needed.
+#
+#   vethtest.sh [packets [flows [trafgen options]]]
+#
+# The flows of the trafgen trace get rewrite actions, some are sent to the
+# CPU ports and some are left out of fastpath's flow file to miss. fptest
+# plays the controller for those: it installs them through fastpath's
+# control FIFO when their first frame comes out of fpm, and fastpath
+# holds their next frames until then and installs them in the mock card.
+
+dir=$(cd $(dirname $0) && pwd)
+pkts=${1:-200000}
+flows=${2:-1000}
+shift 2 2>/dev/null
+tmp=$(mktemp -d)
+ifs="fp0 fp1 fp2 fp3 fpm"
+
+cleanup() {
+	[ -n "$fp_pid" ] && kill $fp_pid 2>/dev/null && wait $fp_pid
+	for i in $ifs; do
+		ip link del $i 2>/dev/null
+	done
+	rm -rf $tmp
+}
+trap cleanup EXIT
+
+for i in $ifs; do
+	ip link add $i type veth peer name ${i}p || exit 1
+	for j in $i ${i}p; do
+		sysctl -qw net.ipv6.conf.$j.disable_ipv6=1
+		ip link set $j up
+	done
+done
+
+$dir/../trafgen/trafgen -n $pkts -f $flows -v 0.2 -o 0.1 -w $tmp/trace "$@" || exit 1
+
+# every tenth flow is left to the controller, every fifteenth goes to
+# CPU port 0, and the others are rewritten in turn
+awk -v fp=$tmp/fp.flows -v ctrl=$tmp/ctrl.flows \
+    '/^#/ { print > fp; print > ctrl; next }
+     { n++ }
+     n % 15 == 0 { sub(/actions=.*/, "actions=output:1") }
+     n % 15 != 0 && n % 4 == 1 { sub(/$/, ",mod_nw_dst:10.99.0.1,mod_tp_dst:8080,mod_nw_tos:32") }
+     n % 15 != 0 && n % 4 == 2 { sub(/$/, ",mod_vlan_vid:42,mod_vlan_pcp:5") }
+     n % 15 != 0 && n % 4 == 3 { sub(/$/, ",strip_vlan,mod_dl_src:02:00:00:00:00:01,mod_tp_src:1") }
+     { print > ctrl }
+     n % 10 != 0 { print > fp }' $tmp/trace.flows
+
+$dir/fastpath -f $tmp/fp.flows -m fpm -c $tmp/ctl -d mock -b 256 fp0 fp1 fp2 fp3 \
+	> $tmp/fastpath.out &
+fp_pid=$!
+sleep 1
+
+traces=""
+for p in 0 2 4 6; do
+	[ -f $tmp/trace-$p.pcap ] && traces="$traces $p:$tmp/trace-$p.pcap"
+done
+$dir/fptest -f $tmp/fp.flows -i fp0p,fp1p,fp2p,fp3p -m fpmp -c $tmp/ctl \
+	-C $tmp/ctrl.flows -D 2 -w 128 $traces
+ret=$?
+
+kill -INT $fp_pid
+wait $fp_pid
+fp_pid=
+cat $tmp/fastpath.out
+exit $ret
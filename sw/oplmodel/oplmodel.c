@@ -0,0 +1,401 @@
+/* ****************************************************************************
+ * Module: oplmodel.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Trace driven model of the output port lookup.
+ *
+ *              Replays pcap traces, one per input port, through the
+ *              transaction level model of output_port_lookup
+ *              (common/nf2_opl_model.c) with the flow tables of a flow
+ *              file (common/nf2_flowfile.h), and reports the hits and
+ *              misses per table, the arbitration, the packets per output
+ *              queue and the drops, the peak CPU and drop rates over the
+ *              trace, the distinct flows that missed the exact table and
+ *              the busiest entries. No card is needed.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <time.h>
+
+#include "../common/nf2_pcap.h"
+#include "../common/nf2_flowkey.h"
+#include "../common/nf2_flowfile.h"
+#include "../common/nf2_opl_model.h"
+
+#define MAX_TRACES		NF2_OPL_NUM_QUEUES
+#define DEFAULT_INTERVAL	1000	/* ms of trace time */
+#define DEFAULT_TOP		10
+#define MAX_TOP			100
+
+#define CPU_QUEUES		0xaaaa	/* odd output queues */
+
+struct trace {
+	const char *path;
+	int port;
+	struct nf2_pcap pcap;
+	struct nf2_pcap_pkt pkt;
+	int have;
+};
+
+/* set of distinct flow entries */
+struct flow_set {
+	nf2_of_entry_wrap *keys;
+	uint8_t *used;
+	unsigned long size;
+	unsigned long num;
+};
+
+/* peak rates over intervals of trace time */
+struct rates {
+	uint64_t interval_ns;
+	uint64_t start;
+	uint64_t pkts, punts, drops;		/* whole trace */
+	uint64_t cur_pkts, cur_punts, cur_drops;	/* current interval */
+	uint64_t peak_pkts, peak_punts, peak_drops;
+};
+
+static struct trace traces[MAX_TRACES];
+static int num_traces;
+
+void usage (void);
+int open_traces (int loops);
+int next_packet (struct nf2_pcap_pkt *, int *port);
+int flow_set_add (struct flow_set *, const nf2_of_entry_wrap *);
+void rates_add (struct rates *, uint64_t ts, const nf2_of_action_wrap *);
+int top_entries (const uint64_t *pkts, int n, int top, int *best);
+void print_top (struct nf2_opl_model *, int top);
+
+int main(int argc, char *argv[]) {
+	struct nf2_opl_model model;
+	struct nf2_flowfile_rule *rules = NULL;
+	struct flow_set flows, missed;
+	struct rates rates;
+	struct timespec t0, t1;
+	nf2_of_entry_wrap keys[NF2_OPL_BATCH];
+	const uint8_t *frames[NF2_OPL_BATCH];
+	uint32_t caplens[NF2_OPL_BATCH], sizes[NF2_OPL_BATCH];
+	int ports[NF2_OPL_BATCH];
+	uint64_t ts[NF2_OPL_BATCH], first_ts = 0, last_ts = 0;
+	const nf2_of_action_wrap *actions[NF2_OPL_BATCH];
+	struct nf2_pcap_pkt pkt;
+	struct trace *t;
+	char *flowfile = NULL, *colon;
+	int interval = DEFAULT_INTERVAL, top = DEFAULT_TOP, loops = 1, loop;
+	int c, i, n, port, num_rules = 0, ret, failed = 0;
+	double secs, trace_secs;
+
+	while ((c = getopt(argc, argv, "f:i:t:l:h")) != -1) {
+		switch (c) {
+		case 'f':
+			flowfile = optarg;
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 't':
+			top = atoi(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (optind == argc || argc - optind > MAX_TRACES || interval <= 0 ||
+	    top < 0 || top > MAX_TOP || loops <= 0) {
+		usage();
+		exit(1);
+	}
+	for (i = optind; i < argc; i++) {
+		t = &traces[num_traces++];
+		t->path = argv[i];
+		colon = strchr(argv[i], ':');
+		if (colon && colon[1]) {
+			t->port = atoi(argv[i]);
+			t->path = colon + 1;
+		}
+	}
+
+	if (nf2_opl_model_init(&model)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	if (flowfile) {
+		num_rules = nf2_flowfile_read(flowfile, &rules);
+		if (num_rules < 0)
+			exit(1);
+		failed = nf2_opl_model_load(&model, rules, num_rules, stderr);
+	}
+
+	memset(&flows, 0, sizeof(flows));
+	memset(&missed, 0, sizeof(missed));
+	memset(&rates, 0, sizeof(rates));
+	rates.interval_ns = interval * 1000000ull;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (loop = 0; loop < loops; loop++) {
+		if (open_traces(loop))
+			exit(1);
+		n = 0;
+		do {
+			ret = next_packet(&pkt, &port);
+			if (ret) {
+				/* the traces are mapped: the frames stay put */
+				frames[n] = pkt.data;
+				caplens[n] = pkt.caplen;
+				ports[n] = port;
+				sizes[n] = pkt.len;
+				ts[n] = pkt.ts_ns;
+				n++;
+			}
+			if (n == NF2_OPL_BATCH || (!ret && n > 0)) {
+				nf2_flowkey_extract_batch(frames, caplens, ports, n, keys);
+				nf2_opl_model_lookup(&model, keys, sizes, n, actions);
+				for (i = 0; i < n; i++) {
+					if (loop > 0)
+						continue;
+					if (first_ts == 0)
+						first_ts = ts[i];
+					last_ts = ts[i];
+					rates_add(&rates, ts[i], actions[i]);
+					if (flow_set_add(&flows, &keys[i]) &&
+					    nf2_exact_find(&model.exact, &keys[i]) < 0)
+						flow_set_add(&missed, &keys[i]);
+				}
+				n = 0;
+			}
+		} while (ret);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	rates_add(&rates, UINT64_MAX, NULL);
+
+	secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	trace_secs = (last_ts - first_ts) / 1e9;
+
+	if (flowfile)
+		printf("%d flows from %s, %d did not fit\n", num_rules, flowfile, failed);
+	printf("%d trace(s), %.3f s of traffic", num_traces, trace_secs);
+	if (loops > 1)
+		printf(", replayed %d times", loops);
+	printf("\n\n");
+
+	nf2_opl_model_print_stats(&model, stdout);
+
+	printf("\ndistinct flows: %lu, missing the exact table: %lu (table holds %d)\n",
+	       flows.num, missed.num, OPENFLOW_NF2_EXACT_TABLE_SIZE);
+	printf("peak per %d ms: %llu pkts, %llu to CPU, %llu dropped\n", interval,
+	       (unsigned long long)rates.peak_pkts, (unsigned long long)rates.peak_punts,
+	       (unsigned long long)rates.peak_drops);
+	if (trace_secs > 0)
+		printf("average rate:   %.0f pkts/s, %.0f to CPU/s, %.0f dropped/s\n",
+		       rates.pkts / trace_secs, rates.punts / trace_secs,
+		       rates.drops / trace_secs);
+
+	print_top(&model, top);
+
+	printf("\nmodel: %.3f s, %.2f Mpkts/s\n", secs, model.stats.pkts / secs / 1e6);
+
+	nf2_opl_model_free(&model);
+	free(rules);
+	return 0;
+}
+
+
+void usage(void) {
+	printf("Usage: oplmodel [-f flow_file] [-i interval_ms] [-t top] [-l loops]\n"
+	       "                [port:]trace.pcap ...\n");
+	printf("  -f  flow table contents (see common/nf2_flowfile.h)\n");
+	printf("  -i  interval for the peak rates, in ms of trace time (default %d)\n",
+	       DEFAULT_INTERVAL);
+	printf("  -t  busiest entries to list (default %d)\n", DEFAULT_TOP);
+	printf("  -l  replay the traces this many times, to time the model (the rates\n"
+	       "      and flow counts are those of the first pass)\n");
+	printf("  port is the source port of the trace's packets: 2n for MAC port n\n"
+	       "  (default 0). Packets of several traces are merged by timestamp.\n");
+}
+
+
+int open_traces(int loop) {
+	int i;
+
+	for (i = 0; i < num_traces; i++) {
+		if (loop)
+			nf2_pcap_close(&traces[i].pcap);
+		if (nf2_pcap_open(&traces[i].pcap, traces[i].path))
+			return -1;
+		traces[i].have = nf2_pcap_next(&traces[i].pcap, &traces[i].pkt);
+	}
+	return 0;
+}
+
+
+//
+// next_packet: the earliest packet of all traces. Returns 0 when all
+//    traces are done. A truncated trace ends at its last whole packet.
+//
+int next_packet(struct nf2_pcap_pkt *pkt, int *port) {
+	struct trace *t = NULL;
+	int i;
+
+	for (i = 0; i < num_traces; i++) {
+		if (traces[i].have < 0) {
+			fprintf(stderr, "warning: %s is truncated\n", traces[i].path);
+			traces[i].have = 0;
+		}
+		if (traces[i].have && (t == NULL || traces[i].pkt.ts_ns < t->pkt.ts_ns))
+			t = &traces[i];
+	}
+	if (t == NULL)
+		return 0;
+
+	*pkt = t->pkt;
+	*port = t->port;
+	t->have = nf2_pcap_next(&t->pcap, &t->pkt);
+	return 1;
+}
+
+
+static uint64_t key_hash(const nf2_of_entry_wrap *key) {
+	uint64_t h = 0;
+	int w;
+
+	for (w = 0; w < NF2_OF_ENTRY_WORD_LEN; w++)
+		h = (h ^ key->raw[w]) * 0x9e3779b97f4a7c15ull;
+	return h ^ (h >> 29);
+}
+
+
+//
+// flow_set_add: returns 1 if the flow was not in the set yet
+//
+int flow_set_add(struct flow_set *s, const nf2_of_entry_wrap *key) {
+	struct flow_set old;
+	unsigned long i, j;
+
+	if (s->num * 2 >= s->size) {
+		old = *s;
+		s->size = old.size ? old.size * 2 : 4096;
+		s->keys = malloc(s->size * sizeof(*s->keys));
+		s->used = calloc(s->size, 1);
+		s->num = 0;
+		if (s->keys == NULL || s->used == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		for (j = 0; j < old.size; j++)
+			if (old.used[j])
+				flow_set_add(s, &old.keys[j]);
+		free(old.keys);
+		free(old.used);
+	}
+
+	for (i = key_hash(key) & (s->size - 1); s->used[i]; i = (i + 1) & (s->size - 1))
+		if (!memcmp(&s->keys[i], key, sizeof(*key)))
+			return 0;
+	s->keys[i] = *key;
+	s->used[i] = 1;
+	s->num++;
+	return 1;
+}
+
+
+//
+// rates_add: count a packet in the interval of ts. A ts of UINT64_MAX
+//    closes the last interval.
+//
+void rates_add(struct rates *r, uint64_t ts, const nf2_of_action_wrap *action) {
+	if (r->start == 0)
+		r->start = ts;
+	if (ts - r->start >= r->interval_ns) {
+		if (r->cur_pkts > r->peak_pkts)
+			r->peak_pkts = r->cur_pkts;
+		if (r->cur_punts > r->peak_punts)
+			r->peak_punts = r->cur_punts;
+		if (r->cur_drops > r->peak_drops)
+			r->peak_drops = r->cur_drops;
+		r->cur_pkts = r->cur_punts = r->cur_drops = 0;
+		if (ts == UINT64_MAX)
+			return;
+		r->start += (ts - r->start) / r->interval_ns * r->interval_ns;
+	}
+
+	r->cur_pkts++;
+	r->pkts++;
+	if (action == NULL) {
+		r->cur_drops++;
+		r->drops++;
+	}
+	else if (action->action.forward_bitmask & CPU_QUEUES) {
+		r->cur_punts++;
+		r->punts++;
+	}
+}
+
+
+//
+// top_entries: the indices of the (at most top) entries with the most
+//    packets, busiest first
+//
+int top_entries(const uint64_t *pkts, int n, int top, int *best) {
+	int i, j, num = 0;
+
+	for (i = 0; i < n; i++) {
+		if (pkts[i] == 0 || (num == top && pkts[i] <= pkts[best[num - 1]]))
+			continue;
+		j = num < top ? num++ : top - 1;
+		for (; j > 0 && pkts[best[j - 1]] < pkts[i]; j--)
+			best[j] = best[j - 1];
+		best[j] = i;
+	}
+	return num;
+}
+
+
+void print_top(struct nf2_opl_model *m, int top) {
+	struct nf2_flowfile_rule r;
+	int best[MAX_TOP];
+	int i, n;
+
+	if (top == 0)
+		return;
+
+	printf("\nbusiest exact flows:\n");
+	n = top_entries(m->exact_pkts, m->exact.size, top, best);
+	for (i = 0; i < n; i++) {
+		memset(&r, 0, sizeof(r));
+		r.exact = 1;
+		r.entry = m->exact.slots[best[i]].entry;
+		r.action = m->exact.slots[best[i]].action;
+		printf("  %12llu pkts  slot %5d  ", (unsigned long long)m->exact_pkts[best[i]],
+		       best[i]);
+		nf2_flowfile_print(stdout, &r);
+	}
+
+	printf("\nbusiest wildcard rules:\n");
+	n = top_entries(m->wildcard_pkts, OPENFLOW_WILDCARD_TABLE_SIZE, top, best);
+	for (i = 0; i < n; i++) {
+		struct nf2_wildcard_rule *w = &m->wildcard.rules[best[i]];
+
+		printf("  %12llu pkts  index %3d  ", (unsigned long long)m->wildcard_pkts[best[i]],
+		       best[i]);
+		if (!w->used) {
+			printf("unused entry (all zero headers)\n");
+			continue;
+		}
+		memset(&r, 0, sizeof(r));
+		r.entry = w->entry;
+		r.mask = w->mask;
+		r.action = w->action;
+		r.priority = w->priority;
+		nf2_flowfile_print(stdout, &r);
+	}
+}
@@ -0,0 +1,273 @@
+/* ****************************************************************************
+ * Module: pairsim.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Trace driven simulation of the pairing scheduler for the
+ *              XOR network coding stage (common/nf2_pair.c).
+ *
+ *              Replays pcap traces, one per input port, through the
+ *              scheduler once per maximum hold time and reports the
+ *              coding gain (packets and bytes in per packet and byte
+ *              sent) against the latency the waiting adds: mean,
+ *              percentiles and maximum. Packets of ports other than 0
+ *              and 2 are not coded and not counted. No card is needed.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/nf2_pcap.h"
+#include "../common/nf2_pair.h"
+
+#define MAX_TRACES		8
+#define MAX_HOLDS		32
+#define DEFAULT_QUEUE		64
+#define DEFAULT_WINDOW		8
+#define DEFAULT_HOLDS		"0,10,50,100,500,1000,5000"	/* us */
+#define OUT_BATCH		64
+
+struct trace {
+	const char *path;
+	int port;
+	struct nf2_pcap pcap;
+	struct nf2_pcap_pkt pkt;
+	int have;
+};
+
+/* added latency of every packet sent, in ns */
+struct latencies {
+	uint64_t *ns;
+	unsigned long num;
+	unsigned long size;
+};
+
+static struct trace traces[MAX_TRACES];
+static int num_traces;
+
+void usage (void);
+int parse_holds (char *s, uint64_t *holds);
+int open_traces (int loop);
+int next_packet (struct nf2_pcap_pkt *, int *port);
+void record (struct latencies *, const struct nf2_pair_out *, int n);
+int cmp_u64 (const void *, const void *);
+uint64_t percentile (const struct latencies *, double pct);
+
+int main(int argc, char *argv[]) {
+	struct nf2_pair_cfg cfg;
+	struct nf2_pair pair;
+	struct nf2_pair_out out[OUT_BATCH];
+	struct nf2_pcap_pkt pkt;
+	struct latencies lat;
+	uint64_t holds[MAX_HOLDS], sum, other = 0;
+	char default_holds[] = DEFAULT_HOLDS;
+	char *hold_list = default_holds, *colon;
+	struct trace *t;
+	int c, h, i, n, dir, port, num_holds;
+
+	cfg.queue_len = DEFAULT_QUEUE;
+	cfg.window = DEFAULT_WINDOW;
+	while ((c = getopt(argc, argv, "H:q:w:h")) != -1) {
+		switch (c) {
+		case 'H':
+			hold_list = optarg;
+			break;
+		case 'q':
+			cfg.queue_len = atoi(optarg);
+			break;
+		case 'w':
+			cfg.window = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	num_holds = parse_holds(hold_list, holds);
+	if (optind == argc || argc - optind > MAX_TRACES || num_holds <= 0 ||
+	    cfg.queue_len < 1 || cfg.queue_len > NF2_PAIR_MAX_QUEUE || cfg.window < 1) {
+		usage();
+		exit(1);
+	}
+	for (i = optind; i < argc; i++) {
+		t = &traces[num_traces++];
+		t->path = argv[i];
+		colon = strchr(argv[i], ':');
+		if (colon && colon[1]) {
+			t->port = atoi(argv[i]);
+			t->path = colon + 1;
+		}
+	}
+
+	memset(&lat, 0, sizeof(lat));
+	printf("queue %d per direction, partner window %d\n\n", cfg.queue_len, cfg.window);
+	printf("%8s %7s %6s %6s %9s %9s %9s %9s %9s %9s %9s\n", "hold us", "coded", "gain",
+	       "bytes", "timeouts", "full", "mean us", "p50 us", "p99 us", "p99.9 us",
+	       "max us");
+
+	for (h = 0; h < num_holds; h++) {
+		cfg.max_hold_ns = holds[h];
+		if (nf2_pair_init(&pair, &cfg)) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		if (open_traces(h))
+			exit(1);
+		lat.num = 0;
+		other = 0;
+
+		while (next_packet(&pkt, &port)) {
+			dir = nf2_pair_dir(port);
+			if (dir < 0) {
+				other++;
+				continue;
+			}
+			do {
+				n = nf2_pair_advance(&pair, pkt.ts_ns, out, OUT_BATCH);
+				record(&lat, out, n);
+			} while (n == OUT_BATCH);
+			n = nf2_pair_add(&pair, dir, 0, pkt.len, pkt.ts_ns, out);
+			record(&lat, out, n);
+		}
+		/* what is left times out after the trace */
+		do {
+			n = nf2_pair_advance(&pair, UINT64_MAX, out, OUT_BATCH);
+			record(&lat, out, n);
+		} while (n == OUT_BATCH);
+
+		qsort(lat.ns, lat.num, sizeof(*lat.ns), cmp_u64);
+		for (sum = 0, i = 0; i < lat.num; i++)
+			sum += lat.ns[i];
+		printf("%8.1f %6.2f%% %6.3f %6.3f %9llu %9llu %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+		       holds[h] / 1e3,
+		       pair.stats.pkts ? 200.0 * pair.stats.coded / pair.stats.pkts : 0,
+		       pair.stats.tx ? (double)pair.stats.pkts / pair.stats.tx : 1,
+		       pair.stats.tx_bytes ? (double)pair.stats.bytes / pair.stats.tx_bytes : 1,
+		       (unsigned long long)pair.stats.timeouts,
+		       (unsigned long long)pair.stats.full,
+		       lat.num ? sum / 1e3 / lat.num : 0, percentile(&lat, 50) / 1e3,
+		       percentile(&lat, 99) / 1e3, percentile(&lat, 99.9) / 1e3,
+		       percentile(&lat, 100) / 1e3);
+		nf2_pair_free(&pair);
+	}
+
+	printf("\n%llu packets of ports 0 and 2", (unsigned long long)lat.num);
+	if (other)
+		printf(", %llu of other ports not coded", (unsigned long long)other);
+	printf("\n");
+	free(lat.ns);
+	return 0;
+}
+
+
+void usage(void) {
+	printf("Usage: pairsim [-H hold_us,...] [-q queue_len] [-w window]\n"
+	       "               [port:]trace.pcap ...\n");
+	printf("  -H  maximum hold times to simulate, in us (default %s)\n", DEFAULT_HOLDS);
+	printf("  -q  packets waiting per direction (default %d, at most %d)\n",
+	       DEFAULT_QUEUE, NF2_PAIR_MAX_QUEUE);
+	printf("  -w  oldest waiting packets considered for the partner closest in\n"
+	       "      length; 1 pairs in arrival order (default %d)\n", DEFAULT_WINDOW);
+	printf("  port is the source port of the trace's packets: 0 and 2 are coded\n"
+	       "  (default 0). Packets of several traces are merged by timestamp.\n");
+}
+
+
+//
+// parse_holds: comma separated hold times in us, into ns. Returns how
+//    many, or -1 if the list is invalid.
+//
+int parse_holds(char *s, uint64_t *holds) {
+	char *tok, *save, *end;
+	double us;
+	int n = 0;
+
+	for (tok = strtok_r(s, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		us = strtod(tok, &end);
+		if (*end || us < 0 || us > 1e9 || n == MAX_HOLDS)
+			return -1;
+		holds[n++] = us * 1e3;
+	}
+	return n;
+}
+
+
+int open_traces(int loop) {
+	int i;
+
+	for (i = 0; i < num_traces; i++) {
+		if (loop)
+			nf2_pcap_close(&traces[i].pcap);
+		if (nf2_pcap_open(&traces[i].pcap, traces[i].path))
+			return -1;
+		traces[i].have = nf2_pcap_next(&traces[i].pcap, &traces[i].pkt);
+	}
+	return 0;
+}
+
+
+//
+// next_packet: the earliest packet of all traces. Returns 0 when all
+//    traces are done. A truncated trace ends at its last whole packet.
+//
+int next_packet(struct nf2_pcap_pkt *pkt, int *port) {
+	struct trace *t = NULL;
+	int i;
+
+	for (i = 0; i < num_traces; i++) {
+		if (traces[i].have < 0) {
+			fprintf(stderr, "warning: %s is truncated\n", traces[i].path);
+			traces[i].have = 0;
+		}
+		if (traces[i].have && (t == NULL || traces[i].pkt.ts_ns < t->pkt.ts_ns))
+			t = &traces[i];
+	}
+	if (t == NULL)
+		return 0;
+
+	*pkt = t->pkt;
+	*port = t->port;
+	t->have = nf2_pcap_next(&t->pcap, &t->pkt);
+	return 1;
+}
+
+
+void record(struct latencies *l, const struct nf2_pair_out *out, int n) {
+	int i, k;
+
+	for (i = 0; i < n; i++) {
+		for (k = 0; k < out[i].num; k++) {
+			if (l->num == l->size) {
+				l->size = l->size ? l->size * 2 : 65536;
+				l->ns = realloc(l->ns, l->size * sizeof(*l->ns));
+				if (l->ns == NULL) {
+					fprintf(stderr, "Out of memory\n");
+					exit(1);
+				}
+			}
+			l->ns[l->num++] = out[i].depart_ns - out[i].pkt[k].arrival_ns;
+		}
+	}
+}
+
+
+int cmp_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+/* of the sorted latencies */
+uint64_t percentile(const struct latencies *l, double pct) {
+	unsigned long i;
+
+	if (l->num == 0)
+		return 0;
+	i = pct / 100 * l->num;
+	return l->ns[i < l->num ? i : l->num - 1];
+}
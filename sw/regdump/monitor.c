@@ -0,0 +1,242 @@
+/* ****************************************************************************
+ * Module: monitor.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Continuous rate monitor for regdump ("regdump -t").
+ *
+ *              Samples the port, output queue and lookup counters at a
+ *              fixed interval, widens them into 64-bit host counters and
+ *              shows per-port packet, bit and drop rates with ncurses.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <time.h>
+#include <curses.h>
+
+#include "../common/nf2_counter.h"
+#include "../common/nf2_snapshot.h"
+#include "monitor.h"
+
+enum {
+	PORT_RX_PKTS,
+	PORT_RX_BYTES,
+	PORT_TX_PKTS,
+	PORT_TX_BYTES,
+	PORT_RX_DROPPED_FULL,
+	PORT_RX_DROPPED_BAD,
+	PORT_NUM_CNTRS
+};
+
+enum {
+	OQ_PKTS,
+	OQ_BYTES,
+	OQ_DROPPED,
+	OQ_NUM_CNTRS
+};
+
+enum {
+	LOOKUP_EXACT_HITS,
+	LOOKUP_EXACT_MISSES,
+	LOOKUP_WILDCARD_HITS,
+	LOOKUP_WILDCARD_MISSES,
+	LOOKUP_NUM_CNTRS
+};
+
+struct rates {
+	struct nf2_counter64 port[NF2_PORT_NUM][PORT_NUM_CNTRS];
+	struct nf2_counter64 oq[NF2_OQ_NUM][OQ_NUM_CNTRS];
+	struct nf2_counter64 lookup[LOOKUP_NUM_CNTRS];
+
+	/* Increments seen over the last interval */
+	uint32_t port_delta[NF2_PORT_NUM][PORT_NUM_CNTRS];
+	uint32_t oq_delta[NF2_OQ_NUM][OQ_NUM_CNTRS];
+	uint32_t lookup_delta[LOOKUP_NUM_CNTRS];
+};
+
+static struct rates rates;
+static struct nf2_snapshot snap;
+
+static void rates_init(void) {
+	int i, j;
+
+	for (i = 0; i < NF2_PORT_NUM; i++)
+		for (j = 0; j < PORT_NUM_CNTRS; j++)
+			nf2_counter64_init(&rates.port[i][j], 32);
+	for (i = 0; i < NF2_OQ_NUM; i++)
+		for (j = 0; j < OQ_NUM_CNTRS; j++)
+			nf2_counter64_init(&rates.oq[i][j], 32);
+	for (j = 0; j < LOOKUP_NUM_CNTRS; j++)
+		nf2_counter64_init(&rates.lookup[j], 32);
+}
+
+
+static void rates_update(void) {
+	struct nf2_port_info *port;
+	struct nf2_queue_info *oq;
+	int i;
+
+#define UPDATE(cntr, delta, raw)	(delta) = nf2_counter64_update(&(cntr), (raw))
+
+	for (i = 0; i < NF2_PORT_NUM; i++) {
+		port = &snap.port[i];
+		UPDATE(rates.port[i][PORT_RX_PKTS], rates.port_delta[i][PORT_RX_PKTS],
+		       port->rx_q_num_pkts_stored);
+		UPDATE(rates.port[i][PORT_RX_BYTES], rates.port_delta[i][PORT_RX_BYTES],
+		       port->rx_q_num_bytes_pushed);
+		UPDATE(rates.port[i][PORT_TX_PKTS], rates.port_delta[i][PORT_TX_PKTS],
+		       port->tx_q_num_pkts_sent);
+		UPDATE(rates.port[i][PORT_TX_BYTES], rates.port_delta[i][PORT_TX_BYTES],
+		       port->tx_q_num_bytes_pushed);
+		UPDATE(rates.port[i][PORT_RX_DROPPED_FULL], rates.port_delta[i][PORT_RX_DROPPED_FULL],
+		       port->rx_q_num_pkts_dropped_full);
+		UPDATE(rates.port[i][PORT_RX_DROPPED_BAD], rates.port_delta[i][PORT_RX_DROPPED_BAD],
+		       port->rx_q_num_pkts_dropped_bad);
+	}
+
+	for (i = 0; i < NF2_OQ_NUM; i++) {
+		oq = &snap.oq[i];
+		UPDATE(rates.oq[i][OQ_PKTS], rates.oq_delta[i][OQ_PKTS],
+		       oq->num_pkts_received);
+		UPDATE(rates.oq[i][OQ_BYTES], rates.oq_delta[i][OQ_BYTES],
+		       oq->num_pkt_bytes_received);
+		UPDATE(rates.oq[i][OQ_DROPPED], rates.oq_delta[i][OQ_DROPPED],
+		       oq->num_pkts_dropped);
+	}
+
+	UPDATE(rates.lookup[LOOKUP_EXACT_HITS], rates.lookup_delta[LOOKUP_EXACT_HITS],
+	       snap.lookup.exact_hits);
+	UPDATE(rates.lookup[LOOKUP_EXACT_MISSES], rates.lookup_delta[LOOKUP_EXACT_MISSES],
+	       snap.lookup.exact_misses);
+	UPDATE(rates.lookup[LOOKUP_WILDCARD_HITS], rates.lookup_delta[LOOKUP_WILDCARD_HITS],
+	       snap.lookup.wildcard_hits);
+	UPDATE(rates.lookup[LOOKUP_WILDCARD_MISSES], rates.lookup_delta[LOOKUP_WILDCARD_MISSES],
+	       snap.lookup.wildcard_misses);
+
+#undef UPDATE
+}
+
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void draw(const char *iface, double interval, unsigned long samples) {
+	int i, row = 0;
+	double mbps;
+
+	erase();
+	mvprintw(row++, 0, "%s  interval %.2fs  samples %lu  (q to quit)",
+		 iface, interval, samples);
+	row++;
+
+	attron(A_BOLD);
+	mvprintw(row++, 0, "%-5s %10s %10s %10s %10s %10s %10s %16s %16s",
+		 "port", "rx pps", "rx Mbps", "tx pps", "tx Mbps",
+		 "full/s", "badfcs/s", "rx bytes", "tx bytes");
+	attroff(A_BOLD);
+	for (i = 0; i < NF2_PORT_NUM; i++) {
+		uint32_t *d = rates.port_delta[i];
+
+		mvprintw(row++, 0, "%-5d %10.0f %10.2f %10.0f %10.2f %10.0f %10.0f %16llu %16llu",
+			 i,
+			 d[PORT_RX_PKTS] / interval,
+			 (double)d[PORT_RX_BYTES] * 8 / interval / 1e6,
+			 d[PORT_TX_PKTS] / interval,
+			 (double)d[PORT_TX_BYTES] * 8 / interval / 1e6,
+			 d[PORT_RX_DROPPED_FULL] / interval,
+			 d[PORT_RX_DROPPED_BAD] / interval,
+			 (unsigned long long)rates.port[i][PORT_RX_BYTES].total,
+			 (unsigned long long)rates.port[i][PORT_TX_BYTES].total);
+	}
+	row++;
+
+	attron(A_BOLD);
+	mvprintw(row++, 0, "%-5s %10s %10s %10s %10s %16s",
+		 "oq", "pps", "Mbps", "drop/s", "drop %", "dropped");
+	attroff(A_BOLD);
+	for (i = 0; i < NF2_OQ_NUM; i++) {
+		uint32_t *d = rates.oq_delta[i];
+		uint64_t offered = (uint64_t)d[OQ_PKTS] + d[OQ_DROPPED];
+
+		mbps = (double)d[OQ_BYTES] * 8 / interval / 1e6;
+		mvprintw(row++, 0, "%-5d %10.0f %10.2f %10.0f %10.2f %16llu",
+			 i, d[OQ_PKTS] / interval, mbps,
+			 d[OQ_DROPPED] / interval,
+			 offered ? 100.0 * d[OQ_DROPPED] / offered : 0.0,
+			 (unsigned long long)rates.oq[i][OQ_DROPPED].total);
+	}
+	row++;
+
+	attron(A_BOLD);
+	mvprintw(row++, 0, "%-10s %10s %10s", "lookup", "hits/s", "misses/s");
+	attroff(A_BOLD);
+	mvprintw(row++, 0, "%-10s %10.0f %10.0f", "exact",
+		 rates.lookup_delta[LOOKUP_EXACT_HITS] / interval,
+		 rates.lookup_delta[LOOKUP_EXACT_MISSES] / interval);
+	mvprintw(row++, 0, "%-10s %10.0f %10.0f", "wildcard",
+		 rates.lookup_delta[LOOKUP_WILDCARD_HITS] / interval,
+		 rates.lookup_delta[LOOKUP_WILDCARD_MISSES] / interval);
+
+	refresh();
+}
+
+
+//
+// monitor: sample the counters every interval_ms until 'q' is pressed.
+//    The interval must be shorter than the wrap time of the 32-bit byte
+//    counters (about 34s at 1Gb/s).
+//
+int monitor(struct nf2_regio *io, const char *iface, int interval_ms) {
+	unsigned long samples = 0;
+	double last, t;
+	int c;
+
+	rates_init();
+	if (nf2_snapshot_read(io, &snap, NF2_SNAP_COUNTERS))
+		return -1;
+	rates_update();
+	last = now();
+
+	initscr();
+	cbreak();
+	noecho();
+	curs_set(0);
+	timeout(interval_ms);
+
+	draw(iface, interval_ms / 1000.0, samples);
+	for (;;) {
+		c = getch();
+		if (c == 'q' || c == 'Q')
+			break;
+
+		t = now();
+		if (t - last < interval_ms / 1000.0) {
+			/* woken up early by a key press */
+			timeout((int)((interval_ms / 1000.0 - (t - last)) * 1000) + 1);
+			continue;
+		}
+
+		if (nf2_snapshot_read(io, &snap, NF2_SNAP_COUNTERS)) {
+			endwin();
+			return -1;
+		}
+		rates_update();
+		samples++;
+		draw(iface, t - last, samples);
+		last = t;
+		timeout(interval_ms);
+	}
+
+	endwin();
+	return 0;
+}
@@ -0,0 +1,19 @@
+/* ****************************************************************************
+ * Module: monitor.h
+ * Project: NetFPGA OpenFlow switch
+ * Description: Continuous rate monitor for regdump ("regdump -t").
+ *
+ * Change history:
+ *
+ */
+
+#ifndef MONITOR_H_
+#define MONITOR_H_
+
+#include "../common/nf2_regio.h"
+
+#define DEFAULT_MONITOR_INTERVAL	1000	/* ms */
+
+int monitor(struct nf2_regio *, const char *iface, int interval_ms);
+
+#endif
@@ -0,0 +1,147 @@
+/* ****************************************************************************
+ * Module: regbench.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Benchmark of the register dump on the mock register file.
+ *              Compares reading every register on its own (the way
+ *              regdump used to) against the bulk snapshot, and checks
+ *              that both give the same snapshot.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <time.h>
+
+#include "../common/nf2_regio.h"
+#include "../common/nf2_snapshot.h"
+
+/* Modelled cost of one ioctl round trip and of one PCI register read */
+#define DEFAULT_TXN_NS	1500
+#define DEFAULT_WORD_NS	500
+
+struct result {
+	const char *name;
+	double host_ns;
+	unsigned long txns;
+	unsigned long words;
+	unsigned long long model_ns;
+};
+
+static struct nf2_snapshot snap_regs, snap_bulk;
+
+void usage (void);
+void fill_mock (struct nf2_regio *);
+double now_ns (void);
+void run (struct nf2_regio *, struct nf2_snapshot *, int iters,
+	  int (*read)(struct nf2_regio *, struct nf2_snapshot *, int),
+	  struct result *);
+
+int main(int argc, char *argv[]) {
+	struct nf2_regio io;
+	struct result res[2];
+	unsigned txn_ns = DEFAULT_TXN_NS;
+	unsigned word_ns = DEFAULT_WORD_NS;
+	int iters = 1000;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "n:t:w:h")) != -1) {
+		switch (c) {
+		case 'n':
+			iters = atoi(optarg);
+			break;
+		case 't':
+			txn_ns = atoi(optarg);
+			break;
+		case 'w':
+			word_ns = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (iters <= 0) {
+		usage();
+		exit(1);
+	}
+
+	if (nf2_regio_open_mock(&io, txn_ns, word_ns)) {
+		fprintf(stderr, "Could not allocate the mock register file\n");
+		exit(1);
+	}
+	fill_mock(&io);
+
+	res[0].name = "per-register";
+	run(&io, &snap_regs, iters, nf2_snapshot_read_regs, &res[0]);
+	res[1].name = "bulk snapshot";
+	run(&io, &snap_bulk, iters, nf2_snapshot_read, &res[1]);
+
+	if (memcmp(&snap_regs, &snap_bulk, sizeof(snap_regs)) != 0) {
+		fprintf(stderr, "ERROR: bulk snapshot differs from per-register read\n");
+		exit(1);
+	}
+
+	printf("%d dumps, model: %u ns/transaction + %u ns/word\n\n",
+	       iters, txn_ns, word_ns);
+	printf("%-14s %12s %12s %14s %14s\n", "method", "txns/dump",
+	       "words/dump", "model us/dump", "host ns/dump");
+	for (i = 0; i < 2; i++) {
+		printf("%-14s %12lu %12lu %14.1f %14.1f\n", res[i].name,
+		       res[i].txns, res[i].words,
+		       res[i].model_ns / 1000.0, res[i].host_ns);
+	}
+	printf("\nmodelled speedup: %.2fx\n",
+	       (double)res[0].model_ns / (double)res[1].model_ns);
+
+	nf2_regio_close(&io);
+	return 0;
+}
+
+
+void usage(void) {
+	printf("Usage: regbench [-n iterations] [-t txn_ns] [-w word_ns]\n");
+}
+
+
+//
+// fill_mock: give every register of the snapshot a distinct value so that
+//    a misplaced word shows up in the comparison.
+//
+void fill_mock(struct nf2_regio *io) {
+	struct nf2_snapshot snap;
+
+	/* Touch the snapshot once so that its registers exist */
+	nf2_snapshot_read_regs(io, &snap, NF2_SNAP_ALL);
+	nf2_regio_mock_fill(io, 1);
+}
+
+
+double now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+void run(struct nf2_regio *io, struct nf2_snapshot *snap, int iters,
+	 int (*read)(struct nf2_regio *, struct nf2_snapshot *, int),
+	 struct result *res) {
+	double start;
+	int i;
+
+	nf2_regio_clear_stats(io);
+	start = now_ns();
+	for (i = 0; i < iters; i++)
+		read(io, snap, NF2_SNAP_ALL);
+	res->host_ns = (now_ns() - start) / iters;
+	res->txns = io->num_txns / iters;
+	res->words = io->num_words / iters;
+	res->model_ns = io->model_ns / iters;
+}
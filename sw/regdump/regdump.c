@@ -23,7 +23,10 @@
 
 #include "../../../../lib/C/common/nf2util.h"
 #include "../../lib/C/reg_defines_openflow_switch.h"
+#include "../common/nf2_regio.h"
+#include "../common/nf2_snapshot.h"
 #include "nf2_drv.h"
+#include "monitor.h"
 
 #define PATHLEN		80
 
@@ -31,22 +34,43 @@
 
 /* Global vars */
 static struct nf2device nf2;
-static int verbose = 0;
-static int force_cnet = 0;
+static struct nf2_regio regio;
+static struct nf2_snapshot snap;
 
 /* Function declarations */
 void print (void);
 void printMAC (unsigned char*);
 void printIP (unsigned);
-void read_openflow_wildcard_table(int, int *entry_not_zero, nf2_of_entry_wrap *wildcard,
-                                  nf2_of_entry_wrap *wildcard_mask,
-                                  nf2_of_action_wrap *wildcard_actions);
+int wildcard_entry_not_zero(struct nf2_wildcard_info *);
 void print_openflow_table(nf2_of_entry_wrap, nf2_of_entry_wrap, nf2_of_action_wrap );
+void usage (void);
 
 int main(int argc, char *argv[]) {
-	unsigned val;
+	int c;
+	int use_mmap = 0;
+	int interval_ms = 0;
 	nf2.device_name = DEFAULT_IFACE;
 
+	while ((c = getopt(argc, argv, "i:mt:h")) != -1) {
+		switch (c) {
+		case 'i':
+			nf2.device_name = optarg;
+			break;
+		case 'm':
+			use_mmap = 1;
+			break;
+		case 't':
+			interval_ms = atoi(optarg);
+			if (interval_ms <= 0)
+				interval_ms = DEFAULT_MONITOR_INTERVAL;
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
 	if (check_iface(&nf2)) {
 		exit(1);
 	}
@@ -54,301 +78,111 @@ int main(int argc, char *argv[]) {
 		exit(1);
 	}
 
+	if (use_mmap) {
+		if (nf2_regio_open_mmap(&regio, nf2.device_name))
+			exit(1);
+	}
+	else {
+		nf2_regio_open_ioctl(&regio, &nf2);
+	}
+
+	if (interval_ms) {
+		if (monitor(&regio, nf2.device_name, interval_ms)) {
+			fprintf(stderr, "Error reading registers from %s\n", nf2.device_name);
+			exit(1);
+		}
+		nf2_regio_close(&regio);
+		closeDescriptor(&nf2);
+		return 0;
+	}
+
+	if (nf2_snapshot_read(&regio, &snap, NF2_SNAP_ALL)) {
+		fprintf(stderr, "Error reading registers from %s\n", nf2.device_name);
+		exit(1);
+	}
+
 	print();
+	nf2_regio_close(&regio);
 	closeDescriptor(&nf2);
 	return 0;
 }
 
 
+void usage(void) {
+	printf("Usage: regdump [-i interface] [-m] [-t interval_ms]\n");
+	printf("  -i  interface of the card (default %s)\n", DEFAULT_IFACE);
+	printf("  -m  read the registers through a mapping of the register BAR\n");
+	printf("  -t  show packet, bit and drop rates continuously, sampling\n");
+	printf("      every interval_ms milliseconds\n");
+}
+
+
 void print(void) {
 	unsigned val;
-	int i, j, entry_not_zero;
-	nf2_of_entry_wrap openflow_wildcard_entry;
-	nf2_of_entry_wrap openflow_wildcard_mask;
-	nf2_of_action_wrap openflow_wildcard_actions;
+	int i;
+	struct nf2_port_info *port;
+	struct nf2_queue_info *oq;
 
 	//	readReg(&nf2, UNET_ID, &val);
 	//	printf("Board ID: Version %i, Device %i\n", GET_VERSION(val), GET_DEVICE(val));
-	readReg(&nf2, MAC_GRP_0_CONTROL_REG, &val);
-	printf("MAC 0 Control: 0x%08x:  ", val);
-	if(val&(1<<MAC_GRP_TX_QUEUE_DISABLE_BIT_NUM)) {
-	  printf("TX disabled, ");
-	}
-	else {
-	  printf("TX enabled,  ");
-	}
-	if(val&(1<<MAC_GRP_RX_QUEUE_DISABLE_BIT_NUM)) {
-	  printf("RX disabled, ");
-	}
-	else {
-	  printf("RX enabled,  ");
-	}
-	if(val&(1<<MAC_GRP_RESET_MAC_BIT_NUM)) {
-	  printf("reset on\n");
-	}
-	else {
-	  printf("reset off\n");
-	}
-	printf("mac config 0x%02x\n", val>>MAC_GRP_MAC_DISABLE_TX_BIT_NUM);
-
-	readReg(&nf2, MAC_GRP_0_RX_QUEUE_NUM_PKTS_STORED_REG, &val);
-	printf("Num pkts enqueued to rx queue 0:    %u\n", val);
-	readReg(&nf2, MAC_GRP_0_RX_QUEUE_NUM_PKTS_DROPPED_FULL_REG, &val);
-	printf("Num pkts dropped (rx queue 0 full): %u\n", val);
-	readReg(&nf2, MAC_GRP_0_RX_QUEUE_NUM_PKTS_DROPPED_BAD_REG, &val);
-	printf("Num pkts dropped (bad fcs q 0):     %u\n", val);
-	readReg(&nf2, MAC_GRP_0_RX_QUEUE_NUM_WORDS_PUSHED_REG, &val);
-	printf("Num words pushed out of rx queue 0: %u\n", val);
-	readReg(&nf2, MAC_GRP_0_RX_QUEUE_NUM_BYTES_PUSHED_REG, &val);
-	printf("Num bytes pushed out of rx queue 0: %u\n", val);
-	readReg(&nf2, MAC_GRP_0_RX_QUEUE_NUM_PKTS_DEQUEUED_REG, &val);
-	printf("Num pkts dequeued from rx queue 0:  %u\n", val);
-	readReg(&nf2, MAC_GRP_0_RX_QUEUE_NUM_PKTS_IN_QUEUE_REG, &val);
-	printf("Num pkts in rx queue 0:             %u\n", val);
-
-	readReg(&nf2, MAC_GRP_0_TX_QUEUE_NUM_PKTS_IN_QUEUE_REG, &val);
-	printf("Num pkts in tx queue 0:             %u\n", val);
-	readReg(&nf2, MAC_GRP_0_TX_QUEUE_NUM_PKTS_SENT_REG, &val);
-	printf("Num pkts dequeued from tx queue 0:  %u\n", val);
-	readReg(&nf2, MAC_GRP_0_TX_QUEUE_NUM_WORDS_PUSHED_REG, &val);
-	printf("Num words pushed out of tx queue 0: %u\n", val);
-	readReg(&nf2, MAC_GRP_0_TX_QUEUE_NUM_BYTES_PUSHED_REG, &val);
-	printf("Num bytes pushed out of tx queue 0: %u\n", val);
-	readReg(&nf2, MAC_GRP_0_TX_QUEUE_NUM_PKTS_ENQUEUED_REG, &val);
-	printf("Num pkts enqueued to tx queue 0:    %u\n\n", val);
-
-	readReg(&nf2, MAC_GRP_1_CONTROL_REG, &val);
-	printf("MAC 1 Control: 0x%08x ", val);
-	if(val&(1<<MAC_GRP_TX_QUEUE_DISABLE_BIT_NUM)) {
-	  printf("TX disabled, ");
-	}
-	else {
-	  printf("TX enabled,  ");
-	}
-	if(val&(1<<MAC_GRP_RX_QUEUE_DISABLE_BIT_NUM)) {
-	  printf("RX disabled, ");
-	}
-	else {
-	  printf("RX enabled,  ");
-	}
-	if(val&(1<<MAC_GRP_RESET_MAC_BIT_NUM)) {
-	  printf("reset on\n");
-	}
-	else {
-	  printf("reset off\n");
-	}
-	printf("mac config 0x%02x\n", val>>MAC_GRP_MAC_DISABLE_TX_BIT_NUM);
-	readReg(&nf2, MAC_GRP_1_RX_QUEUE_NUM_PKTS_STORED_REG, &val);
-	printf("Num pkts enqueued to rx queue 1:    %u\n", val);
-	readReg(&nf2, MAC_GRP_1_RX_QUEUE_NUM_PKTS_DROPPED_FULL_REG, &val);
-	printf("Num pkts dropped (rx queue 1 full): %u\n", val);
-	readReg(&nf2, MAC_GRP_1_RX_QUEUE_NUM_PKTS_DROPPED_BAD_REG, &val);
-	printf("Num pkts dropped (bad fcs q 1):     %u\n", val);
-	readReg(&nf2, MAC_GRP_1_RX_QUEUE_NUM_WORDS_PUSHED_REG, &val);
-	printf("Num words pushed out of rx queue 1: %u\n", val);
-	readReg(&nf2, MAC_GRP_1_RX_QUEUE_NUM_BYTES_PUSHED_REG, &val);
-	printf("Num bytes pushed out of rx queue 1: %u\n", val);
-	readReg(&nf2, MAC_GRP_1_RX_QUEUE_NUM_PKTS_DEQUEUED_REG, &val);
-	printf("Num pkts dequeued from rx queue 1:  %u\n", val);
-	readReg(&nf2, MAC_GRP_1_RX_QUEUE_NUM_PKTS_IN_QUEUE_REG, &val);
-	printf("Num pkts in rx queue 1:             %u\n", val);
-
-	readReg(&nf2, MAC_GRP_1_TX_QUEUE_NUM_PKTS_IN_QUEUE_REG, &val);
-	printf("Num pkts in tx queue 1:             %u\n", val);
-	readReg(&nf2, MAC_GRP_1_TX_QUEUE_NUM_PKTS_SENT_REG, &val);
-	printf("Num pkts dequeued from tx queue 1:  %u\n", val);
-	readReg(&nf2, MAC_GRP_1_TX_QUEUE_NUM_WORDS_PUSHED_REG, &val);
-	printf("Num words pushed out of tx queue 1: %u\n", val);
-	readReg(&nf2, MAC_GRP_1_TX_QUEUE_NUM_BYTES_PUSHED_REG, &val);
-	printf("Num bytes pushed out of tx queue 1: %u\n", val);
-        readReg(&nf2, MAC_GRP_1_TX_QUEUE_NUM_PKTS_ENQUEUED_REG, &val);
-        printf("Num pkts enqueued to tx queue 1:    %u\n\n", val);
-
-	readReg(&nf2, MAC_GRP_2_CONTROL_REG, &val);
-	printf("MAC 2 Control: 0x%08x ", val);
-	if(val&(1<<MAC_GRP_TX_QUEUE_DISABLE_BIT_NUM)) {
-	  printf("TX disabled, ");
-	}
-	else {
-	  printf("TX enabled,  ");
-	}
-	if(val&(1<<MAC_GRP_RX_QUEUE_DISABLE_BIT_NUM)) {
-	  printf("RX disabled, ");
-	}
-	else {
-	  printf("RX enabled,  ");
-	}
-	if(val&(1<<MAC_GRP_RESET_MAC_BIT_NUM)) {
-	  printf("reset on\n");
-	}
-	else {
-	  printf("reset off\n");
-	}
-	printf("mac config 0x%02x\n", val>>MAC_GRP_MAC_DISABLE_TX_BIT_NUM);
-	readReg(&nf2, MAC_GRP_2_RX_QUEUE_NUM_PKTS_STORED_REG, &val);
-	printf("Num pkts enqueued to rx queue 2:    %u\n", val);
-	readReg(&nf2, MAC_GRP_2_RX_QUEUE_NUM_PKTS_DROPPED_FULL_REG, &val);
-	printf("Num pkts dropped (rx queue 2 full): %u\n", val);
-	readReg(&nf2, MAC_GRP_2_RX_QUEUE_NUM_PKTS_DROPPED_BAD_REG, &val);
-	printf("Num pkts dropped (bad fcs q 2):     %u\n", val);
-	readReg(&nf2, MAC_GRP_2_RX_QUEUE_NUM_WORDS_PUSHED_REG, &val);
-	printf("Num words pushed out of rx queue 2: %u\n", val);
-	readReg(&nf2, MAC_GRP_2_RX_QUEUE_NUM_BYTES_PUSHED_REG, &val);
-	printf("Num bytes pushed out of rx queue 2: %u\n", val);
-	readReg(&nf2, MAC_GRP_2_RX_QUEUE_NUM_PKTS_DEQUEUED_REG, &val);
-	printf("Num pkts dequeued from rx queue 2:  %u\n", val);
-	readReg(&nf2, MAC_GRP_2_RX_QUEUE_NUM_PKTS_IN_QUEUE_REG, &val);
-	printf("Num pkts in rx queue 2:             %u\n", val);
-
-	readReg(&nf2, MAC_GRP_2_TX_QUEUE_NUM_PKTS_IN_QUEUE_REG, &val);
-	printf("Num pkts in tx queue 2:             %u\n", val);
-	readReg(&nf2, MAC_GRP_2_TX_QUEUE_NUM_PKTS_SENT_REG, &val);
-	printf("Num pkts dequeued from tx queue 2:  %u\n", val);
-	readReg(&nf2, MAC_GRP_2_TX_QUEUE_NUM_WORDS_PUSHED_REG, &val);
-	printf("Num words pushed out of tx queue 2: %u\n", val);
-	readReg(&nf2, MAC_GRP_2_TX_QUEUE_NUM_BYTES_PUSHED_REG, &val);
-	printf("Num bytes pushed out of tx queue 2: %u\n", val);
-        readReg(&nf2, MAC_GRP_2_TX_QUEUE_NUM_PKTS_ENQUEUED_REG, &val);
-        printf("Num pkts enqueued to tx queue 2:    %u\n\n", val);
-
-	readReg(&nf2, MAC_GRP_3_CONTROL_REG, &val);
-	printf("MAC 3 Control: 0x%08x ", val);
-	if(val&(1<<MAC_GRP_TX_QUEUE_DISABLE_BIT_NUM)) {
-	  printf("TX disabled, ");
-	}
-	else {
-	  printf("TX enabled,  ");
-	}
-	if(val&(1<<MAC_GRP_RX_QUEUE_DISABLE_BIT_NUM)) {
-	  printf("RX disabled, ");
-	}
-	else {
-	  printf("RX enabled,  ");
-	}
-	if(val&(1<<MAC_GRP_RESET_MAC_BIT_NUM)) {
-	  printf("reset on\n");
-	}
-	else {
-	  printf("reset off\n");
+	for (i = 0; i < NF2_PORT_NUM; i++) {
+		val = snap.mac_control[i];
+		port = &snap.port[i];
+
+		printf("MAC %d Control: 0x%08x ", i, val);
+		if(val&(1<<MAC_GRP_TX_QUEUE_DISABLE_BIT_NUM)) {
+		  printf("TX disabled, ");
+		}
+		else {
+		  printf("TX enabled,  ");
+		}
+		if(val&(1<<MAC_GRP_RX_QUEUE_DISABLE_BIT_NUM)) {
+		  printf("RX disabled, ");
+		}
+		else {
+		  printf("RX enabled,  ");
+		}
+		if(val&(1<<MAC_GRP_RESET_MAC_BIT_NUM)) {
+		  printf("reset on\n");
+		}
+		else {
+		  printf("reset off\n");
+		}
+		printf("mac config 0x%02x\n", val>>MAC_GRP_MAC_DISABLE_TX_BIT_NUM);
+
+		printf("Num pkts enqueued to rx queue %d:    %u\n", i, port->rx_q_num_pkts_stored);
+		printf("Num pkts dropped (rx queue %d full): %u\n", i, port->rx_q_num_pkts_dropped_full);
+		printf("Num pkts dropped (bad fcs q %d):     %u\n", i, port->rx_q_num_pkts_dropped_bad);
+		printf("Num words pushed out of rx queue %d: %u\n", i, port->rx_q_num_words_pushed);
+		printf("Num bytes pushed out of rx queue %d: %u\n", i, port->rx_q_num_bytes_pushed);
+		printf("Num pkts dequeued from rx queue %d:  %u\n", i, port->rx_q_num_pkts_dequeued);
+		printf("Num pkts in rx queue %d:             %u\n", i, port->rx_q_num_pkts_in_queue);
+
+		printf("Num pkts in tx queue %d:             %u\n", i, port->tx_q_num_pkts_in_queue);
+		printf("Num pkts dequeued from tx queue %d:  %u\n", i, port->tx_q_num_pkts_sent);
+		printf("Num words pushed out of tx queue %d: %u\n", i, port->tx_q_num_words_pushed);
+		printf("Num bytes pushed out of tx queue %d: %u\n", i, port->tx_q_num_bytes_pushed);
+		printf("Num pkts enqueued to tx queue %d:    %u\n\n", i, port->tx_q_num_pkts_enqueued);
+	}
+
+	printf("IN_ARB_NUM_PKTS_SENT_REG            %u\n", snap.in_arb.num_pkts_sent);
+	printf("IN_ARB_LAST_PKT_WORD_0_LO_REG       0x%08x\n", snap.in_arb.last_pkt_word_0_lo);
+	printf("IN_ARB_LAST_PKT_WORD_0_HI_REG       0x%08x\n", snap.in_arb.last_pkt_word_0_hi);
+	printf("IN_ARB_LAST_PKT_CTRL_0_REG          0x%02x\n", snap.in_arb.last_pkt_ctrl_0);
+	printf("IN_ARB_LAST_PKT_WORD_1_LO_REG       0x%08x\n", snap.in_arb.last_pkt_word_1_lo);
+	printf("IN_ARB_LAST_PKT_WORD_1_HI_REG       0x%08x\n", snap.in_arb.last_pkt_word_1_hi);
+	printf("IN_ARB_LAST_PKT_CTRL_1_REG          0x%02x\n", snap.in_arb.last_pkt_ctrl_1);
+	printf("IN_ARB_STATE_REG                    %u\n\n", snap.in_arb.state);
+
+	printf("BRAM_OQ_DISABLE_QUEUES_REG                    %u\n\n", snap.oq_disable);
+
+	for (i = 0; i < NF2_OQ_NUM; i++) {
+		oq = &snap.oq[i];
+		printf("BRAM_OQ_QUEUE_%d_NUM_PKT_BYTES_RECEIVED_REG    %u\n", i, oq->num_pkt_bytes_received);
+		printf("BRAM_OQ_QUEUE_%d_NUM_PKTS_RECEIVED_REG         %u\n", i, oq->num_pkts_received);
+		printf("BRAM_OQ_QUEUE_%d_NUM_PKTS_DROPPED_REG          %u\n", i, oq->num_pkts_dropped);
+		printf("BRAM_OQ_QUEUE_%d_NUM_WORDS_IN_QUEUE_REG        %u\n\n", i, oq->num_words_in_queue);
 	}
-        printf("mac config 0x%02x\n", val>>MAC_GRP_MAC_DISABLE_TX_BIT_NUM);
-	readReg(&nf2, MAC_GRP_3_RX_QUEUE_NUM_PKTS_STORED_REG, &val);
-	printf("Num pkts enqueued to rx queue 3:    %u\n", val);
-	readReg(&nf2, MAC_GRP_3_RX_QUEUE_NUM_PKTS_DROPPED_FULL_REG, &val);
-	printf("Num pkts dropped (rx queue 3 full): %u\n", val);
-	readReg(&nf2, MAC_GRP_3_RX_QUEUE_NUM_PKTS_DROPPED_BAD_REG, &val);
-	printf("Num pkts dropped (bad fcs q 3):     %u\n", val);
-	readReg(&nf2, MAC_GRP_3_RX_QUEUE_NUM_WORDS_PUSHED_REG, &val);
-	printf("Num words pushed out of rx queue 3: %u\n", val);
-	readReg(&nf2, MAC_GRP_3_RX_QUEUE_NUM_BYTES_PUSHED_REG, &val);
-	printf("Num bytes pushed out of rx queue 3: %u\n", val);
-	readReg(&nf2, MAC_GRP_3_RX_QUEUE_NUM_PKTS_DEQUEUED_REG, &val);
-	printf("Num pkts dequeued from rx queue 3:  %u\n", val);
-	readReg(&nf2, MAC_GRP_3_RX_QUEUE_NUM_PKTS_IN_QUEUE_REG, &val);
-	printf("Num pkts in rx queue 3:             %u\n", val);
-
-	readReg(&nf2, MAC_GRP_3_TX_QUEUE_NUM_PKTS_IN_QUEUE_REG, &val);
-	printf("Num pkts in tx queue 3:             %u\n", val);
-	readReg(&nf2, MAC_GRP_3_TX_QUEUE_NUM_PKTS_SENT_REG, &val);
-	printf("Num pkts dequeued from tx queue 3:  %u\n", val);
-	readReg(&nf2, MAC_GRP_3_TX_QUEUE_NUM_WORDS_PUSHED_REG, &val);
-	printf("Num words pushed out of tx queue 3: %u\n", val);
-	readReg(&nf2, MAC_GRP_3_TX_QUEUE_NUM_BYTES_PUSHED_REG, &val);
-	printf("Num bytes pushed out of tx queue 3: %u\n", val);
-        readReg(&nf2, MAC_GRP_3_TX_QUEUE_NUM_PKTS_ENQUEUED_REG, &val);
-        printf("Num pkts enqueued to tx queue 3:    %u\n\n", val);
-
-	readReg(&nf2, IN_ARB_NUM_PKTS_SENT_REG, &val);
-	printf("IN_ARB_NUM_PKTS_SENT_REG            %u\n", val);
-	readReg(&nf2, IN_ARB_LAST_PKT_WORD_0_LO_REG, &val);
-	printf("IN_ARB_LAST_PKT_WORD_0_LO_REG       0x%08x\n", val);
-	readReg(&nf2, IN_ARB_LAST_PKT_WORD_0_HI_REG, &val);
-	printf("IN_ARB_LAST_PKT_WORD_0_HI_REG       0x%08x\n", val);
-	readReg(&nf2, IN_ARB_LAST_PKT_CTRL_0_REG, &val);
-	printf("IN_ARB_LAST_PKT_CTRL_0_REG          0x%02x\n", val);
-	readReg(&nf2, IN_ARB_LAST_PKT_WORD_1_LO_REG, &val);
-	printf("IN_ARB_LAST_PKT_WORD_1_LO_REG       0x%08x\n", val);
-	readReg(&nf2, IN_ARB_LAST_PKT_WORD_1_HI_REG, &val);
-	printf("IN_ARB_LAST_PKT_WORD_1_HI_REG       0x%08x\n", val);
-	readReg(&nf2, IN_ARB_LAST_PKT_CTRL_1_REG, &val);
-	printf("IN_ARB_LAST_PKT_CTRL_1_REG          0x%02x\n", val);
-	readReg(&nf2, IN_ARB_STATE_REG, &val);
-	printf("IN_ARB_STATE_REG                    %u\n\n", val);
-
-	readReg(&nf2, BRAM_OQ_DISABLE_QUEUES_REG, &val);
-	printf("BRAM_OQ_DISABLE_QUEUES_REG                    %u\n\n", val);
-
-	readReg(&nf2, BRAM_OQ_QUEUE_0_NUM_PKT_BYTES_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_0_NUM_PKT_BYTES_RECEIVED_REG    %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_0_NUM_PKTS_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_0_NUM_PKTS_RECEIVED_REG         %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_0_NUM_PKTS_DROPPED_REG, &val);
-	printf("BRAM_OQ_QUEUE_0_NUM_PKTS_DROPPED_REG          %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_0_NUM_WORDS_IN_QUEUE_REG, &val);
-	printf("BRAM_OQ_QUEUE_0_NUM_WORDS_IN_QUEUE_REG        %u\n\n", val);
-
-	readReg(&nf2, BRAM_OQ_QUEUE_1_NUM_PKT_BYTES_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_1_NUM_PKT_BYTES_RECEIVED_REG    %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_1_NUM_PKTS_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_1_NUM_PKTS_RECEIVED_REG         %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_1_NUM_PKTS_DROPPED_REG, &val);
-	printf("BRAM_OQ_QUEUE_1_NUM_PKTS_DROPPED_REG          %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_1_NUM_WORDS_IN_QUEUE_REG, &val);
-	printf("BRAM_OQ_QUEUE_1_NUM_WORDS_IN_QUEUE_REG        %u\n\n", val);
-
-	readReg(&nf2, BRAM_OQ_QUEUE_2_NUM_PKT_BYTES_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_2_NUM_PKT_BYTES_RECEIVED_REG    %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_2_NUM_PKTS_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_2_NUM_PKTS_RECEIVED_REG         %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_2_NUM_PKTS_DROPPED_REG, &val);
-	printf("BRAM_OQ_QUEUE_2_NUM_PKTS_DROPPED_REG          %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_2_NUM_WORDS_IN_QUEUE_REG, &val);
-	printf("BRAM_OQ_QUEUE_2_NUM_WORDS_IN_QUEUE_REG        %u\n\n", val);
-
-	readReg(&nf2, BRAM_OQ_QUEUE_3_NUM_PKT_BYTES_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_3_NUM_PKT_BYTES_RECEIVED_REG    %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_3_NUM_PKTS_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_3_NUM_PKTS_RECEIVED_REG         %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_3_NUM_PKTS_DROPPED_REG, &val);
-	printf("BRAM_OQ_QUEUE_3_NUM_PKTS_DROPPED_REG          %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_3_NUM_WORDS_IN_QUEUE_REG, &val);
-	printf("BRAM_OQ_QUEUE_3_NUM_WORDS_IN_QUEUE_REG        %u\n\n", val);
-
-	readReg(&nf2, BRAM_OQ_QUEUE_4_NUM_PKT_BYTES_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_4_NUM_PKT_BYTES_RECEIVED_REG    %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_4_NUM_PKTS_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_4_NUM_PKTS_RECEIVED_REG         %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_4_NUM_PKTS_DROPPED_REG, &val);
-	printf("BRAM_OQ_QUEUE_4_NUM_PKTS_DROPPED_REG          %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_4_NUM_WORDS_IN_QUEUE_REG, &val);
-	printf("BRAM_OQ_QUEUE_4_NUM_WORDS_IN_QUEUE_REG        %u\n\n", val);
-
-	readReg(&nf2, BRAM_OQ_QUEUE_5_NUM_PKT_BYTES_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_5_NUM_PKT_BYTES_RECEIVED_REG    %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_5_NUM_PKTS_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_5_NUM_PKTS_RECEIVED_REG         %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_5_NUM_PKTS_DROPPED_REG, &val);
-	printf("BRAM_OQ_QUEUE_5_NUM_PKTS_DROPPED_REG          %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_5_NUM_WORDS_IN_QUEUE_REG, &val);
-	printf("BRAM_OQ_QUEUE_5_NUM_WORDS_IN_QUEUE_REG        %u\n\n", val);
-
-	readReg(&nf2, BRAM_OQ_QUEUE_6_NUM_PKT_BYTES_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_6_NUM_PKT_BYTES_RECEIVED_REG    %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_6_NUM_PKTS_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_6_NUM_PKTS_RECEIVED_REG         %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_6_NUM_PKTS_DROPPED_REG, &val);
-	printf("BRAM_OQ_QUEUE_6_NUM_PKTS_DROPPED_REG          %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_6_NUM_WORDS_IN_QUEUE_REG, &val);
-	printf("BRAM_OQ_QUEUE_6_NUM_WORDS_IN_QUEUE_REG        %u\n\n", val);
-
-	readReg(&nf2, BRAM_OQ_QUEUE_7_NUM_PKT_BYTES_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_7_NUM_PKT_BYTES_RECEIVED_REG    %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_7_NUM_PKTS_RECEIVED_REG, &val);
-	printf("BRAM_OQ_QUEUE_7_NUM_PKTS_RECEIVED_REG         %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_7_NUM_PKTS_DROPPED_REG, &val);
-	printf("BRAM_OQ_QUEUE_7_NUM_PKTS_DROPPED_REG          %u\n", val);
-	readReg(&nf2, BRAM_OQ_QUEUE_7_NUM_WORDS_IN_QUEUE_REG, &val);
-	printf("BRAM_OQ_QUEUE_7_NUM_WORDS_IN_QUEUE_REG        %u\n\n", val);
 
 	printf("OPENFLOW_WILDCARD_TABLE_SIZE                  %u\n",
 	        OPENFLOW_WILDCARD_TABLE_SIZE);
@@ -357,52 +191,27 @@ void print(void) {
 	printf("OPENFLOW_WILDCARD_NUM_CMP_WORDS_USED          %u\n\n",
 	        OPENFLOW_WILDCARD_NUM_CMP_WORDS_USED);
 
-	readReg(&nf2, OPENFLOW_LOOKUP_WILDCARD_MISSES_REG, &val);
-	printf("OPENFLOW_LOOKUP_WILDCARD_MISSES_REG           %u\n",val);
-	readReg(&nf2, OPENFLOW_LOOKUP_WILDCARD_HITS_REG, &val);
-	printf("OPENFLOW_LOOKUP_WILDCARD_HITS_REG             %u\n",val);
-	readReg(&nf2, OPENFLOW_LOOKUP_EXACT_MISSES_REG, &val);
-	printf("OPENFLOW_LOOKUP_EXACT_MISSES_REG              %u\n",val);
-	readReg(&nf2, OPENFLOW_LOOKUP_EXACT_HITS_REG, &val);
-	printf("OPENFLOW_LOOKUP_EXACT_HITS_REG                %u\n",val);
-	readReg(&nf2, OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_0_REG, &val);
-	printf("OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_0_REG        %u\n",val);
-	readReg(&nf2, OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_1_REG, &val);
-	printf("OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_1_REG        %u\n",val);
-	readReg(&nf2, OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_2_REG, &val);
-	printf("OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_2_REG        %u\n",val);
-	readReg(&nf2, OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_3_REG, &val);
-	printf("OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_3_REG        %u\n",val);
-	readReg(&nf2, OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_4_REG, &val);
-	printf("OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_4_REG        %u\n",val);
-	readReg(&nf2, OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_5_REG, &val);
-	printf("OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_5_REG        %u\n",val);
-	readReg(&nf2, OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_6_REG, &val);
-	printf("OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_6_REG        %u\n",val);
-	readReg(&nf2, OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_7_REG, &val);
-	printf("OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_7_REG        %u\n",val);
-	readReg(&nf2, OPENFLOW_LOOKUP_TIMER_REG, &val);
-	printf("OPENFLOW_LOOKUP_TIMER_REG                     %u\n\n",val);
-
-	readReg(&nf2, WDT_ENABLE_FLG_REG, &val);
-	printf("WDT_ENABLE_FLG_REG                            0x%08x\n",val);
-	readReg(&nf2, WDT_COUNTER_REG, &val);
-	printf("WDT_COUNTER_REG                               %u\n\n",val);
+	printf("OPENFLOW_LOOKUP_WILDCARD_MISSES_REG           %u\n", snap.lookup.wildcard_misses);
+	printf("OPENFLOW_LOOKUP_WILDCARD_HITS_REG             %u\n", snap.lookup.wildcard_hits);
+	printf("OPENFLOW_LOOKUP_EXACT_MISSES_REG              %u\n", snap.lookup.exact_misses);
+	printf("OPENFLOW_LOOKUP_EXACT_HITS_REG                %u\n", snap.lookup.exact_hits);
+	for (i = 0; i < NF2_OQ_NUM; i++) {
+		printf("OPENFLOW_LOOKUP_NUM_PKTS_DROPPED_%d_REG        %u\n",
+		       i, snap.lookup.num_pkts_dropped[i]);
+	}
+	printf("OPENFLOW_LOOKUP_TIMER_REG                     %u\n\n", snap.lookup.timer);
 
-	for(i=0; i<OPENFLOW_WILDCARD_TABLE_SIZE; i=i+1){
-		//Read the Header data from the table
-		read_openflow_wildcard_table(i, &entry_not_zero,
-		                             &openflow_wildcard_entry,
-		                             &openflow_wildcard_mask,
-		                             &openflow_wildcard_actions);
+	printf("WDT_ENABLE_FLG_REG                            0x%08x\n", snap.wdt_enable_flg);
+	printf("WDT_COUNTER_REG                               %u\n\n", snap.wdt_counter);
 
-		if (entry_not_zero == 1) {
+	for(i=0; i<OPENFLOW_WILDCARD_TABLE_SIZE; i=i+1){
+		if (wildcard_entry_not_zero(&snap.wildcard[i])) {
 			printf("#    tr_d tr_s pr ts ip_dst          ip_src          type eth_dst      eth_src      sp vlan\n");
 			printf("%02u", i);
 			//Print the entry
-			print_openflow_table(openflow_wildcard_entry,
-			                     openflow_wildcard_mask,
-			                     openflow_wildcard_actions);
+			print_openflow_table(snap.wildcard[i].entry,
+			                     snap.wildcard[i].mask,
+			                     snap.wildcard[i].action);
 		}
 	}
 	printf("\n");
@@ -431,42 +240,21 @@ void printIP(unsigned ip) {
 }
 
 
-void read_openflow_wildcard_table(int index, int *entry_not_zero,
-                                  nf2_of_entry_wrap *wildcard,
-                                  nf2_of_entry_wrap *wildcard_mask,
-                                  nf2_of_action_wrap *wildcard_actions) {
+int wildcard_entry_not_zero(struct nf2_wildcard_info *wildcard) {
 	int j;
 
-	*entry_not_zero = 0;
-
-	writeReg(&nf2, OPENFLOW_WILDCARD_LOOKUP_READ_ADDR_REG, index);
-
-	//Read the Header data from the table
 	for(j=0; j<OPENFLOW_WILDCARD_NUM_CMP_WORDS_USED; j=j+1) {
-		readReg(&nf2, OPENFLOW_WILDCARD_LOOKUP_CMP_0_REG + j * 4,
-		        &wildcard->raw[j]);
-		if (wildcard->raw[j] != 0)
-			*entry_not_zero = 1;
-		readReg(&nf2, OPENFLOW_WILDCARD_LOOKUP_CMP_MASK_0_REG + j * 4,
-		        &wildcard_mask->raw[j]);
-		if (wildcard_mask->raw[j] != 0)
-			*entry_not_zero = 1;
-	}
-
-	//Read the Action data from the table
-	for (j=0; j<OPENFLOW_WILDCARD_NUM_CMP_WORDS_USED; j=j+1) {
-		readReg(&nf2, OPENFLOW_WILDCARD_LOOKUP_ACTION_0_REG + j * 4,
-		        &wildcard_actions->raw[j]);
-		if (wildcard_actions->raw[j] != 0)
-			*entry_not_zero = 1;
+		if (wildcard->entry.raw[j] != 0 || wildcard->mask.raw[j] != 0 ||
+		    wildcard->action.raw[j] != 0)
+			return 1;
 	}
+	return 0;
 }
 
 
 void print_openflow_table(nf2_of_entry_wrap wildcard, nf2_of_entry_wrap wildcard_mask,
                           nf2_of_action_wrap wildcard_actions) {
 	int j;
-	unsigned val;
 
 	//print entry
 	printf(" E");
@@ -0,0 +1,237 @@
+/* ****************************************************************************
+ * Module: sramsim.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: SRAM slot budget of the exact table.
+ *
+ *              Runs the cycle level model of sram_arbiter's schedule and
+ *              exact_match's lookups (common/nf2_sram_model.c) under a
+ *              packet load and a host register load, and reports the
+ *              lookup rate reached, the input fifo occupancy, the drops,
+ *              the slots used per round and the latency of the host's
+ *              counter reads and flow installs. "-L" sweeps the load to
+ *              find the drop point; "-P" sweeps the counter read rate
+ *              to show what polling costs the forwarding and the
+ *              installs. No card is needed.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/nf2_sram_model.h"
+
+#define DEFAULT_MS		10
+#define LOAD_STEPS		10
+#define POLL_START		1000	/* entries per second */
+
+void usage (void);
+int run (const struct nf2_sram_cfg *, int ms, struct nf2_sram_model *);
+void load_sweep (struct nf2_sram_cfg *, int ms);
+void poll_sweep (struct nf2_sram_cfg *, int ms);
+
+int main(int argc, char *argv[]) {
+	struct nf2_sram_cfg cfg;
+	struct nf2_sram_model m;
+	const char *mix = NULL;
+	int ms = DEFAULT_MS, sweep_load = 0, sweep_poll = 0, ports, c, p;
+	double load = 1.0;
+
+	nf2_sram_model_defaults(&cfg);
+	ports = cfg.num_ports;
+	while ((c = getopt(argc, argv, "p:l:m:q:c:i:w:t:s:LPh")) != -1) {
+		switch (c) {
+		case 'p':
+			ports = atoi(optarg);
+			break;
+		case 'l':
+			load = atof(optarg);
+			break;
+		case 'm':
+			mix = optarg;
+			break;
+		case 'q':
+			cfg.rx_queue_bytes = atoi(optarg);
+			break;
+		case 'c':
+			cfg.sweep_rate = atof(optarg);
+			break;
+		case 'i':
+			cfg.install_rate = atof(optarg);
+			break;
+		case 'w':
+			cfg.word_ns = atoi(optarg);
+			break;
+		case 't':
+			ms = atoi(optarg);
+			break;
+		case 's':
+			cfg.seed = atoi(optarg);
+			break;
+		case 'L':
+			sweep_load = 1;
+			break;
+		case 'P':
+			sweep_poll = 1;
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (optind != argc || ports < 1 || ports > NF2_SRAM_MAX_PORTS || load < 0 || load > 1 ||
+	    ms <= 0 || cfg.rx_queue_bytes < 2048 || cfg.sweep_rate < 0 || cfg.install_rate < 0 ||
+	    (sweep_load && sweep_poll)) {
+		usage();
+		exit(1);
+	}
+	if (mix && nf2_sram_model_parse_mix(&cfg, mix)) {
+		fprintf(stderr, "Bad size mix: %s\n", mix);
+		exit(1);
+	}
+	cfg.num_ports = ports;
+	for (p = 0; p < ports; p++)
+		cfg.load[p] = load;
+
+	printf("schedule:       28 reads, 2 writes, 1 register word, 1 counter clear "
+	       "per %d cycles; %d lookups per round, %.3f M/s\n\n", NF2_SRAM_ROUND,
+	       NF2_SRAM_FLOWS_PER_ROUND, nf2_sram_model_lookup_capacity() / 1e6);
+
+	if (sweep_load)
+		load_sweep(&cfg, ms);
+	else if (sweep_poll)
+		poll_sweep(&cfg, ms);
+	else {
+		if (run(&cfg, ms, &m))
+			exit(1);
+		nf2_sram_model_print_stats(&m, stdout);
+		nf2_sram_model_free(&m);
+	}
+	return 0;
+}
+
+
+void usage(void) {
+	printf("Usage: sramsim [-p ports] [-l load] [-m mix] [-q rx_bytes] [-c sweep_rate]\n"
+	       "               [-i install_rate] [-w word_ns] [-t ms] [-s seed] [-L | -P]\n");
+	printf("  -p  ports receiving (default %d)\n", NF2_SRAM_MAX_PORTS);
+	printf("  -l  share of the 1 Gb/s line rate offered per port (default 1)\n");
+	printf("  -m  frame sizes with the FCS and their weights, e.g. 64:7,576:4,1500:1\n"
+	       "      (default 64)\n");
+	printf("  -q  rx queue bytes per port (default 4096)\n");
+	printf("  -c  exact entries whose counters the host reads per second (default 0)\n");
+	printf("  -i  exact flows the host installs per second (default 0)\n");
+	printf("  -w  least ns per host register word (default 500, the modelled PCI cost)\n");
+	printf("  -t  ms simulated per run (default %d)\n", DEFAULT_MS);
+	printf("  -s  seed (default 1)\n");
+	printf("  -L  run at %d loads up to the given one and report the drop point\n",
+	       LOAD_STEPS);
+	printf("  -P  double the counter read rate from %d/s until the host falls behind\n",
+	       POLL_START);
+}
+
+
+int run(const struct nf2_sram_cfg *cfg, int ms, struct nf2_sram_model *m) {
+	if (nf2_sram_model_init(m, cfg)) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+	nf2_sram_model_run(m, (uint64_t)ms * 1000000 / NF2_SRAM_CLOCK_NS);
+	return 0;
+}
+
+
+static double rate(const struct nf2_sram_model *m, uint64_t n) {
+	return n * 1e9 / (m->stats.cycles * NF2_SRAM_CLOCK_NS);
+}
+
+
+static uint64_t dropped(const struct nf2_sram_model *m) {
+	uint64_t drops = 0;
+	int p;
+
+	for (p = 0; p < m->cfg.num_ports; p++)
+		drops += m->stats.drops[p];
+	return drops;
+}
+
+
+//
+// load_sweep: the same run at LOAD_STEPS loads up to cfg's; the drop
+//    point is the first load that drops
+//
+void load_sweep(struct nf2_sram_cfg *cfg, int ms) {
+	struct nf2_sram_model m;
+	double top = cfg->load[0], drop_load = -1, drop_mpps = 0;
+	uint64_t drops;
+	int i, p;
+
+	printf("%6s %10s %10s %10s %8s %9s %9s %10s %10s\n", "load", "offer Mpps",
+	       "fwd Mpps", "lookups", "drop %", "fifo p50", "fifo p99", "lookup p99",
+	       "pkt p99");
+	for (i = 1; i <= LOAD_STEPS; i++) {
+		for (p = 0; p < cfg->num_ports; p++)
+			cfg->load[p] = top * i / LOAD_STEPS;
+		if (run(cfg, ms, &m))
+			exit(1);
+		drops = dropped(&m);
+		printf("%6.2f %10.3f %10.3f %9.1f%% %8.2f %9llu %9llu %10llu %10llu\n",
+		       cfg->load[0], rate(&m, m.stats.offered_pkts) / 1e6,
+		       rate(&m, m.stats.out_pkts) / 1e6,
+		       100.0 * m.stats.lookups / (m.stats.rounds * NF2_SRAM_FLOWS_PER_ROUND),
+		       m.stats.offered_pkts ? 100.0 * drops / m.stats.offered_pkts : 0.0,
+		       (unsigned long long)nf2_hdr_value_at(&m.stats.in_fifo, 50),
+		       (unsigned long long)nf2_hdr_value_at(&m.stats.in_fifo, 99),
+		       (unsigned long long)nf2_hdr_value_at(&m.stats.lookup_ns, 99),
+		       (unsigned long long)nf2_hdr_value_at(&m.stats.pkt_ns, 99));
+		if (drops && drop_load < 0) {
+			drop_load = cfg->load[0];
+			drop_mpps = rate(&m, m.stats.offered_pkts) / 1e6;
+		}
+		nf2_sram_model_free(&m);
+	}
+	if (drop_load < 0)
+		printf("\nno drops up to load %.2f\n", top);
+	else
+		printf("\ndrop point:     load %.2f (%.3f Mpps offered)\n", drop_load, drop_mpps);
+}
+
+
+//
+// poll_sweep: doubles the counter read rate until the host cannot keep
+//    up with it; the lookups do not share a slot with the host, so the
+//    forwarding should not move while the installs wait longer
+//
+void poll_sweep(struct nf2_sram_cfg *cfg, int ms) {
+	struct nf2_sram_model m;
+	const struct nf2_hdr *h;
+	double asked;
+
+	printf("%10s %10s %8s %10s %9s %10s %12s %12s\n", "asked/s", "swept/s", "fwd Mpps",
+	       "lookups", "drop %", "reg busy", "install p50", "install p99");
+	for (asked = POLL_START; ; asked *= 2) {
+		cfg->sweep_rate = asked;
+		if (run(cfg, ms, &m))
+			exit(1);
+		h = &m.stats.job_ns[NF2_SRAM_JOB_INSTALL];
+		printf("%10.0f %10.0f %8.3f %9.1f%% %9.2f %9.1f%% %10.1fus %10.1fus\n", asked,
+		       rate(&m, m.stats.jobs_done[NF2_SRAM_JOB_SWEEP]),
+		       rate(&m, m.stats.out_pkts) / 1e6,
+		       100.0 * m.stats.lookups / (m.stats.rounds * NF2_SRAM_FLOWS_PER_ROUND),
+		       m.stats.offered_pkts ? 100.0 * dropped(&m) / m.stats.offered_pkts : 0.0,
+		       100.0 * m.stats.reg_used / m.stats.rounds,
+		       h->total ? nf2_hdr_value_at(h, 50) / 1e3 : 0.0,
+		       h->total ? nf2_hdr_value_at(h, 99) / 1e3 : 0.0);
+		if (m.stats.jobs_left > NF2_SRAM_MAX_HOST_JOBS / 64 || m.stats.jobs_lost) {
+			printf("\nthe host falls behind at %.0f entries/s (%llu jobs queued)\n",
+			       asked, (unsigned long long)m.stats.jobs_left);
+			nf2_sram_model_free(&m);
+			break;
+		}
+		nf2_sram_model_free(&m);
+	}
+}
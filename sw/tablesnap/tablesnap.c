@@ -0,0 +1,144 @@
+/* ****************************************************************************
+ * Module: tablesnap.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Restore the flow tables of a card from a table image
+ *              (common/nf2_tablesnap.h) after a watchdog flush or a card
+ *              reset, or print the image as a flow file.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../../../lib/C/common/nf2util.h"
+#include "../common/nf2_regio.h"
+#include "../common/nf2_tablesnap.h"
+#include "../common/nf2_flowfile.h"
+
+#define DEFAULT_IFACE	"nf2c0"
+
+void usage (void);
+int restore (struct nf2_tablesnap *, int use_mmap);
+void show (struct nf2_tablesnap *);
+
+static struct nf2device nf2;
+
+int main(int argc, char *argv[]) {
+	struct nf2_tablesnap snap;
+	int use_mmap = 0, c, ret = 0;
+
+	nf2.device_name = DEFAULT_IFACE;
+	while ((c = getopt(argc, argv, "i:mh")) != -1) {
+		switch (c) {
+		case 'i':
+			nf2.device_name = optarg;
+			break;
+		case 'm':
+			use_mmap = 1;
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (argc - optind != 2 ||
+	    (strcmp(argv[optind], "restore") && strcmp(argv[optind], "show"))) {
+		usage();
+		exit(1);
+	}
+
+	if (access(argv[optind + 1], F_OK)) {
+		perror(argv[optind + 1]);
+		exit(1);
+	}
+	if (nf2_tablesnap_open(&snap, argv[optind + 1]))
+		exit(1);
+	if (strcmp(argv[optind], "restore") == 0)
+		ret = restore(&snap, use_mmap);
+	else
+		show(&snap);
+	nf2_tablesnap_close(&snap);
+	return ret;
+}
+
+
+void usage(void) {
+	printf("Usage: tablesnap [-i interface] [-m] restore image\n"
+	       "       tablesnap show image\n");
+	printf("  restore  write the tables of the image to a card just flushed by\n"
+	       "           the watchdog or reset, and report how long it took\n");
+	printf("  show     print the image as a flow file\n");
+	printf("  -i  interface of the card (default %s)\n", DEFAULT_IFACE);
+	printf("  -m  write the registers through a mapping of the register BAR\n");
+}
+
+
+int restore(struct nf2_tablesnap *snap, int use_mmap) {
+	struct nf2_regio io;
+	struct nf2_tablesnap_stats st;
+	uint32_t timer;
+
+	if (check_iface(&nf2) || openDescriptor(&nf2))
+		return 1;
+	if (use_mmap) {
+		if (nf2_regio_open_mmap(&io, nf2.device_name))
+			return 1;
+	}
+	else {
+		nf2_regio_open_ioctl(&io, &nf2);
+	}
+
+	if (nf2_regio_read(&io, OPENFLOW_LOOKUP_TIMER_REG, &timer) ||
+	    nf2_tablesnap_restore(snap, &io, timer, &st)) {
+		fprintf(stderr, "Error writing the tables of %s\n", nf2.device_name);
+		return 1;
+	}
+
+	printf("restored %d exact and %d wildcard entries in %.1f ms "
+	       "(%lu register transactions, %lu words)\n", st.exact, st.wildcard,
+	       st.elapsed_ns / 1e6, io.num_txns, io.num_words);
+	if (st.torn)
+		printf("%d entries were still being written after the retries and were "
+		       "skipped\n", st.torn);
+
+	nf2_regio_close(&io);
+	closeDescriptor(&nf2);
+	return 0;
+}
+
+
+void show(struct nf2_tablesnap *snap) {
+	struct nf2_flowfile_rule r;
+	struct nf2_tablesnap_wildcard *w;
+	struct nf2_tablesnap_exact *e;
+	int i;
+
+	for (i = 0; i < OPENFLOW_WILDCARD_TABLE_SIZE; i++) {
+		w = &snap->file->wildcard[i];
+		if (!w->used)
+			continue;
+		memset(&r, 0, sizeof(r));
+		r.entry = w->entry;
+		r.mask = w->mask;
+		r.action = w->action;
+		r.priority = w->priority;
+		printf("# wildcard index %d\n", i);
+		nf2_flowfile_print(stdout, &r);
+	}
+	for (i = 0; i < OPENFLOW_NF2_EXACT_TABLE_SIZE; i++) {
+		e = &snap->file->exact[i];
+		if (!e->used)
+			continue;
+		memset(&r, 0, sizeof(r));
+		r.exact = 1;
+		r.entry = e->entry;
+		r.action = e->action;
+		printf("# exact slot %d\n", i);
+		nf2_flowfile_print(stdout, &r);
+	}
+}
@@ -0,0 +1,255 @@
+/* ****************************************************************************
+ * Module: trafgen.c
+ * Project: NetFPGA OpenFlow switch
+ * Description: Writes seeded random test traffic as pcap traces, one per
+ *              source port, and the exact flow table that matches it as
+ *              a flow file (common/nf2_flowfile.h), for oplmodel, pairsim
+ *              and the benchmarks. The generator is common/nf2_trafgen.c.
+ *
+ * Change history:
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <time.h>
+
+#include "../common/nf2_pcap.h"
+#include "../common/nf2_flowfile.h"
+#include "../common/nf2_trafgen.h"
+
+#define DEFAULT_PKTS		1000000
+#define DEFAULT_FLOWS		1000
+#define DEFAULT_PORTS		"0,2,4,6"
+#define DEFAULT_PREFIX		"trace"
+#define PATHLEN			256
+
+#if NF2_TRAFGEN_SLACK > NF2_PCAP_APPEND_SLACK
+#error "nf2_trafgen_build writes past the room nf2_pcap_append leaves"
+#endif
+
+void usage (void);
+int parse_len (const char *, struct nf2_trafgen_cfg *);
+int parse_ports (char *, struct nf2_trafgen_cfg *);
+int write_flows (const struct nf2_trafgen *, const char *path, int argc, char *argv[]);
+double now_ns (void);
+
+static struct nf2_pcap_writer out[NF2_TRAFGEN_MAX_PORTS];
+
+int main(int argc, char *argv[]) {
+	struct nf2_trafgen_cfg cfg;
+	struct nf2_trafgen gen;
+	struct nf2_trafgen_pkt pkt;
+	char default_ports[] = DEFAULT_PORTS, *ports = default_ports;
+	const char *prefix = DEFAULT_PREFIX;
+	char path[PATHLEN];
+	uint64_t num_pkts = DEFAULT_PKTS, n, bytes = 0;
+	uint8_t *frame;
+	double start, secs;
+	int c, i, used[NF2_TRAFGEN_MAX_PORTS];
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.seed = 1;
+	cfg.num_flows = DEFAULT_FLOWS;
+	cfg.len_min = NF2_TRAFGEN_IMIX;
+	cfg.tcp_frac = 0.5;
+	cfg.rate_mbps = 1000;
+	while ((c = getopt(argc, argv, "n:f:s:z:l:v:o:t:p:P:r:w:h")) != -1) {
+		switch (c) {
+		case 'n':
+			num_pkts = strtoull(optarg, NULL, 0);
+			break;
+		case 'f':
+			cfg.num_flows = atoi(optarg);
+			break;
+		case 's':
+			cfg.seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'z':
+			cfg.zipf_s = atof(optarg);
+			break;
+		case 'l':
+			if (parse_len(optarg, &cfg)) {
+				usage();
+				exit(1);
+			}
+			break;
+		case 'v':
+			cfg.vlan_frac = atof(optarg);
+			break;
+		case 'o':
+			cfg.ipopt_frac = atof(optarg);
+			break;
+		case 't':
+			cfg.tcp_frac = atof(optarg);
+			break;
+		case 'p':
+			ports = optarg;
+			break;
+		case 'P':
+			if (!strcmp(optarg, "equal"))
+				cfg.pair = NF2_TRAFGEN_PAIR_EQUAL;
+			else if (!strcmp(optarg, "unequal"))
+				cfg.pair = NF2_TRAFGEN_PAIR_UNEQUAL;
+			else {
+				usage();
+				exit(1);
+			}
+			break;
+		case 'r':
+			cfg.rate_mbps = atoi(optarg);
+			break;
+		case 'w':
+			prefix = optarg;
+			break;
+		case 'h':
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (optind != argc || parse_ports(ports, &cfg)) {
+		usage();
+		exit(1);
+	}
+	if (cfg.pair != NF2_TRAFGEN_PAIR_NONE) {
+		cfg.ports[0] = 0;
+		cfg.ports[1] = 2;
+		cfg.num_ports = 2;
+	}
+	if (nf2_trafgen_init(&gen, &cfg))
+		exit(1);
+
+	snprintf(path, sizeof(path), "%s.flows", prefix);
+	if (write_flows(&gen, path, argc, argv))
+		exit(1);
+
+	memset(used, 0, sizeof(used));
+	for (i = 0; i < cfg.num_ports; i++) {
+		if (used[cfg.ports[i]])
+			continue;
+		used[cfg.ports[i]] = 1;
+		snprintf(path, sizeof(path), "%s-%d.pcap", prefix, cfg.ports[i]);
+		if (nf2_pcap_create(&out[cfg.ports[i]], path))
+			exit(1);
+	}
+
+	start = now_ns();
+	for (n = 0; n < num_pkts; n++) {
+		nf2_trafgen_next(&gen, &pkt);
+		frame = nf2_pcap_append(&out[pkt.port], pkt.len, pkt.len, pkt.ts_ns);
+		if (frame == NULL)
+			exit(1);
+		nf2_trafgen_build(&gen, &pkt, frame);
+		bytes += pkt.len;
+	}
+	for (i = 0; i < NF2_TRAFGEN_MAX_PORTS; i++) {
+		if (used[i] && nf2_pcap_finish(&out[i]))
+			exit(1);
+	}
+	secs = (now_ns() - start) / 1e9;
+
+	printf("%d flows, %llu packets, %llu bytes in %.2f s: %.1f Mpps, %.0f MB/s\n",
+	       gen.num_flows, (unsigned long long)num_pkts, (unsigned long long)bytes, secs,
+	       num_pkts / secs / 1e6, bytes / secs / 1e6);
+	for (i = 0; i < NF2_TRAFGEN_MAX_PORTS; i++) {
+		if (used[i])
+			printf("  %s-%d.pcap: %llu packets, %.3f s of traffic\n", prefix, i,
+			       (unsigned long long)out[i].pkts, gen.clock_ns[i] / 1e9);
+	}
+	printf("  %s.flows: %d exact flows\n", prefix, gen.num_flows);
+
+	nf2_trafgen_free(&gen);
+	return 0;
+}
+
+
+void usage(void) {
+	printf("Usage: trafgen [-n packets] [-f flows] [-s seed] [-z zipf_s] [-l len]\n"
+	       "               [-v vlan_frac] [-o ipopt_frac] [-t tcp_frac] [-p ports]\n"
+	       "               [-P equal|unequal] [-r rate_mbps] [-w prefix]\n");
+	printf("  -n  packets to write (default %d)\n", DEFAULT_PKTS);
+	printf("  -f  flows, or flow pairs with -P (default %d)\n", DEFAULT_FLOWS);
+	printf("  -s  seed; the same options and seed give the same traces\n");
+	printf("  -z  Zipf exponent of the flow sizes, 0 for uniform (default 0)\n");
+	printf("  -l  frame length without FCS: N, MIN-MAX or imix (default imix)\n");
+	printf("  -v  fraction of flows with an 802.1Q tag (default 0)\n");
+	printf("  -o  fraction of flows with IP options (default 0)\n");
+	printf("  -t  fraction of TCP flows, the others UDP (default 0.5)\n");
+	printf("  -p  source ports, 2n for MAC port n (default %s)\n", DEFAULT_PORTS);
+	printf("  -P  pairs of flows on ports 0 and 2, each packet on port 0 followed\n"
+	       "      by one of the reverse flow on port 2 of equal or unequal length\n");
+	printf("  -r  line rate of the timestamps, per port, in Mb/s (default 1000)\n");
+	printf("  -w  writes prefix-<port>.pcap and prefix.flows (default %s)\n",
+	       DEFAULT_PREFIX);
+}
+
+
+int parse_len(const char *s, struct nf2_trafgen_cfg *cfg) {
+	char *end;
+
+	if (!strcmp(s, "imix")) {
+		cfg->len_min = NF2_TRAFGEN_IMIX;
+		return 0;
+	}
+	cfg->len_min = cfg->len_max = strtol(s, &end, 0);
+	if (*end == '-')
+		cfg->len_max = strtol(end + 1, &end, 0);
+	return *end != '\0' || end == s;
+}
+
+
+//
+// parse_ports: comma separated source ports. Returns -1 if the list is
+//    invalid.
+//
+int parse_ports(char *s, struct nf2_trafgen_cfg *cfg) {
+	char *tok, *save, *end;
+
+	cfg->num_ports = 0;
+	for (tok = strtok_r(s, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		if (cfg->num_ports == NF2_TRAFGEN_MAX_PORTS)
+			return -1;
+		cfg->ports[cfg->num_ports++] = strtol(tok, &end, 0);
+		if (*end != '\0' || end == tok)
+			return -1;
+	}
+	return cfg->num_ports ? 0 : -1;
+}
+
+
+int write_flows(const struct nf2_trafgen *gen, const char *path, int argc, char *argv[]) {
+	struct nf2_flowfile_rule r;
+	FILE *f;
+	int i;
+
+	f = fopen(path, "w");
+	if (f == NULL) {
+		perror(path);
+		return -1;
+	}
+	fprintf(f, "#");
+	for (i = 0; i < argc; i++)
+		fprintf(f, " %s", argv[i]);
+	fprintf(f, "\n");
+	for (i = 0; i < gen->num_flows; i++) {
+		nf2_trafgen_rule(gen, i, &r);
+		nf2_flowfile_print(f, &r);
+	}
+	if (fclose(f)) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+
+double now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}